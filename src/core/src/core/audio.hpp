@@ -41,7 +41,7 @@ struct AudioMode {
 };
 
 struct AudioDevice {
-  std::string_view sink_name;
+  std::string sink_name;
   AudioMode mode;
 };
 
@@ -59,6 +59,41 @@ std::shared_ptr<VSink> create_virtual_sink(const std::shared_ptr<Server> &server
 
 void delete_virtual_sink(const std::shared_ptr<Server> &server, const std::shared_ptr<VSink> &vsink);
 
+/**
+ * A set of virtual sinks that are created ahead of time, grouped by channel layout.
+ * Loading a null-sink module requires a full round-trip to the audio server, by keeping a few of them around
+ * a new session can start outputting audio straight away.
+ */
+typedef struct VSinkPool VSinkPool;
+
+/**
+ * Will pre-create `sinks_per_mode` virtual sinks for each of the passed modes.
+ * Sinks are created asynchronously, this will not wait for the server to be ready.
+ */
+std::shared_ptr<VSinkPool> create_sink_pool(const std::shared_ptr<Server> &server,
+                                            const std::vector<AudioMode> &modes,
+                                            std::size_t sinks_per_mode);
+
+/**
+ * Hands out an idle sink that matches the channel layout of `mode`, the sink will be back into the pool once returned.
+ * If no idle sink is available a new one will be created on the fly.
+ *
+ * The returned sink name is picked by the pool: use `vsink->device.sink_name` instead of assuming one.
+ */
+std::shared_ptr<VSink> lease_virtual_sink(const std::shared_ptr<VSinkPool> &pool, const AudioMode &mode);
+
+/**
+ * Resets volume and mute status of the sink and puts it back into the pool.
+ * If the pool is already full the sink will be deleted instead.
+ */
+void return_virtual_sink(const std::shared_ptr<VSinkPool> &pool, const std::shared_ptr<VSink> &vsink);
+
+/**
+ * Unloads the idle sinks, sinks that are returned afterwards are unloaded straight away.
+ * Pool sinks have fixed names: leaving them behind on an external audio server would clash with the next Wolf.
+ */
+void delete_sink_pool(const std::shared_ptr<VSinkPool> &pool);
+
 void disconnect(const std::shared_ptr<Server> &server);
 
 std::string get_server_name(const std::shared_ptr<Server> &server);
@@ -31,9 +31,31 @@ static void pipeline_eos_handler(GstBus *bus, GstMessage *message, gpointer data
   g_main_loop_quit(loop);
 }
 
+using StreamingThreadHook = std::function<void(bool /* entering */)>;
+
+/**
+ * STREAM_STATUS messages are posted synchronously by the streaming threads themselves when they start and stop,
+ * this is the place where their priority (or affinity) can be changed.
+ * See: https://gstreamer.freedesktop.org/documentation/application-development/advanced/threads.html
+ */
+static GstBusSyncReply pipeline_stream_status_handler(GstBus *bus, GstMessage *message, gpointer data) {
+  if (GST_MESSAGE_TYPE(message) == GST_MESSAGE_STREAM_STATUS) {
+    GstStreamStatusType type;
+    gst_message_parse_stream_status(message, &type, nullptr);
+    if (type == GST_STREAM_STATUS_TYPE_ENTER || type == GST_STREAM_STATUS_TYPE_LEAVE) {
+      (*static_cast<const StreamingThreadHook *>(data))(type == GST_STREAM_STATUS_TYPE_ENTER);
+    }
+  }
+  return GST_BUS_PASS;
+}
+
+/**
+ * @param on_streaming_thread: optional, called on every streaming thread of the pipeline when it starts and stops
+ */
 static bool run_pipeline(const std::string &pipeline_desc,
-                         const std::function<immer::array<immer::box<events::EventBusHandlers>>(
-                             gst_element_ptr /* pipeline */, gst_main_loop_ptr /* main_loop */)> &on_pipeline_ready) {
+                         const std::function<immer::array<immer::box<events::SessionHandlerRegistration>>(
+                             gst_element_ptr /* pipeline */, gst_main_loop_ptr /* main_loop */)> &on_pipeline_ready,
+                         const StreamingThreadHook &on_streaming_thread = {}) {
   GError *error = nullptr;
   gst_element_ptr pipeline(gst_parse_launch(pipeline_desc.c_str(), &error), [](const auto &pipeline) {
     logs::log(logs::trace, "~pipeline");
@@ -63,7 +85,9 @@ static bool run_pipeline(const std::string &pipeline_desc,
   gst_bus_add_signal_watch(bus);
   g_signal_connect(bus, "message::error", G_CALLBACK(pipeline_error_handler), loop.get());
   g_signal_connect(bus, "message::eos", G_CALLBACK(pipeline_eos_handler), loop.get());
-  gst_object_unref(bus);
+  if (on_streaming_thread) {
+    gst_bus_set_sync_handler(bus, pipeline_stream_status_handler, (gpointer)&on_streaming_thread, nullptr);
+  }
 
   /* Set the pipeline to "playing" state*/
   gst_element_set_state(pipeline.get(), GST_STATE_PLAYING);
@@ -82,6 +106,10 @@ static bool run_pipeline(const std::string &pipeline_desc,
   gst_element_set_state(pipeline.get(), GST_STATE_READY);
   gst_element_set_state(pipeline.get(), GST_STATE_NULL);
 
+  /* All the streaming threads are gone, on_streaming_thread can't be called anymore */
+  gst_bus_set_sync_handler(bus, nullptr, nullptr, nullptr);
+  gst_object_unref(bus);
+
   return true;
 }
 
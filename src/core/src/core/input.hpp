@@ -28,6 +28,11 @@ class Mouse : public inputtino::Mouse, public VirtualDevice {
 public:
   Mouse(inputtino::Mouse &&j) noexcept : inputtino::Mouse(std::move(j)) {}
 
+  /**
+   * Same as inputtino::Mouse::move() but the whole frame is sent with a single write()
+   */
+  void move(int delta_x, int delta_y);
+
   std::vector<std::map<std::string, std::string>> get_udev_events() const override;
   std::vector<std::pair<std::string, std::vector<std::string>>> get_udev_hw_db_entries() const override;
 };
@@ -68,6 +73,12 @@ class XboxOneJoypad : public inputtino::XboxOneJoypad, public VirtualDevice {
 public:
   XboxOneJoypad(inputtino::XboxOneJoypad &&j) noexcept : inputtino::XboxOneJoypad(std::move(j)) {}
 
+  /**
+   * Equivalent to calling set_stick(LS), set_stick(RS) and set_triggers() but all the axes are sent in a
+   * single frame, with one write()
+   */
+  void set_axes(short ls_x, short ls_y, short rs_x, short rs_y, int16_t left_trigger, int16_t right_trigger);
+
   std::vector<std::map<std::string, std::string>> get_udev_events() const override;
   std::vector<std::pair<std::string, std::vector<std::string>>> get_udev_hw_db_entries() const override;
 };
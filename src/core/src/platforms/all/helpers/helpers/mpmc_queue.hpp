@@ -0,0 +1,259 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+struct MPMCQueueStats {
+  std::uint64_t pushed;
+  std::uint64_t popped;
+  /* Pushes that failed because the queue was full or closed */
+  std::uint64_t rejected;
+  /* The highest number of elements that have been waiting in the queue at the same time */
+  std::size_t high_watermark;
+};
+
+/**
+ * Bounded, lock-free, multi producer multi consumer queue (Dmitry Vyukov's sequence based ring buffer)
+ *
+ * Pushing and popping never take a lock; consumers can block on wait() or pop(timeout) which sleep on an eventfd.
+ * The eventfd is only written when a consumer is actually sleeping, and it can be handed over to epoll or asio
+ * (see arm() and native_handle()) instead of dedicating a thread to the queue.
+ */
+template <typename T, std::size_t Capacity> class MPMCQueue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+  static constexpr std::size_t MASK = Capacity - 1;
+
+  struct Cell {
+    std::atomic<std::size_t> sequence;
+    std::optional<T> item;
+  };
+
+  std::unique_ptr<Cell[]> m_buffer = std::make_unique<Cell[]>(Capacity);
+
+  alignas(64) std::atomic<std::size_t> m_enqueue_pos = 0;
+  alignas(64) std::atomic<std::size_t> m_dequeue_pos = 0;
+
+  // true when at least one consumer might be sleeping on the eventfd
+  alignas(64) std::atomic<bool> m_armed = false;
+  std::atomic<bool> m_closed = false;
+  int m_event_fd;
+
+  alignas(64) std::atomic<std::uint64_t> m_pushed = 0;
+  std::atomic<std::uint64_t> m_popped = 0;
+  std::atomic<std::uint64_t> m_rejected = 0;
+  std::atomic<std::size_t> m_high_watermark = 0;
+
+  void signal() {
+    std::uint64_t one = 1;
+    [[maybe_unused]] auto written = ::write(m_event_fd, &one, sizeof(one));
+  }
+
+  void update_high_watermark(std::size_t current_size) {
+    auto high = m_high_watermark.load(std::memory_order_relaxed);
+    while (current_size > high &&
+           !m_high_watermark.compare_exchange_weak(high, current_size, std::memory_order_relaxed)) {
+    }
+  }
+
+public:
+  MPMCQueue() : m_event_fd(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    if (m_event_fd < 0) {
+      throw std::runtime_error("Unable to create eventfd for MPMCQueue");
+    }
+    for (std::size_t i = 0; i < Capacity; i++) {
+      m_buffer[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ~MPMCQueue() {
+    ::close(m_event_fd);
+  }
+
+  MPMCQueue(const MPMCQueue &) = delete;
+  MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+  /**
+   * Moves the item at the end of the queue, can be called from any thread
+   * @return false if the queue is full or has been closed, in that case the item is left untouched
+   */
+  bool push(T &&item) {
+    if (m_closed.load(std::memory_order_acquire)) {
+      m_rejected.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    Cell *cell;
+    auto pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &m_buffer[pos & MASK];
+      auto diff = static_cast<std::intptr_t>(cell->sequence.load(std::memory_order_acquire)) -
+                  static_cast<std::intptr_t>(pos);
+      if (diff == 0) {
+        if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
+        return false;
+      } else {
+        pos = m_enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->item.emplace(std::move(item));
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    m_pushed.fetch_add(1, std::memory_order_relaxed);
+    // Consumers (and other producers) can be past our item already, only count it if it's still queued
+    auto dequeue_pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    if (dequeue_pos <= pos) {
+      update_high_watermark(std::min(pos + 1 - dequeue_pos, Capacity));
+    }
+
+    // Pairs with the fence in arm(): either the consumer sees the new item or we see that it's going to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_armed.exchange(false, std::memory_order_relaxed)) {
+      signal();
+    }
+    return true;
+  }
+
+  /**
+   * Pops the first element of the queue without blocking, can be called from any thread
+   * @return the element if it was available, empty optional otherwise
+   */
+  std::optional<T> try_pop() {
+    Cell *cell;
+    auto pos = m_dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &m_buffer[pos & MASK];
+      auto diff = static_cast<std::intptr_t>(cell->sequence.load(std::memory_order_acquire)) -
+                  static_cast<std::intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (diff < 0) {
+        return {};
+      } else {
+        pos = m_dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    std::optional<T> item = std::move(cell->item);
+    cell->item.reset();
+    cell->sequence.store(pos + MASK + 1, std::memory_order_release);
+    m_popped.fetch_add(1, std::memory_order_relaxed);
+    return item;
+  }
+
+  /**
+   * Pops the first element of the queue
+   * @param timeout it'll wait up until this time for an element to be available
+   * @return the element if it was available, empty optional otherwise
+   */
+  std::optional<T> pop(std::chrono::milliseconds timeout = std::chrono::milliseconds(100)) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (true) {
+      if (auto item = try_pop()) {
+        return item;
+      }
+      auto remaining =
+          std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+      if (remaining.count() <= 0 || !wait(remaining) || m_closed.load(std::memory_order_acquire)) {
+        return try_pop();
+      }
+    }
+  }
+
+  /**
+   * Tells producers that a consumer is about to sleep on native_handle(), must be called before each wait.
+   * Typical asio usage: if arm() returns false, async_wait() on the descriptor; once it's readable try_pop() until
+   * the queue is empty and arm() again.
+   *
+   * @return true if there's no need to wait: the queue is not empty or it has been closed
+   */
+  bool arm() {
+    std::uint64_t counter;
+    [[maybe_unused]] auto read = ::read(m_event_fd, &counter, sizeof(counter));
+
+    m_armed.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    return !empty() || m_closed.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Blocks until there might be an element available, the queue has been closed or wake() has been called
+   * @param timeout if empty it'll wait forever
+   * @return false if the timeout expired
+   */
+  bool wait(std::optional<std::chrono::milliseconds> timeout = {}) {
+    if (arm()) {
+      return true;
+    }
+    pollfd fd = {.fd = m_event_fd, .events = POLLIN, .revents = 0};
+    return ::poll(&fd, 1, timeout ? static_cast<int>(timeout->count()) : -1) > 0;
+  }
+
+  /**
+   * Wakes up all the consumers that are already waiting without pushing anything, can be called from any thread.
+   * A consumer that isn't sleeping yet will miss it: use close() to stop consumers for good.
+   */
+  void wake() {
+    signal();
+  }
+
+  /**
+   * Stops accepting new elements and wakes up the consumers, elements already in the queue can still be popped
+   */
+  void close() {
+    m_closed.store(true, std::memory_order_release);
+    signal();
+  }
+
+  [[nodiscard]] bool is_closed() const {
+    return m_closed.load(std::memory_order_acquire);
+  }
+
+  /**
+   * A file descriptor that becomes readable when an element is pushed after arm() has been called
+   */
+  [[nodiscard]] int native_handle() const {
+    return m_event_fd;
+  }
+
+  [[nodiscard]] bool empty() const {
+    return size() == 0;
+  }
+
+  /**
+   * Approximate when called concurrently with push or pop
+   */
+  [[nodiscard]] std::size_t size() const {
+    auto dequeue_pos = m_dequeue_pos.load(std::memory_order_acquire);
+    auto enqueue_pos = m_enqueue_pos.load(std::memory_order_acquire);
+    return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+  }
+
+  [[nodiscard]] static constexpr std::size_t capacity() {
+    return Capacity;
+  }
+
+  [[nodiscard]] MPMCQueueStats get_stats() const {
+    return {.pushed = m_pushed.load(std::memory_order_relaxed),
+            .popped = m_popped.load(std::memory_order_relaxed),
+            .rejected = m_rejected.load(std::memory_order_relaxed),
+            .high_watermark = m_high_watermark.load(std::memory_order_relaxed)};
+  }
+};
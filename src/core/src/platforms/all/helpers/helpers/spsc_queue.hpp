@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <memory>
+#include <optional>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <utility>
+
+/**
+ * Bounded, lock-free, single producer single consumer queue
+ *
+ * Exactly one thread is allowed to push and exactly one thread is allowed to pop.
+ * The consumer can block on wait() or wait_until() until there's something to read. They sleep on a futex, which is
+ * only woken up by the producer when the consumer is actually sleeping.
+ */
+template <typename T, std::size_t Capacity> class SPSCQueue {
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+  static constexpr std::size_t MASK = Capacity - 1;
+
+  std::unique_ptr<T[]> m_buffer = std::make_unique<T[]>(Capacity);
+
+  // Only written by the consumer
+  alignas(64) std::atomic<std::size_t> m_head = 0;
+
+  // Only written by the producer
+  alignas(64) std::atomic<std::size_t> m_tail = 0;
+
+  // Bumped on every push and on close, the consumer sleeps on it
+  alignas(64) std::atomic<std::uint32_t> m_signal = 0;
+  std::atomic<bool> m_sleeping = false;
+  std::atomic<bool> m_closed = false;
+
+  static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "The futex is the atomic itself");
+
+  void signal() {
+    m_signal.fetch_add(1, std::memory_order_release);
+    // Pairs with the fence in sleep_on_signal(): either the consumer sees the new signal or we see that it sleeps
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_relaxed)) {
+      syscall(SYS_futex, &m_signal, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+    }
+  }
+
+  /**
+   * Sleeps until m_signal moves away from current_signal, deadline (CLOCK_MONOTONIC, same as steady_clock) is absolute
+   */
+  void sleep_on_signal(std::uint32_t current_signal, const timespec *deadline) {
+    m_sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Returns straight away (EAGAIN) if a signal came in after current_signal has been read
+    syscall(SYS_futex,
+            &m_signal,
+            FUTEX_WAIT_BITSET_PRIVATE,
+            current_signal,
+            deadline,
+            nullptr,
+            FUTEX_BITSET_MATCH_ANY);
+    m_sleeping.store(false, std::memory_order_relaxed);
+  }
+
+  template <typename Pred> bool wait(Pred &&has_work, const timespec *deadline) {
+    while (true) {
+      auto current_signal = m_signal.load(std::memory_order_acquire);
+      if (!empty() || has_work()) {
+        return true;
+      }
+      if (m_closed.load(std::memory_order_acquire)) {
+        return false;
+      }
+      if (deadline) {
+        timespec now = {};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline->tv_sec || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec)) {
+          return true;
+        }
+      }
+      sleep_on_signal(current_signal, deadline);
+    }
+  }
+
+public:
+  SPSCQueue() = default;
+  SPSCQueue(const SPSCQueue &) = delete;
+  SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+  /**
+   * Producer: copies the item at the end of the queue
+   * @return false if the queue is full or has been closed, the item is not pushed
+   */
+  bool try_push(const T &item) {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    if (m_closed.load(std::memory_order_relaxed) || tail - m_head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+    m_buffer[tail & MASK] = item;
+    m_tail.store(tail + 1, std::memory_order_release);
+    signal();
+    return true;
+  }
+
+  /**
+   * Consumer: pops the first element of the queue
+   * @return the element if it was available, empty optional otherwise
+   */
+  std::optional<T> try_pop() {
+    auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      return {};
+    }
+    auto item = std::move(m_buffer[head & MASK]);
+    m_head.store(head + 1, std::memory_order_release);
+    return item;
+  }
+
+  /**
+   * Consumer: calls fn(T &) on each available element, in place, and pops it.
+   * Slots are given back to the producer one by one, so a slow fn doesn't hold the whole queue.
+   * @return the number of consumed elements
+   */
+  template <typename F> std::size_t consume_all(F &&fn) {
+    auto head = m_head.load(std::memory_order_relaxed);
+    auto tail = m_tail.load(std::memory_order_acquire);
+    for (auto i = head; i != tail; i++) {
+      fn(m_buffer[i & MASK]);
+      m_head.store(i + 1, std::memory_order_release);
+    }
+    return tail - head;
+  }
+
+  /**
+   * Consumer: blocks until there's at least one element available or the queue has been closed
+   * @return false once the queue has been closed and there's nothing left to read
+   */
+  bool wait() {
+    return wait([]() { return false; });
+  }
+
+  /**
+   * Consumer: like wait() but also returns when has_work() is true, has_work() is checked again after each wake()
+   */
+  template <typename Pred> bool wait(Pred &&has_work) {
+    return wait(std::forward<Pred>(has_work), nullptr);
+  }
+
+  /**
+   * Consumer: like wait(has_work) but it also returns once the deadline has passed
+   * @return false once the queue has been closed and there's nothing left to read, true otherwise (even on timeout)
+   */
+  template <typename Pred> bool wait_until(std::chrono::steady_clock::time_point deadline, Pred &&has_work) {
+    auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+    timespec abs_deadline = {.tv_sec = static_cast<time_t>(since_epoch.count() / 1'000'000'000),
+                             .tv_nsec = static_cast<long>(since_epoch.count() % 1'000'000'000)};
+    return wait(std::forward<Pred>(has_work), &abs_deadline);
+  }
+
+  /**
+   * Wakes up the consumer without pushing anything, can be called from any thread
+   */
+  void wake() {
+    signal();
+  }
+
+  /**
+   * Stops accepting new elements and wakes up the consumer
+   */
+  void close() {
+    m_closed.store(true, std::memory_order_release);
+    signal();
+  }
+
+  [[nodiscard]] bool empty() const {
+    return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+  }
+
+  /**
+   * Approximate when called concurrently with push or pop
+   */
+  [[nodiscard]] std::size_t size() const {
+    return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+  }
+
+  [[nodiscard]] static constexpr std::size_t capacity() {
+    return Capacity;
+  }
+};
@@ -1,6 +1,9 @@
+#include <atomic>
 #include <core/audio.hpp>
 #include <helpers/logger.hpp>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <pulse/pulseaudio.h>
 
 namespace fmt {
@@ -173,6 +176,113 @@ void delete_virtual_sink(const std::shared_ptr<Server> &server, const std::share
   });
 }
 
+struct VSinkPool {
+  std::shared_ptr<Server> server;
+  std::size_t sinks_per_mode;
+  std::map<int /* channels */, AudioMode> modes;
+
+  std::mutex idle_mutex;
+  std::map<int /* channels */, std::vector<std::shared_ptr<VSink>>> idle_sinks;
+  /* Once deleted, returned sinks are unloaded straight away */
+  bool deleted = false;
+  std::atomic<std::size_t> next_sink_id = 0;
+};
+
+/**
+ * Loading the module goes through queue_op(): don't call this while holding pool.idle_mutex
+ */
+static std::shared_ptr<VSink> create_pool_sink(VSinkPool &pool, const AudioMode &mode) {
+  auto sink_name = fmt::format("wolf_sink_{}ch_{}", mode.channels, pool.next_sink_id++);
+  return create_virtual_sink(pool.server, AudioDevice{.sink_name = sink_name, .mode = mode});
+}
+
+std::shared_ptr<VSinkPool> create_sink_pool(const std::shared_ptr<Server> &server,
+                                            const std::vector<AudioMode> &modes,
+                                            std::size_t sinks_per_mode) {
+  auto pool = std::make_shared<VSinkPool>();
+  pool->server = server;
+  pool->sinks_per_mode = sinks_per_mode;
+
+  for (const auto &mode : modes) {
+    if (pool->modes.contains(mode.channels)) { // sinks only care about the channel layout, skip duplicates
+      continue;
+    }
+    pool->modes[mode.channels] = mode;
+    std::vector<std::shared_ptr<VSink>> idle;
+    for (std::size_t i = 0; i < sinks_per_mode; i++) {
+      idle.push_back(create_pool_sink(*pool, mode));
+    }
+    std::lock_guard lock(pool->idle_mutex);
+    pool->idle_sinks[mode.channels] = std::move(idle);
+  }
+  logs::log(logs::debug, "[PULSE] Pre-created {} virtual sinks per channel layout", sinks_per_mode);
+  return pool;
+}
+
+std::shared_ptr<VSink> lease_virtual_sink(const std::shared_ptr<VSinkPool> &pool, const AudioMode &mode) {
+  {
+    std::lock_guard lock(pool->idle_mutex);
+    auto &idle = pool->idle_sinks[mode.channels];
+    if (!idle.empty()) {
+      auto vsink = idle.back();
+      idle.pop_back();
+      logs::log(logs::debug, "[PULSE] Leased virtual sink: {}", vsink->device.sink_name);
+      return vsink;
+    }
+  }
+
+  logs::log(logs::debug, "[PULSE] No idle sink for {} channels, creating a new one", mode.channels);
+  return create_pool_sink(*pool, mode);
+}
+
+void return_virtual_sink(const std::shared_ptr<VSinkPool> &pool, const std::shared_ptr<VSink> &vsink) {
+  bool keep = false;
+  {
+    std::lock_guard lock(pool->idle_mutex);
+    auto &idle = pool->idle_sinks[vsink->device.mode.channels];
+    keep = !pool->deleted && idle.size() < pool->sinks_per_mode;
+    if (keep) {
+      idle.push_back(vsink);
+    }
+  }
+
+  if (!keep) {
+    delete_virtual_sink(pool->server, vsink);
+    return;
+  }
+
+  queue_op(pool->server, [server = pool->server, vsink]() {
+    // Reset whatever the previous app might have changed, so that the next session starts from a clean state
+    pa_cvolume volume;
+    pa_cvolume_reset(&volume, vsink->device.mode.channels);
+    auto op = pa_context_set_sink_volume_by_name(server->ctx,
+                                                 vsink->device.sink_name.c_str(),
+                                                 &volume,
+                                                 nullptr,
+                                                 nullptr);
+    pa_operation_unref(op);
+    op = pa_context_set_sink_mute_by_name(server->ctx, vsink->device.sink_name.c_str(), 0, nullptr, nullptr);
+    pa_operation_unref(op);
+  });
+  logs::log(logs::debug, "[PULSE] Returned virtual sink to the pool: {}", vsink->device.sink_name);
+}
+
+void delete_sink_pool(const std::shared_ptr<VSinkPool> &pool) {
+  std::map<int /* channels */, std::vector<std::shared_ptr<VSink>>> idle_sinks;
+  {
+    std::lock_guard lock(pool->idle_mutex);
+    pool->deleted = true;
+    idle_sinks.swap(pool->idle_sinks);
+  }
+
+  for (const auto &[channels, sinks] : idle_sinks) {
+    for (const auto &vsink : sinks) {
+      delete_virtual_sink(pool->server, vsink);
+    }
+  }
+  logs::log(logs::debug, "[PULSE] Removed the virtual sinks pool");
+}
+
 void disconnect(const std::shared_ptr<Server> &server) {
   server->on_ready = boost::promise<bool>(); // Creates a new promise
   pa_context_disconnect(server->ctx);
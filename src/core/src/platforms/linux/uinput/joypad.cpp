@@ -3,6 +3,21 @@
 
 namespace wolf::core::input {
 
+void XboxOneJoypad::set_axes(
+    short ls_x, short ls_y, short rs_x, short rs_y, int16_t left_trigger, int16_t right_trigger) {
+  if (auto controller = _state->joy.get()) {
+    EventFrame frame;
+    // Moonlight sends Y as positive up, evdev expects it positive down
+    frame.add(EV_ABS, ABS_X, ls_x);
+    frame.add(EV_ABS, ABS_Y, -ls_y);
+    frame.add(EV_ABS, ABS_RX, rs_x);
+    frame.add(EV_ABS, ABS_RY, -rs_y);
+    frame.add(EV_ABS, ABS_Z, left_trigger);
+    frame.add(EV_ABS, ABS_RZ, right_trigger);
+    frame.submit(controller);
+  }
+}
+
 std::vector<std::map<std::string, std::string>> XboxOneJoypad::get_udev_events() const {
   std::vector<std::map<std::string, std::string>> events;
 
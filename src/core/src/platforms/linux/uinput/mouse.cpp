@@ -4,6 +4,19 @@
 
 namespace wolf::core::input {
 
+void Mouse::move(int delta_x, int delta_y) {
+  if (auto mouse = _state->mouse_rel.get()) {
+    EventFrame frame;
+    if (delta_x != 0) {
+      frame.add(EV_REL, REL_X, delta_x);
+    }
+    if (delta_y != 0) {
+      frame.add(EV_REL, REL_Y, delta_y);
+    }
+    frame.submit(mouse);
+  }
+}
+
 std::vector<std::map<std::string, std::string>> Mouse::get_udev_events() const {
   std::vector<std::map<std::string, std::string>> events;
 
@@ -1,5 +1,6 @@
 #include "uinput.hpp"
 #include <helpers/logger.hpp>
+#include <unistd.h>
 
 namespace wolf::core::input {
 
@@ -29,6 +30,27 @@ std::vector<inputtino::libevdev_event_ptr> fetch_events(const libevdev_ptr &dev,
   return events;
 }
 
+bool EventFrame::add(unsigned short type, unsigned short code, int value) {
+  if (count >= MAX_EVENTS) {
+    logs::log(logs::warning, "[UINPUT] Event frame is full, discarding event {}:{}", type, code);
+    return false;
+  }
+  events[count++] = {.type = type, .code = code, .value = value};
+  return true;
+}
+
+bool EventFrame::submit(const libevdev_uinput *device) {
+  events[count++] = {.type = EV_SYN, .code = SYN_REPORT, .value = 0};
+  auto size = count * sizeof(input_event);
+  auto ret = write(libevdev_uinput_get_fd(device), events.data(), size);
+  count = 0;
+  if (ret != static_cast<ssize_t>(size)) {
+    logs::log(logs::warning, "[UINPUT] Failed writing event frame; ret={}", ret < 0 ? strerror(errno) : "short write");
+    return false;
+  }
+  return true;
+}
+
 std::vector<inputtino::libevdev_event_ptr> fetch_events(int uinput_fd, int max_events) {
   std::vector<inputtino::libevdev_event_ptr> events = {};
   struct input_event ev {};
@@ -20,6 +20,7 @@
  */
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <core/input.hpp>
 #include <filesystem>
@@ -46,6 +47,34 @@ using libevdev_ptr = std::shared_ptr<libevdev>;
  */
 std::vector<inputtino::libevdev_event_ptr> fetch_events(const libevdev_ptr &dev, int max_events = 50);
 
+/**
+ * Accumulates the events of a single SYN frame and writes them to the uinput device with one write() call.
+ * libevdev_uinput_write_event() does a syscall for each event, including the final SYN_REPORT.
+ */
+class EventFrame {
+public:
+  static constexpr std::size_t MAX_EVENTS = 32;
+
+  /**
+   * @return false if the frame is full, the event is discarded
+   */
+  bool add(unsigned short type, unsigned short code, int value);
+
+  /**
+   * Appends a SYN_REPORT and writes the whole frame, the frame is then cleared and can be reused
+   * @return false if the write failed
+   */
+  bool submit(const libevdev_uinput *device);
+
+  [[nodiscard]] std::size_t size() const {
+    return count;
+  }
+
+private:
+  std::array<input_event, MAX_EVENTS + 1 /* SYN_REPORT */> events = {};
+  std::size_t count = 0;
+};
+
 static std::pair<unsigned int, unsigned int> get_major_minor(const std::string &devnode) {
   struct stat buf {};
   if (stat(devnode.c_str(), &buf) == -1) {
@@ -16,6 +16,22 @@ std::shared_ptr<VSink> create_virtual_sink(const std::shared_ptr<Server> &server
 
 void delete_virtual_sink(const std::shared_ptr<Server> &server, const std::shared_ptr<VSink> &vsink) {}
 
+struct VSinkPool {};
+
+std::shared_ptr<VSinkPool> create_sink_pool(const std::shared_ptr<Server> &server,
+                                            const std::vector<AudioMode> &modes,
+                                            std::size_t sinks_per_mode) {
+  return std::make_shared<VSinkPool>();
+}
+
+std::shared_ptr<VSink> lease_virtual_sink(const std::shared_ptr<VSinkPool> &pool, const AudioMode &mode) {
+  return std::make_shared<VSink>();
+}
+
+void return_virtual_sink(const std::shared_ptr<VSinkPool> &pool, const std::shared_ptr<VSink> &vsink) {}
+
+void delete_sink_pool(const std::shared_ptr<VSinkPool> &pool) {}
+
 bool connected(const std::shared_ptr<Server> &server) {
   return false;
 }
@@ -4,6 +4,7 @@
 #include <openssl/aes.h>
 #include <openssl/x509.h>
 #include <optional>
+#include <span>
 #include <string>
 
 namespace crypto {
@@ -101,6 +102,106 @@ std::string aes_decrypt_gcm(std::string_view msg,
                             int iv_size = -1,
                             bool padding = false);
 
+/**
+ * A reusable AES 128 context, bound to a single key.
+ *
+ * Allocating the OpenSSL context and expanding the key is most of the work when encrypting small packets;
+ * an AesContext does that once on creation and only resets the IV on each call.
+ * Results are written into caller provided buffers so that no allocation happens after construction.
+ *
+ * Not thread safe: a context should only be used by the thread that owns it.
+ */
+class AesContext {
+public:
+  enum MODE {
+    ECB,
+    CBC,
+    GCM
+  };
+
+  static constexpr std::size_t GCM_TAG_SIZE = 16;
+
+  /**
+   * @param mode: the AES mode of operation
+   * @param key: the key used for both encryption and decryption (not in HEX form), must be exactly 16 bytes
+   * @param padding: optional, enables or disables padding
+   * @param iv_size: optional, GCM only: the size of the IVs that will be passed to encrypt/decrypt
+   * @throws std::runtime_error if the key or the IV size are invalid, IVs are also checked on each call
+   */
+  AesContext(MODE mode, std::string_view key, bool padding = false, int iv_size = -1);
+  ~AesContext();
+
+  AesContext(const AesContext &) = delete;
+  AesContext &operator=(const AesContext &) = delete;
+  AesContext(AesContext &&other) noexcept;
+  AesContext &operator=(AesContext &&other) noexcept;
+
+  /**
+   * @return: the maximum number of bytes that encrypt() will write for a plaintext of the given size
+   */
+  static constexpr std::size_t max_encrypted_size(std::size_t plaintext_size) {
+    return plaintext_size + AES_BLOCK_SIZE;
+  }
+
+  /**
+   * Encrypt using ECB or CBC
+   *
+   * @param plaintext: the message to be encrypted
+   * @param out: where the encrypted message will be written, must be at least max_encrypted_size() bytes
+   * @param iv: the IV for this message, ignored in ECB mode
+   * @return: the number of bytes written into out
+   */
+  std::size_t encrypt(std::span<const unsigned char> plaintext,
+                      std::span<unsigned char> out,
+                      std::span<const unsigned char> iv = {});
+
+  /**
+   * Decrypt using ECB or CBC
+   *
+   * @param ciphertext: the message to be decrypted
+   * @param out: where the decrypted message will be written, must be at least as big as ciphertext
+   * @param iv: the IV for this message, ignored in ECB mode
+   * @return: the number of bytes written into out
+   */
+  std::size_t decrypt(std::span<const unsigned char> ciphertext,
+                      std::span<unsigned char> out,
+                      std::span<const unsigned char> iv = {});
+
+  /**
+   * Encrypt using GCM
+   *
+   * @param plaintext: the message to be encrypted
+   * @param out: where the encrypted message will be written, must be at least as big as plaintext
+   * @param tag: where the MAC tag will be written, must be at least GCM_TAG_SIZE bytes
+   * @param iv: the IV for this message
+   * @return: the number of bytes written into out
+   */
+  std::size_t encrypt_gcm(std::span<const unsigned char> plaintext,
+                          std::span<unsigned char> out,
+                          std::span<unsigned char> tag,
+                          std::span<const unsigned char> iv);
+
+  /**
+   * Decrypt using GCM, throws if the MAC tag doesn't match
+   *
+   * @param ciphertext: the message to be decrypted
+   * @param out: where the decrypted message will be written, must be at least as big as ciphertext
+   * @param tag: the MAC tag that was received together with the message
+   * @param iv: the IV for this message
+   * @return: the number of bytes written into out
+   */
+  std::size_t decrypt_gcm(std::span<const unsigned char> ciphertext,
+                          std::span<unsigned char> out,
+                          std::span<const unsigned char> tag,
+                          std::span<const unsigned char> iv);
+
+private:
+  MODE mode;
+  std::size_t iv_size;
+  EVP_CIPHER_CTX *encrypt_ctx;
+  EVP_CIPHER_CTX *decrypt_ctx;
+};
+
 /**
  * Will sign the given message using the private key
  * @param msg: the message to be signed
@@ -0,0 +1,198 @@
+#include <crypto/crypto.hpp>
+#include <crypto/utils.hpp>
+#include <cstdint>
+#include <openssl/evp.h>
+#include <stdexcept>
+
+namespace crypto {
+
+using CIPHER_CTX_ptr = std::unique_ptr<EVP_CIPHER_CTX, decltype(&::EVP_CIPHER_CTX_free)>;
+
+static const evp_cipher_st *aes_cipher(AesContext::MODE mode) {
+  switch (mode) {
+  case AesContext::ECB:
+    return EVP_aes_128_ecb();
+  case AesContext::CBC:
+    return EVP_aes_128_cbc();
+  case AesContext::GCM:
+    return EVP_aes_128_gcm();
+  }
+  throw std::runtime_error("Unknown AES mode");
+}
+
+static EVP_CIPHER_CTX *
+aes_context_init(AesContext::MODE mode, std::string_view key, bool padding, int iv_size, bool is_encryption) {
+  // OpenSSL reads as many bytes as the cipher needs, no matter how long the key actually is
+  if (key.size() != (std::size_t)EVP_CIPHER_key_length(aes_cipher(mode)))
+    throw std::runtime_error("AesContext invalid key size");
+
+  CIPHER_CTX_ptr ctx(EVP_CIPHER_CTX_new(), ::EVP_CIPHER_CTX_free);
+  auto init = is_encryption ? EVP_EncryptInit_ex : EVP_DecryptInit_ex;
+
+  // The key is expanded once here, following calls will only set the IV
+  if (init(ctx.get(), aes_cipher(mode), nullptr, nullptr, nullptr) != 1)
+    handle_openssl_error("EVP_CipherInit_ex failed");
+
+  if (mode == AesContext::GCM && iv_size != -1) {
+    if (EVP_CIPHER_CTX_ctrl(ctx.get(), EVP_CTRL_GCM_SET_IVLEN, iv_size, nullptr) != 1)
+      handle_openssl_error("EVP_CTRL_GCM_SET_IVLEN failed");
+  }
+
+  if (init(ctx.get(), nullptr, nullptr, (const std::uint8_t *)key.data(), nullptr) != 1)
+    handle_openssl_error("EVP_CipherInit_ex (key) failed");
+
+  if (EVP_CIPHER_CTX_set_padding(ctx.get(), padding) != 1)
+    handle_openssl_error("EVP_CIPHER_CTX_set_padding failed");
+
+  return ctx.release();
+}
+
+/**
+ * The size of the IVs that encrypt and decrypt will accept
+ */
+static std::size_t expected_iv_size(AesContext::MODE mode, int iv_size) {
+  if (mode == AesContext::ECB)
+    return 0;
+  if (mode == AesContext::GCM && iv_size != -1) {
+    if (iv_size <= 0)
+      throw std::runtime_error("AesContext invalid IV size");
+    return iv_size;
+  }
+  return EVP_CIPHER_iv_length(aes_cipher(mode));
+}
+
+AesContext::AesContext(MODE mode, std::string_view key, bool padding, int iv_size)
+    : mode(mode), iv_size(expected_iv_size(mode, iv_size)),
+      encrypt_ctx(aes_context_init(mode, key, padding, iv_size, true)), decrypt_ctx(nullptr) {
+  try {
+    decrypt_ctx = aes_context_init(mode, key, padding, iv_size, false);
+  } catch (...) {
+    EVP_CIPHER_CTX_free(encrypt_ctx);
+    throw;
+  }
+}
+
+AesContext::~AesContext() {
+  EVP_CIPHER_CTX_free(encrypt_ctx);
+  EVP_CIPHER_CTX_free(decrypt_ctx);
+}
+
+AesContext::AesContext(AesContext &&other) noexcept
+    : mode(other.mode), iv_size(other.iv_size), encrypt_ctx(other.encrypt_ctx), decrypt_ctx(other.decrypt_ctx) {
+  other.encrypt_ctx = nullptr;
+  other.decrypt_ctx = nullptr;
+}
+
+AesContext &AesContext::operator=(AesContext &&other) noexcept {
+  if (this != &other) {
+    EVP_CIPHER_CTX_free(encrypt_ctx);
+    EVP_CIPHER_CTX_free(decrypt_ctx);
+    mode = other.mode;
+    iv_size = other.iv_size;
+    encrypt_ctx = other.encrypt_ctx;
+    decrypt_ctx = other.decrypt_ctx;
+    other.encrypt_ctx = nullptr;
+    other.decrypt_ctx = nullptr;
+  }
+  return *this;
+}
+
+std::size_t AesContext::encrypt(std::span<const unsigned char> plaintext,
+                                std::span<unsigned char> out,
+                                std::span<const unsigned char> iv) {
+  if (out.size() < max_encrypted_size(plaintext.size()))
+    throw std::runtime_error("AesContext::encrypt output buffer too small");
+  if (mode != ECB && iv.size() != iv_size)
+    throw std::runtime_error("AesContext::encrypt invalid IV size");
+
+  /* resets the state, keeps the expanded key */
+  if (EVP_EncryptInit_ex(encrypt_ctx, nullptr, nullptr, nullptr, iv.empty() ? nullptr : iv.data()) != 1)
+    handle_openssl_error("EVP_EncryptInit_ex failed");
+
+  int c_len = 0, f_len = 0;
+  if (EVP_EncryptUpdate(encrypt_ctx, out.data(), &c_len, plaintext.data(), (int)plaintext.size()) != 1)
+    handle_openssl_error("EVP_EncryptUpdate failed");
+
+  if (EVP_EncryptFinal_ex(encrypt_ctx, out.data() + c_len, &f_len) != 1)
+    handle_openssl_error("EVP_EncryptFinal_ex failed");
+
+  return c_len + f_len;
+}
+
+std::size_t AesContext::decrypt(std::span<const unsigned char> ciphertext,
+                                std::span<unsigned char> out,
+                                std::span<const unsigned char> iv) {
+  if (out.size() < ciphertext.size())
+    throw std::runtime_error("AesContext::decrypt output buffer too small");
+  if (mode != ECB && iv.size() != iv_size)
+    throw std::runtime_error("AesContext::decrypt invalid IV size");
+
+  if (EVP_DecryptInit_ex(decrypt_ctx, nullptr, nullptr, nullptr, iv.empty() ? nullptr : iv.data()) != 1)
+    handle_openssl_error("EVP_DecryptInit_ex failed");
+
+  int len = 0, f_len = 0;
+  if (EVP_DecryptUpdate(decrypt_ctx, out.data(), &len, ciphertext.data(), (int)ciphertext.size()) != 1)
+    handle_openssl_error("EVP_DecryptUpdate failed");
+
+  if (EVP_DecryptFinal_ex(decrypt_ctx, out.data() + len, &f_len) != 1)
+    handle_openssl_error("EVP_DecryptFinal_ex failed");
+
+  return len + f_len;
+}
+
+std::size_t AesContext::encrypt_gcm(std::span<const unsigned char> plaintext,
+                                    std::span<unsigned char> out,
+                                    std::span<unsigned char> tag,
+                                    std::span<const unsigned char> iv) {
+  // GCM is a stream mode, the ciphertext is exactly as big as the plaintext
+  if (out.size() < plaintext.size() || tag.size() < GCM_TAG_SIZE)
+    throw std::runtime_error("AesContext::encrypt_gcm output buffer too small");
+  if (iv.size() != iv_size)
+    throw std::runtime_error("AesContext::encrypt_gcm invalid IV size");
+
+  if (EVP_EncryptInit_ex(encrypt_ctx, nullptr, nullptr, nullptr, iv.data()) != 1)
+    handle_openssl_error("EVP_EncryptInit_ex failed");
+
+  int c_len = 0, f_len = 0;
+  if (EVP_EncryptUpdate(encrypt_ctx, out.data(), &c_len, plaintext.data(), (int)plaintext.size()) != 1)
+    handle_openssl_error("EVP_EncryptUpdate failed");
+
+  // GCM encryption won't ever fill ciphertext here but we have to call it anyway
+  if (EVP_EncryptFinal_ex(encrypt_ctx, out.data() + c_len, &f_len) != 1)
+    handle_openssl_error("EVP_EncryptFinal_ex failed");
+
+  if (EVP_CIPHER_CTX_ctrl(encrypt_ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_SIZE, tag.data()) != 1)
+    handle_openssl_error("EVP_CTRL_GCM_GET_TAG failed");
+
+  return c_len + f_len;
+}
+
+std::size_t AesContext::decrypt_gcm(std::span<const unsigned char> ciphertext,
+                                    std::span<unsigned char> out,
+                                    std::span<const unsigned char> tag,
+                                    std::span<const unsigned char> iv) {
+  if (out.size() < ciphertext.size())
+    throw std::runtime_error("AesContext::decrypt_gcm output buffer too small");
+  if (tag.size() < GCM_TAG_SIZE)
+    throw std::runtime_error("AesContext::decrypt_gcm invalid tag");
+  if (iv.size() != iv_size)
+    throw std::runtime_error("AesContext::decrypt_gcm invalid IV size");
+
+  if (EVP_DecryptInit_ex(decrypt_ctx, nullptr, nullptr, nullptr, iv.data()) != 1)
+    handle_openssl_error("EVP_DecryptInit_ex failed");
+
+  int len = 0, f_len = 0;
+  if (EVP_DecryptUpdate(decrypt_ctx, out.data(), &len, ciphertext.data(), (int)ciphertext.size()) != 1)
+    handle_openssl_error("EVP_DecryptUpdate failed");
+
+  if (EVP_CIPHER_CTX_ctrl(decrypt_ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_SIZE, const_cast<unsigned char *>(tag.data())) !=
+      1)
+    handle_openssl_error("EVP_CTRL_GCM_SET_TAG failed");
+
+  if (EVP_DecryptFinal_ex(decrypt_ctx, out.data() + len, &f_len) != 1)
+    handle_openssl_error("EVP_DecryptFinal_ex failed");
+
+  return len + f_len;
+}
+
+} // namespace crypto
\ No newline at end of file
@@ -1,11 +1,13 @@
 #pragma once
 #include <array>
+#include <bitset>
 #include <boost/endian/conversion.hpp>
 #include <core/input.hpp>
 #include <crypto/crypto.hpp>
 #include <cstdint>
 #include <helpers/utils.hpp>
 #include <memory>
+#include <span>
 
 namespace moonlight::control {
 
@@ -49,6 +51,18 @@ enum INPUT_TYPE : int {
   UTF8_TEXT = boost::endian::native_to_little(0x00000017),
 };
 
+/**
+ * INPUT_TYPE values are sparse: 0x00000003-0x00000017 and 0x55000001-0x55000007.
+ * This maps each one of them to a distinct slot in [0, INPUT_TYPE_SLOTS) so that they can index a dense table.
+ * Unknown values can end up in the slot of a known type, callers have to check the type stored in the slot.
+ */
+constexpr std::size_t INPUT_TYPE_SLOTS = 64;
+
+constexpr std::size_t input_type_slot(INPUT_TYPE type) {
+  auto value = boost::endian::little_to_native(static_cast<std::uint32_t>(type));
+  return (value & 0x1F) | ((value >> 25) & 0x20);
+}
+
 enum CONTROLLER_TYPE : uint8_t {
   UNKNOWN = 0x00,
   XBOX = 0x01,
@@ -370,45 +384,142 @@ struct ControlEncryptedPacket {
   }
 };
 
+/**
+ * Creates a reusable AES GCM context for the given HEX encoded key.
+ * The context can then be used to encrypt and decrypt multiple packets without setting up OpenSSL every time.
+ */
+static crypto::AesContext create_gcm_context(std::string_view gcm_key) {
+  return {crypto::AesContext::GCM, crypto::hex_to_str(gcm_key.data(), true), false, GCM_TAG_SIZE};
+}
+
 /**
  * Given a received packet will decrypt the payload inside it.
  * This includes checking that the AES GCM TAG is valid and not tampered
+ *
+ * @param out: where the decrypted payload will be written, must be at least as big as the encrypted message
+ * @return a view over the decrypted payload inside `out`
  */
-static std::string decrypt_packet(const ControlEncryptedPacket &packet_data, std::string_view gcm_key) {
+static std::string_view
+decrypt_packet(const ControlEncryptedPacket &packet_data, crypto::AesContext &gcm_ctx, std::span<char> out) {
   std::array<std::uint8_t, GCM_TAG_SIZE> iv_data = {0};
   iv_data[0] = boost::endian::little_to_native(packet_data.seq);
 
-  return crypto::aes_decrypt_gcm(packet_data.encrypted_msg(),
-                                 crypto::hex_to_str(gcm_key.data(), true),
-                                 packet_data.gcm_tag,
-                                 {(char *)iv_data.data(), iv_data.size()},
-                                 GCM_TAG_SIZE);
+  auto encrypted = packet_data.encrypted_msg();
+  auto size = gcm_ctx.decrypt_gcm({(const unsigned char *)encrypted.data(), encrypted.size()},
+                                  {(unsigned char *)out.data(), out.size()},
+                                  {(const unsigned char *)packet_data.gcm_tag, GCM_TAG_SIZE},
+                                  iv_data);
+  return {out.data(), size};
+}
+
+static std::string decrypt_packet(const ControlEncryptedPacket &packet_data, std::string_view gcm_key) {
+  auto gcm_ctx = create_gcm_context(gcm_key);
+  std::array<char, MAX_PAYLOAD_SIZE> decrypted = {};
+  return std::string(decrypt_packet(packet_data, gcm_ctx, decrypted));
 }
 
 /**
- * Turns a payload into a properly formatted control encrypted packet
+ * The size on the wire of a control encrypted packet that wraps a payload of the given size
  */
-static std::unique_ptr<ControlEncryptedPacket>
-encrypt_packet(std::string_view gcm_key, std::uint32_t seq, std::string_view payload) {
+static constexpr std::size_t encrypted_packet_size(std::size_t payload_size) {
+  return sizeof(ControlPacket) + sizeof(ControlEncryptedPacket::seq) + GCM_TAG_SIZE + payload_size;
+}
+
+/**
+ * Turns a payload into a properly formatted control encrypted packet, written directly into `out`
+ *
+ * @param out: must be at least encrypted_packet_size(payload.size()) bytes
+ * @return the number of bytes written into `out`
+ */
+static std::size_t
+encrypt_packet(crypto::AesContext &gcm_ctx, std::uint32_t seq, std::string_view payload, std::span<unsigned char> out) {
+  auto total_size = encrypted_packet_size(payload.size());
+  if (out.size() < total_size || payload.size() > MAX_PAYLOAD_SIZE) {
+    throw std::runtime_error("Control packet buffer too small");
+  }
+
   std::array<std::uint8_t, GCM_TAG_SIZE> iv_data = {0};
   iv_data[0] = boost::endian::native_to_little(seq);
 
-  auto [encrypted_str, gcm_tag] = crypto::aes_encrypt_gcm(payload,
-                                                          crypto::hex_to_str(gcm_key.data(), true),
-                                                          {(char *)iv_data.data(), iv_data.size()},
-                                                          GCM_TAG_SIZE);
+  auto encrypted_pkt = (ControlEncryptedPacket *)out.data();
+  gcm_ctx.encrypt_gcm({(const unsigned char *)payload.data(), payload.size()},
+                      {(unsigned char *)encrypted_pkt->payload, payload.size()},
+                      {(unsigned char *)encrypted_pkt->gcm_tag, GCM_TAG_SIZE},
+                      iv_data);
 
-  std::uint16_t size = sizeof(seq) + GCM_TAG_SIZE + encrypted_str.length();
-  ControlEncryptedPacket encrypted_pkt = {
-      .header = {.type = pkts::ENCRYPTED, .length = boost::endian::native_to_little(size)},
-      .seq = boost::endian::native_to_little(seq)};
+  std::uint16_t size = total_size - sizeof(ControlPacket);
+  encrypted_pkt->header = {.type = pkts::ENCRYPTED, .length = boost::endian::native_to_little(size)};
+  encrypted_pkt->seq = boost::endian::native_to_little(seq);
 
-  std::copy(gcm_tag.begin(), gcm_tag.end(), encrypted_pkt.gcm_tag);
-  std::copy(encrypted_str.begin(), encrypted_str.end(), encrypted_pkt.payload);
+  return total_size;
+}
 
-  return std::make_unique<ControlEncryptedPacket>(encrypted_pkt);
+static std::unique_ptr<ControlEncryptedPacket>
+encrypt_packet(std::string_view gcm_key, std::uint32_t seq, std::string_view payload) {
+  auto gcm_ctx = create_gcm_context(gcm_key);
+  auto encrypted_pkt = std::make_unique<ControlEncryptedPacket>();
+  encrypt_packet(gcm_ctx, seq, payload, {(unsigned char *)encrypted_pkt.get(), sizeof(ControlEncryptedPacket)});
+  return encrypted_pkt;
 }
 
+/**
+ * Sliding window used to reject replayed incoming encrypted packets.
+ * Follows the anti-replay algorithm described in RFC 4303 section 3.4.3: a bitmap keeps track of the last
+ * WINDOW_SIZE sequence numbers.
+ *
+ * Only the low byte of the sequence number goes into the GCM IV, the rest of it isn't authenticated and is ignored:
+ * a packet is placed at most 127 behind or 128 ahead of the highest sequence number seen so far.
+ */
+class ReplayWindow {
+public:
+  static constexpr std::uint32_t WINDOW_SIZE = 128;
+
+  /**
+   * Cheap check that can be done before decrypting the packet.
+   * @return true if the sequence number hasn't been seen yet
+   */
+  [[nodiscard]] bool check(std::uint32_t seq) const {
+    if (!initialized) {
+      return true;
+    }
+    auto ahead = distance(seq);
+    return ahead > 0 || !seen[-ahead];
+  }
+
+  /**
+   * Marks the sequence number as received, should only be called once the packet has been authenticated
+   */
+  void update(std::uint32_t seq) {
+    if (!initialized) {
+      initialized = true;
+      highest_seq = static_cast<std::uint8_t>(seq);
+      seen.set(0);
+      return;
+    }
+    auto ahead = distance(seq);
+    if (ahead > 0) {
+      seen <<= ahead;
+      seen.set(0);
+      highest_seq = static_cast<std::uint8_t>(seq);
+    } else {
+      seen.set(-ahead);
+    }
+  }
+
+private:
+  /**
+   * How far ahead of highest_seq the authenticated part of seq is, between -127 and 128
+   */
+  [[nodiscard]] int distance(std::uint32_t seq) const {
+    int ahead = static_cast<std::uint8_t>(static_cast<std::uint8_t>(seq) - highest_seq);
+    return ahead > 128 ? ahead - 256 : ahead;
+  }
+
+  bool initialized = false;
+  std::uint8_t highest_seq = 0;
+  std::bitset<WINDOW_SIZE> seen;
+};
+
 static constexpr const char *packet_type_to_str(pkts::PACKET_TYPE p) noexcept {
   switch (p) {
   case pkts::START_A:
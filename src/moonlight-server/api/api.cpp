@@ -9,7 +9,7 @@ namespace wolf::api {
 
 using namespace wolf::core;
 
-void start_server(immer::box<state::AppState> app_state) {
+void start_server(immer::box<state::AppState> app_state, std::stop_token stop_token) {
   auto socket_path = utils::get_env("WOLF_SOCKET_PATH", "/tmp/wolf.sock");
   logs::log(logs::info, "Starting API server on {}", socket_path);
 
@@ -27,6 +27,7 @@ void start_server(immer::box<state::AppState> app_state) {
         ev);
   });
 
+  std::stop_callback stop_server(stop_token, [&io_context]() { io_context.stop(); });
   io_context.run();
 }
 
@@ -3,13 +3,21 @@
 #include <api/http_server.hpp>
 #include <events/events.hpp>
 #include <events/reflectors.hpp>
+#include <platforms/services.hpp>
+#include <platforms/threads.hpp>
 #include <state/data-structures.hpp>
+#include <stop_token>
+#include <streaming/latency.hpp>
+#include <streaming/startup.hpp>
 
 namespace wolf::api {
 
 using namespace wolf::core;
 
-void start_server(immer::box<state::AppState> app_state);
+/**
+ * Blocks until a stop is requested
+ */
+void start_server(immer::box<state::AppState> app_state, std::stop_token stop_token = {});
 
 struct PairRequest {
   std::string pair_secret;
@@ -62,6 +70,28 @@ struct StreamSessionStopRequest {
   std::string session_id;
 };
 
+struct StreamSessionLatencyResponse {
+  bool success = true;
+  bool tracing_enabled;
+  std::vector<streaming::latency::SessionLatencySnapshot> sessions;
+};
+
+struct StreamSessionStartupResponse {
+  bool success = true;
+  std::vector<streaming::startup::SessionStartupSnapshot> sessions;
+};
+
+struct ThreadsResponse {
+  bool success = true;
+  wolf::config::ThreadsCfg config;
+  std::vector<wolf::core::threads::ThreadInfo> threads;
+};
+
+struct ServicesResponse {
+  bool success = true;
+  std::vector<wolf::core::services::ServiceInfo> services;
+};
+
 struct RunnerStartRequest {
   bool stop_stream_when_over;
   rfl::TaggedUnion<"type", wolf::config::AppCMD, wolf::config::AppDocker, wolf::config::AppChildSession> runner;
@@ -98,9 +128,15 @@ private:
   void endpoint_StreamSessionAdd(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket);
   void endpoint_StreamSessionPause(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket);
   void endpoint_StreamSessionStop(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket);
+  void endpoint_StreamSessionLatency(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket);
+  void endpoint_StreamSessionLatencyTrace(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket);
+  void endpoint_StreamSessionStartup(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket);
 
   void endpoint_RunnerStart(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket);
 
+  void endpoint_Threads(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket);
+  void endpoint_Services(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket);
+
   void sse_broadcast(const std::string &payload);
   void sse_keepalive(const boost::system::error_code &e);
 
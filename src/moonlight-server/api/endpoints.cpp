@@ -76,6 +76,7 @@ void UnixSocketServer::endpoint_AddApp(const HTTPRequest &req, std::shared_ptr<U
           .start_virtual_compositor = app.start_virtual_compositor,
           .runner = runner,
           .joypad_type = state::get_controller_type(app.joypad_type),
+          .input_coalescing_window_us = app.input_coalescing_window_us,
       });
     });
     auto res = GenericSuccessResponse{.success = true};
@@ -107,8 +108,8 @@ void UnixSocketServer::endpoint_RemoveApp(const HTTPRequest &req, std::shared_pt
 void UnixSocketServer::endpoint_StreamSessions(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket) {
   auto res = StreamSessionListResponse{.success = true};
   auto sessions = state_->app_state->running_sessions->load();
-  for (const auto &session : sessions.get()) {
-    res.sessions.push_back(rfl::Reflector<events::StreamSession>::from(session));
+  for (const auto &[session_id, session] : sessions) {
+    res.sessions.push_back(rfl::Reflector<events::StreamSession>::from(*session));
   }
   send_http(socket, 200, rfl::json::write(res));
 }
@@ -133,20 +134,29 @@ void UnixSocketServer::endpoint_StreamSessionAdd(const HTTPRequest &req, std::sh
       return;
     }
 
-    auto new_session = state::create_stream_session( //
-        state_->app_state,
-        app.value(),
-        client.value(),
-        moonlight::DisplayMode{.width = ss.video_width,
-                               .height = ss.video_height,
-                               .refreshRate = ss.video_refresh_rate,
-                               .hevc_supported = state_->app_state->config->support_hevc,
-                               .av1_supported = state_->app_state->config->support_av1},
-        ss.audio_channel_count);
+    auto startup_profile = streaming::startup::Registry::get().start(state::get_client_id(client.value()));
+    std::shared_ptr<events::StreamSession> new_session;
+    try {
+      auto create_phase = streaming::startup::ScopedPhase(startup_profile, "create_stream_session");
+      new_session = state::create_stream_session( //
+          state_->app_state,
+          app.value(),
+          client.value(),
+          moonlight::DisplayMode{.width = ss.video_width,
+                                 .height = ss.video_height,
+                                 .refreshRate = ss.video_refresh_rate,
+                                 .hevc_supported = state_->app_state->config->support_hevc,
+                                 .av1_supported = state_->app_state->config->support_av1},
+          ss.audio_channel_count);
+    } catch (const std::runtime_error &e) { // ex: all the ports are taken
+      logs::log(logs::warning, "[API] Unable to create session: {}", e.what());
+      auto res = GenericErrorResponse{.error = e.what()};
+      send_http(socket, 503, rfl::json::write(res));
+      return;
+    }
     new_session->ip = ss.client_ip; // Needed in order to match `/serverinfo`
 
-    state_->app_state->running_sessions->update(
-        [new_session](const immer::vector<events::StreamSession> &ses_v) { return ses_v.push_back(*new_session); });
+    state_->app_state->running_sessions->add(*new_session);
     state_->app_state->event_bus->fire_event(immer::box<events::StreamSession>(*new_session));
 
     auto res = GenericSuccessResponse{.success = true};
@@ -161,9 +171,8 @@ void UnixSocketServer::endpoint_StreamSessionAdd(const HTTPRequest &req, std::sh
 void UnixSocketServer::endpoint_StreamSessionPause(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket) {
   auto session = rfl::json::read<StreamSessionPauseRequest>(req.body);
   if (session) {
-    auto sessions = state_->app_state->running_sessions->load();
     auto session_id = std::stoul(session.value().session_id);
-    if (state::get_session_by_id(sessions.get(), session_id)) {
+    if (state::find_session_by_id(state_->app_state->running_sessions->load_index(), session_id)) {
       this->state_->app_state->event_bus->fire_event(
           immer::box<events::PauseStreamEvent>(events::PauseStreamEvent{.session_id = session_id}));
       auto res = GenericSuccessResponse{.success = true};
@@ -183,9 +192,8 @@ void UnixSocketServer::endpoint_StreamSessionPause(const HTTPRequest &req, std::
 void UnixSocketServer::endpoint_StreamSessionStop(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket) {
   auto session = rfl::json::read<StreamSessionStopRequest>(req.body);
   if (session) {
-    auto sessions = state_->app_state->running_sessions->load();
     auto session_id = std::stoul(session.value().session_id);
-    if (state::get_session_by_id(sessions.get(), session_id)) {
+    if (state::find_session_by_id(state_->app_state->running_sessions->load_index(), session_id)) {
       this->state_->app_state->event_bus->fire_event(
           immer::box<events::StopStreamEvent>(events::StopStreamEvent{.session_id = session_id}));
       auto res = GenericSuccessResponse{.success = true};
@@ -203,10 +211,31 @@ void UnixSocketServer::endpoint_StreamSessionStop(const HTTPRequest &req, std::s
   }
 }
 
+void UnixSocketServer::endpoint_StreamSessionLatency(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket) {
+  auto res = StreamSessionLatencyResponse{.tracing_enabled = streaming::latency::is_enabled()};
+  for (const auto &tracer : streaming::latency::Registry::get().get_all()) {
+    res.sessions.push_back(tracer->snapshot());
+  }
+  send_http(socket, 200, rfl::json::write(res));
+}
+
+void UnixSocketServer::endpoint_StreamSessionLatencyTrace(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket) {
+  auto trace = streaming::latency::to_chrome_trace(streaming::latency::Registry::get().get_all());
+  send_http(socket, 200, rfl::json::write(trace));
+}
+
+void UnixSocketServer::endpoint_StreamSessionStartup(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket) {
+  auto res = StreamSessionStartupResponse{};
+  for (const auto &profile : streaming::startup::Registry::get().get_all()) {
+    res.sessions.push_back(profile->snapshot());
+  }
+  send_http(socket, 200, rfl::json::write(res));
+}
+
 void UnixSocketServer::endpoint_RunnerStart(const wolf::api::HTTPRequest &req, std::shared_ptr<UnixSocket> socket) {
   auto event = rfl::json::read<RunnerStartRequest>(req.body);
   if (event) {
-    auto session = state::get_session_by_id(this->state_->app_state->running_sessions->load(),
+    auto session = state::get_session_by_id(this->state_->app_state->running_sessions->load_index(),
                                             std::stoul(event.value().session_id));
     if (!session) {
       logs::log(logs::warning, "[API] Invalid session_id: {}", event.value().session_id);
@@ -229,4 +258,15 @@ void UnixSocketServer::endpoint_RunnerStart(const wolf::api::HTTPRequest &req, s
   }
 }
 
+void UnixSocketServer::endpoint_Threads(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket) {
+  auto res = ThreadsResponse{.config = core::threads::Topology::get().get_config(),
+                             .threads = core::threads::Topology::get().get_threads()};
+  send_http(socket, 200, rfl::json::write(res));
+}
+
+void UnixSocketServer::endpoint_Services(const HTTPRequest &req, std::shared_ptr<UnixSocket> socket) {
+  auto res = ServicesResponse{.services = core::services::Registry::get().get_all()};
+  send_http(socket, 200, rfl::json::write(res));
+}
+
 } // namespace wolf::api
\ No newline at end of file
@@ -147,6 +147,39 @@ UnixSocketServer::UnixSocketServer(boost::asio::io_context &io_context,
           .handler = [this](auto req, auto socket) { endpoint_StreamSessionStop(req, socket); },
       });
 
+  state_->http.add(
+      HTTPMethod::GET,
+      "/api/v1/sessions/latency",
+      {
+          .summary = "Get the input latency of the running sessions",
+          .description = "Histograms of how long input takes from being received to being sent back in a video frame. "
+                         "Only available when Wolf is started with WOLF_LATENCY_TRACING=TRUE.",
+          .response_description = {{200, {.json_schema = rfl::json::to_schema<StreamSessionLatencyResponse>()}}},
+          .handler = [this](auto req, auto socket) { endpoint_StreamSessionLatency(req, socket); },
+      });
+
+  state_->http.add(
+      HTTPMethod::GET,
+      "/api/v1/sessions/latency/trace",
+      {
+          .summary = "Export the latest input latency traces",
+          .description = "The latest traces of each session in the Chrome trace event format, "
+                         "they can be loaded in https://ui.perfetto.dev or chrome://tracing",
+          .response_description = {{200, {.json_schema = rfl::json::to_schema<streaming::latency::ChromeTrace>()}}},
+          .handler = [this](auto req, auto socket) { endpoint_StreamSessionLatencyTrace(req, socket); },
+      });
+
+  state_->http.add(
+      HTTPMethod::GET,
+      "/api/v1/sessions/startup",
+      {
+          .summary = "Get how long it took to start the latest sessions",
+          .description = "A waterfall of the phases of each session startup, from the HTTPS launch until the first "
+                         "video packet is sent. Times are in microseconds, relative to the session creation.",
+          .response_description = {{200, {.json_schema = rfl::json::to_schema<StreamSessionStartupResponse>()}}},
+          .handler = [this](auto req, auto socket) { endpoint_StreamSessionStartup(req, socket); },
+      });
+
   state_->http.add(HTTPMethod::POST,
                    "/api/v1/runners/start",
                    {
@@ -157,6 +190,28 @@ UnixSocketServer::UnixSocketServer(boost::asio::io_context &io_context,
                        .handler = [this](auto req, auto socket) { endpoint_RunnerStart(req, socket); },
                    });
 
+  state_->http.add(
+      HTTPMethod::GET,
+      "/api/v1/threads",
+      {
+          .summary = "Get the CPU affinity and scheduling of the streaming threads",
+          .description = "The [threads] settings from the config file and what has been effectively applied to each "
+                         "thread that is currently running (control, video, audio and API).",
+          .response_description = {{200, {.json_schema = rfl::json::to_schema<ThreadsResponse>()}}},
+          .handler = [this](auto req, auto socket) { endpoint_Threads(req, socket); },
+      });
+
+  state_->http.add(
+      HTTPMethod::GET,
+      "/api/v1/services",
+      {
+          .summary = "Get the long-running services",
+          .description = "Each subsystem (HTTP, HTTPS, RTSP, control, API, ...) runs on its own thread, "
+                         "cpu_time_us is the CPU time consumed by that thread so far.",
+          .response_description = {{200, {.json_schema = rfl::json::to_schema<ServicesResponse>()}}},
+          .handler = [this](auto req, auto socket) { endpoint_Services(req, socket); },
+      });
+
   /**
    * OpenAPI schema
    */
@@ -1,10 +1,13 @@
 #include "core/input.hpp"
 #include <control/control.hpp>
-#include <control/input_handler.hpp>
+#include <control/input_worker.hpp>
+#include <control/recording.hpp>
 #include <events/events.hpp>
 #include <immer/box.hpp>
 #include <state/sessions.hpp>
+#include <stdexcept>
 #include <sys/socket.h>
+#include <unordered_map>
 
 namespace control {
 
@@ -43,7 +46,7 @@ enet_host create_host(std::string_view host, std::uint16_t port, std::size_t pee
 
   auto enet_host = enet_host_create(AF_INET, &addr, peers, 0, 0, 0);
   if (enet_host == nullptr) {
-    logs::log(logs::error, "An error occurred while trying to create an ENet server host.");
+    throw std::runtime_error(fmt::format("Unable to create an ENet server host on port {}", port));
   }
 
   return {enet_host, free_host};
@@ -71,10 +74,34 @@ std::pair<std::string /* ip */, int /* port */> get_ip(const sockaddr *const ip_
   return {std::string{data}, port};
 }
 
-bool send_packet(std::string_view payload, ENetPeer *peer) {
+bool encrypt_and_send(std::string_view payload,
+                      const enet_clients_atom &connected_clients,
+                      std::size_t session_id) {
+  auto clients = connected_clients->load();
+  auto client = clients->find(session_id);
+  if (client == nullptr) {
+    logs::log(logs::debug, "[ENET] Unable to find enet client {}", session_id);
+    return false;
+  }
+
+  std::lock_guard lock((*client)->encrypt_m);
+  if ((*client)->peer == nullptr) {
+    logs::log(logs::debug, "[ENET] Enet client {} has disconnected", session_id);
+    return false;
+  }
+
+  auto packet =
+      enet_packet_create(nullptr, control::encrypted_packet_size(payload.size()), ENET_PACKET_FLAG_RELIABLE);
+  try {
+    control::encrypt_packet((*client)->encrypt_ctx, (*client)->next_seq++, payload, {packet->data, packet->dataLength});
+  } catch (std::runtime_error &e) {
+    logs::log(logs::warning, "[ENET] Unable to encrypt outgoing packet: {}", e.what());
+    enet_packet_destroy(packet);
+    return false;
+  }
+
   logs::log(logs::trace, "[ENET] Sending packet");
-  auto packet = enet_packet_create(payload.data(), payload.size(), ENET_PACKET_FLAG_RELIABLE);
-  if (enet_peer_send(peer, 0, packet) < 0) {
+  if (enet_peer_send((*client)->peer, 0, packet) < 0) {
     logs::log(logs::warning, "[ENET] Failed to send packet");
     enet_packet_destroy(packet);
     return false;
@@ -82,24 +109,18 @@ bool send_packet(std::string_view payload, ENetPeer *peer) {
   return true;
 }
 
-bool encrypt_and_send(std::string_view payload,
-                      std::string_view aes_key,
-                      const immer::atom<enet_clients_map> &connected_clients,
-                      std::size_t session_id) {
-  auto clients = connected_clients.load();
-  auto enet_peer = clients->find(session_id);
-  if (enet_peer == nullptr) {
-    logs::log(logs::debug, "[ENET] Unable to find enet client {}", session_id);
-    return false;
-  } else {
-    auto encrypted = control::encrypt_packet(aes_key, 0, payload); // TODO: seq?
-    return send_packet({(char *)encrypted.get(), encrypted->full_size()}, enet_peer->get().get());
-  }
+/**
+ * Senders that are still holding on to the client (input workers, rumble, ...) will skip it from now on
+ */
+static void detach_peer(ControlClient &client) {
+  std::lock_guard lock(client.encrypt_m);
+  client.peer = nullptr;
 }
 
 void run_control(int port,
                  const state::SessionsAtoms &running_sessions,
                  const std::shared_ptr<events::EventBusType> &event_bus,
+                 std::stop_token stop_token,
                  int peers,
                  std::chrono::milliseconds timeout,
                  const std::string &host_ip) {
@@ -109,58 +130,154 @@ void run_control(int port,
 
   ENetEvent event;
 
-  immer::atom<enet_clients_map> connected_clients;
+  auto connected_clients = std::make_shared<immer::atom<enet_clients_map>>();
+  // Declared after the host: the peers are detached before it's destroyed, even when leaving with an exception
+  struct ClientsCleanup {
+    enet_clients_atom clients;
+    ~ClientsCleanup() {
+      auto connected = clients->load();
+      for (const auto &[session_id, client] : *connected) {
+        detach_peer(*client);
+      }
+      clients->update([](const enet_clients_map &) { return enet_clients_map{}; });
+    }
+  } clients_cleanup{connected_clients};
 
   auto stop_ev = event_bus->register_handler<immer::box<StopStreamEvent>>(
-      [&connected_clients, &running_sessions](const immer::box<StopStreamEvent> &ev) {
-        auto client_session = state::get_session_by_id(running_sessions->load(), ev->session_id);
+      [connected_clients](const immer::box<StopStreamEvent> &ev) {
         auto terminate_pkt = ControlTerminatePacket{};
-        std::string plaintext = {(char *)&terminate_pkt, sizeof(terminate_pkt)};
-        encrypt_and_send(plaintext, client_session->aes_key, connected_clients, ev->session_id);
+        encrypt_and_send({(char *)&terminate_pkt, sizeof(terminate_pkt)}, connected_clients, ev->session_id);
       });
 
-  while (true) {
+  /*
+   * Peers are matched to a session by IP only once, when they connect; following events are resolved with a hash
+   * probe on the peer pointer, the session is only looked up again once it has been replaced or removed.
+   * Only the control thread touches this map.
+   */
+  std::unordered_map<ENetPeer *, state::SessionHandle> peer_sessions;
+
+  /*
+   * Input is executed on a per session worker, this thread only receives and decrypts packets
+   */
+  std::unordered_map<std::size_t, std::shared_ptr<InputWorker>> input_workers;
+  const bool latency_tracing = streaming::latency::is_enabled();
+
+  /*
+   * When WOLF_CONTROL_RECORDING_DIR is set, the decrypted packets of each connection are saved for later replay
+   */
+  std::unordered_map<std::size_t, std::unique_ptr<recording::Recorder>> recorders;
+  auto stop_input_worker = [&input_workers](std::size_t session_id) {
+    if (auto worker = input_workers.find(session_id); worker != input_workers.end()) {
+      worker->second->stop();
+      input_workers.erase(worker);
+    }
+  };
+
+  while (!stop_token.stop_requested()) {
     if (enet_host_service(host.get(), &event, timeout.count()) > 0) {
-      auto [client_ip, client_port] = get_ip((sockaddr *)&event.peer->address.address);
-      auto client_session = state::get_session_by_ip(running_sessions->load(), client_ip);
+      const events::StreamSession *client_session = nullptr;
+      if (event.type == ENET_EVENT_TYPE_CONNECT) {
+        auto [client_ip, client_port] = get_ip((sockaddr *)&event.peer->address.address);
+        auto handle = state::get_session_handle_by_ip(running_sessions->load_index(), client_ip);
+        if (handle && state::get_control_port(handle->session_id) != port) {
+          // The session has been handed to another shard over RTSP, its input worker and state live there
+          logs::log(logs::warning,
+                    "[ENET] Refusing client {}: its session belongs to port {}",
+                    client_ip,
+                    state::get_control_port(handle->session_id));
+          enet_peer_disconnect_now(event.peer, 0);
+          continue;
+        } else if (handle) {
+          client_session = &*(peer_sessions[event.peer] = std::move(handle));
+        }
+      } else if (auto peer_session = peer_sessions.find(event.peer); peer_session != peer_sessions.end()) {
+        auto &handle = peer_session->second;
+        if (handle && !handle.is_current()) {
+          handle = state::get_session_handle(running_sessions->load_index(), handle.id());
+        }
+        client_session = handle ? &*handle : nullptr;
+      }
+
       if (client_session) {
         switch (event.type) {
         case ENET_EVENT_TYPE_NONE:
           break;
-        case ENET_EVENT_TYPE_CONNECT:
-          logs::log(logs::debug, "[ENET] connected client: {}:{}", client_ip, client_port);
-          connected_clients.update([&event, sess_id = client_session->session_id](const enet_clients_map &m) {
-            return m.set(sess_id, std::shared_ptr<ENetPeer>(event.peer, [](auto peer) {
-                           // DO NOTHING, we don't want to free peer, the lifecycle is dictated by enet
-                         }));
+        case ENET_EVENT_TYPE_CONNECT: {
+          logs::log(logs::debug, "[ENET] connected client: {}", client_session->ip);
+          std::shared_ptr<ControlClient> client;
+          try {
+            client = std::make_shared<ControlClient>(event.peer, client_session->aes_key);
+          } catch (const std::exception &e) {
+            logs::log(logs::warning, "[ENET] Refusing client {}: {}", client_session->ip, e.what());
+            enet_peer_disconnect_now(event.peer, 0);
+            peer_sessions.erase(event.peer);
+            break;
+          }
+          connected_clients->update([client, sess_id = client_session->session_id](const enet_clients_map &m) {
+            // We don't own the peer, the lifecycle is dictated by enet
+            return m.set(sess_id, client);
           });
+          stop_input_worker(client_session->session_id); // in case the client reconnected without a disconnect
+          input_workers.emplace(client_session->session_id,
+                                InputWorker::start(client_session->session_id, running_sessions, connected_clients));
+          if (auto recorder = recording::Recorder::create(client_session->session_id)) {
+            recorders.insert_or_assign(client_session->session_id, std::move(recorder));
+          }
           event_bus->fire_event(
               immer::box<ResumeStreamEvent>(ResumeStreamEvent{.session_id = client_session->session_id}));
           break;
+        }
         case ENET_EVENT_TYPE_DISCONNECT:
-          logs::log(logs::debug, "[ENET] disconnected client: {}:{}", client_ip, client_port);
-          connected_clients.update(
+          logs::log(logs::debug, "[ENET] disconnected client: {}", client_session->ip);
+          if (auto clients = connected_clients->load(); auto client = clients->find(client_session->session_id)) {
+            detach_peer(**client);
+          }
+          connected_clients->update(
               [sess_id = client_session->session_id](const enet_clients_map &m) { return m.erase(sess_id); });
+          stop_input_worker(client_session->session_id);
+          recorders.erase(client_session->session_id);
           event_bus->fire_event(
               immer::box<PauseStreamEvent>(PauseStreamEvent{.session_id = client_session->session_id}));
+          peer_sessions.erase(event.peer); // client_session is owned by the handle, it's not valid past this point
           break;
         case ENET_EVENT_TYPE_RECEIVE:
+          auto received_at =
+              latency_tracing ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point{};
           enet_packet packet = {event.packet, enet_packet_destroy};
+          const auto &client_ip = client_session->ip;
 
           auto type = ((ControlPacket *)packet->data)->type;
 
           logs::log(logs::trace,
-                    "[ENET] received {} of {} bytes from: {}:{} HEX: {}",
+                    "[ENET] received {} of {} bytes from: {} HEX: {}",
                     packet_type_to_str(type),
                     packet->dataLength,
                     client_ip,
-                    client_port,
                     crypto::str_to_hex({(char *)packet->data, packet->dataLength}));
 
           if (type == ENCRYPTED) {
+            auto clients = connected_clients->load();
+            auto client = clients->find(client_session->session_id);
+            auto enc_pkt = (ControlEncryptedPacket *)(packet->data);
+            if (client == nullptr) {
+              logs::log(logs::warning, "[ENET] Received encrypted packet before connection from {}", client_ip);
+              break;
+            }
+            if (packet->dataLength < encrypted_packet_size(0) || enc_pkt->full_size() > packet->dataLength) {
+              logs::log(logs::warning, "[ENET] Received malformed encrypted packet from {}", client_ip);
+              break;
+            }
+            auto seq = boost::endian::little_to_native(enc_pkt->seq);
+            if (!(*client)->replay_window.check(seq)) {
+              logs::log(logs::warning, "[ENET] Dropping replayed packet with seq {} from {}", seq, client_ip);
+              break;
+            }
             try {
-              auto enc_pkt = (ControlEncryptedPacket *)(packet->data);
-              auto decrypted = decrypt_packet(*enc_pkt, client_session->aes_key);
+              auto decrypted = decrypt_packet(*enc_pkt, (*client)->decrypt_ctx, (*client)->decrypt_buffer);
+              (*client)->replay_window.update(seq);
+              if (auto recorder = recorders.find(client_session->session_id); recorder != recorders.end()) {
+                recorder->second->write(decrypted);
+              }
               auto sub_type = ((ControlPacket *)decrypted.data())->type;
 
               logs::log(logs::trace,
@@ -172,7 +289,9 @@ void run_control(int port,
                 event_bus->fire_event(
                     immer::box<PauseStreamEvent>(PauseStreamEvent{.session_id = client_session->session_id}));
               } else if (sub_type == INPUT_DATA) {
-                handle_input(client_session.value(), connected_clients, (INPUT_PKT *)decrypted.data());
+                if (auto worker = input_workers.find(client_session->session_id); worker != input_workers.end()) {
+                  worker->second->push(decrypted, received_at);
+                }
               } else if (sub_type == IDR_FRAME) {
                 auto ev = IDRRequestEvent{.session_id = client_session->session_id};
                 event_bus->fire_event(immer::box<IDRRequestEvent>{ev});
@@ -189,12 +308,21 @@ void run_control(int port,
           break;
         }
       } else {
+        auto [client_ip, client_port] = get_ip((sockaddr *)&event.peer->address.address);
         logs::log(logs::warning, "[ENET] Received packet from unrecognised client {}:{}", client_ip, client_port);
+        if (event.type == ENET_EVENT_TYPE_RECEIVE) {
+          enet_packet_destroy(event.packet);
+        }
+        peer_sessions.erase(event.peer);
         enet_peer_disconnect_now(event.peer, 0);
       }
     }
   }
 
+  logs::log(logs::info, "Control server on port {} stopped", port);
+  for (const auto &[session_id, worker] : input_workers) {
+    worker->stop();
+  }
   stop_ev.unregister();
 }
 
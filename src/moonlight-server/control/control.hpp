@@ -1,12 +1,15 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <enet/enet.h>
 #include <events/events.hpp>
 #include <helpers/logger.hpp>
 #include <moonlight/control.hpp>
+#include <mutex>
 #include <range/v3/view.hpp>
 #include <state/data-structures.hpp>
+#include <stop_token>
 #include <thread>
 
 namespace control {
@@ -14,18 +17,55 @@ namespace control {
 using namespace std::chrono_literals;
 using namespace wolf::core;
 
+/**
+ * Runs the ENet host until a stop is requested, it'll return in at most `timeout`
+ * @throws std::runtime_error if the ENet host can't be created (ex: the port is still in use)
+ */
 void run_control(int port,
                  const state::SessionsAtoms &running_sessions,
                  const std::shared_ptr<events::EventBusType> &event_bus,
+                 std::stop_token stop_token = {},
                  int peers = 20,
                  std::chrono::milliseconds timeout = 1000ms,
                  const std::string &host_ip = "0.0.0.0");
 
-using enet_clients_map = immer::map<std::size_t, immer::box<std::shared_ptr<ENetPeer>>>;
+/**
+ * The state of a connected control client, created on ENet connect and dropped on disconnect.
+ * The GCM contexts are created once for the session key and reused for every packet.
+ * Sequence numbers restart from 0 on each new connection, just like Moonlight does.
+ */
+struct ControlClient {
+  /* Protected by encrypt_m, nullptr once the peer or its host are gone: the client can outlive them */
+  ENetPeer *peer;
 
+  /* Only used by the control thread when receiving packets */
+  crypto::AesContext decrypt_ctx;
+  std::array<char, moonlight::control::MAX_PAYLOAD_SIZE> decrypt_buffer = {};
+  moonlight::control::ReplayWindow replay_window;
+
+  /* Outgoing packets can be sent from any thread (rumble, LEDs, ...) */
+  std::mutex encrypt_m;
+  crypto::AesContext encrypt_ctx;
+  std::uint32_t next_seq = 0; // protected by encrypt_m
+
+  ControlClient(ENetPeer *peer, std::string_view aes_key)
+      : peer(peer), decrypt_ctx(moonlight::control::create_gcm_context(aes_key)),
+        encrypt_ctx(moonlight::control::create_gcm_context(aes_key)) {}
+};
+
+using enet_clients_map = immer::map<std::size_t, std::shared_ptr<ControlClient>>;
+
+/**
+ * The input workers and the virtual devices (rumble, LEDs) hold on to it, they can outlive the control thread
+ */
+using enet_clients_atom = std::shared_ptr<immer::atom<enet_clients_map>>;
+
+/**
+ * Encrypts the payload using the client GCM context and sends it as a reliable packet.
+ * The ciphertext is written directly into the ENet packet memory.
+ */
 bool encrypt_and_send(std::string_view payload,
-                      std::string_view aes_key,
-                      const immer::atom<enet_clients_map> &connected_clients,
+                      const enet_clients_atom &connected_clients,
                       std::size_t session_id);
 
 bool init();
@@ -0,0 +1,206 @@
+#pragma once
+
+#include <array>
+#include <boost/endian/conversion.hpp>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <moonlight/control.hpp>
+#include <optional>
+#include <vector>
+
+namespace control {
+
+using namespace moonlight::control::pkts;
+
+/**
+ * A decrypted INPUT_DATA payload, copied as is in the worker queue
+ */
+struct InputPayload {
+  std::uint8_t size = 0;
+  std::array<char, moonlight::control::MAX_PAYLOAD_SIZE> data = {};
+  /* When the control thread got the packet, only set when latency tracing is enabled */
+  std::chrono::steady_clock::time_point received_at = {};
+
+  [[nodiscard]] INPUT_PKT *pkt() {
+    return (INPUT_PKT *)data.data();
+  }
+
+  [[nodiscard]] const INPUT_PKT *pkt() const {
+    return (const INPUT_PKT *)data.data();
+  }
+};
+
+/**
+ * Merges high rate motion events so that we only write to the virtual devices what can actually be seen:
+ *  - relative mouse movements are summed up
+ *  - for absolute mouse movements, touch moves and controller motion only the latest sample is kept
+ *
+ * Everything else can't be coalesced: the caller has to flush() the merged events first, and then execute it,
+ * this way the order between (for example) a mouse move and a button press is always preserved.
+ */
+class InputCoalescer {
+public:
+  struct Stats {
+    std::size_t received = 0;  // events that went through add()
+    std::size_t coalesced = 0; // events that have been merged into another one and never written on their own
+  };
+
+  /**
+   * @param window: how long merged events can be held back, 0 means that we only merge what's already queued up
+   */
+  explicit InputCoalescer(std::chrono::microseconds window) : window(window) {}
+
+  /**
+   * @return true if the event has been merged, false if it can't be coalesced
+   */
+  bool add(const InputPayload &input, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) {
+    auto key = coalescing_key(input);
+    if (!key) {
+      return false;
+    }
+
+    for (auto &slot : slots) {
+      if (slot.key != *key) {
+        continue;
+      }
+      auto received_at = slot.input.received_at;
+      if (!merge(slot.input, input)) {
+        return false;
+      }
+      slot.input.received_at = received_at; // The merged event has been waiting since the first one arrived
+      stats.received++;
+      stats.coalesced++;
+      return true;
+    }
+
+    if (slots.empty()) {
+      first_event = now;
+    }
+    slots.push_back({*key, input});
+    stats.received++;
+    return true;
+  }
+
+  /**
+   * Calls fn(const InputPayload &) for each merged event, in the order in which they were first seen
+   */
+  template <typename F> void flush(F &&fn) {
+    for (const auto &slot : slots) {
+      fn(slot.input);
+    }
+    slots.clear();
+  }
+
+  [[nodiscard]] bool empty() const {
+    return slots.empty();
+  }
+
+  /**
+   * When the merged events should be flushed, only meaningful if !empty()
+   */
+  [[nodiscard]] std::chrono::steady_clock::time_point deadline() const {
+    return first_event + window;
+  }
+
+  [[nodiscard]] const Stats &get_stats() const {
+    return stats;
+  }
+
+private:
+  struct Slot {
+    std::uint64_t key;
+    InputPayload input;
+  };
+
+  /**
+   * Events with the same key are candidates for merging, mouse moves (relative and absolute) share the same key
+   * since they act on the same pointer.
+   */
+  static std::optional<std::uint64_t> coalescing_key(const InputPayload &input) {
+    auto pkt = input.pkt();
+    switch (pkt->type) {
+    case MOUSE_MOVE_REL:
+    case MOUSE_MOVE_ABS:
+      return MOUSE_MOVE_REL;
+    case TOUCH: {
+      auto touch_pkt = static_cast<const TOUCH_PACKET *>(pkt);
+      if (touch_pkt->event_type != TOUCH_EVENT_MOVE && touch_pkt->event_type != TOUCH_EVENT_HOVER) {
+        return {};
+      }
+      return (std::uint64_t)TOUCH << 32 | boost::endian::little_to_native(touch_pkt->pointer_id);
+    }
+    case CONTROLLER_TOUCH: {
+      auto touch_pkt = static_cast<const CONTROLLER_TOUCH_PACKET *>(pkt);
+      if (touch_pkt->event_type != TOUCH_EVENT_MOVE && touch_pkt->event_type != TOUCH_EVENT_HOVER) {
+        return {};
+      }
+      return (std::uint64_t)CONTROLLER_TOUCH << 32 | (std::uint64_t)touch_pkt->controller_number << 24 |
+             (boost::endian::little_to_native(touch_pkt->pointer_id) & 0xFFFFFF);
+    }
+    case CONTROLLER_MOTION: {
+      auto motion_pkt = static_cast<const CONTROLLER_MOTION_PACKET *>(pkt);
+      return (std::uint64_t)CONTROLLER_MOTION << 32 | (std::uint64_t)motion_pkt->controller_number << 8 |
+             motion_pkt->motion_type;
+    }
+    default:
+      return {};
+    }
+  }
+
+  /**
+   * Merges next into current
+   * @return false if they can't be merged (the caller has to flush and execute next on its own)
+   */
+  static bool merge(InputPayload &current, const InputPayload &next) {
+    if (current.pkt()->type != next.pkt()->type) {
+      return false;
+    }
+
+    switch (next.pkt()->type) {
+    case MOUSE_MOVE_REL: {
+      auto current_pkt = static_cast<MOUSE_MOVE_REL_PACKET *>(current.pkt());
+      auto next_pkt = static_cast<const MOUSE_MOVE_REL_PACKET *>(next.pkt());
+      int delta_x = boost::endian::big_to_native(current_pkt->delta_x);
+      int delta_y = boost::endian::big_to_native(current_pkt->delta_y);
+      delta_x += boost::endian::big_to_native(next_pkt->delta_x);
+      delta_y += boost::endian::big_to_native(next_pkt->delta_y);
+      if (!fits_in_short(delta_x) || !fits_in_short(delta_y)) {
+        return false;
+      }
+      current_pkt->delta_x = boost::endian::native_to_big((short)delta_x);
+      current_pkt->delta_y = boost::endian::native_to_big((short)delta_y);
+      return true;
+    }
+    case TOUCH:
+      // A hover followed by a move (or the other way around) changes the meaning of the event
+      if (static_cast<const TOUCH_PACKET *>(current.pkt())->event_type !=
+          static_cast<const TOUCH_PACKET *>(next.pkt())->event_type) {
+        return false;
+      }
+      current = next;
+      return true;
+    case CONTROLLER_TOUCH:
+      if (static_cast<const CONTROLLER_TOUCH_PACKET *>(current.pkt())->event_type !=
+          static_cast<const CONTROLLER_TOUCH_PACKET *>(next.pkt())->event_type) {
+        return false;
+      }
+      current = next;
+      return true;
+    default: // Only the latest sample matters
+      current = next;
+      return true;
+    }
+  }
+
+  static bool fits_in_short(int value) {
+    return value >= std::numeric_limits<short>::min() && value <= std::numeric_limits<short>::max();
+  }
+
+  std::chrono::microseconds window;
+  std::chrono::steady_clock::time_point first_event;
+  std::vector<Slot> slots;
+  Stats stats;
+};
+
+} // namespace control
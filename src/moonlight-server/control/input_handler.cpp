@@ -1,11 +1,14 @@
+#include <array>
 #include <boost/endian/conversion.hpp>
 #include <boost/locale.hpp>
 #include <control/input_handler.hpp>
+#include <core/keycodes.hpp>
 #include <events/events.hpp>
 #include <helpers/logger.hpp>
 #include <immer/box.hpp>
 #include <platforms/input.hpp>
 #include <string>
+#include <type_traits>
 
 namespace control {
 
@@ -16,36 +19,32 @@ using namespace std::string_literals;
 using namespace moonlight::control;
 
 std::shared_ptr<events::JoypadTypes> create_new_joypad(const events::StreamSession &session,
-                                                       const immer::atom<enet_clients_map> &connected_clients,
+                                                       const enet_clients_atom &connected_clients,
                                                        int controller_number,
                                                        CONTROLLER_TYPE type,
                                                        uint8_t capabilities) {
 
-  auto on_rumble_fn = ([clients = &connected_clients,
-                        controller_number,
-                        session_id = session.session_id,
-                        aes_key = session.aes_key](int low_freq, int high_freq) {
+  auto on_rumble_fn = ([clients = connected_clients, controller_number, session_id = session.session_id](
+                           int low_freq,
+                           int high_freq) {
     auto rumble_pkt = ControlRumblePacket{
         .header = {.type = RUMBLE_DATA, .length = sizeof(ControlRumblePacket) - sizeof(ControlPacket)},
         .controller_number = boost::endian::native_to_little((uint16_t)controller_number),
         .low_freq = boost::endian::native_to_little((uint16_t)low_freq),
         .high_freq = boost::endian::native_to_little((uint16_t)high_freq)};
-    std::string plaintext = {(char *)&rumble_pkt, sizeof(rumble_pkt)};
-    encrypt_and_send(plaintext, aes_key, *clients, session_id);
+    encrypt_and_send({(char *)&rumble_pkt, sizeof(rumble_pkt)}, clients, session_id);
   });
 
-  auto on_led_fn = ([clients = &connected_clients,
-                     controller_number,
-                     session_id = session.session_id,
-                     aes_key = session.aes_key](int r, int g, int b) {
+  auto on_led_fn = ([clients = connected_clients, controller_number, session_id = session.session_id](int r,
+                                                                                                   int g,
+                                                                                                   int b) {
     auto led_pkt = ControlRGBLedPacket{
         .header{.type = RGB_LED_EVENT, .length = sizeof(ControlRGBLedPacket) - sizeof(ControlPacket)},
         .controller_number = boost::endian::native_to_little((uint16_t)controller_number),
         .r = static_cast<uint8_t>(r),
         .g = static_cast<uint8_t>(g),
         .b = static_cast<uint8_t>(b)};
-    std::string plaintext = {(char *)&led_pkt, sizeof(led_pkt)};
-    encrypt_and_send(plaintext, aes_key, *clients, session_id);
+    encrypt_and_send({(char *)&led_pkt, sizeof(led_pkt)}, clients, session_id);
   });
 
   std::shared_ptr<events::JoypadTypes> new_pad;
@@ -124,8 +123,7 @@ std::shared_ptr<events::JoypadTypes> create_new_joypad(const events::StreamSessi
         .controller_number = static_cast<uint16_t>(controller_number),
         .reportrate = 100,
         .type = ACCELERATION};
-    std::string plaintext = {(char *)&accelerometer_pkt, sizeof(accelerometer_pkt)};
-    encrypt_and_send(plaintext, session.aes_key, connected_clients, session.session_id);
+    encrypt_and_send({(char *)&accelerometer_pkt, sizeof(accelerometer_pkt)}, connected_clients, session.session_id);
   }
 
   if (capabilities & GYRO && final_type == PS) {
@@ -136,8 +134,7 @@ std::shared_ptr<events::JoypadTypes> create_new_joypad(const events::StreamSessi
         .controller_number = static_cast<uint16_t>(controller_number),
         .reportrate = 100,
         .type = GYROSCOPE};
-    std::string plaintext = {(char *)&gyro_pkt, sizeof(gyro_pkt)};
-    encrypt_and_send(plaintext, session.aes_key, connected_clients, session.session_id);
+    encrypt_and_send({(char *)&gyro_pkt, sizeof(gyro_pkt)}, connected_clients, session.session_id);
   }
 
   session.joypads->update([&](events::JoypadList joypads) {
@@ -160,7 +157,7 @@ std::shared_ptr<events::JoypadTypes> create_new_joypad(const events::StreamSessi
  * Creates a new PenTablet and saves it into the session;
  * will also trigger a PlugDeviceEvent
  */
-bool create_pen_tablet(events::StreamSession &session) {
+bool create_pen_tablet(const events::StreamSession &session) {
   logs::log(logs::debug, "[INPUT] Creating new pen tablet");
   auto tablet = PenTablet::create();
   if (!tablet) {
@@ -185,7 +182,7 @@ bool create_pen_tablet(events::StreamSession &session) {
  * Creates a new Touch screen and saves it into the session;
  * will also trigger a PlugDeviceEvent
  */
-bool create_touch_screen(events::StreamSession &session) {
+bool create_touch_screen(const events::StreamSession &session) {
   logs::log(logs::debug, "[INPUT] Creating new touch screen");
   auto touch = TouchScreen::create();
   if (!touch) {
@@ -214,7 +211,7 @@ static inline float deg2rad(float degree) {
   return degree * (M_PI / 180.f);
 }
 
-void mouse_move_rel(const MOUSE_MOVE_REL_PACKET &pkt, events::StreamSession &session) {
+void mouse_move_rel(const MOUSE_MOVE_REL_PACKET &pkt, const events::StreamSession &session) {
   if (session.mouse->has_value()) {
     short delta_x = boost::endian::big_to_native(pkt.delta_x);
     short delta_y = boost::endian::big_to_native(pkt.delta_y);
@@ -224,7 +221,7 @@ void mouse_move_rel(const MOUSE_MOVE_REL_PACKET &pkt, events::StreamSession &ses
   }
 }
 
-void mouse_move_abs(const MOUSE_MOVE_ABS_PACKET &pkt, events::StreamSession &session) {
+void mouse_move_abs(const MOUSE_MOVE_ABS_PACKET &pkt, const events::StreamSession &session) {
   if (session.mouse->has_value()) {
     float x = boost::endian::big_to_native(pkt.x);
     float y = boost::endian::big_to_native(pkt.y);
@@ -236,28 +233,28 @@ void mouse_move_abs(const MOUSE_MOVE_ABS_PACKET &pkt, events::StreamSession &ses
   }
 }
 
-void mouse_button(const MOUSE_BUTTON_PACKET &pkt, events::StreamSession &session) {
+/**
+ * inputtino takes its own enum instead of the Linux button code
+ */
+static Mouse::MOUSE_BUTTON to_inputtino_button(unsigned int moonlight_button) {
+  switch (keycodes::moonlight_button_to_linux(moonlight_button)) {
+  case BTN_LEFT:
+    return Mouse::LEFT;
+  case BTN_MIDDLE:
+    return Mouse::MIDDLE;
+  case BTN_RIGHT:
+    return Mouse::RIGHT;
+  case BTN_SIDE:
+    return Mouse::SIDE;
+  default:
+    return Mouse::EXTRA;
+  }
+}
+
+void mouse_button(const MOUSE_BUTTON_PACKET &pkt, const events::StreamSession &session) {
   if (session.mouse->has_value()) {
     if (std::holds_alternative<state::input::Mouse>(session.mouse->value())) {
-      Mouse::MOUSE_BUTTON btn_type;
-
-      switch (pkt.button) {
-      case 1:
-        btn_type = Mouse::LEFT;
-        break;
-      case 2:
-        btn_type = Mouse::MIDDLE;
-        break;
-      case 3:
-        btn_type = Mouse::RIGHT;
-        break;
-      case 4:
-        btn_type = Mouse::SIDE;
-        break;
-      default:
-        btn_type = Mouse::EXTRA;
-        break;
-      }
+      auto btn_type = to_inputtino_button(pkt.button);
       if (pkt.type == MOUSE_BUTTON_PRESS) {
         std::get<state::input::Mouse>(session.mouse->value()).press(btn_type);
       } else {
@@ -275,7 +272,7 @@ void mouse_button(const MOUSE_BUTTON_PACKET &pkt, events::StreamSession &session
   }
 }
 
-void mouse_scroll(const MOUSE_SCROLL_PACKET &pkt, events::StreamSession &session) {
+void mouse_scroll(const MOUSE_SCROLL_PACKET &pkt, const events::StreamSession &session) {
   if (session.mouse->has_value()) {
     std::visit([scroll_amount = boost::endian::big_to_native(pkt.scroll_amt1)](
                    auto &mouse) { mouse.vertical_scroll(scroll_amount); },
@@ -285,7 +282,7 @@ void mouse_scroll(const MOUSE_SCROLL_PACKET &pkt, events::StreamSession &session
   }
 }
 
-void mouse_h_scroll(const MOUSE_HSCROLL_PACKET &pkt, events::StreamSession &session) {
+void mouse_h_scroll(const MOUSE_HSCROLL_PACKET &pkt, const events::StreamSession &session) {
   if (session.mouse->has_value()) {
     std::visit([scroll_amount = boost::endian::big_to_native(pkt.scroll_amount)](
                    auto &mouse) { mouse.horizontal_scroll(scroll_amount); },
@@ -295,7 +292,7 @@ void mouse_h_scroll(const MOUSE_HSCROLL_PACKET &pkt, events::StreamSession &sess
   }
 }
 
-void keyboard_key(const KEYBOARD_PACKET &pkt, events::StreamSession &session) {
+void keyboard_key(const KEYBOARD_PACKET &pkt, const events::StreamSession &session) {
   // moonlight always sets the high bit; not sure why but mask it off here
   short moonlight_key = (short)boost::endian::little_to_native(pkt.key_code) & (short)0x7fff;
   if (session.keyboard->has_value()) {
@@ -331,7 +328,7 @@ void keyboard_key(const KEYBOARD_PACKET &pkt, events::StreamSession &session) {
   }
 }
 
-void utf8_text(const UTF8_TEXT_PACKET &pkt, events::StreamSession &session) {
+void utf8_text(const UTF8_TEXT_PACKET &pkt, const events::StreamSession &session) {
   if (session.keyboard->has_value()) {
     /* Here we receive a single UTF-8 encoded char at a time,
      * the trick is to convert it to UTF-32 then send CTRL+SHIFT+U+<HEXCODE> in order to produce any
@@ -354,7 +351,7 @@ void utf8_text(const UTF8_TEXT_PACKET &pkt, events::StreamSession &session) {
   }
 }
 
-void touch(const TOUCH_PACKET &pkt, events::StreamSession &session) {
+void touch(const TOUCH_PACKET &pkt, const events::StreamSession &session) {
   bool has_touch_device = session.touch_screen->has_value();
   if (!has_touch_device) {
     has_touch_device = create_touch_screen(session);
@@ -396,7 +393,7 @@ void touch(const TOUCH_PACKET &pkt, events::StreamSession &session) {
   }
 }
 
-void pen(const PEN_PACKET &pkt, events::StreamSession &session) {
+void pen(const PEN_PACKET &pkt, const events::StreamSession &session) {
   bool has_pen_device = session.pen_tablet->has_value();
   if (!has_pen_device) {
     create_pen_tablet(session);
@@ -459,8 +456,8 @@ void pen(const PEN_PACKET &pkt, events::StreamSession &session) {
 }
 
 void controller_arrival(const CONTROLLER_ARRIVAL_PACKET &pkt,
-                        events::StreamSession &session,
-                        const immer::atom<enet_clients_map> &connected_clients) {
+                        const events::StreamSession &session,
+                        const enet_clients_atom &connected_clients) {
   auto joypads = session.joypads->load();
   if (joypads->find(pkt.controller_number)) {
     // TODO: should we replace it instead?
@@ -477,8 +474,8 @@ void controller_arrival(const CONTROLLER_ARRIVAL_PACKET &pkt,
 }
 
 void controller_multi(const CONTROLLER_MULTI_PACKET &pkt,
-                      events::StreamSession &session,
-                      const immer::atom<enet_clients_map> &connected_clients) {
+                      const events::StreamSession &session,
+                      const enet_clients_atom &connected_clients) {
   auto joypads = session.joypads->load();
   std::shared_ptr<events::JoypadTypes> selected_pad;
   if (auto joypad = joypads->find(pkt.controller_number)) {
@@ -505,18 +502,27 @@ void controller_multi(const CONTROLLER_MULTI_PACKET &pkt,
     selected_pad = create_new_joypad(session, connected_clients, pkt.controller_number, XBOX, ANALOG_TRIGGERS | RUMBLE);
   }
   std::visit(
-      [pkt](inputtino::Joypad &pad) {
+      [pkt](auto &pad) {
         std::uint16_t bf = pkt.button_flags;
         std::uint32_t bf2 = pkt.buttonFlags2;
         pad.set_pressed_buttons(bf | (bf2 << 16));
-        pad.set_stick(inputtino::Joypad::LS, pkt.left_stick_x, pkt.left_stick_y);
-        pad.set_stick(inputtino::Joypad::RS, pkt.right_stick_x, pkt.right_stick_y);
-        pad.set_triggers(pkt.left_trigger, pkt.right_trigger);
+        if constexpr (std::is_same_v<std::decay_t<decltype(pad)>, XboxOneJoypad>) {
+          pad.set_axes(pkt.left_stick_x,
+                       pkt.left_stick_y,
+                       pkt.right_stick_x,
+                       pkt.right_stick_y,
+                       pkt.left_trigger,
+                       pkt.right_trigger);
+        } else {
+          pad.set_stick(inputtino::Joypad::LS, pkt.left_stick_x, pkt.left_stick_y);
+          pad.set_stick(inputtino::Joypad::RS, pkt.right_stick_x, pkt.right_stick_y);
+          pad.set_triggers(pkt.left_trigger, pkt.right_trigger);
+        }
       },
       *selected_pad);
 }
 
-void controller_touch(const CONTROLLER_TOUCH_PACKET &pkt, events::StreamSession &session) {
+void controller_touch(const CONTROLLER_TOUCH_PACKET &pkt, const events::StreamSession &session) {
   auto joypads = session.joypads->load();
   std::shared_ptr<events::JoypadTypes> selected_pad;
   if (auto joypad = joypads->find(pkt.controller_number)) {
@@ -554,7 +560,7 @@ void controller_touch(const CONTROLLER_TOUCH_PACKET &pkt, events::StreamSession
   }
 }
 
-void controller_motion(const CONTROLLER_MOTION_PACKET &pkt, events::StreamSession &session) {
+void controller_motion(const CONTROLLER_MOTION_PACKET &pkt, const events::StreamSession &session) {
   auto joypads = session.joypads->load();
   std::shared_ptr<events::JoypadTypes> selected_pad;
   if (auto joypad = joypads->find(pkt.controller_number)) {
@@ -574,7 +580,7 @@ void controller_motion(const CONTROLLER_MOTION_PACKET &pkt, events::StreamSessio
   }
 }
 
-void controller_battery(const CONTROLLER_BATTERY_PACKET &pkt, events::StreamSession &session) {
+void controller_battery(const CONTROLLER_BATTERY_PACKET &pkt, const events::StreamSession &session) {
   auto joypads = session.joypads->load();
   std::shared_ptr<events::JoypadTypes> selected_pad;
   if (auto joypad = joypads->find(pkt.controller_number)) {
@@ -605,99 +611,87 @@ void controller_battery(const CONTROLLER_BATTERY_PACKET &pkt, events::StreamSess
   }
 }
 
-void handle_input(events::StreamSession &session,
-                  const immer::atom<enet_clients_map> &connected_clients,
-                  INPUT_PKT *pkt) {
-  switch (pkt->type) {
-  case MOUSE_MOVE_REL: {
-    logs::log(logs::trace, "[INPUT] Received input of type: MOUSE_MOVE_REL");
-    auto move_pkt = static_cast<MOUSE_MOVE_REL_PACKET *>(pkt);
-    mouse_move_rel(*move_pkt, session);
-    break;
-  }
-  case MOUSE_MOVE_ABS: {
-    logs::log(logs::trace, "[INPUT] Received input of type: MOUSE_MOVE_ABS");
-    auto move_pkt = static_cast<MOUSE_MOVE_ABS_PACKET *>(pkt);
-    mouse_move_abs(*move_pkt, session);
-    break;
-  }
-  case MOUSE_BUTTON_PRESS:
-  case MOUSE_BUTTON_RELEASE: {
-    logs::log(logs::trace, "[INPUT] Received input of type: MOUSE_BUTTON_PACKET");
-    auto btn_pkt = static_cast<MOUSE_BUTTON_PACKET *>(pkt);
-    mouse_button(*btn_pkt, session);
-    break;
-  }
-  case MOUSE_SCROLL: {
-    logs::log(logs::trace, "[INPUT] Received input of type: MOUSE_SCROLL_PACKET");
-    auto scroll_pkt = (static_cast<MOUSE_SCROLL_PACKET *>(pkt));
-    mouse_scroll(*scroll_pkt, session);
-    break;
-  }
-  case MOUSE_HSCROLL: {
-    logs::log(logs::trace, "[INPUT] Received input of type: MOUSE_HSCROLL_PACKET");
-    auto scroll_pkt = (static_cast<MOUSE_HSCROLL_PACKET *>(pkt));
-    mouse_h_scroll(*scroll_pkt, session);
-    break;
-  }
-  case KEY_PRESS:
-  case KEY_RELEASE: {
-    logs::log(logs::trace, "[INPUT] Received input of type: KEYBOARD_PACKET");
-    auto key_pkt = static_cast<KEYBOARD_PACKET *>(pkt);
-    keyboard_key(*key_pkt, session);
-    break;
-  }
-  case UTF8_TEXT: {
-    logs::log(logs::trace, "[INPUT] Received input of type: UTF8_TEXT");
-    auto txt_pkt = static_cast<UTF8_TEXT_PACKET *>(pkt);
-    utf8_text(*txt_pkt, session);
-    break;
-  }
-  case TOUCH: {
-    logs::log(logs::trace, "[INPUT] Received input of type: TOUCH");
-    auto touch_pkt = static_cast<TOUCH_PACKET *>(pkt);
-    touch(*touch_pkt, session);
-    break;
-  }
-  case PEN: {
-    logs::log(logs::trace, "[INPUT] Received input of type: PEN");
-    auto pen_pkt = static_cast<PEN_PACKET *>(pkt);
-    pen(*pen_pkt, session);
-    break;
-  }
-  case CONTROLLER_ARRIVAL: {
-    logs::log(logs::trace, "[INPUT] Received input of type: CONTROLLER_ARRIVAL");
-    auto new_controller = static_cast<CONTROLLER_ARRIVAL_PACKET *>(pkt);
-    controller_arrival(*new_controller, session, connected_clients);
-    break;
-  }
-  case CONTROLLER_MULTI: {
-    logs::log(logs::trace, "[INPUT] Received input of type: CONTROLLER_MULTI");
-    auto controller_pkt = static_cast<CONTROLLER_MULTI_PACKET *>(pkt);
-    controller_multi(*controller_pkt, session, connected_clients);
-    break;
-  }
-  case CONTROLLER_TOUCH: {
-    logs::log(logs::trace, "[INPUT] Received input of type: CONTROLLER_TOUCH");
-    auto touch_pkt = static_cast<CONTROLLER_TOUCH_PACKET *>(pkt);
-    controller_touch(*touch_pkt, session);
-    break;
+using input_handler_fn = void (*)(const events::StreamSession &session,
+                                  const enet_clients_atom &connected_clients,
+                                  INPUT_PKT *pkt);
+
+template <typename PKT, void (*fn)(const PKT &, const events::StreamSession &)>
+void handle(const events::StreamSession &session, const enet_clients_atom &, INPUT_PKT *pkt) {
+  fn(*static_cast<PKT *>(pkt), session);
+}
+
+template <typename PKT,
+          void (*fn)(const PKT &, const events::StreamSession &, const enet_clients_atom &)>
+void handle(const events::StreamSession &session,
+            const enet_clients_atom &connected_clients,
+            INPUT_PKT *pkt) {
+  fn(*static_cast<PKT *>(pkt), session, connected_clients);
+}
+
+struct InputHandler {
+  INPUT_TYPE type;
+  const char *name = nullptr; // nullptr marks an empty slot
+  input_handler_fn handle = nullptr;
+};
+
+static constexpr InputHandler INPUT_HANDLERS[] = {
+    {MOUSE_MOVE_REL, "MOUSE_MOVE_REL", handle<MOUSE_MOVE_REL_PACKET, mouse_move_rel>},
+    {MOUSE_MOVE_ABS, "MOUSE_MOVE_ABS", handle<MOUSE_MOVE_ABS_PACKET, mouse_move_abs>},
+    {MOUSE_BUTTON_PRESS, "MOUSE_BUTTON_PACKET", handle<MOUSE_BUTTON_PACKET, mouse_button>},
+    {MOUSE_BUTTON_RELEASE, "MOUSE_BUTTON_PACKET", handle<MOUSE_BUTTON_PACKET, mouse_button>},
+    {MOUSE_SCROLL, "MOUSE_SCROLL_PACKET", handle<MOUSE_SCROLL_PACKET, mouse_scroll>},
+    {MOUSE_HSCROLL, "MOUSE_HSCROLL_PACKET", handle<MOUSE_HSCROLL_PACKET, mouse_h_scroll>},
+    {KEY_PRESS, "KEYBOARD_PACKET", handle<KEYBOARD_PACKET, keyboard_key>},
+    {KEY_RELEASE, "KEYBOARD_PACKET", handle<KEYBOARD_PACKET, keyboard_key>},
+    {UTF8_TEXT, "UTF8_TEXT", handle<UTF8_TEXT_PACKET, utf8_text>},
+    {TOUCH, "TOUCH", handle<TOUCH_PACKET, touch>},
+    {PEN, "PEN", handle<PEN_PACKET, pen>},
+    {CONTROLLER_ARRIVAL, "CONTROLLER_ARRIVAL", handle<CONTROLLER_ARRIVAL_PACKET, controller_arrival>},
+    {CONTROLLER_MULTI, "CONTROLLER_MULTI", handle<CONTROLLER_MULTI_PACKET, controller_multi>},
+    {CONTROLLER_TOUCH, "CONTROLLER_TOUCH", handle<CONTROLLER_TOUCH_PACKET, controller_touch>},
+    {CONTROLLER_MOTION, "CONTROLLER_MOTION", handle<CONTROLLER_MOTION_PACKET, controller_motion>},
+    {CONTROLLER_BATTERY, "CONTROLLER_BATTERY", handle<CONTROLLER_BATTERY_PACKET, controller_battery>},
+    {HAPTICS, "HAPTICS", nullptr},
+};
+
+static constexpr bool has_unique_slots() {
+  for (std::size_t i = 0; i < std::size(INPUT_HANDLERS); i++) {
+    for (std::size_t j = i + 1; j < std::size(INPUT_HANDLERS); j++) {
+      if (input_type_slot(INPUT_HANDLERS[i].type) == input_type_slot(INPUT_HANDLERS[j].type)) {
+        return false;
+      }
+    }
   }
-  case CONTROLLER_MOTION: {
-    logs::log(logs::trace, "[INPUT] Received input of type: CONTROLLER_MOTION");
-    auto motion_pkt = static_cast<CONTROLLER_MOTION_PACKET *>(pkt);
-    controller_motion(*motion_pkt, session);
-    break;
+  return true;
+}
+
+static_assert(has_unique_slots(), "input_type_slot() must map each INPUT_TYPE to a different slot");
+
+static constexpr auto INPUT_DISPATCH_TABLE = []() {
+  std::array<InputHandler, INPUT_TYPE_SLOTS> table = {};
+  for (const auto &handler : INPUT_HANDLERS) {
+    table[input_type_slot(handler.type)] = handler;
   }
-  case CONTROLLER_BATTERY: {
-    logs::log(logs::trace, "[INPUT] Received input of type: CONTROLLER_BATTERY");
-    auto battery_pkt = static_cast<CONTROLLER_BATTERY_PACKET *>(pkt);
-    controller_battery(*battery_pkt, session);
-    break;
+  return table;
+}();
+
+const char *input_type_to_str(INPUT_TYPE type) {
+  const auto &handler = INPUT_DISPATCH_TABLE[input_type_slot(type)];
+  return handler.name != nullptr && handler.type == type ? handler.name : "Unrecognised";
+}
+
+void handle_input(const events::StreamSession &session,
+                  const enet_clients_atom &connected_clients,
+                  INPUT_PKT *pkt) {
+  const auto &handler = INPUT_DISPATCH_TABLE[input_type_slot(pkt->type)];
+  if (handler.name == nullptr || handler.type != pkt->type) {
+    logs::log(logs::debug, "[INPUT] Received unknown input of type: {:#x}", static_cast<std::uint32_t>(pkt->type));
+    return;
   }
-  case HAPTICS:
-    logs::log(logs::trace, "[INPUT] Received input of type: HAPTICS");
-    break;
+
+  logs::log(logs::trace, "[INPUT] Received input of type: {}", handler.name);
+  if (handler.handle) {
+    handler.handle(session, connected_clients, pkt);
   }
 }
 } // namespace control
\ No newline at end of file
@@ -12,40 +12,59 @@ using namespace wolf::core;
 /**
  * Side effect: session devices might be updated when hotplugging
  */
-void handle_input(events::StreamSession &session,
-                  const immer::atom<enet_clients_map> &connected_clients,
+void handle_input(const events::StreamSession &session,
+                  const enet_clients_atom &connected_clients,
                   INPUT_PKT *pkt);
 
-void mouse_move_rel(const MOUSE_MOVE_REL_PACKET &pkt, events::StreamSession &session);
+/**
+ * @return the name of the input type, "Unrecognised" for unknown types
+ */
+const char *input_type_to_str(INPUT_TYPE type);
+
+/**
+ * Creates a new joypad and saves it into the session; will also trigger a PlugDeviceEvent
+ * @return nullptr if the device couldn't be created
+ */
+std::shared_ptr<events::JoypadTypes> create_new_joypad(const events::StreamSession &session,
+                                                       const enet_clients_atom &connected_clients,
+                                                       int controller_number,
+                                                       CONTROLLER_TYPE type,
+                                                       uint8_t capabilities);
+
+bool create_pen_tablet(const events::StreamSession &session);
+
+bool create_touch_screen(const events::StreamSession &session);
+
+void mouse_move_rel(const MOUSE_MOVE_REL_PACKET &pkt, const events::StreamSession &session);
 
-void mouse_move_abs(const MOUSE_MOVE_ABS_PACKET &pkt, events::StreamSession &session);
+void mouse_move_abs(const MOUSE_MOVE_ABS_PACKET &pkt, const events::StreamSession &session);
 
-void mouse_button(const MOUSE_BUTTON_PACKET &pkt, events::StreamSession &session);
+void mouse_button(const MOUSE_BUTTON_PACKET &pkt, const events::StreamSession &session);
 
-void mouse_scroll(const MOUSE_SCROLL_PACKET &pkt, events::StreamSession &session);
+void mouse_scroll(const MOUSE_SCROLL_PACKET &pkt, const events::StreamSession &session);
 
-void mouse_h_scroll(const MOUSE_HSCROLL_PACKET &pkt, events::StreamSession &session);
+void mouse_h_scroll(const MOUSE_HSCROLL_PACKET &pkt, const events::StreamSession &session);
 
-void keyboard_key(const KEYBOARD_PACKET &pkt, events::StreamSession &session);
+void keyboard_key(const KEYBOARD_PACKET &pkt, const events::StreamSession &session);
 
-void utf8_text(const UTF8_TEXT_PACKET &pkt, events::StreamSession &session);
+void utf8_text(const UTF8_TEXT_PACKET &pkt, const events::StreamSession &session);
 
-void touch(const TOUCH_PACKET &pkt, events::StreamSession &session);
+void touch(const TOUCH_PACKET &pkt, const events::StreamSession &session);
 
-void pen(const PEN_PACKET &pkt, events::StreamSession &session);
+void pen(const PEN_PACKET &pkt, const events::StreamSession &session);
 
 void controller_arrival(const CONTROLLER_ARRIVAL_PACKET &pkt,
-                        events::StreamSession &session,
-                        const immer::atom<enet_clients_map> &connected_clients);
+                        const events::StreamSession &session,
+                        const enet_clients_atom &connected_clients);
 
 void controller_multi(const CONTROLLER_MULTI_PACKET &pkt,
-                      events::StreamSession &session,
-                      const immer::atom<enet_clients_map> &connected_clients);
+                      const events::StreamSession &session,
+                      const enet_clients_atom &connected_clients);
 
-void controller_touch(const CONTROLLER_TOUCH_PACKET &pkt, events::StreamSession &session);
+void controller_touch(const CONTROLLER_TOUCH_PACKET &pkt, const events::StreamSession &session);
 
-void controller_motion(const CONTROLLER_MOTION_PACKET &pkt, events::StreamSession &session);
+void controller_motion(const CONTROLLER_MOTION_PACKET &pkt, const events::StreamSession &session);
 
-void controller_battery(const CONTROLLER_BATTERY_PACKET &pkt, events::StreamSession &session);
+void controller_battery(const CONTROLLER_BATTERY_PACKET &pkt, const events::StreamSession &session);
 
 } // namespace control
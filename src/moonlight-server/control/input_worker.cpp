@@ -0,0 +1,254 @@
+#include <control/input_handler.hpp>
+#include <control/input_worker.hpp>
+#include <helpers/logger.hpp>
+#include <optional>
+#include <state/sessions.hpp>
+#include <thread>
+
+namespace control {
+
+std::shared_ptr<InputWorker> InputWorker::start(std::size_t session_id,
+                                                const state::SessionsAtoms &running_sessions,
+                                                const enet_clients_atom &connected_clients) {
+  auto worker = std::make_shared<InputWorker>(session_id, running_sessions, connected_clients);
+  std::thread([worker]() { worker->run(); }).detach();
+  return worker;
+}
+
+bool InputWorker::push(std::string_view payload, std::chrono::steady_clock::time_point received_at) {
+  InputPayload input = {.size = static_cast<std::uint8_t>(payload.size()), .received_at = received_at};
+  std::copy(payload.begin(), payload.begin() + std::min(payload.size(), input.data.size()), input.data.begin());
+
+  if (!queue.try_push(input)) {
+    auto total_dropped = dropped.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (total_dropped == 1 || total_dropped % 1000 == 0) {
+      logs::log(logs::warning, "[INPUT] Session {} input queue is full, dropped {} packets", session_id, total_dropped);
+    }
+    return false;
+  }
+  return true;
+}
+
+void InputWorker::stop() {
+  queue.close();
+}
+
+void InputWorker::execute(const events::StreamSession &session, const InputPayload &input) {
+  try {
+    handle_input(session, connected_clients, const_cast<INPUT_PKT *>(input.pkt()));
+  } catch (std::runtime_error &e) {
+    logs::log(logs::warning, "[INPUT] Unable to handle input for session {}: {}", session.session_id, e.what());
+    return;
+  }
+  if (latency_tracer && input.received_at != std::chrono::steady_clock::time_point{}) {
+    latency_tracer->on_inject(input.received_at);
+  }
+}
+
+void InputWorker::run() {
+  logs::log(logs::debug, "[INPUT] Starting input worker for session {}", session_id);
+  latency_tracer = streaming::latency::Registry::get().get_or_create(session_id);
+  auto has_provisioned_devices = [this]() { return has_provisioned.load(std::memory_order_acquire); };
+  while (true) {
+    bool closed = false;
+    if (!coalescer || coalescer->empty()) {
+      if (!queue.wait(has_provisioned_devices)) {
+        break;
+      }
+    } else {
+      // Give more events the chance to be merged, anything that can't be merged flushes them straight away (submit())
+      closed = !queue.wait_until(coalescer->deadline(), has_provisioned_devices);
+    }
+
+    // The session is only looked up again once it has been replaced or removed
+    if (!session_handle.is_current()) {
+      session_handle = state::get_session_handle(running_sessions->load_index(), session_id);
+    }
+    if (!session_handle) { // The session is gone, nothing left to drive
+      queue.consume_all([](InputPayload &) {});
+      if (coalescer) {
+        coalescer->flush([](const InputPayload &) {});
+      }
+      std::lock_guard lock(provisioned_m);
+      provisioned.clear();
+      pending_devices.clear();
+      has_provisioned.store(false, std::memory_order_release);
+      continue;
+    }
+
+    const auto &session = *session_handle;
+    if (!coalescer && session.app->input_coalescing_window_us) {
+      coalescer.emplace(std::chrono::microseconds(*session.app->input_coalescing_window_us));
+    }
+
+    replay_provisioned(session);
+    queue.consume_all([&](InputPayload &input) { dispatch(session, input); });
+
+    if (coalescer && !coalescer->empty() && (closed || coalescer->deadline() <= std::chrono::steady_clock::now())) {
+      flush_coalesced(session);
+    }
+  }
+
+  if (coalescer) {
+    auto stats = coalescer->get_stats();
+    logs::log(logs::debug,
+              "[INPUT] Session {} coalesced {} out of {} motion events",
+              session_id,
+              stats.coalesced,
+              stats.received);
+  }
+  logs::log(logs::debug, "[INPUT] Stopped input worker for session {}", session_id);
+}
+
+void InputWorker::submit(const events::StreamSession &session, const InputPayload &input) {
+  if (coalescer && coalescer->add(input)) {
+    return;
+  }
+  // Merged events have to be written before this one, in order to preserve the ordering
+  flush_coalesced(session);
+  execute(session, input);
+}
+
+void InputWorker::flush_coalesced(const events::StreamSession &session) {
+  if (coalescer) {
+    coalescer->flush([&](const InputPayload &input) { execute(session, input); });
+  }
+}
+
+void InputWorker::dispatch(const events::StreamSession &session, const InputPayload &input) {
+  auto pkt = input.pkt();
+
+  // Which device is this event for? Only the ones that we create on demand are relevant here
+  std::optional<int> device;
+  std::function<bool()> create_fn;
+  switch (pkt->type) {
+  case CONTROLLER_ARRIVAL: {
+    auto arrival_pkt = static_cast<const CONTROLLER_ARRIVAL_PACKET *>(pkt);
+    device = arrival_pkt->controller_number;
+    create_fn = [session,
+                 clients = connected_clients,
+                 controller_number = arrival_pkt->controller_number,
+                 type = (CONTROLLER_TYPE)arrival_pkt->controller_type,
+                 capabilities = arrival_pkt->capabilities]() {
+      return create_new_joypad(session, clients, controller_number, type, capabilities) != nullptr;
+    };
+    break;
+  }
+  case CONTROLLER_MULTI: {
+    auto controller_number = static_cast<const CONTROLLER_MULTI_PACKET *>(pkt)->controller_number;
+    device = controller_number;
+    // Old Moonlight doesn't support CONTROLLER_ARRIVAL, we create a default pad when it's first mentioned
+    create_fn = [session, clients = connected_clients, controller_number]() {
+      return create_new_joypad(session, clients, controller_number, XBOX, ANALOG_TRIGGERS | RUMBLE) != nullptr;
+    };
+    break;
+  }
+  case CONTROLLER_TOUCH:
+    device = static_cast<const CONTROLLER_TOUCH_PACKET *>(pkt)->controller_number;
+    break;
+  case CONTROLLER_MOTION:
+    device = static_cast<const CONTROLLER_MOTION_PACKET *>(pkt)->controller_number;
+    break;
+  case CONTROLLER_BATTERY:
+    device = static_cast<const CONTROLLER_BATTERY_PACKET *>(pkt)->controller_number;
+    break;
+  case TOUCH:
+    device = TOUCH_SCREEN_DEVICE;
+    create_fn = [session]() { return create_touch_screen(session); };
+    break;
+  case PEN:
+    device = PEN_TABLET_DEVICE;
+    create_fn = [session]() { return create_pen_tablet(session); };
+    break;
+  default:
+    break;
+  }
+
+  if (!device) {
+    submit(session, input);
+    return;
+  }
+
+  if (auto pending = pending_devices.find(*device); pending != pending_devices.end()) {
+    if (pkt->type == CONTROLLER_ARRIVAL) {
+      return; // Already being created
+    }
+    if (pending->second.size() >= MAX_PENDING_EVENTS) {
+      logs::log(logs::warning, "[INPUT] Too many events while waiting for device {}, dropping", *device);
+      return;
+    }
+    pending->second.push_back(input);
+    return;
+  }
+
+  bool is_present;
+  if (*device == TOUCH_SCREEN_DEVICE) {
+    is_present = session.touch_screen->has_value();
+  } else if (*device == PEN_TABLET_DEVICE) {
+    is_present = session.pen_tablet->has_value();
+  } else {
+    is_present = session.joypads->load()->find(*device) != nullptr;
+  }
+
+  if (is_present || !create_fn) {
+    submit(session, input);
+    return;
+  }
+
+  auto &buffered = pending_devices[*device];
+  if (pkt->type != CONTROLLER_ARRIVAL) {
+    buffered.push_back(input);
+  }
+  provision(*device, std::move(create_fn));
+}
+
+void InputWorker::provision(int device, std::function<bool()> create_fn) {
+  logs::log(logs::debug, "[INPUT] Provisioning device {} for session {}", device, session_id);
+  std::thread([self = shared_from_this(), device, create_fn = std::move(create_fn)]() {
+    bool created = false;
+    try {
+      created = create_fn();
+    } catch (std::exception &e) {
+      logs::log(logs::error, "[INPUT] Unable to create device {}: {}", device, e.what());
+    }
+    {
+      std::lock_guard lock(self->provisioned_m);
+      self->provisioned.emplace_back(device, created);
+      self->has_provisioned.store(true, std::memory_order_release);
+    }
+    self->queue.wake();
+  }).detach();
+}
+
+void InputWorker::replay_provisioned(const events::StreamSession &session) {
+  if (!has_provisioned.load(std::memory_order_acquire)) {
+    return;
+  }
+
+  std::vector<std::pair<int, bool>> ready;
+  {
+    std::lock_guard lock(provisioned_m);
+    ready.swap(provisioned);
+    has_provisioned.store(false, std::memory_order_release);
+  }
+
+  for (const auto &[device, created] : ready) {
+    auto pending = pending_devices.extract(device);
+    if (pending.empty()) {
+      continue;
+    }
+    if (!created) {
+      logs::log(logs::warning,
+                "[INPUT] Device {} couldn't be created, dropping {} events",
+                device,
+                pending.mapped().size());
+      continue;
+    }
+    logs::log(logs::debug, "[INPUT] Device {} is ready, replaying {} events", device, pending.mapped().size());
+    for (const auto &input : pending.mapped()) {
+      submit(session, input);
+    }
+  }
+}
+
+} // namespace control
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <atomic>
+#include <control/control.hpp>
+#include <control/input_coalescer.hpp>
+#include <functional>
+#include <helpers/spsc_queue.hpp>
+#include <memory>
+#include <moonlight/control.hpp>
+#include <mutex>
+#include <optional>
+#include <state/data-structures.hpp>
+#include <streaming/latency.hpp>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace control {
+
+/**
+ * Drives the virtual devices of a single session on a dedicated thread.
+ *
+ * The control thread only receives and decrypts packets, input is pushed on a lock-free SPSC queue and executed here,
+ * this way a slow operation only stalls the session that triggered it.
+ *
+ * Devices (joypads, touch screen, pen tablet) are provisioned in the background: while a device is being created the
+ * events directed to it are buffered and then replayed, in order, once the device is ready. Events for the other
+ * devices of the session keep flowing in the meantime.
+ *
+ * When the app enables it, high rate motion events are merged by an InputCoalescer before being executed.
+ */
+class InputWorker : public std::enable_shared_from_this<InputWorker> {
+public:
+  static constexpr std::size_t QUEUE_SIZE = 256;
+
+  /**
+   * How many events we buffer for a single device while it's being created
+   */
+  static constexpr std::size_t MAX_PENDING_EVENTS = 256;
+
+  /**
+   * Creates the worker and starts its (detached) thread, the thread keeps the worker alive until stop() is called
+   * and the queue has been drained
+   */
+  static std::shared_ptr<InputWorker> start(std::size_t session_id,
+                                            const state::SessionsAtoms &running_sessions,
+                                            const enet_clients_atom &connected_clients);
+
+  /**
+   * Control thread only.
+   * @param received_at: when the packet has been received, used for latency tracing
+   * @return false if the queue is full (or the worker has been stopped) and the payload has been dropped
+   */
+  bool push(std::string_view payload, std::chrono::steady_clock::time_point received_at = {});
+
+  /**
+   * Doesn't wait for the thread, pending input is still executed before the worker goes away
+   */
+  void stop();
+
+  [[nodiscard]] std::size_t dropped_packets() const {
+    return dropped.load(std::memory_order_relaxed);
+  }
+
+  InputWorker(std::size_t session_id,
+              state::SessionsAtoms running_sessions,
+              enet_clients_atom connected_clients)
+      : session_id(session_id), running_sessions(std::move(running_sessions)),
+        connected_clients(std::move(connected_clients)) {}
+
+private:
+  /* Joypads are identified by their controller number */
+  static constexpr int TOUCH_SCREEN_DEVICE = -1;
+  static constexpr int PEN_TABLET_DEVICE = -2;
+
+  void run();
+
+  /**
+   * Buffers the event if its device is being created, starts provisioning the device if it's missing,
+   * executes it straight away otherwise
+   */
+  void dispatch(const events::StreamSession &session, const InputPayload &input);
+
+  /**
+   * Executes the event, going through the coalescer when enabled
+   */
+  void submit(const events::StreamSession &session, const InputPayload &input);
+
+  void flush_coalesced(const events::StreamSession &session);
+
+  /**
+   * Writes the event to the virtual devices
+   */
+  void execute(const events::StreamSession &session, const InputPayload &input);
+
+  /**
+   * Runs create_fn on a background thread, the worker is woken up once it's done
+   */
+  void provision(int device, std::function<bool()> create_fn);
+
+  /**
+   * Replays the buffered events of the devices that have been provisioned since the last call
+   */
+  void replay_provisioned(const events::StreamSession &session);
+
+  std::size_t session_id;
+  state::SessionsAtoms running_sessions;
+  /* Worker thread only */
+  state::SessionHandle session_handle;
+  enet_clients_atom connected_clients;
+
+  SPSCQueue<InputPayload, QUEUE_SIZE> queue;
+  std::atomic<std::size_t> dropped = 0;
+
+  /* Only accessed by the worker thread */
+  std::unordered_map<int, std::vector<InputPayload>> pending_devices;
+  std::optional<InputCoalescer> coalescer;
+  std::shared_ptr<streaming::latency::SessionTracer> latency_tracer = nullptr;
+
+  /* Filled by the provisioning threads: device -> created successfully */
+  std::mutex provisioned_m;
+  std::vector<std::pair<int, bool>> provisioned;
+  std::atomic<bool> has_provisioned = false;
+};
+
+} // namespace control
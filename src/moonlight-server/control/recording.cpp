@@ -0,0 +1,114 @@
+#include <boost/endian/conversion.hpp>
+#include <cerrno>
+#include <control/recording.hpp>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <helpers/logger.hpp>
+#include <helpers/utils.hpp>
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace control::recording {
+
+/* How many times we try a new file name when the session already has a recording for the same second */
+static constexpr int MAX_NAME_ATTEMPTS = 100;
+
+template <typename T> static void write_le(std::ostream &out, T value) {
+  boost::endian::native_to_little_inplace(value);
+  out.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+template <typename T> static bool read_le(std::istream &in, T &value) {
+  if (!in.read(reinterpret_cast<char *>(&value), sizeof(value))) {
+    return false;
+  }
+  boost::endian::little_to_native_inplace(value);
+  return true;
+}
+
+Recorder::Recorder(std::unique_ptr<std::ostream> out) : out(std::move(out)) {
+  this->out->write(MAGIC.data(), MAGIC.size());
+  write_le(*this->out, VERSION);
+}
+
+std::unique_ptr<Recorder> Recorder::create(std::size_t session_id) {
+  auto dir = get_recording_dir();
+  if (!dir) {
+    return nullptr;
+  }
+
+  std::error_code ec;
+  std::filesystem::create_directories(*dir, ec);
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch());
+
+  // The same session can reconnect within a second: never reuse (and truncate) a file that might still be open
+  std::filesystem::path path;
+  int fd = -1;
+  for (int attempt = 0; fd < 0 && attempt < MAX_NAME_ATTEMPTS; attempt++) {
+    path = *dir / (attempt == 0 ? fmt::format("{}-{}.wolfctrl", session_id, now.count())
+                                : fmt::format("{}-{}-{}.wolfctrl", session_id, now.count(), attempt));
+    // Decrypted input contains everything the user typed, only the owner can read it
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd < 0 && errno != EEXIST) {
+      break;
+    }
+  }
+  if (fd < 0) {
+    logs::log(logs::warning, "[ENET] Unable to record control stream to {}: {}", path.string(), strerror(errno));
+    return nullptr;
+  }
+
+  // Re-opening through /proc gets us the very same file, even if the path has been replaced in the meantime
+  auto file = std::make_unique<std::ofstream>(fmt::format("/proc/self/fd/{}", fd), std::ios::binary | std::ios::app);
+  ::close(fd);
+  if (!file->is_open()) {
+    logs::log(logs::warning, "[ENET] Unable to record control stream to {}", path.string());
+    return nullptr;
+  }
+
+  logs::log(logs::info, "[ENET] Recording control stream of session {} to {}", session_id, path.string());
+  return std::make_unique<Recorder>(std::move(file));
+}
+
+void Recorder::write(std::string_view payload, std::chrono::steady_clock::time_point received_at) {
+  auto timestamp = std::chrono::duration_cast<std::chrono::microseconds>(received_at - start);
+  write_le(*out, static_cast<std::uint64_t>(std::max<std::int64_t>(timestamp.count(), 0)));
+  write_le(*out, static_cast<std::uint16_t>(payload.size()));
+  out->write(payload.data(), static_cast<std::streamsize>(payload.size()));
+  packets++;
+}
+
+std::optional<std::filesystem::path> get_recording_dir() {
+  if (auto dir = utils::get_env("WOLF_CONTROL_RECORDING_DIR")) {
+    return std::filesystem::path(dir);
+  }
+  return {};
+}
+
+std::vector<Record> read_recording(std::istream &in) {
+  std::array<char, MAGIC.size()> magic = {};
+  std::uint32_t version = 0;
+  if (!in.read(magic.data(), magic.size()) || magic != MAGIC || !read_le(in, version)) {
+    throw std::runtime_error("Not a control stream recording");
+  }
+  if (version != VERSION) {
+    throw std::runtime_error(fmt::format("Unsupported recording version: {}", version));
+  }
+
+  std::vector<Record> records;
+  std::uint64_t timestamp;
+  std::uint16_t size;
+  while (read_le(in, timestamp) && read_le(in, size)) {
+    std::string payload(size, '\0');
+    if (!in.read(payload.data(), size)) {
+      break; // Wolf might have been killed while writing the last packet
+    }
+    records.push_back({.timestamp = std::chrono::microseconds(timestamp), .payload = std::move(payload)});
+  }
+  return records;
+}
+
+} // namespace control::recording
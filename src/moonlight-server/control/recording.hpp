@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <istream>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Recording of the decrypted control stream, used to replay real traffic without a Moonlight client.
+ *
+ * File format (all integers are little endian):
+ *  - header: "WOLFCTRL" magic, uint32 version
+ *  - one record per packet: uint64 microseconds since the start of the recording, uint16 size, size bytes of payload
+ */
+namespace control::recording {
+
+static constexpr std::array<char, 8> MAGIC = {'W', 'O', 'L', 'F', 'C', 'T', 'R', 'L'};
+static constexpr std::uint32_t VERSION = 1;
+
+struct Record {
+  std::chrono::microseconds timestamp;
+  std::string payload;
+};
+
+class Recorder {
+public:
+  /**
+   * Writes the header straight away, timestamps are relative to when the recorder has been created
+   */
+  explicit Recorder(std::unique_ptr<std::ostream> out);
+
+  /**
+   * @return a recorder writing to a new file in WOLF_CONTROL_RECORDING_DIR, nullptr if recording is disabled or the
+   * file can't be created. Existing files are never overwritten, new ones are only readable by the owner (0600).
+   */
+  static std::unique_ptr<Recorder> create(std::size_t session_id);
+
+  void write(std::string_view payload,
+             std::chrono::steady_clock::time_point received_at = std::chrono::steady_clock::now());
+
+  [[nodiscard]] std::size_t recorded_packets() const {
+    return packets;
+  }
+
+private:
+  std::unique_ptr<std::ostream> out;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::size_t packets = 0;
+};
+
+/**
+ * @return the folder where recordings are saved, set via WOLF_CONTROL_RECORDING_DIR
+ */
+std::optional<std::filesystem::path> get_recording_dir();
+
+/**
+ * Reads a whole recording
+ * @throws std::runtime_error if the header is invalid, a truncated last record is silently ignored
+ */
+std::vector<Record> read_recording(std::istream &in);
+
+} // namespace control::recording
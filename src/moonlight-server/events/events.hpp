@@ -9,7 +9,8 @@
 #include <core/virtual-display.hpp>
 #include <cstddef>
 #include <eventbus/event_bus.hpp>
-#include <helpers/tsqueue.hpp>
+#include <events/session_router.hpp>
+#include <helpers/mpmc_queue.hpp>
 #include <immer/array.hpp>
 #include <immer/atom.hpp>
 #include <immer/box.hpp>
@@ -21,6 +22,7 @@
 #include <rfl/json.hpp>
 #include <state/serialised_config.hpp>
 #include <string_view>
+#include <type_traits>
 
 namespace wolf::core::events {
 
@@ -42,7 +44,10 @@ struct UnplugDeviceEvent {
   std::vector<std::pair<std::string, std::vector<std::string>>> udev_hw_db_entries;
 };
 
-using devices_atom_queue = TSQueue<immer::box<events::PlugDeviceEvent>>;
+/**
+ * Devices waiting to be plugged into a session, there are only a handful per session (mouse, keyboard, joypads)
+ */
+using devices_atom_queue = MPMCQueue<immer::box<events::PlugDeviceEvent>, 64>;
 
 struct Runner {
 
@@ -72,6 +77,12 @@ struct App {
   bool start_audio_server;
   std::shared_ptr<Runner> runner;
   moonlight::control::pkts::CONTROLLER_TYPE joypad_type;
+
+  /**
+   * When set, high rate motion events are merged for up to this amount of microseconds before being executed.
+   * 0 only merges the events that are already queued up.
+   */
+  std::optional<int> input_coalescing_window_us = {};
 };
 
 using MouseTypes = std::variant<input::Mouse, virtual_display::WaylandMouse>;
@@ -181,7 +192,7 @@ using EventBusHandlers = dp::handler_registration<immer::box<PlugDeviceEvent>,
                                                   immer::box<RTPVideoPingEvent>,
                                                   immer::box<RTPAudioPingEvent>,
                                                   immer::box<StartRunner>>;
-using EventBusType = dp::event_bus<immer::box<PlugDeviceEvent>,
+using EventBusBase = dp::event_bus<immer::box<PlugDeviceEvent>,
                                    immer::box<PairSignal>,
                                    immer::box<UnplugDeviceEvent>,
                                    immer::box<StreamSession>,
@@ -194,6 +205,57 @@ using EventBusType = dp::event_bus<immer::box<PlugDeviceEvent>,
                                    immer::box<RTPVideoPingEvent>,
                                    immer::box<RTPAudioPingEvent>,
                                    immer::box<StartRunner>>;
+
+/**
+ * The global event bus plus session scoped handlers: register_session_handler() only receives the events of a given
+ * session, fire_event() calls them after the global handlers.
+ */
+class EventBusType : public EventBusBase {
+public:
+  template <typename Event, typename Fn>
+  [[nodiscard]] SessionHandlerRegistration register_session_handler(std::size_t session_id, Fn &&fn) {
+    return session_router.template register_handler<Event>(session_id, std::forward<Fn>(fn));
+  }
+
+  /**
+   * fn will be enqueued on the executor instead of being called by the thread that fires the event.
+   * Once unregistered, events that are still queued are dropped.
+   */
+  template <typename Event, typename Fn>
+  [[nodiscard]] SessionHandlerRegistration
+  register_session_handler(std::size_t session_id, Executor executor, Fn &&fn) {
+    return session_router.template register_handler<Event>(session_id, std::move(executor), std::forward<Fn>(fn));
+  }
+
+  template <typename Event> auto fire_event(Event &&ev) {
+    // Global handlers go first, the global bookkeeping (ex: removing a stopped session) was registered before the
+    // pipelines and runners back when everything lived on the global bus
+    auto res = EventBusBase::fire_event(std::remove_cvref_t<Event>(ev));
+    session_router.dispatch(std::as_const(ev));
+    return res;
+  }
+
+  template <typename Event> [[nodiscard]] std::size_t session_handler_count(std::size_t session_id) {
+    return session_router.template handler_count<Event>(session_id);
+  }
+
+private:
+  SessionRouter<immer::box<PlugDeviceEvent>,
+                immer::box<PairSignal>,
+                immer::box<UnplugDeviceEvent>,
+                immer::box<StreamSession>,
+                immer::box<VideoSession>,
+                immer::box<AudioSession>,
+                immer::box<IDRRequestEvent>,
+                immer::box<PauseStreamEvent>,
+                immer::box<ResumeStreamEvent>,
+                immer::box<StopStreamEvent>,
+                immer::box<RTPVideoPingEvent>,
+                immer::box<RTPAudioPingEvent>,
+                immer::box<StartRunner>>
+      session_router;
+};
+
 using EventsVariant = std::variant<immer::box<PlugDeviceEvent>,
                                    immer::box<PairSignal>,
                                    immer::box<UnplugDeviceEvent>,
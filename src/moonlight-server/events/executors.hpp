@@ -0,0 +1,71 @@
+#pragma once
+
+#include <boost/asio/post.hpp>
+#include <boost/asio/strand.hpp>
+#include <algorithm>
+#include <boost/asio/thread_pool.hpp>
+#include <functional>
+#include <helpers/utils.hpp>
+#include <utility>
+
+namespace wolf::core::events {
+
+/**
+ * Where an event handler runs.
+ *
+ * By default handlers run inline: fire_event() calls them on the thread that fired the event.
+ * Handlers that might block (Docker API calls, pushing events into a GStreamer pipeline, ...) should declare an
+ * executor instead, so that the thread firing the event (ex: control, RTP) only pays for enqueuing them.
+ */
+class Executor {
+public:
+  using Task = std::function<void()>;
+
+  /**
+   * Inline executor
+   */
+  Executor() = default;
+
+  explicit Executor(std::function<void(Task)> post) : post(std::move(post)) {}
+
+  /**
+   * Posts tasks to any asio executor: an io_context, a thread_pool, a strand...
+   */
+  template <typename AsioExecutor> static Executor asio(AsioExecutor executor) {
+    return Executor([executor](Task task) { boost::asio::post(executor, std::move(task)); });
+  }
+
+  /**
+   * Tasks are executed one after the other, in the order they have been posted, on the shared blocking pool
+   */
+  static Executor blocking_strand();
+
+  void execute(Task task) const {
+    if (post) {
+      post(std::move(task));
+    } else {
+      task();
+    }
+  }
+
+  [[nodiscard]] bool is_inline() const {
+    return !post;
+  }
+
+private:
+  std::function<void(Task)> post;
+};
+
+/**
+ * A few threads shared by all the handlers that do blocking calls, see WOLF_BLOCKING_THREADS
+ */
+inline boost::asio::thread_pool &blocking_pool() {
+  static boost::asio::thread_pool pool(std::max(std::stoi(utils::get_env("WOLF_BLOCKING_THREADS", "4")), 1));
+  return pool;
+}
+
+inline Executor Executor::blocking_strand() {
+  return Executor::asio(boost::asio::make_strand(blocking_pool()));
+}
+
+} // namespace wolf::core::events
@@ -44,6 +44,7 @@ template <> struct Reflector<events::App> {
     bool start_audio_server;
     rfl::TaggedUnion<"type", AppCMD, AppDocker, AppChildSession> runner;
     ControllerType joypad_type;
+    std::optional<int> input_coalescing_window_us;
   };
 
   static ReflType from(const events::App &v) {
@@ -75,7 +76,8 @@ template <> struct Reflector<events::App> {
             .start_virtual_compositor = v.start_virtual_compositor,
             .start_audio_server = v.start_audio_server,
             .runner = v.runner->serialize(),
-            .joypad_type = ctrl_type};
+            .joypad_type = ctrl_type,
+            .input_coalescing_window_us = v.input_coalescing_window_us};
   }
 };
 
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <atomic>
+#include <concepts>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <events/executors.hpp>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace wolf::core::events {
+
+/**
+ * An event that belongs to a single session, ex: immer::box<StopStreamEvent>
+ */
+template <typename Event>
+concept SessionEvent = requires(const Event &ev) {
+  { ev->session_id } -> std::convertible_to<std::size_t>;
+};
+
+/**
+ * Keeps a session handler registered until unregister() is called or this goes out of scope
+ */
+class SessionHandlerRegistration {
+public:
+  SessionHandlerRegistration() = default;
+  explicit SessionHandlerRegistration(std::function<void()> remove) : remove(std::move(remove)) {}
+
+  SessionHandlerRegistration(const SessionHandlerRegistration &) = delete;
+  SessionHandlerRegistration &operator=(const SessionHandlerRegistration &) = delete;
+
+  SessionHandlerRegistration(SessionHandlerRegistration &&other) noexcept : remove(std::move(other.remove)) {
+    other.remove = nullptr;
+  }
+
+  SessionHandlerRegistration &operator=(SessionHandlerRegistration &&other) noexcept {
+    if (this != &other) {
+      unregister();
+      remove = std::move(other.remove);
+      other.remove = nullptr;
+    }
+    return *this;
+  }
+
+  ~SessionHandlerRegistration() {
+    unregister();
+  }
+
+  /**
+   * Once this returns the handler is not running and it'll not be called anymore.
+   * Like for the global handlers, it can't be called from inside the handler itself.
+   */
+  void unregister() {
+    if (remove) {
+      remove();
+      remove = nullptr;
+    }
+  }
+
+private:
+  std::function<void()> remove;
+};
+
+/**
+ * Handlers registered for a specific session id, looked up with a hash map when an event is fired.
+ * This way firing a StopStreamEvent only wakes up the handlers of that session instead of every handler of every
+ * session filtering on ev->session_id.
+ */
+template <typename... Events> class SessionRouter {
+private:
+  /**
+   * Lets unregister() wait for the calls that are running, and drop the events that are still queued.
+   * Running calls are counted instead of holding a shared lock: a handler can fire an event that calls it again.
+   */
+  struct Liveness {
+    std::mutex m;
+    std::condition_variable idle;
+    bool alive = true;
+    int running = 0;
+
+    template <typename Fn> void run(Fn &&fn) {
+      {
+        std::lock_guard lock(m);
+        if (!alive) {
+          return;
+        }
+        running++;
+      }
+      struct Done {
+        Liveness &liveness;
+        ~Done() {
+          std::lock_guard lock(liveness.m);
+          if (--liveness.running == 0) {
+            liveness.idle.notify_all();
+          }
+        }
+      } done{*this};
+      fn();
+    }
+
+    void kill() {
+      std::unique_lock lock(m);
+      alive = false;
+      idle.wait(lock, [this]() { return running == 0; });
+    }
+  };
+
+  template <typename Event> struct Handler {
+    std::uint64_t id;
+    // Shared with the tasks queued on the executor
+    std::shared_ptr<std::function<void(const Event &)>> fn;
+    Executor executor;
+    std::shared_ptr<Liveness> liveness;
+  };
+
+  template <typename Event> struct Handlers {
+    std::shared_mutex m;
+    std::unordered_map<std::size_t /* session_id */, std::vector<Handler<Event>>> by_session;
+  };
+
+  struct State {
+    std::tuple<Handlers<Events>...> handlers;
+    std::atomic<std::uint64_t> next_id = 0;
+  };
+
+  // Registrations only keep a weak reference, they can safely outlive the event bus
+  std::shared_ptr<State> state = std::make_shared<State>();
+
+public:
+  /**
+   * @param executor where fn will be called, events are delivered in the same order they have been fired as long as
+   * the executor runs tasks in order (inline, strand, single thread)
+   */
+  template <typename Event, typename Fn>
+  requires SessionEvent<Event>
+  [[nodiscard]] SessionHandlerRegistration register_handler(std::size_t session_id, Executor executor, Fn &&fn) {
+    auto id = state->next_id.fetch_add(1, std::memory_order_relaxed);
+    auto liveness = std::make_shared<Liveness>();
+    {
+      auto &handlers = std::get<Handlers<Event>>(state->handlers);
+      std::unique_lock lock(handlers.m);
+      handlers.by_session[session_id].push_back(
+          {.id = id,
+           .fn = std::make_shared<std::function<void(const Event &)>>(std::forward<Fn>(fn)),
+           .executor = std::move(executor),
+           .liveness = liveness});
+    }
+
+    return SessionHandlerRegistration([weak_state = std::weak_ptr<State>(state), session_id, id, liveness]() {
+      if (auto state = weak_state.lock()) {
+        auto &handlers = std::get<Handlers<Event>>(state->handlers);
+        std::unique_lock lock(handlers.m);
+        if (auto session = handlers.by_session.find(session_id); session != handlers.by_session.end()) {
+          std::erase_if(session->second, [id](const Handler<Event> &handler) { return handler.id == id; });
+          if (session->second.empty()) {
+            handlers.by_session.erase(session);
+          }
+        }
+      }
+
+      liveness->kill();
+    });
+  }
+
+  template <typename Event, typename Fn>
+  requires SessionEvent<Event>
+  [[nodiscard]] SessionHandlerRegistration register_handler(std::size_t session_id, Fn &&fn) {
+    return register_handler<Event>(session_id, Executor{}, std::forward<Fn>(fn));
+  }
+
+  /**
+   * Calls (or enqueues) the handlers registered for ev->session_id, events that don't belong to a session are ignored.
+   * Handlers are called without holding the lock: they are free to fire events or to register new handlers.
+   */
+  template <typename Event> void dispatch(const Event &ev) {
+    if constexpr (SessionEvent<Event>) {
+      std::vector<Handler<Event>> session_handlers;
+      {
+        auto &handlers = std::get<Handlers<Event>>(state->handlers);
+        std::shared_lock lock(handlers.m);
+        if (auto session = handlers.by_session.find(ev->session_id); session != handlers.by_session.end()) {
+          session_handlers = session->second;
+        }
+      }
+
+      for (const auto &handler : session_handlers) {
+        if (handler.executor.is_inline()) {
+          handler.liveness->run([&handler, &ev]() { (*handler.fn)(ev); });
+        } else {
+          handler.executor.execute([fn = handler.fn, liveness = handler.liveness, ev]() {
+            liveness->run([&fn, &ev]() { (*fn)(ev); });
+          });
+        }
+      }
+    }
+  }
+
+  template <typename Event> [[nodiscard]] std::size_t handler_count(std::size_t session_id) {
+    auto &handlers = std::get<Handlers<Event>>(state->handlers);
+    std::shared_lock lock(handlers.m);
+    auto session = handlers.by_session.find(session_id);
+    return session == handlers.by_session.end() ? 0 : session->second.size();
+  }
+};
+
+} // namespace wolf::core::events
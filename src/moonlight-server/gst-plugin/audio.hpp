@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <gst-plugin/gstrtpmoonlightpay_audio.hpp>
 #include <gst-plugin/utils.hpp>
 #include <helpers/logger.hpp>
@@ -26,19 +27,29 @@ struct AudioFECPacket {
 
 constexpr auto RTP_HEADER_SIZE = sizeof(AudioRTPHeaders);
 constexpr auto FEC_HEADER_SIZE = sizeof(AudioFECPacket);
+/* An encrypted packet: the RTP header followed by the ciphertext of an audio block */
+constexpr auto ENCRYPTED_PACKET_SIZE =
+    RTP_HEADER_SIZE + crypto::AesContext::max_encrypted_size(AUDIO_MAX_BLOCK_SIZE);
 
 /**
- * Creates an RTP header and returns a GstBuffer to it
+ * The encrypted packets are written into buffers from this pool, they go back to it once they have been sent
+ * @returns nullptr if the pool can't be started, packets will be allocated one by one
  */
-static GstBuffer *create_rtp_header(const gst_rtp_moonlight_pay_audio &rtpmoonlightpay) {
-  GstBuffer *buf = gst_buffer_new_and_fill(RTP_HEADER_SIZE, 0x00);
-
-  /* get WRITE access to the memory */
-  GstMapInfo info;
-  gst_buffer_map(buf, &info, GST_MAP_WRITE);
+static GstBufferPool *create_packets_pool() {
+  GstBufferPool *pool = gst_buffer_pool_new();
+  GstStructure *config = gst_buffer_pool_get_config(pool);
+  // No upper limit: we must never block the streaming thread waiting for downstream to release a buffer
+  gst_buffer_pool_config_set_params(config, nullptr, ENCRYPTED_PACKET_SIZE, AUDIO_TOTAL_SHARDS, 0);
+  if (!gst_buffer_pool_set_config(pool, config) || !gst_buffer_pool_set_active(pool, TRUE)) {
+    gst_object_unref(pool);
+    return nullptr;
+  }
+  return pool;
+}
 
-  /* set RTP headers */
-  auto packet = (AudioRTPHeaders *)info.data;
+static void write_rtp_header(const gst_rtp_moonlight_pay_audio &rtpmoonlightpay, unsigned char *data) {
+  auto packet = (AudioRTPHeaders *)data;
+  std::fill(data, data + RTP_HEADER_SIZE, 0x00);
 
   packet->rtp.header = 0x80;
   packet->rtp.packetType = 97;
@@ -47,7 +58,18 @@ static GstBuffer *create_rtp_header(const gst_rtp_moonlight_pay_audio &rtpmoonli
   auto timestamp = rtpmoonlightpay.cur_seq_number * rtpmoonlightpay.packet_duration;
   packet->rtp.sequenceNumber = boost::endian::native_to_big((uint16_t)rtpmoonlightpay.cur_seq_number);
   packet->rtp.timestamp = boost::endian::native_to_big((uint32_t)timestamp);
+}
+
+/**
+ * Creates an RTP header and returns a GstBuffer to it
+ */
+static GstBuffer *create_rtp_header(const gst_rtp_moonlight_pay_audio &rtpmoonlightpay) {
+  GstBuffer *buf = gst_buffer_new_allocate(nullptr, RTP_HEADER_SIZE, nullptr);
 
+  /* get WRITE access to the memory */
+  GstMapInfo info;
+  gst_buffer_map(buf, &info, GST_MAP_WRITE);
+  write_rtp_header(rtpmoonlightpay, info.data);
   gst_buffer_unmap(buf, &info);
 
   return buf;
@@ -84,16 +106,41 @@ static GstBuffer *create_rtp_fec_header(const gst_rtp_moonlight_pay_audio &rtpmo
   return buf;
 }
 
-static GstBuffer *create_rtp_audio_buffer(const gst_rtp_moonlight_pay_audio &rtpmoonlightpay, GstBuffer *inbuf) {
-  GstBuffer *payload = inbuf;
+/**
+ * The ciphertext is written right after the RTP header into a single pooled buffer:
+ * there's no allocation per packet once the pool has warmed up.
+ */
+static GstBuffer *create_encrypted_rtp_audio_buffer(const gst_rtp_moonlight_pay_audio &rtpmoonlightpay,
+                                                    GstBuffer *inbuf) {
+  auto packet_size = RTP_HEADER_SIZE + crypto::AesContext::max_encrypted_size(gst_buffer_get_size(inbuf));
+  GstBuffer *full_rtp_buf = nullptr;
+  if (!rtpmoonlightpay.packets_pool || packet_size > ENCRYPTED_PACKET_SIZE ||
+      gst_buffer_pool_acquire_buffer(rtpmoonlightpay.packets_pool, &full_rtp_buf, nullptr) != GST_FLOW_OK) {
+    full_rtp_buf = gst_buffer_new_allocate(nullptr, packet_size, nullptr);
+  }
 
-  if (rtpmoonlightpay.encrypt) {
-    auto derived_iv = derive_iv(rtpmoonlightpay.aes_iv, rtpmoonlightpay.cur_seq_number);
-    payload = encrypt_payload(rtpmoonlightpay.aes_key, derived_iv, inbuf);
+  GstMapInfo info;
+  gst_buffer_map(full_rtp_buf, &info, GST_MAP_WRITE);
+  write_rtp_header(rtpmoonlightpay, info.data);
+  gst_buffer_unmap(full_rtp_buf, &info);
+
+  auto derived_iv = derive_iv_bytes(rtpmoonlightpay.aes_iv, rtpmoonlightpay.cur_seq_number);
+  try {
+    encrypt_payload(*rtpmoonlightpay.aes_ctx, derived_iv, inbuf, full_rtp_buf, RTP_HEADER_SIZE);
+  } catch (...) {
+    gst_buffer_unref(full_rtp_buf);
+    throw;
   }
+  return full_rtp_buf;
+}
 
-  auto rtp_header = create_rtp_header(rtpmoonlightpay);
-  auto full_rtp_buf = gst_buffer_append(rtp_header, payload);
+static GstBuffer *create_rtp_audio_buffer(const gst_rtp_moonlight_pay_audio &rtpmoonlightpay, GstBuffer *inbuf) {
+  GstBuffer *full_rtp_buf;
+  if (rtpmoonlightpay.encrypt) {
+    full_rtp_buf = create_encrypted_rtp_audio_buffer(rtpmoonlightpay, inbuf);
+  } else {
+    full_rtp_buf = gst_buffer_append(create_rtp_header(rtpmoonlightpay), inbuf);
+  }
   gst_copy_timestamps(inbuf, full_rtp_buf);
 
   return full_rtp_buf;
@@ -111,6 +158,14 @@ static GstBufferList *split_into_rtp(gst_rtp_moonlight_pay_audio *rtpmoonlightpa
 
   GstBufferList *rtp_packets = gst_buffer_list_new();
 
+  if (rtpmoonlightpay->encrypt && !rtpmoonlightpay->aes_ctx) {
+    rtpmoonlightpay->aes_ctx =
+        std::make_unique<crypto::AesContext>(crypto::AesContext::CBC, rtpmoonlightpay->aes_key, true);
+  }
+  if (rtpmoonlightpay->encrypt && !rtpmoonlightpay->packets_pool) {
+    rtpmoonlightpay->packets_pool = create_packets_pool();
+  }
+
   auto rtp_audio_buf = create_rtp_audio_buffer(*rtpmoonlightpay, inbuf);
   gst_buffer_list_add(rtp_packets, rtp_audio_buf);
 
@@ -0,0 +1,552 @@
+/**
+ * SECTION:element-gstmoonlightopusenc
+ *
+ * The moonlightopusenc element encodes raw audio into Opus multistream packets using libopus directly.
+ *
+ * Unlike the upstream opusenc this allows to set the number of streams and coupled streams, which is required in
+ * order to support the Moonlight high quality surround configurations.
+ * Bitrate, complexity and FEC can be changed while the pipeline is running.
+ *
+ * <refsect2>
+ * <title>Example launch line</title>
+ * |[
+ * gst-launch-1.0 -v audiotestsrc ! audio/x-raw, channels=6, rate=48000 !
+ *    moonlightopusenc streams=6 coupled_streams=0 bitrate=1536000 ! rtpmoonlightpay_audio ! fakesink
+ * ]|
+ * </refsect2>
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst-plugin/gstmoonlightopusenc.hpp>
+#include <gst-plugin/gstrtpmoonlightpay_audio.hpp>
+#include <gst/audio/audio.h>
+#include <gst/gst.h>
+#include <vector>
+
+GST_DEBUG_CATEGORY_STATIC(gst_moonlight_opus_enc_debug_category);
+#define GST_CAT_DEFAULT gst_moonlight_opus_enc_debug_category
+
+/* prototypes */
+
+static void
+gst_moonlight_opus_enc_set_property(GObject *object, guint property_id, const GValue *value, GParamSpec *pspec);
+static void
+gst_moonlight_opus_enc_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec);
+
+static gboolean gst_moonlight_opus_enc_stop(GstAudioEncoder *enc);
+static gboolean gst_moonlight_opus_enc_set_format(GstAudioEncoder *enc, GstAudioInfo *info);
+static gboolean gst_moonlight_opus_enc_decide_allocation(GstAudioEncoder *enc, GstQuery *query);
+static GstFlowReturn gst_moonlight_opus_enc_handle_frame(GstAudioEncoder *enc, GstBuffer *buffer);
+
+enum {
+  PROP_0,
+
+  /**
+   * Target bitrate in bits per second, can be changed at runtime
+   */
+  PROP_BITRATE,
+
+  /**
+   * Number of opus streams, must be set before the pipeline starts
+   */
+  PROP_STREAMS,
+
+  /**
+   * Number of coupled (stereo) opus streams, must be set before the pipeline starts
+   */
+  PROP_COUPLED_STREAMS,
+
+  /**
+   * The duration (in ms) of each encoded frame
+   */
+  PROP_PACKET_DURATION,
+
+  /**
+   * Encoder complexity (0-10), can be changed at runtime
+   */
+  PROP_COMPLEXITY,
+
+  /**
+   * Set to TRUE in order to enable Opus in-band FEC, can be changed at runtime
+   */
+  PROP_INBAND_FEC,
+
+  /**
+   * Expected packet loss percentage, used by the in-band FEC; can be changed at runtime
+   */
+  PROP_PACKET_LOSS_PERCENTAGE
+};
+
+/* pad templates */
+
+static GstStaticPadTemplate gst_moonlight_opus_enc_src_template =
+    GST_STATIC_PAD_TEMPLATE("src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS("audio/x-opus"));
+
+static GstStaticPadTemplate gst_moonlight_opus_enc_sink_template =
+    GST_STATIC_PAD_TEMPLATE("sink",
+                            GST_PAD_SINK,
+                            GST_PAD_ALWAYS,
+                            GST_STATIC_CAPS("audio/x-raw, "
+                                            "format = (string) " GST_AUDIO_NE(S16) ", "
+                                            "layout = (string) interleaved, "
+                                            "rate = (int) 48000, "
+                                            "channels = (int) [ 1, 2 ]; "
+                                            // 5.1: FL FR FC LFE RL RR
+                                            "audio/x-raw, "
+                                            "format = (string) " GST_AUDIO_NE(S16) ", "
+                                            "layout = (string) interleaved, "
+                                            "rate = (int) 48000, "
+                                            "channels = (int) 6, "
+                                            "channel-mask = (bitmask) 0x3f; "
+                                            // 7.1: FL FR FC LFE RL RR SL SR
+                                            "audio/x-raw, "
+                                            "format = (string) " GST_AUDIO_NE(S16) ", "
+                                            "layout = (string) interleaved, "
+                                            "rate = (int) 48000, "
+                                            "channels = (int) 8, "
+                                            "channel-mask = (bitmask) 0xc3f"));
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE(gst_moonlight_opus_enc,
+                        gst_moonlight_opus_enc,
+                        GST_TYPE_AUDIO_ENCODER,
+                        GST_DEBUG_CATEGORY_INIT(gst_moonlight_opus_enc_debug_category,
+                                                "moonlightopusenc",
+                                                0,
+                                                "debug category for moonlightopusenc element"));
+
+static void gst_moonlight_opus_enc_class_init(gst_moonlight_opus_encClass *klass) {
+  GObjectClass *gobject_class = G_OBJECT_CLASS(klass);
+  GstAudioEncoderClass *audio_encoder_class = GST_AUDIO_ENCODER_CLASS(klass);
+
+  gst_element_class_add_static_pad_template(GST_ELEMENT_CLASS(klass), &gst_moonlight_opus_enc_src_template);
+  gst_element_class_add_static_pad_template(GST_ELEMENT_CLASS(klass), &gst_moonlight_opus_enc_sink_template);
+
+  gst_element_class_set_static_metadata(GST_ELEMENT_CLASS(klass),
+                                        "Moonlight Opus multistream encoder",
+                                        "Codec/Encoder/Audio",
+                                        "Encodes raw audio into Opus multistream packets for Moonlight",
+                                        "games-on-whales");
+
+  gobject_class->set_property = gst_moonlight_opus_enc_set_property;
+  gobject_class->get_property = gst_moonlight_opus_enc_get_property;
+
+  g_object_class_install_property(
+      gobject_class,
+      PROP_BITRATE,
+      g_param_spec_int("bitrate",
+                       "bitrate",
+                       "Target bitrate in bits per second, can be changed at runtime",
+                       6000,
+                       OPUS_MAX_CHANNELS * 510000,
+                       96000,
+                       (GParamFlags)(G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property(gobject_class,
+                                  PROP_STREAMS,
+                                  g_param_spec_int("streams",
+                                                   "streams",
+                                                   "Number of opus streams",
+                                                   1,
+                                                   OPUS_MAX_CHANNELS,
+                                                   1,
+                                                   (GParamFlags)(G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(gobject_class,
+                                  PROP_COUPLED_STREAMS,
+                                  g_param_spec_int("coupled_streams",
+                                                   "coupled_streams",
+                                                   "Number of coupled (stereo) opus streams",
+                                                   0,
+                                                   OPUS_MAX_CHANNELS / 2,
+                                                   1,
+                                                   (GParamFlags)(G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(gobject_class,
+                                  PROP_PACKET_DURATION,
+                                  g_param_spec_int("packet_duration",
+                                                   "packet_duration",
+                                                   "The duration (in ms) of each encoded frame: 5, 10, 20, 40 or 60",
+                                                   5,
+                                                   60,
+                                                   5,
+                                                   (GParamFlags)(G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY)));
+
+  g_object_class_install_property(
+      gobject_class,
+      PROP_COMPLEXITY,
+      g_param_spec_int("complexity",
+                       "complexity",
+                       "Encoder complexity (0-10), can be changed at runtime",
+                       0,
+                       10,
+                       10,
+                       (GParamFlags)(G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property(
+      gobject_class,
+      PROP_INBAND_FEC,
+      g_param_spec_boolean("inband_fec",
+                           "inband_fec",
+                           "Set to TRUE in order to enable Opus in-band FEC, can be changed at runtime",
+                           FALSE,
+                           (GParamFlags)(G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING)));
+
+  g_object_class_install_property(
+      gobject_class,
+      PROP_PACKET_LOSS_PERCENTAGE,
+      g_param_spec_int("packet_loss_percentage",
+                       "packet_loss_percentage",
+                       "Expected packet loss percentage, used by the in-band FEC; can be changed at runtime",
+                       0,
+                       100,
+                       0,
+                       (GParamFlags)(G_PARAM_READWRITE | GST_PARAM_MUTABLE_PLAYING)));
+
+  audio_encoder_class->stop = GST_DEBUG_FUNCPTR(gst_moonlight_opus_enc_stop);
+  audio_encoder_class->set_format = GST_DEBUG_FUNCPTR(gst_moonlight_opus_enc_set_format);
+  audio_encoder_class->decide_allocation = GST_DEBUG_FUNCPTR(gst_moonlight_opus_enc_decide_allocation);
+  audio_encoder_class->handle_frame = GST_DEBUG_FUNCPTR(gst_moonlight_opus_enc_handle_frame);
+}
+
+static void gst_moonlight_opus_enc_init(gst_moonlight_opus_enc *opusenc) {
+  opusenc->encoder = nullptr;
+  opusenc->pool = nullptr;
+  opusenc->channels = 0;
+  opusenc->frame_samples = 0;
+
+  opusenc->streams = 1;
+  opusenc->coupled_streams = 1;
+  opusenc->packet_duration = 5;
+
+  opusenc->settings_changed = false;
+  opusenc->bitrate = 96000;
+  opusenc->complexity = 10;
+  opusenc->inband_fec = false;
+  opusenc->packet_loss_percentage = 0;
+}
+
+void gst_moonlight_opus_enc_set_property(GObject *object,
+                                         guint property_id,
+                                         const GValue *value,
+                                         GParamSpec *pspec) {
+  gst_moonlight_opus_enc *opusenc = gst_moonlight_opus_enc(object);
+
+  GST_DEBUG_OBJECT(opusenc, "set_property");
+
+  GST_OBJECT_LOCK(opusenc);
+  switch (property_id) {
+  case PROP_BITRATE:
+    opusenc->bitrate = g_value_get_int(value);
+    opusenc->settings_changed = true;
+    break;
+  case PROP_STREAMS:
+    opusenc->streams = g_value_get_int(value);
+    break;
+  case PROP_COUPLED_STREAMS:
+    opusenc->coupled_streams = g_value_get_int(value);
+    break;
+  case PROP_PACKET_DURATION: {
+    // libopus only encodes frames of 2.5, 5, 10, 20, 40 or 60 ms
+    auto packet_duration = g_value_get_int(value);
+    if (packet_duration == 5 || packet_duration == 10 || packet_duration == 20 || packet_duration == 40 ||
+        packet_duration == 60) {
+      opusenc->packet_duration = packet_duration;
+    } else {
+      GST_WARNING_OBJECT(opusenc,
+                         "Invalid packet_duration %d ms, keeping %d ms",
+                         packet_duration,
+                         opusenc->packet_duration);
+    }
+    break;
+  }
+  case PROP_COMPLEXITY:
+    opusenc->complexity = g_value_get_int(value);
+    opusenc->settings_changed = true;
+    break;
+  case PROP_INBAND_FEC:
+    opusenc->inband_fec = g_value_get_boolean(value);
+    opusenc->settings_changed = true;
+    break;
+  case PROP_PACKET_LOSS_PERCENTAGE:
+    opusenc->packet_loss_percentage = g_value_get_int(value);
+    opusenc->settings_changed = true;
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    break;
+  }
+  GST_OBJECT_UNLOCK(opusenc);
+}
+
+void gst_moonlight_opus_enc_get_property(GObject *object, guint property_id, GValue *value, GParamSpec *pspec) {
+  gst_moonlight_opus_enc *opusenc = gst_moonlight_opus_enc(object);
+
+  GST_DEBUG_OBJECT(opusenc, "get_property");
+
+  GST_OBJECT_LOCK(opusenc);
+  switch (property_id) {
+  case PROP_BITRATE:
+    g_value_set_int(value, opusenc->bitrate);
+    break;
+  case PROP_STREAMS:
+    g_value_set_int(value, opusenc->streams);
+    break;
+  case PROP_COUPLED_STREAMS:
+    g_value_set_int(value, opusenc->coupled_streams);
+    break;
+  case PROP_PACKET_DURATION:
+    g_value_set_int(value, opusenc->packet_duration);
+    break;
+  case PROP_COMPLEXITY:
+    g_value_set_int(value, opusenc->complexity);
+    break;
+  case PROP_INBAND_FEC:
+    g_value_set_boolean(value, opusenc->inband_fec);
+    break;
+  case PROP_PACKET_LOSS_PERCENTAGE:
+    g_value_set_int(value, opusenc->packet_loss_percentage);
+    break;
+  default:
+    G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
+    break;
+  }
+  GST_OBJECT_UNLOCK(opusenc);
+}
+
+/**
+ * Pushes the runtime settings into the encoder, must be called from the streaming thread
+ */
+static void apply_settings(gst_moonlight_opus_enc *opusenc) {
+  GST_OBJECT_LOCK(opusenc);
+  if (!opusenc->settings_changed) {
+    GST_OBJECT_UNLOCK(opusenc);
+    return;
+  }
+  auto bitrate = opusenc->bitrate;
+  auto complexity = opusenc->complexity;
+  auto inband_fec = opusenc->inband_fec;
+  auto packet_loss_percentage = opusenc->packet_loss_percentage;
+  opusenc->settings_changed = false;
+  GST_OBJECT_UNLOCK(opusenc);
+
+  GST_DEBUG_OBJECT(opusenc,
+                   "bitrate: %d, complexity: %d, inband_fec: %d, packet_loss: %d%%",
+                   bitrate,
+                   complexity,
+                   inband_fec,
+                   packet_loss_percentage);
+  opus_multistream_encoder_ctl(opusenc->encoder, OPUS_SET_BITRATE(bitrate));
+  opus_multistream_encoder_ctl(opusenc->encoder, OPUS_SET_COMPLEXITY(complexity));
+  opus_multistream_encoder_ctl(opusenc->encoder, OPUS_SET_INBAND_FEC(inband_fec ? 1 : 0));
+  opus_multistream_encoder_ctl(opusenc->encoder, OPUS_SET_PACKET_LOSS_PERC(packet_loss_percentage));
+}
+
+static void release_encoder(gst_moonlight_opus_enc *opusenc) {
+  if (opusenc->encoder) {
+    opus_multistream_encoder_destroy(opusenc->encoder);
+    opusenc->encoder = nullptr;
+  }
+  if (opusenc->pool) {
+    gst_buffer_pool_set_active(opusenc->pool, FALSE);
+    gst_object_unref(opusenc->pool);
+    opusenc->pool = nullptr;
+  }
+}
+
+static gboolean gst_moonlight_opus_enc_stop(GstAudioEncoder *enc) {
+  gst_moonlight_opus_enc *opusenc = gst_moonlight_opus_enc(enc);
+
+  GST_DEBUG_OBJECT(opusenc, "stop");
+  release_encoder(opusenc);
+  return TRUE;
+}
+
+static gboolean gst_moonlight_opus_enc_set_format(GstAudioEncoder *enc, GstAudioInfo *info) {
+  gst_moonlight_opus_enc *opusenc = gst_moonlight_opus_enc(enc);
+
+  if (opusenc->encoder) {
+    opus_multistream_encoder_destroy(opusenc->encoder);
+    opusenc->encoder = nullptr;
+  }
+
+  opusenc->channels = GST_AUDIO_INFO_CHANNELS(info);
+  if (opusenc->streams + opusenc->coupled_streams != opusenc->channels ||
+      opusenc->coupled_streams > opusenc->streams) {
+    GST_ELEMENT_ERROR(opusenc,
+                      LIBRARY,
+                      SETTINGS,
+                      (nullptr),
+                      ("Invalid configuration: %d channels, %d streams, %d coupled streams",
+                       opusenc->channels,
+                       opusenc->streams,
+                       opusenc->coupled_streams));
+    return FALSE;
+  }
+
+  auto mapping = opus_channel_mapping(opusenc->channels, opusenc->coupled_streams);
+  int error = OPUS_OK;
+  opusenc->encoder = opus_multistream_encoder_create(GST_AUDIO_INFO_RATE(info),
+                                                     opusenc->channels,
+                                                     opusenc->streams,
+                                                     opusenc->coupled_streams,
+                                                     mapping.data(),
+                                                     OPUS_APPLICATION_RESTRICTED_LOWDELAY,
+                                                     &error);
+  if (error != OPUS_OK || !opusenc->encoder) {
+    GST_ELEMENT_ERROR(opusenc,
+                      LIBRARY,
+                      INIT,
+                      (nullptr),
+                      ("Unable to create the opus encoder: %s", opus_strerror(error)));
+    return FALSE;
+  }
+
+  // The RTP payloader FEC assumes that all audio blocks will have the exact same size
+  opus_multistream_encoder_ctl(opusenc->encoder, OPUS_SET_VBR(0));
+  opus_multistream_encoder_ctl(opusenc->encoder, OPUS_SET_BANDWIDTH(OPUS_BANDWIDTH_FULLBAND));
+  GST_OBJECT_LOCK(opusenc);
+  opusenc->settings_changed = true; // the new encoder starts from the libopus defaults
+  GST_OBJECT_UNLOCK(opusenc);
+  apply_settings(opusenc);
+
+  opusenc->frame_samples = GST_AUDIO_INFO_RATE(info) * opusenc->packet_duration / 1000;
+  gst_audio_encoder_set_frame_samples_min(enc, opusenc->frame_samples);
+  gst_audio_encoder_set_frame_samples_max(enc, opusenc->frame_samples);
+  gst_audio_encoder_set_frame_max(enc, 1);
+
+  auto caps = gst_caps_new_simple("audio/x-opus",
+                                  "rate",
+                                  G_TYPE_INT,
+                                  GST_AUDIO_INFO_RATE(info),
+                                  "channels",
+                                  G_TYPE_INT,
+                                  opusenc->channels,
+                                  "channel-mapping-family",
+                                  G_TYPE_INT,
+                                  opusenc->channels > 2 ? 1 : 0,
+                                  "stream-count",
+                                  G_TYPE_INT,
+                                  opusenc->streams,
+                                  "coupled-count",
+                                  G_TYPE_INT,
+                                  opusenc->coupled_streams,
+                                  nullptr);
+  auto res = gst_audio_encoder_set_output_format(enc, caps);
+  gst_caps_unref(caps);
+  return res;
+}
+
+/**
+ * If downstream (rtpmoonlightpay_audio) proposes a buffer pool we'll encode straight into it
+ */
+static gboolean gst_moonlight_opus_enc_decide_allocation(GstAudioEncoder *enc, GstQuery *query) {
+  gst_moonlight_opus_enc *opusenc = gst_moonlight_opus_enc(enc);
+
+  if (!GST_AUDIO_ENCODER_CLASS(gst_moonlight_opus_enc_parent_class)->decide_allocation(enc, query)) {
+    return FALSE;
+  }
+
+  if (opusenc->pool) {
+    gst_buffer_pool_set_active(opusenc->pool, FALSE);
+    gst_object_unref(opusenc->pool);
+    opusenc->pool = nullptr;
+  }
+
+  if (gst_query_get_n_allocation_pools(query) > 0) {
+    GstBufferPool *pool = nullptr;
+    guint size, min, max;
+    gst_query_parse_nth_allocation_pool(query, 0, &pool, &size, &min, &max);
+    if (pool && size >= AUDIO_MAX_BLOCK_SIZE && gst_buffer_pool_set_active(pool, TRUE)) {
+      GST_DEBUG_OBJECT(opusenc, "Using downstream buffer pool, size: %u", size);
+      opusenc->pool = pool;
+    } else if (pool) {
+      gst_object_unref(pool);
+    }
+  }
+
+  return TRUE;
+}
+
+static GstFlowReturn gst_moonlight_opus_enc_handle_frame(GstAudioEncoder *enc, GstBuffer *buffer) {
+  gst_moonlight_opus_enc *opusenc = gst_moonlight_opus_enc(enc);
+
+  /* we are not buffering any data, nothing to drain */
+  if (buffer == nullptr) {
+    return GST_FLOW_OK;
+  }
+
+  apply_settings(opusenc);
+
+  GstMapInfo in_info;
+  gst_buffer_map(buffer, &in_info, GST_MAP_READ);
+  auto samples = (int)(in_info.size / (sizeof(opus_int16) * opusenc->channels));
+  auto pcm = (const opus_int16 *)in_info.data;
+
+  /* Only the last buffer before EOS can be shorter than a full frame, pad it with silence */
+  std::vector<opus_int16> padded;
+  if (samples < opusenc->frame_samples) {
+    padded.resize(opusenc->frame_samples * opusenc->channels, 0);
+    std::copy(pcm, pcm + samples * opusenc->channels, padded.begin());
+    pcm = padded.data();
+  }
+
+  GstBuffer *outbuf = nullptr;
+  if (!opusenc->pool || gst_buffer_pool_acquire_buffer(opusenc->pool, &outbuf, nullptr) != GST_FLOW_OK) {
+    outbuf = gst_audio_encoder_allocate_output_buffer(enc, AUDIO_MAX_BLOCK_SIZE);
+  }
+
+  GstMapInfo out_info;
+  gst_buffer_map(outbuf, &out_info, GST_MAP_WRITE);
+  auto encoded_size = opus_multistream_encode(opusenc->encoder,
+                                              pcm,
+                                              opusenc->frame_samples,
+                                              out_info.data,
+                                              (opus_int32)std::min<gsize>(out_info.size, AUDIO_MAX_BLOCK_SIZE));
+  gst_buffer_unmap(outbuf, &out_info);
+  gst_buffer_unmap(buffer, &in_info);
+
+  if (encoded_size < 0) {
+    gst_buffer_unref(outbuf);
+    GST_ELEMENT_ERROR(opusenc,
+                      STREAM,
+                      ENCODE,
+                      (nullptr),
+                      ("Encoding failed: %s", opus_strerror(encoded_size)));
+    return GST_FLOW_ERROR;
+  }
+
+  gst_buffer_set_size(outbuf, encoded_size);
+  return gst_audio_encoder_finish_frame(enc, outbuf, samples);
+}
+
+static gboolean plugin_init(GstPlugin *plugin) {
+  return gst_element_register(plugin, "moonlightopusenc", GST_RANK_NONE, gst_TYPE_moonlight_opus_enc);
+}
+
+#ifndef VERSION
+#define VERSION "0.0.FIXME"
+#endif
+#ifndef PACKAGE
+#define PACKAGE "FIXME_package"
+#endif
+#ifndef PACKAGE_NAME
+#define PACKAGE_NAME "FIXME_package_name"
+#endif
+#ifndef GST_PACKAGE_ORIGIN
+#define GST_PACKAGE_ORIGIN "http://FIXME.org/"
+#endif
+
+GST_PLUGIN_DEFINE(GST_VERSION_MAJOR,
+                  GST_VERSION_MINOR,
+                  moonlightopusenc,
+                  "Opus multistream encoder for Moonlight",
+                  plugin_init,
+                  VERSION,
+                  "LGPL",
+                  PACKAGE_NAME,
+                  GST_PACKAGE_ORIGIN)
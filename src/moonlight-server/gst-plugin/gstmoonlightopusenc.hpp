@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <gst/audio/gstaudioencoder.h>
+#include <gst/gst.h>
+#include <opus_multistream.h>
+
+constexpr int OPUS_MAX_CHANNELS = 8;
+
+/**
+ * Returns the opus channel mapping for the given configuration.
+ *
+ * Normal quality surround follows the Vorbis layout that the upstream opusenc forces (and that we advertise over
+ * RTSP), this way both encoders can be used interchangeably. High quality surround doesn't couple any channel, so
+ * the mapping is just the identity.
+ */
+static std::array<unsigned char, OPUS_MAX_CHANNELS> opus_channel_mapping(int channels, int coupled_streams) {
+  if (channels > 2 && coupled_streams > 0) {
+    if (channels == 6) {
+      return {0, 1, 4, 5, 2, 3};
+    } else if (channels == 8) {
+      return {0, 1, 4, 5, 2, 3, 6, 7};
+    }
+  }
+  return {0, 1, 2, 3, 4, 5, 6, 7};
+}
+
+G_BEGIN_DECLS
+
+#define gst_TYPE_moonlight_opus_enc (gst_moonlight_opus_enc_get_type())
+#define gst_moonlight_opus_enc(obj)                                                                                    \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj), gst_TYPE_moonlight_opus_enc, gst_moonlight_opus_enc))
+#define gst_moonlight_opus_enc_CLASS(klass)                                                                            \
+  (G_TYPE_CHECK_CLASS_CAST((klass), gst_TYPE_moonlight_opus_enc, gst_moonlight_opus_encClass))
+#define gst_IS_moonlight_opus_enc(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), gst_TYPE_moonlight_opus_enc))
+#define gst_IS_moonlight_opus_enc_CLASS(obj) (G_TYPE_CHECK_CLASS_TYPE((klass), gst_TYPE_moonlight_opus_enc))
+
+typedef struct _gst_moonlight_opus_enc gst_moonlight_opus_enc;
+typedef struct _gst_moonlight_opus_encClass gst_moonlight_opus_encClass;
+
+struct _gst_moonlight_opus_enc {
+  GstAudioEncoder base_moonlight_opus_enc;
+
+  OpusMSEncoder *encoder;
+  int channels;
+  int frame_samples;
+
+  /* Set when the output buffers can be acquired from the downstream pool */
+  GstBufferPool *pool;
+
+  /* Fixed once the encoder has been created */
+  int streams;
+  int coupled_streams;
+  int packet_duration;
+
+  /* Can be changed at runtime, protected by the object lock */
+  bool settings_changed;
+  int bitrate;
+  int complexity;
+  bool inband_fec;
+  int packet_loss_percentage;
+};
+
+struct _gst_moonlight_opus_encClass {
+  GstAudioEncoderClass base_moonlight_opus_enc_class;
+};
+
+GType gst_moonlight_opus_enc_get_type(void);
+
+G_END_DECLS
@@ -35,6 +35,8 @@ static void gst_rtp_moonlight_pay_audio_dispose(GObject *object);
 static void gst_rtp_moonlight_pay_audio_finalize(GObject *object);
 
 static GstFlowReturn gst_rtp_moonlight_pay_audio_generate_output(GstBaseTransform *trans, GstBuffer **outbuf);
+static gboolean
+gst_rtp_moonlight_pay_audio_propose_allocation(GstBaseTransform *trans, GstQuery *decide_query, GstQuery *query);
 
 enum {
 
@@ -134,12 +136,14 @@ static void gst_rtp_moonlight_pay_audio_class_init(gst_rtp_moonlight_pay_audioCl
   gobject_class->finalize = gst_rtp_moonlight_pay_audio_finalize;
 
   base_transform_class->generate_output = GST_DEBUG_FUNCPTR(gst_rtp_moonlight_pay_audio_generate_output);
+  base_transform_class->propose_allocation = GST_DEBUG_FUNCPTR(gst_rtp_moonlight_pay_audio_propose_allocation);
 }
 
 static void gst_rtp_moonlight_pay_audio_init(gst_rtp_moonlight_pay_audio *rtpmoonlightpay_audio) {
   rtpmoonlightpay_audio->cur_seq_number = 0;
 
   rtpmoonlightpay_audio->encrypt = true;
+  rtpmoonlightpay_audio->packets_pool = nullptr;
 
   rtpmoonlightpay_audio->packet_duration = 5;
   rtpmoonlightpay_audio->packets_buffer = new unsigned char *[AUDIO_TOTAL_SHARDS];
@@ -166,6 +170,7 @@ void gst_rtp_moonlight_pay_audio_set_property(GObject *object,
     break;
   case PROP_AES_KEY:
     rtpmoonlightpay_audio->aes_key = crypto::hex_to_str(g_value_get_string(value), true);
+    rtpmoonlightpay_audio->aes_ctx.reset();
     break;
   case PROP_AES_IV:
     rtpmoonlightpay_audio->aes_iv = g_value_get_string(value);
@@ -213,6 +218,12 @@ void gst_rtp_moonlight_pay_audio_dispose(GObject *object) {
     delete[] rtpmoonlightpay_audio->packets_buffer[i];
   }
   delete[] rtpmoonlightpay_audio->packets_buffer;
+  rtpmoonlightpay_audio->aes_ctx.reset();
+  if (rtpmoonlightpay_audio->packets_pool) {
+    gst_buffer_pool_set_active(rtpmoonlightpay_audio->packets_pool, FALSE);
+    gst_object_unref(rtpmoonlightpay_audio->packets_pool);
+    rtpmoonlightpay_audio->packets_pool = nullptr;
+  }
 
   G_OBJECT_CLASS(gst_rtp_moonlight_pay_audio_parent_class)->dispose(object);
 }
@@ -241,7 +252,14 @@ static GstFlowReturn gst_rtp_moonlight_pay_audio_generate_output(GstBaseTransfor
   if (inbuf == nullptr)
     return GST_FLOW_OK;
 
-  auto rtp_packets = audio::split_into_rtp(rtpmoonlightpay_audio, inbuf);
+  GstBufferList *rtp_packets;
+  try {
+    rtp_packets = audio::split_into_rtp(rtpmoonlightpay_audio, inbuf);
+  } catch (const std::exception &e) { // ex: the client sent an invalid AES key
+    GST_ELEMENT_ERROR(trans, STREAM, ENCODE, ("Unable to create the RTP packets"), ("%s", e.what()));
+    gst_buffer_unref(inbuf);
+    return GST_FLOW_ERROR;
+  }
 
   /* Send the generated packets to any downstream listener */
   gst_pad_push_list(trans->srcpad, rtp_packets);
@@ -253,6 +271,29 @@ static GstFlowReturn gst_rtp_moonlight_pay_audio_generate_output(GstBaseTransfor
   return GST_BASE_TRANSFORM_FLOW_DROPPED;
 }
 
+/**
+ * Offers upstream a pool of buffers big enough to hold a full audio block.
+ * This way the encoder (see moonlightopusenc) doesn't have to allocate a new buffer for each packet.
+ */
+static gboolean
+gst_rtp_moonlight_pay_audio_propose_allocation(GstBaseTransform *trans, GstQuery *decide_query, GstQuery *query) {
+  GstCaps *caps;
+  gboolean need_pool;
+  gst_query_parse_allocation(query, &caps, &need_pool);
+
+  if (need_pool) {
+    GstBufferPool *pool = gst_buffer_pool_new();
+    GstStructure *config = gst_buffer_pool_get_config(pool);
+    gst_buffer_pool_config_set_params(config, caps, AUDIO_MAX_BLOCK_SIZE, AUDIO_TOTAL_SHARDS, 0);
+    if (gst_buffer_pool_set_config(pool, config)) {
+      gst_query_add_allocation_pool(query, pool, AUDIO_MAX_BLOCK_SIZE, AUDIO_TOTAL_SHARDS, 0);
+    }
+    gst_object_unref(pool);
+  }
+
+  return TRUE;
+}
+
 static gboolean plugin_init(GstPlugin *plugin) {
   return gst_element_register(plugin, "rtpmoonlightpay_audio", GST_RANK_PRIMARY, gst_TYPE_rtp_moonlight_pay_audio);
 }
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <array>
+#include <crypto/crypto.hpp>
 #include <gst/base/gstbasetransform.h>
+#include <memory>
 #include <moonlight/fec.hpp>
 #include <vector>
 
@@ -38,6 +40,10 @@ struct _gst_rtp_moonlight_pay_audio {
   bool encrypt;
   std::string aes_key;
   std::string aes_iv;
+  /* Lazily created from aes_key, reused for every packet */
+  std::unique_ptr<crypto::AesContext> aes_ctx;
+  /* Lazily created, the encrypted packets are written into its buffers */
+  GstBufferPool *packets_pool;
 
   int packet_duration;
 
@@ -7,6 +7,7 @@
 #include <gst/base/gstbasetransform.h>
 #include <gst/gst.h>
 #include <moonlight/fec.hpp>
+#include <span>
 #include <vector>
 
 static void gst_buffer_copy_into(GstBuffer *buf, unsigned char *destination) {
@@ -108,10 +109,15 @@ static void gst_copy_timestamps(GstBuffer *src, GstBuffer *dest) {
 /**
  * Derives the proper IV following Moonlight implementation
  */
-static std::string derive_iv(const std::string &aes_iv, int cur_seq_number) {
+static std::array<std::uint8_t, 16> derive_iv_bytes(const std::string &aes_iv, int cur_seq_number) {
   auto iv = std::array<std::uint8_t, 16>{};
   std::uint32_t input_iv = std::stoul(aes_iv);
   *(std::uint32_t *)iv.data() = boost::endian::native_to_big(input_iv + cur_seq_number);
+  return iv;
+}
+
+static std::string derive_iv(const std::string &aes_iv, int cur_seq_number) {
+  auto iv = derive_iv_bytes(aes_iv, cur_seq_number);
   return {iv.begin(), iv.end()};
 }
 
@@ -128,4 +134,27 @@ static GstBuffer *encrypt_payload(const std::string &aes_key, const std::string
 
   gst_buffer_unmap(inbuf, &info);
   return gst_buffer_new_and_fill(encrypted.size(), encrypted.c_str());
-}
\ No newline at end of file
+}
+
+/**
+ * Encrypts the input buffer using a reusable AES CBC context,
+ * the ciphertext is written straight into the memory of `outbuf` (ex: from a pool) starting at `offset`.
+ * `outbuf` must hold at least offset + max_encrypted_size() bytes, it'll be shrunk to the encrypted size.
+ */
+static void encrypt_payload(crypto::AesContext &aes_ctx,
+                            std::span<const std::uint8_t> aes_iv,
+                            GstBuffer *inbuf,
+                            GstBuffer *outbuf,
+                            gsize offset) {
+  auto in_size = gst_buffer_get_size(inbuf);
+
+  GstMapInfo in_info, out_info;
+  gst_buffer_map(inbuf, &in_info, GST_MAP_READ);
+  gst_buffer_map(outbuf, &out_info, GST_MAP_WRITE);
+  auto encrypted_size =
+      aes_ctx.encrypt({in_info.data, in_size}, {out_info.data + offset, out_info.size - offset}, aes_iv);
+  gst_buffer_unmap(outbuf, &out_info);
+  gst_buffer_unmap(inbuf, &in_info);
+
+  gst_buffer_set_size(outbuf, (gssize)(offset + encrypted_size));
+}
@@ -0,0 +1,248 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fmt/core.h>
+#include <handover/handover.hpp>
+#include <helpers/logger.hpp>
+#include <poll.h>
+#include <rfl/json.hpp>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace handover {
+
+/* More than enough for the sockets that we pass along */
+static constexpr std::size_t MAX_FDS = 16;
+static constexpr char ACK = 'A';
+
+struct Header {
+  std::uint32_t state_size;
+  std::uint32_t fd_count;
+};
+
+static std::runtime_error socket_error(std::string_view what) {
+  return std::runtime_error(fmt::format("[HANDOVER] {}: {}", what, strerror(errno)));
+}
+
+static void send_all(int socket, const char *data, std::size_t size) {
+  while (size > 0) {
+    auto sent = ::send(socket, data, size, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw socket_error("Unable to send");
+    }
+    data += sent;
+    size -= sent;
+  }
+}
+
+static void recv_all(int socket, char *data, std::size_t size) {
+  while (size > 0) {
+    auto received = ::recv(socket, data, size, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    } else if (received < 0) {
+      throw socket_error("Unable to receive");
+    } else if (received == 0) {
+      throw std::runtime_error("[HANDOVER] Connection closed by the other process");
+    }
+    data += received;
+    size -= received;
+  }
+}
+
+void send_state(int socket, const State &state, const std::vector<int> &fds) {
+  if (fds.size() > MAX_FDS) {
+    throw std::runtime_error(fmt::format("[HANDOVER] Too many sockets: {}", fds.size()));
+  }
+  auto json = rfl::json::write(state);
+  auto header = Header{.state_size = static_cast<std::uint32_t>(json.size()),
+                       .fd_count = static_cast<std::uint32_t>(fds.size())};
+
+  // The file descriptors travel as ancillary data of the header
+  iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS)] = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  if (!fds.empty()) {
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+    auto cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+    std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+  }
+
+  ssize_t sent;
+  do {
+    sent = ::sendmsg(socket, &msg, MSG_NOSIGNAL);
+  } while (sent < 0 && errno == EINTR);
+  if (sent < 0) {
+    throw socket_error("Unable to send the sockets");
+  }
+  // A partial write only happens on tiny socket buffers, the file descriptors have been sent along the first byte
+  send_all(socket, reinterpret_cast<const char *>(&header) + sent, sizeof(header) - sent);
+  send_all(socket, json.data(), json.size());
+}
+
+ReceivedState receive_state(int socket) {
+  Header header = {};
+  iovec iov = {.iov_base = &header, .iov_len = sizeof(header)};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_FDS)] = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t received;
+  do {
+    received = ::recvmsg(socket, &msg, MSG_CMSG_CLOEXEC);
+  } while (received < 0 && errno == EINTR);
+  if (received < 0) {
+    throw socket_error("Unable to receive the sockets");
+  } else if (received == 0) {
+    throw std::runtime_error("[HANDOVER] Connection closed by the other process");
+  }
+
+  ReceivedState res;
+  for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      res.fds.resize(count);
+      std::memcpy(res.fds.data(), CMSG_DATA(cmsg), sizeof(int) * count);
+    }
+  }
+  if (msg.msg_flags & MSG_CTRUNC) {
+    for (auto fd : res.fds) {
+      ::close(fd);
+    }
+    throw std::runtime_error("[HANDOVER] Too many sockets received");
+  }
+  recv_all(socket, reinterpret_cast<char *>(&header) + received, sizeof(header) - received);
+
+  std::string json(header.state_size, '\0');
+  recv_all(socket, json.data(), json.size());
+  auto state = rfl::json::read<State>(json);
+  if (!state || res.fds.size() != header.fd_count || state->sockets.size() != res.fds.size()) {
+    for (auto fd : res.fds) {
+      ::close(fd);
+    }
+    throw std::runtime_error("[HANDOVER] Invalid state received");
+  }
+  res.state = state.value();
+  return res;
+}
+
+void send_ack(int socket) {
+  send_all(socket, &ACK, 1);
+}
+
+void wait_ack(int socket) {
+  char ack = 0;
+  recv_all(socket, &ack, 1);
+  if (ack != ACK) {
+    throw std::runtime_error("[HANDOVER] Unexpected message from the previous process");
+  }
+}
+
+std::optional<int> connect(const std::string &path) {
+  sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (path.size() >= sizeof(addr.sun_path)) {
+    logs::log(logs::warning, "[HANDOVER] Socket path is too long: {}", path);
+    return {};
+  }
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+  auto fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    logs::log(logs::warning, "[HANDOVER] Unable to create socket: {}", strerror(errno));
+    return {};
+  }
+  if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    // Nobody listening (ENOENT, ECONNREFUSED): we are the first process
+    logs::log(logs::debug, "[HANDOVER] No previous process on {}: {}", path, strerror(errno));
+    ::close(fd);
+    return {};
+  }
+  return fd;
+}
+
+bool wait_closed(int socket, std::chrono::milliseconds timeout) {
+  pollfd fd = {.fd = socket, .events = POLLIN};
+  auto ready = ::poll(&fd, 1, static_cast<int>(timeout.count()));
+  if (ready < 0) {
+    return errno != EINTR;
+  } else if (ready == 0) {
+    return false;
+  }
+  // Nothing else is expected on this connection, anything readable means EOF
+  return true;
+}
+
+State collect_state(const immer::box<state::AppState> &app_state) {
+  State res;
+  for (const auto &[session_id, session] : app_state->running_sessions->load()) {
+    res.sessions.push_back({.session_id = std::to_string(session_id),
+                            .client_ip = session->ip,
+                            .app_id = session->app->base.id,
+                            .video_stream_port = session->video_stream_port,
+                            .audio_stream_port = session->audio_stream_port});
+  }
+  res.control_port = state::control_port_base();
+  res.control_shards = state::get_control_shards();
+  for (const auto &client : app_state->config->paired_clients->load()) {
+    res.paired_clients.push_back(*client);
+  }
+  return res;
+}
+
+void adopt_state(const immer::box<state::AppState> &app_state, const State &previous) {
+  app_state->config->paired_clients->update([&previous](const state::PairedClientList &paired_clients) {
+    auto res = paired_clients;
+    for (const auto &client : previous.paired_clients) {
+      auto known = std::any_of(paired_clients.begin(), paired_clients.end(), [&client](const auto &paired_client) {
+        return paired_client->client_cert == client.client_cert;
+      });
+      if (!known) {
+        res = res.push_back(client);
+      }
+    }
+    return res;
+  });
+
+  for (const auto &session : previous.sessions) {
+    logs::log(logs::info,
+              "[HANDOVER] Session {} ({}, app {}) keeps running in the previous process",
+              session.session_id,
+              session.client_ip,
+              session.app_id);
+    app_state->running_sessions->reserve_ports(session.video_stream_port, session.audio_stream_port);
+  }
+}
+
+std::optional<unsigned short> pick_control_port(const State &previous, int shards) {
+  int previous_first = previous.control_port.value_or(state::CONTROL_PORT);
+  int previous_end = previous_first + previous.control_shards.value_or(shards);
+  for (int first = state::CONTROL_PORT; first + shards <= state::RTSP_SETUP_PORT; first++) {
+    if (first + shards <= previous_first || first >= previous_end) {
+      return static_cast<unsigned short>(first);
+    }
+  }
+  return {};
+}
+
+void release_ports(const immer::box<state::AppState> &app_state, const State &previous) {
+  for (const auto &session : previous.sessions) {
+    app_state->running_sessions->release_ports(session.video_stream_port, session.audio_stream_port);
+  }
+}
+
+} // namespace handover
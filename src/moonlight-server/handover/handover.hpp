@@ -0,0 +1,156 @@
+#pragma once
+
+#include <chrono>
+#include <immer/box.hpp>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <state/data-structures.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Lets a new Wolf process take over from a running one without interrupting the players.
+ *
+ * The previous process listens on a Unix socket (WOLF_HANDOVER_SOCKET); when the new one connects:
+ *  1. the previous process sends its State together with its listening sockets (SCM_RIGHTS)
+ *  2. it stops accepting new sessions (HTTP, HTTPS, RTSP, RTP PING) and sends an ack
+ *  3. the new process starts its servers, using the sockets it has received where possible
+ *  4. the previous process keeps streaming to its running sessions and exits once they are all over,
+ *     the new process notices it when the Unix socket gets closed.
+ *
+ * GStreamer pipelines, Wayland compositors and runners can't be moved to a different process: running sessions are
+ * drained, not migrated.
+ */
+namespace handover {
+
+/**
+ * A session that is still running in the previous process
+ */
+struct Session {
+  std::string session_id;
+  std::string client_ip;
+  std::string app_id;
+  unsigned short video_stream_port;
+  unsigned short audio_stream_port;
+};
+
+struct State {
+  int version = 1;
+  /* The names of the sockets that have been sent, in the same order as the file descriptors */
+  std::vector<std::string> sockets;
+  /* The ENet hosts stay with the previous process: CONTROL_PORT onwards when missing */
+  std::optional<unsigned short> control_port;
+  std::optional<int> control_shards;
+  std::vector<Session> sessions;
+  std::vector<wolf::config::PairedClient> paired_clients;
+};
+
+struct ReceivedState {
+  State state;
+  std::vector<int> fds;
+};
+
+/**
+ * Sends the state and the file descriptors over a connected Unix socket
+ * @throws std::runtime_error
+ */
+void send_state(int socket, const State &state, const std::vector<int> &fds);
+
+/**
+ * Blocks until the state sent with send_state() has been received, the file descriptors are owned by the caller
+ * @throws std::runtime_error
+ */
+ReceivedState receive_state(int socket);
+
+/**
+ * The previous process has stopped accepting new sessions
+ */
+void send_ack(int socket);
+
+/**
+ * @throws std::runtime_error if the previous process has gone away without sending the ack
+ */
+void wait_ack(int socket);
+
+/**
+ * @return a connected Unix socket, empty if nobody is listening on the given path
+ */
+std::optional<int> connect(const std::string &path);
+
+/**
+ * @return true if the other process has closed the connection (or exited), false if the timeout elapsed first
+ */
+bool wait_closed(int socket, std::chrono::milliseconds timeout);
+
+/**
+ * The running sessions and the paired clients of this process, without the sockets
+ */
+State collect_state(const immer::box<state::AppState> &app_state);
+
+/**
+ * Adds the paired clients that we don't know yet and reserves the RTP ports of the sessions that are still running
+ * in the previous process
+ */
+void adopt_state(const immer::box<state::AppState> &app_state, const State &previous);
+
+/**
+ * Our control shards can't be bound until the previous process exits if they overlap with its own.
+ * @return the first port of a range of `shards` ports, between CONTROL_PORT and RTSP_SETUP_PORT, that the previous
+ *         process isn't listening on; empty if there's no room for both
+ */
+std::optional<unsigned short> pick_control_port(const State &previous, int shards);
+
+/**
+ * The previous process is gone, its ports can be used for new sessions
+ */
+void release_ports(const immer::box<state::AppState> &app_state, const State &previous);
+
+/**
+ * The listening sockets that can be passed to the next process, and the ones that have been received from the
+ * previous one.
+ */
+class Sockets {
+public:
+  static Sockets &get() {
+    static Sockets sockets;
+    return sockets;
+  }
+
+  void publish(const std::string &name, int fd) {
+    std::lock_guard lock(m);
+    published.insert_or_assign(name, fd);
+  }
+
+  void unpublish(const std::string &name) {
+    std::lock_guard lock(m);
+    published.erase(name);
+  }
+
+  [[nodiscard]] std::vector<std::pair<std::string, int>> get_published() const {
+    std::lock_guard lock(m);
+    return {published.begin(), published.end()};
+  }
+
+  void inherit(const std::string &name, int fd) {
+    std::lock_guard lock(m);
+    inherited.insert_or_assign(name, fd);
+  }
+
+  /**
+   * @return the socket received from the previous process, only the first call for a given name gets it
+   */
+  std::optional<int> take_inherited(const std::string &name) {
+    std::lock_guard lock(m);
+    auto node = inherited.extract(name);
+    return node ? std::optional<int>(node.mapped()) : std::nullopt;
+  }
+
+private:
+  mutable std::mutex m;
+  std::map<std::string, int> published;
+  std::map<std::string, int> inherited;
+};
+
+} // namespace handover
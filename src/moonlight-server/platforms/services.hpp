@@ -0,0 +1,174 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <helpers/logger.hpp>
+#include <memory>
+#include <mutex>
+#include <platforms/threads.hpp>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * The long-running subsystems of Wolf (HTTP, HTTPS, RTSP, control, API, ...) each run on a service thread.
+ *
+ * Services are stopped cooperatively: they get a std::stop_token and are expected to return shortly after a stop has
+ * been requested, either by polling it in their loop or by registering a std::stop_callback (ex: to stop an
+ * io_context).
+ */
+namespace wolf::core::services {
+
+struct ServiceInfo {
+  std::string name;
+  bool running;
+  bool stop_requested;
+  /* 0 until the thread has started */
+  std::int64_t tid;
+  std::int64_t cpu_time_us;
+};
+
+class Service {
+public:
+  using Fn = std::function<void(std::stop_token)>;
+
+  Service(std::string name, Fn fn) : name(std::move(name)) {
+    thread = std::jthread([this, fn = std::move(fn)](std::stop_token stop_token) {
+      tid = threads::current_thread_id();
+      try {
+        fn(stop_token);
+      } catch (const std::exception &e) {
+        logs::log(logs::error, "[SERVICES] {} stopped with an exception: {}", this->name, e.what());
+      }
+      final_cpu_time_us = threads::get_current_thread_cpu_time().value_or(std::chrono::microseconds(0)).count();
+      running = false;
+      logs::log(logs::debug, "[SERVICES] {} stopped", this->name);
+    });
+  }
+
+  Service(const Service &) = delete;
+  Service &operator=(const Service &) = delete;
+
+  [[nodiscard]] const std::string &get_name() const {
+    return name;
+  }
+
+  void request_stop() {
+    thread.request_stop();
+  }
+
+  /**
+   * Waits for the service to return, it can't be called from the service itself
+   */
+  void join() {
+    std::lock_guard lock(join_m);
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  [[nodiscard]] bool is_running() const {
+    return running;
+  }
+
+  [[nodiscard]] ServiceInfo get_info() {
+    auto cpu_time_us = final_cpu_time_us.load();
+    // The native handle is only valid until the thread has been joined, don't wait on a join that is in progress
+    std::unique_lock lock(join_m, std::try_to_lock);
+    if (lock.owns_lock() && running && thread.joinable()) {
+      // Reading the clock of a thread that is exiting fails, we'll get the final value on the next call
+      if (auto cpu_time = threads::get_cpu_time(thread.native_handle())) {
+        cpu_time_us = cpu_time->count();
+      }
+    }
+    return {.name = name,
+            .running = running,
+            .stop_requested = thread.get_stop_token().stop_requested(),
+            .tid = tid,
+            .cpu_time_us = cpu_time_us};
+  }
+
+private:
+  std::string name;
+  std::atomic<bool> running = true;
+  std::atomic<std::int64_t> tid = 0;
+  std::atomic<std::int64_t> final_cpu_time_us = 0;
+  std::mutex join_m;
+  // Last, everything else has to be initialised before the thread starts
+  std::jthread thread;
+};
+
+class Registry {
+public:
+  static Registry &get() {
+    static Registry registry;
+    return registry;
+  }
+
+  std::shared_ptr<Service> start(std::string name, Service::Fn fn) {
+    logs::log(logs::debug, "[SERVICES] Starting {}", name);
+    auto service = std::make_shared<Service>(std::move(name), std::move(fn));
+    std::lock_guard lock(m);
+    services.push_back(service);
+    return service;
+  }
+
+  /**
+   * In the order they have been started
+   */
+  [[nodiscard]] std::vector<ServiceInfo> get_all() {
+    std::lock_guard lock(m);
+    std::vector<ServiceInfo> res;
+    for (const auto &service : services) {
+      res.push_back(service->get_info());
+    }
+    return res;
+  }
+
+  /**
+   * Asks the services with the given name to stop and waits for them
+   */
+  void stop(const std::string &name) {
+    std::vector<std::shared_ptr<Service>> to_stop;
+    {
+      std::lock_guard lock(m);
+      std::copy_if(services.begin(), services.end(), std::back_inserter(to_stop), [&name](const auto &service) {
+        return service->get_name() == name;
+      });
+    }
+    for (const auto &service : to_stop) {
+      service->request_stop();
+    }
+    for (const auto &service : to_stop) {
+      service->join();
+    }
+  }
+
+  /**
+   * Asks every service to stop and waits for them, the last one to start is the first one to be joined
+   */
+  void stop_all() {
+    std::vector<std::shared_ptr<Service>> to_stop;
+    {
+      std::lock_guard lock(m);
+      to_stop = services;
+    }
+    for (const auto &service : to_stop) {
+      service->request_stop();
+    }
+    for (auto service = to_stop.rbegin(); service != to_stop.rend(); service++) {
+      logs::log(logs::debug, "[SERVICES] Waiting for {}", (*service)->get_name());
+      (*service)->join();
+    }
+  }
+
+private:
+  std::mutex m;
+  std::vector<std::shared_ptr<Service>> services;
+};
+
+} // namespace wolf::core::services
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <helpers/logger.hpp>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <state/serialised_config.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Pins the streaming threads to a set of CPUs and/or changes their scheduling, as configured in the [threads] section
+ * of the config file.
+ *
+ * Settings are applied by the threads themselves when they start (see ScopedRole); threads inherit the settings of
+ * the thread that spawned them (ex: the input workers of a control thread).
+ */
+namespace wolf::core::threads {
+
+enum class Role {
+  CONTROL,
+  VIDEO, // Video producer and RTP pipeline, including the GStreamer streaming threads
+  AUDIO, // Audio producer and RTP pipeline, including the GStreamer streaming threads
+  API
+};
+
+inline std::string to_string(Role role) {
+  switch (role) {
+  case Role::CONTROL:
+    return "control";
+  case Role::VIDEO:
+    return "video";
+  case Role::AUDIO:
+    return "audio";
+  case Role::API:
+    return "api";
+  }
+  return "unknown";
+}
+
+/**
+ * What the OS has actually granted to a thread
+ */
+struct ThreadInfo {
+  std::string role;
+  std::string name;
+  std::int64_t tid;
+  std::vector<int> cpus;
+  wolf::config::ThreadScheduling scheduling = wolf::config::ThreadScheduling::OTHER;
+  int priority = 0;
+  int nice = 0;
+  /* Set when the configured settings couldn't be applied (ex: SCHED_FIFO without CAP_SYS_NICE) */
+  std::optional<std::string> error;
+};
+
+/**
+ * Applies the given settings to the calling thread and reads back the effective ones.
+ * Platforms other than Linux will only report the thread.
+ */
+ThreadInfo apply_to_current_thread(const wolf::config::ThreadRoleCfg &settings);
+
+/**
+ * The affinity, scheduling and nice level the calling thread is running with, in a form that can be given back to
+ * apply_to_current_thread(). Platforms other than Linux will return empty settings.
+ */
+wolf::config::ThreadRoleCfg get_current_thread_settings();
+
+std::int64_t current_thread_id();
+
+/**
+ * CPU time consumed so far by a thread, empty if it can't be read (ex: the thread has already exited)
+ */
+std::optional<std::chrono::microseconds> get_cpu_time(std::thread::native_handle_type thread);
+
+std::optional<std::chrono::microseconds> get_current_thread_cpu_time();
+
+/**
+ * The configured settings and the threads that are currently running with a role
+ */
+class Topology {
+public:
+  static Topology &get() {
+    static Topology topology;
+    return topology;
+  }
+
+  void configure(const wolf::config::ThreadsCfg &threads_cfg) {
+    for (auto role : {Role::CONTROL, Role::VIDEO, Role::AUDIO, Role::API}) {
+      auto settings = get_settings(threads_cfg, role);
+      if (settings.priority && settings.scheduling.value_or(wolf::config::ThreadScheduling::OTHER) ==
+                                   wolf::config::ThreadScheduling::OTHER) {
+        logs::log(logs::warning,
+                  "[THREADS] {} priority is ignored, it's only used together with scheduling FIFO or RR",
+                  to_string(role));
+      }
+    }
+    std::lock_guard lock(m);
+    cfg = threads_cfg;
+  }
+
+  [[nodiscard]] wolf::config::ThreadsCfg get_config() const {
+    std::lock_guard lock(m);
+    return cfg;
+  }
+
+  /**
+   * Applies the settings of the role to the calling thread, and keeps track of it until leave() is called
+   */
+  ThreadInfo enter(Role role) {
+    auto settings = get_settings(get_config(), role);
+    // Pooled threads (ex: GStreamer streaming threads) outlive the role, leave() puts back what the role changed
+    std::optional<wolf::config::ThreadRoleCfg> previous;
+    if (settings.cpus || settings.scheduling || settings.nice) {
+      auto current = get_current_thread_settings();
+      previous = wolf::config::ThreadRoleCfg{.cpus = settings.cpus ? current.cpus : std::nullopt,
+                                             .scheduling = settings.scheduling ? current.scheduling : std::nullopt,
+                                             .priority = settings.scheduling ? current.priority : std::nullopt,
+                                             .nice = settings.nice ? current.nice : std::nullopt};
+    }
+    auto info = apply_to_current_thread(settings);
+    info.role = to_string(role);
+    if (info.error) {
+      logs::log(logs::warning, "[THREADS] Unable to apply {} settings to {}: {}", info.role, info.tid, *info.error);
+    }
+
+    std::lock_guard lock(m);
+    auto &entry = threads[info.tid];
+    entry.info = info;
+    if (!entry.previous) { // Entering again keeps the settings that the thread had in the first place
+      entry.previous = std::move(previous);
+    }
+    return info;
+  }
+
+  void leave() {
+    auto tid = current_thread_id();
+    std::optional<wolf::config::ThreadRoleCfg> previous;
+    {
+      std::lock_guard lock(m);
+      if (auto entry = threads.find(tid); entry != threads.end()) {
+        previous = std::move(entry->second.previous);
+        threads.erase(entry);
+      }
+    }
+    if (previous) {
+      auto info = apply_to_current_thread(*previous);
+      if (info.error) {
+        logs::log(logs::warning, "[THREADS] Unable to restore the settings of {}: {}", tid, *info.error);
+      }
+    }
+  }
+
+  /**
+   * Ordered by thread id
+   */
+  [[nodiscard]] std::vector<ThreadInfo> get_threads() const {
+    std::lock_guard lock(m);
+    std::vector<ThreadInfo> res;
+    for (const auto &[tid, entry] : threads) {
+      res.push_back(entry.info);
+    }
+    return res;
+  }
+
+private:
+  struct Entry {
+    ThreadInfo info;
+    /* What the thread was running with before enter(), empty if the role didn't change anything */
+    std::optional<wolf::config::ThreadRoleCfg> previous;
+  };
+
+  static wolf::config::ThreadRoleCfg get_settings(const wolf::config::ThreadsCfg &threads_cfg, Role role) {
+    std::optional<wolf::config::ThreadRoleCfg> settings;
+    switch (role) {
+    case Role::CONTROL:
+      settings = threads_cfg.control;
+      break;
+    case Role::VIDEO:
+      settings = threads_cfg.video;
+      break;
+    case Role::AUDIO:
+      settings = threads_cfg.audio;
+      break;
+    case Role::API:
+      settings = threads_cfg.api;
+      break;
+    }
+    return settings.value_or(wolf::config::ThreadRoleCfg{});
+  }
+
+  mutable std::mutex m;
+  wolf::config::ThreadsCfg cfg;
+  std::map<std::int64_t /* tid */, Entry> threads;
+};
+
+/**
+ * Gives a role to the calling thread for as long as this is in scope
+ */
+class ScopedRole {
+public:
+  explicit ScopedRole(Role role) {
+    Topology::get().enter(role);
+  }
+
+  ScopedRole(const ScopedRole &) = delete;
+  ScopedRole &operator=(const ScopedRole &) = delete;
+
+  ~ScopedRole() {
+    Topology::get().leave();
+  }
+};
+
+} // namespace wolf::core::threads
@@ -0,0 +1,153 @@
+#include "threads.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fmt/core.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace wolf::core::threads {
+
+using namespace wolf::config;
+
+std::int64_t current_thread_id() {
+  return static_cast<std::int64_t>(syscall(SYS_gettid));
+}
+
+static std::optional<std::chrono::microseconds> read_cpu_clock(clockid_t clock) {
+  timespec ts = {};
+  if (clock_gettime(clock, &ts) != 0) {
+    return {};
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::seconds(ts.tv_sec) +
+                                                               std::chrono::nanoseconds(ts.tv_nsec));
+}
+
+std::optional<std::chrono::microseconds> get_cpu_time(std::thread::native_handle_type thread) {
+  clockid_t clock;
+  if (pthread_getcpuclockid(thread, &clock) != 0) {
+    return {};
+  }
+  return read_cpu_clock(clock);
+}
+
+std::optional<std::chrono::microseconds> get_current_thread_cpu_time() {
+  return read_cpu_clock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+static int to_policy(ThreadScheduling scheduling) {
+  switch (scheduling) {
+  case ThreadScheduling::FIFO:
+    return SCHED_FIFO;
+  case ThreadScheduling::RR:
+    return SCHED_RR;
+  case ThreadScheduling::OTHER:
+    break;
+  }
+  return SCHED_OTHER;
+}
+
+static ThreadScheduling from_policy(int policy) {
+  switch (policy) {
+  case SCHED_FIFO:
+    return ThreadScheduling::FIFO;
+  case SCHED_RR:
+    return ThreadScheduling::RR;
+  default:
+    return ThreadScheduling::OTHER;
+  }
+}
+
+ThreadRoleCfg get_current_thread_settings() {
+  auto self = pthread_self();
+  ThreadRoleCfg res;
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  if (pthread_getaffinity_np(self, sizeof(cpus), &cpus) == 0) {
+    res.cpus.emplace();
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (CPU_ISSET(cpu, &cpus)) {
+        res.cpus->push_back(cpu);
+      }
+    }
+  }
+
+  int policy;
+  sched_param param = {};
+  if (pthread_getschedparam(self, &policy, &param) == 0) {
+    res.scheduling = from_policy(policy);
+    if (policy != SCHED_OTHER) {
+      res.priority = param.sched_priority;
+    }
+  }
+
+  errno = 0; // getpriority() can legitimately return -1
+  auto nice = getpriority(PRIO_PROCESS, current_thread_id());
+  if (errno == 0) {
+    res.nice = nice;
+  }
+  return res;
+}
+
+ThreadInfo apply_to_current_thread(const ThreadRoleCfg &settings) {
+  auto self = pthread_self();
+  auto info = ThreadInfo{.tid = current_thread_id()};
+  std::vector<std::string> errors;
+
+  if (settings.cpus && !settings.cpus->empty()) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    for (auto cpu : *settings.cpus) {
+      if (cpu >= 0 && cpu < CPU_SETSIZE) {
+        CPU_SET(cpu, &cpus);
+      } else {
+        errors.push_back(fmt::format("invalid CPU {}", cpu));
+      }
+    }
+    if (auto err = pthread_setaffinity_np(self, sizeof(cpus), &cpus)) {
+      errors.push_back(fmt::format("unable to set the CPU affinity, {}", strerror(err)));
+    }
+  }
+
+  if (settings.scheduling) {
+    auto policy = to_policy(*settings.scheduling);
+    sched_param param = {};
+    if (policy != SCHED_OTHER) {
+      param.sched_priority = settings.priority.value_or(sched_get_priority_min(policy));
+    }
+    if (auto err = pthread_setschedparam(self, policy, &param)) {
+      errors.push_back(fmt::format("unable to set the scheduling policy, {}", strerror(err)));
+    }
+  }
+
+  // On Linux the nice level is per thread
+  if (settings.nice && setpriority(PRIO_PROCESS, info.tid, *settings.nice) != 0) {
+    errors.push_back(fmt::format("unable to set the nice level, {}", strerror(errno)));
+  }
+
+  char name[16] = {}; // Thread names are limited to 16 chars, including the terminating null byte
+  if (pthread_getname_np(self, name, sizeof(name)) == 0) {
+    info.name = name;
+  }
+
+  auto effective = get_current_thread_settings();
+  info.cpus = effective.cpus.value_or(std::vector<int>{});
+  info.scheduling = effective.scheduling.value_or(ThreadScheduling::OTHER);
+  info.priority = effective.priority.value_or(0);
+  info.nice = effective.nice.value_or(0);
+
+  if (!errors.empty()) {
+    std::string error = errors[0];
+    for (std::size_t i = 1; i < errors.size(); i++) {
+      error += ", " + errors[i];
+    }
+    info.error = error;
+  }
+  return info;
+}
+
+} // namespace wolf::core::threads
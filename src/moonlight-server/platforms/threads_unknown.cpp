@@ -0,0 +1,31 @@
+#include "threads.hpp"
+#include <functional>
+#include <thread>
+
+namespace wolf::core::threads {
+
+std::int64_t current_thread_id() {
+  return static_cast<std::int64_t>(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+}
+
+std::optional<std::chrono::microseconds> get_cpu_time(std::thread::native_handle_type thread) {
+  return {};
+}
+
+std::optional<std::chrono::microseconds> get_current_thread_cpu_time() {
+  return {};
+}
+
+wolf::config::ThreadRoleCfg get_current_thread_settings() {
+  return {};
+}
+
+ThreadInfo apply_to_current_thread(const wolf::config::ThreadRoleCfg &settings) {
+  auto info = ThreadInfo{.tid = current_thread_id()};
+  if (settings.cpus || settings.scheduling || settings.nice) {
+    info.error = "thread settings are only supported on Linux";
+  }
+  return info;
+}
+
+} // namespace wolf::core::threads
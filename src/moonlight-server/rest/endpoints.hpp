@@ -9,6 +9,7 @@
 #include <immer/vector_transient.hpp>
 #include <moonlight/control.hpp>
 #include <moonlight/protocol.hpp>
+#include <optional>
 #include <platforms/hw.hpp>
 #include <range/v3/view.hpp>
 #include <rest/helpers.hpp>
@@ -16,6 +17,7 @@
 #include <rtp/udp-ping.hpp>
 #include <state/config.hpp>
 #include <state/sessions.hpp>
+#include <streaming/startup.hpp>
 #include <utility>
 
 namespace endpoints {
@@ -29,6 +31,18 @@ template <class T> void server_error(const std::shared_ptr<typename SimpleWeb::S
   send_xml<T>(response, SimpleWeb::StatusCode::client_error_bad_request, xml);
 }
 
+/**
+ * Moonlight shows status_message to the user
+ */
+template <class T>
+void service_unavailable(const std::shared_ptr<typename SimpleWeb::Server<T>::Response> &response,
+                         const std::string &message) {
+  XML xml;
+  xml.put("root.<xmlattr>.status_code", 503);
+  xml.put("root.<xmlattr>.status_message", message);
+  send_xml<T>(response, SimpleWeb::StatusCode::server_error_service_unavailable, xml);
+}
+
 template <class T>
 void not_found(const std::shared_ptr<typename SimpleWeb::Server<T>::Response> &response,
                const std::shared_ptr<typename SimpleWeb::Server<T>::Request> &request) {
@@ -57,7 +71,7 @@ void serverinfo(const std::shared_ptr<typename SimpleWeb::Server<T>::Response> &
   auto host = state->host;
   bool is_https = std::is_same_v<SimpleWeb::HTTPS, T>;
 
-  auto session = state::get_session_by_ip(state->running_sessions->load(), get_client_ip<T>(request));
+  auto session = state::get_session_by_ip(state->running_sessions->load_index(), get_client_ip<T>(request));
   bool is_busy = session.has_value();
   int app_id = session.has_value() ? std::stoi(session->app->base.id) : 0;
 
@@ -273,7 +287,8 @@ auto create_run_session(const SimpleWeb::CaseInsensitiveMultimap &headers,
                         const std::string &client_ip,
                         const state::PairedClient &current_client,
                         immer::box<state::AppState> state,
-                        const events::App &run_app) {
+                        const events::App &run_app,
+                        const std::shared_ptr<streaming::startup::SessionProfile> &startup_profile) {
   auto display_mode_str = utils::split(get_header(headers, "mode").value_or("1920x1080x60"), 'x');
   moonlight::DisplayMode display_mode = {std::stoi(display_mode_str[0].data()),
                                          std::stoi(display_mode_str[1].data()),
@@ -283,38 +298,55 @@ auto create_run_session(const SimpleWeb::CaseInsensitiveMultimap &headers,
 
   auto surround_info = std::stoi(get_header(headers, "surroundAudioInfo").value_or("196610"));
   int channelCount = surround_info & (0xffff /* last 16 bits */);
-
-  auto base_session = create_stream_session(state, run_app, current_client, display_mode, channelCount);
+  // Read before creating the session: once created, its ports are taken until it's added to the running sessions
+  auto aes_key = get_header(headers, "rikey").value();
+  auto aes_iv = get_header(headers, "rikeyid").value();
+
+  std::shared_ptr<events::StreamSession> base_session;
+  {
+    auto create_phase = streaming::startup::ScopedPhase(startup_profile, "create_stream_session");
+    base_session = create_stream_session(state, run_app, current_client, display_mode, channelCount);
+  }
 
   base_session->ip = client_ip;
-  base_session->aes_key = get_header(headers, "rikey").value();
-  base_session->aes_iv = get_header(headers, "rikeyid").value();
+  base_session->aes_key = aes_key;
+  base_session->aes_iv = aes_iv;
   return std::move(base_session);
 }
 
 void start_rtp_ping(const events::StreamSession &session) {
+  // The client will start sending PINGs after the RTSP handshake
+  constexpr auto ping_timeout = std::chrono::seconds(4);
 
   // Video RTP Ping
-  rtp::wait_for_ping(session.video_stream_port,
-                     [ev_bus = session.event_bus](unsigned short client_port, const std::string &client_ip) {
-                       logs::log(logs::trace, "[PING] video from {}:{}", client_ip, client_port);
-                       auto ev = events::RTPVideoPingEvent{.client_ip = client_ip, .client_port = client_port};
-                       ev_bus->fire_event(immer::box<events::RTPVideoPingEvent>(ev));
-                     });
+  rtp::ping_server().expect_ping(
+      session.video_stream_port,
+      session.ip,
+      ping_timeout,
+      [ev_bus = session.event_bus](unsigned short client_port, const std::string &client_ip) {
+        logs::log(logs::trace, "[PING] video from {}:{}", client_ip, client_port);
+        auto ev = events::RTPVideoPingEvent{.client_ip = client_ip, .client_port = client_port};
+        ev_bus->fire_event(immer::box<events::RTPVideoPingEvent>(ev));
+      });
 
   // Audio RTP Ping
-  rtp::wait_for_ping(session.audio_stream_port,
-                     [ev_bus = session.event_bus](unsigned short client_port, const std::string &client_ip) {
-                       logs::log(logs::trace, "[PING] audio from {}:{}", client_ip, client_port);
-                       auto ev = events::RTPAudioPingEvent{.client_ip = client_ip, .client_port = client_port};
-                       ev_bus->fire_event(immer::box<events::RTPAudioPingEvent>(ev));
-                     });
+  rtp::ping_server().expect_ping(
+      session.audio_stream_port,
+      session.ip,
+      ping_timeout,
+      [ev_bus = session.event_bus](unsigned short client_port, const std::string &client_ip) {
+        logs::log(logs::trace, "[PING] audio from {}:{}", client_ip, client_port);
+        auto ev = events::RTPAudioPingEvent{.client_ip = client_ip, .client_port = client_port};
+        ev_bus->fire_event(immer::box<events::RTPAudioPingEvent>(ev));
+      });
 }
 
 void launch(const std::shared_ptr<typename SimpleWeb::Server<SimpleWeb::HTTPS>::Response> &response,
             const std::shared_ptr<typename SimpleWeb::Server<SimpleWeb::HTTPS>::Request> &request,
             const state::PairedClient &current_client,
             const immer::box<state::AppState> &state) {
+  auto startup_profile = streaming::startup::Registry::get().start(state::get_client_id(current_client));
+  auto launch_phase = streaming::startup::ScopedPhase(startup_profile, "HTTPS /launch");
   log_req<SimpleWeb::HTTPS>(request);
 
   SimpleWeb::CaseInsensitiveMultimap headers = request->parse_query_string();
@@ -325,10 +357,21 @@ void launch(const std::shared_ptr<typename SimpleWeb::Server<SimpleWeb::HTTPS>::
     return;
   }
   auto client_ip = get_client_ip<SimpleWeb::HTTPS>(request);
-  auto new_session = create_run_session(request->parse_query_string(), client_ip, current_client, state, app.value());
+  std::shared_ptr<events::StreamSession> new_session;
+  try {
+    new_session = create_run_session(request->parse_query_string(),
+                                     client_ip,
+                                     current_client,
+                                     state,
+                                     app.value(),
+                                     startup_profile);
+  } catch (const std::runtime_error &e) { // ex: all the ports are taken
+    logs::log(logs::warning, "[HTTPS] Unable to launch {}: {}", app.value()->base.title, e.what());
+    service_unavailable<SimpleWeb::HTTPS>(response, e.what());
+    return;
+  }
   state->event_bus->fire_event(immer::box<events::StreamSession>(*new_session));
-  state->running_sessions->update(
-      [new_session](const immer::vector<events::StreamSession> &ses_v) { return ses_v.push_back(*new_session); });
+  state->running_sessions->add(*new_session);
 
   start_rtp_ping(*new_session);
 
@@ -341,15 +384,33 @@ void resume(const std::shared_ptr<typename SimpleWeb::Server<SimpleWeb::HTTPS>::
             const std::shared_ptr<typename SimpleWeb::Server<SimpleWeb::HTTPS>::Request> &request,
             const state::PairedClient &current_client,
             const immer::box<state::AppState> &state) {
+  auto resume_start = streaming::startup::clock::now();
   log_req<SimpleWeb::HTTPS>(request);
 
   auto client_ip = get_client_ip<SimpleWeb::HTTPS>(request);
-  auto old_session = state::get_session_by_client(state->running_sessions->load(), current_client);
+  auto old_session = state::get_session_by_client(state->running_sessions->load_index(), current_client);
+  std::optional<streaming::startup::ScopedPhase> resume_phase;
   if (old_session) {
-    auto new_session =
-        create_run_session(request->parse_query_string(), client_ip, current_client, state, *old_session->app);
+    // The resumed session gets a new profile, starting from when the request has been received
+    auto startup_profile = streaming::startup::Registry::get().start(old_session->session_id, resume_start);
+    resume_phase.emplace(startup_profile, "HTTPS /resume", resume_start);
+    std::shared_ptr<events::StreamSession> new_session;
+    try {
+      new_session = create_run_session(request->parse_query_string(),
+                                       client_ip,
+                                       current_client,
+                                       state,
+                                       *old_session->app,
+                                       startup_profile);
+    } catch (const std::runtime_error &e) { // ex: all the ports are taken
+      logs::log(logs::warning, "[HTTPS] Unable to resume session {}: {}", old_session->session_id, e.what());
+      service_unavailable<SimpleWeb::HTTPS>(response, e.what());
+      return;
+    }
     // Carry over the old session display handle
     new_session->wayland_display = std::move(old_session->wayland_display);
+    // Carry over the leased audio sink, the running app is still outputting to it
+    new_session->audio_sink = std::move(old_session->audio_sink);
     // Carry over the old session devices, they'll be already plugged into the container
     new_session->mouse = std::move(old_session->mouse);
     new_session->keyboard = std::move(old_session->keyboard);
@@ -359,9 +420,8 @@ void resume(const std::shared_ptr<typename SimpleWeb::Server<SimpleWeb::HTTPS>::
 
     start_rtp_ping(*new_session);
 
-    state->running_sessions->update([&old_session, new_session](const immer::vector<events::StreamSession> ses_v) {
-      return state::remove_session(ses_v, old_session.value()).push_back(*new_session);
-    });
+    // Same session_id: this replaces the old session
+    state->running_sessions->add(*new_session);
   } else {
     logs::log(logs::warning, "[HTTPS] Received resume event from an unregistered session, ip: {}", client_ip);
   }
@@ -380,14 +440,12 @@ void cancel(const std::shared_ptr<typename SimpleWeb::Server<SimpleWeb::HTTPS>::
             const immer::box<state::AppState> &state) {
   log_req<SimpleWeb::HTTPS>(request);
 
-  auto client_session = state::get_session_by_client(state->running_sessions->load(), current_client);
+  auto client_session = state::get_session_by_client(state->running_sessions->load_index(), current_client);
   if (client_session) {
     state->event_bus->fire_event(
         immer::box<events::StopStreamEvent>(events::StopStreamEvent{.session_id = client_session->session_id}));
 
-    state->running_sessions->update([&client_session](const immer::vector<events::StreamSession> &ses_v) {
-      return state::remove_session(ses_v, client_session.value());
-    });
+    state->running_sessions->remove(client_session->session_id);
   } else {
     auto client_ip = get_client_ip<SimpleWeb::HTTPS>(request);
     logs::log(logs::warning, "[HTTPS] Received resume event from an unregistered session, ip: {}", client_ip);
@@ -1,71 +1,118 @@
-#include <boost/bind/bind.hpp>
-#include <boost/enable_shared_from_this.hpp>
 #include <rtp/udp-ping.hpp>
 #include <thread>
 
 namespace rtp {
 
-UDP_Server::UDP_Server(
-    unsigned short port,
-    const std::function<void(unsigned short /* client_port */, const std::string & /* client_ip */)> &callback)
-    : io_context(), socket_(io_context, udp::endpoint(udp::v4(), port)), callback(callback) {
-  // We have to enable this because we'll bind additional sockets as udpsink in the audio/video pipelines
-  socket_.set_option(udp::socket::reuse_address(true));
-  start_receive();
-}
+PingServer::PingServer(boost::asio::io_context &io_context) : io_context(io_context) {}
 
-UDP_Server::~UDP_Server() {
-  socket_.close();
-  io_context.stop();
-}
+void PingServer::expect_ping(unsigned short port,
+                             const std::string &client_ip,
+                             std::chrono::milliseconds timeout,
+                             const Callback &callback) {
+  boost::asio::post(io_context, [this, port, client_ip, timeout, callback]() {
+    if (!listen(port)) {
+      return;
+    }
+
+    auto key = PendingKey{port, client_ip};
+    if (auto previous = pending.find(key); previous != pending.end()) {
+      previous->second.timeout->cancel();
+    }
 
-void UDP_Server::run(std::chrono::milliseconds timeout) {
-  io_context.run_for(timeout);
+    auto timer = std::make_shared<boost::asio::steady_timer>(io_context, timeout);
+    pending.insert_or_assign(key, Pending{.callback = callback, .timeout = timer});
+    timer->async_wait([this, key, timer](const boost::system::error_code &ec) {
+      if (ec == boost::asio::error::operation_aborted) {
+        return;
+      }
+      if (auto expired = pending.find(key); expired != pending.end() && expired->second.timeout == timer) {
+        logs::log(logs::debug, "[RTP] Stopped waiting for PING on port {} from {}", key.first, key.second);
+        pending.erase(expired);
+      }
+    });
+  });
 }
 
-void UDP_Server::start_receive() {
-  socket_.async_receive_from(boost::asio::buffer(recv_buffer_),
-                             remote_endpoint_,
-                             boost::bind(&UDP_Server::handle_receive,
-                                         this,
-                                         boost::asio::placeholders::error,
-                                         boost::asio::placeholders::bytes_transferred));
+void PingServer::close_all() {
+  boost::asio::post(io_context, [this]() {
+    for (auto &[key, session] : pending) {
+      session.timeout->cancel();
+    }
+    pending.clear();
+
+    auto closed = std::make_shared<decltype(listeners)>(std::move(listeners));
+    listeners.clear();
+    for (auto &[port, listener] : *closed) {
+      boost::system::error_code ec;
+      listener->socket.close(ec);
+      logs::log(logs::debug, "[RTP] Closed RTP server on port: {}", port);
+    }
+    // The aborted receive handlers are still referencing the listeners, they'll run before this one
+    boost::asio::post(io_context, [closed]() {});
+  });
 }
 
-void UDP_Server::handle_receive(const boost::system::error_code &error, std::size_t /*bytes_transferred*/) {
-  if (!error) {
-    auto client_ip = remote_endpoint_.address().to_string();
-    auto client_port = remote_endpoint_.port();
+bool PingServer::listen(unsigned short port) {
+  if (listeners.contains(port)) {
+    return true;
+  }
 
-    logs::log(logs::trace, "[RTP] Received ping from {}:{}", client_ip, client_port);
-    callback(client_port, client_ip);
-    // We'll keep receiving pings and sending callback events until the timeout elapsed.
-    // This is because we don't know if downstream they are ready to start the session.
-    // Downstream will make sure to only send one ping per session
-    std::this_thread::sleep_for(std::chrono::milliseconds(500)); // let's avoid spamming though
-    start_receive();
+  try {
+    auto listener = std::make_unique<Listener>(Listener{.socket = udp::socket(io_context)});
+    listener->socket.open(udp::v4());
+    // We have to enable this because we'll bind additional sockets as udpsink in the audio/video pipelines
+    listener->socket.set_option(udp::socket::reuse_address(true));
+    listener->socket.bind(udp::endpoint(udp::v4(), port));
+    start_receive(port, *listener);
+    listeners.emplace(port, std::move(listener));
+    logs::log(logs::info, "RTP server started on port: {}", port);
+    return true;
+  } catch (std::exception &e) {
+    logs::log(logs::warning, "[RTP] Unable to start RTP server on {}: {}", port, e.what());
+    return false;
   }
 }
 
-void wait_for_ping(
-    unsigned short port,
-    const std::function<void(unsigned short /* client_port */, const std::string & /* client_ip */)> &callback) {
-  auto thread = std::thread(
-      [port](
-          const std::function<void(unsigned short /* client_port */, const std::string & /* client_ip */)> &callback) {
-        try {
-          auto server = UDP_Server(port, callback);
+void PingServer::start_receive(unsigned short port, Listener &listener) {
+  listener.socket.async_receive_from(
+      boost::asio::buffer(listener.recv_buffer),
+      listener.remote_endpoint,
+      [this, port, &listener](const boost::system::error_code &error, std::size_t /*bytes_transferred*/) {
+        if (error == boost::asio::error::operation_aborted || !listener.socket.is_open()) {
+          return;
+        }
 
-          logs::log(logs::info, "RTP server started on port: {}", port);
-          server.run(std::chrono::seconds(4));
-          logs::log(logs::debug, "RTP server on port: {} stopped", port);
+        if (!error) {
+          auto client_ip = listener.remote_endpoint.address().to_string();
+          auto client_port = listener.remote_endpoint.port();
+          logs::log(logs::trace, "[RTP] Received ping from {}:{}", client_ip, client_port);
 
-        } catch (std::exception &e) {
-          logs::log(logs::warning, "[RTP] Unable to start RTP server on {}: {}", port, e.what());
+          // We'll keep receiving pings and sending callback events until the timeout elapsed.
+          // This is because we don't know if downstream they are ready to start the session.
+          // Downstream will make sure to only start one stream per session
+          if (auto session = pending.find(PendingKey{port, client_ip}); session != pending.end()) {
+            session->second.callback(client_port, client_ip);
+          }
         }
-      },
-      callback);
-  thread.detach();
+        start_receive(port, listener);
+      });
+}
+
+PingServer &ping_server() {
+  static struct Service {
+    boost::asio::io_context io_context;
+    PingServer server{io_context};
+    std::thread thread{[this]() {
+      auto work_guard = boost::asio::make_work_guard(io_context);
+      io_context.run();
+    }};
+
+    ~Service() {
+      io_context.stop();
+      thread.join();
+    }
+  } service;
+  return service.server;
 }
 
-} // namespace rtp
\ No newline at end of file
+} // namespace rtp
@@ -2,39 +2,78 @@
 
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
+#include <boost/container_hash/hash.hpp>
+#include <chrono>
+#include <functional>
 #include <helpers/logger.hpp>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
 
 namespace rtp {
 
 using boost::asio::ip::udp;
 
 /**
- * Generic UDP server, adapted from:
- * https://www.boost.org/doc/libs/1_81_0/doc/html/boost_asio/tutorial/tutdaytime6/src.html
+ * Moonlight clients keep sending PINGs to the RTP video and audio ports until the stream starts.
+ *
+ * A single, long-lived, server receives them for all the sessions: each port is bound the first time it's needed and
+ * stays open; PINGs are matched to the pending sessions with a hash table lookup on (port, client ip).
+ * All the work is done on the given io_context.
  */
-class UDP_Server : public boost::enable_shared_from_this<UDP_Server> {
+class PingServer {
 public:
-  UDP_Server(
-      unsigned short port,
-      const std::function<void(unsigned short /* client_port */, const std::string & /* client_ip */)> &callback);
+  using Callback = std::function<void(unsigned short /* client_port */, const std::string & /* client_ip */)>;
 
-  ~UDP_Server();
+  explicit PingServer(boost::asio::io_context &io_context);
 
-  void run(std::chrono::milliseconds timeout);
+  PingServer(const PingServer &) = delete;
+  PingServer &operator=(const PingServer &) = delete;
+
+  /**
+   * Calls callback for every PING received on port from client_ip until timeout expires.
+   * A previous expectation for the same port and client ip (ex: resume) is replaced.
+   * Can be called from any thread.
+   */
+  void expect_ping(unsigned short port,
+                   const std::string &client_ip,
+                   std::chrono::milliseconds timeout,
+                   const Callback &callback);
+
+  /**
+   * Closes every port and drops the pending expectations, ports will be bound again by the next expect_ping().
+   * Used when handing over to a new Wolf process. Can be called from any thread.
+   */
+  void close_all();
 
 private:
-  void start_receive();
-  void handle_receive(const boost::system::error_code &error, std::size_t /*bytes_transferred*/);
-
-  boost::asio::io_context io_context;
-  udp::socket socket_;
-  udp::endpoint remote_endpoint_;
-  boost::array<char, 1> recv_buffer_{};
-  std::function<void(unsigned short /* client_port */, const std::string & /* client_ip */)> callback;
+  struct Listener {
+    udp::socket socket;
+    udp::endpoint remote_endpoint;
+    boost::array<char, 1> recv_buffer{};
+  };
+
+  using PendingKey = std::pair<unsigned short /* port */, std::string /* client_ip */>;
+
+  struct Pending {
+    Callback callback;
+    std::shared_ptr<boost::asio::steady_timer> timeout;
+  };
+
+  bool listen(unsigned short port);
+  void start_receive(unsigned short port, Listener &listener);
+
+  boost::asio::io_context &io_context;
+
+  // Only accessed from the io_context thread
+  std::unordered_map<unsigned short /* port */, std::unique_ptr<Listener>> listeners;
+  std::unordered_map<PendingKey, Pending, boost::hash<PendingKey>> pending;
 };
 
-void wait_for_ping(
-    unsigned short port,
-    const std::function<void(unsigned short /* client_port */, const std::string & /* client_ip */)> &callback);
+/**
+ * The ping server used by Wolf, it runs on its own thread
+ */
+PingServer &ping_server();
 
-} // namespace rtp
\ No newline at end of file
+} // namespace rtp
@@ -7,6 +7,7 @@
 #include <rtp/udp-ping.hpp>
 #include <rtsp/parser.hpp>
 #include <state/data-structures.hpp>
+#include <streaming/startup.hpp>
 #include <string>
 
 namespace rtsp::commands {
@@ -40,6 +41,13 @@ constexpr uint32_t FS_PEN_TOUCH_EVENTS = 0x01;
 constexpr uint32_t FS_CONTROLLER_TOUCH_EVENTS = 0x02;
 using namespace wolf::core::audio;
 
+/**
+ * opusenc hardcodes the number of streams, only moonlightopusenc can honour the high quality configurations
+ */
+inline bool supports_high_quality_audio(const events::App &app) {
+  return app.opus_gst_pipeline.find("moonlightopusenc") != std::string::npos;
+}
+
 RTSP_PACKET
 describe(const RTSP_PACKET &req, const events::StreamSession &session) {
   std::vector<std::pair<std::string, std::string>> payloads;
@@ -50,12 +58,19 @@ describe(const RTSP_PACKET &req, const events::StreamSession &session) {
     payloads.push_back({"a", "a=rtpmap:98 AV1/90000"});
   }
 
-  // Advertise all audio configurations
-  for (const auto audio_mode : state::AUDIO_CONFIGURATIONS) {
+  // Advertise all audio configurations; when the app can't encode high quality we advertise the normal quality
+  // layout in its place, the client has to decode what we'll actually send
+  bool high_quality_supported = supports_high_quality_audio(*session.app);
+  for (std::size_t i = 0; i < state::AUDIO_CONFIGURATIONS.size(); i++) {
+    bool high_quality = i % 2 == 1; // See AUDIO_CONFIGURATIONS
+    auto audio_mode = state::AUDIO_CONFIGURATIONS[high_quality && !high_quality_supported ? i - 1 : i];
     auto mapping_p = audio_mode.speakers;
+    // High quality surround doesn't couple any channel, the mapping is just the list of speakers
+    bool normal_surround = audio_mode.channels > 2 && audio_mode.coupled_streams > 0;
     // Opusenc forces a re-mapping to Vorbis; see
     // https://gitlab.freedesktop.org/gstreamer/gstreamer/-/blob/1.24.6/subprojects/gst-plugins-base/ext/opus/gstopusenc.c#L549-572
-    if (audio_mode.channels == 6) { // 5.1
+    // moonlightopusenc follows the same mapping so that both can be used with normal quality
+    if (normal_surround && audio_mode.channels == 6) { // 5.1
       mapping_p = {
           // The mapping for 5.1 is: [0 1 4 5 2 3]
           AudioMode::Speakers::FRONT_LEFT,
@@ -65,7 +80,7 @@ describe(const RTSP_PACKET &req, const events::StreamSession &session) {
           AudioMode::Speakers::FRONT_CENTER,
           AudioMode::Speakers::LOW_FREQUENCY,
       };
-    } else if (audio_mode.channels == 8) { // 7.1
+    } else if (normal_surround && audio_mode.channels == 8) { // 7.1
       mapping_p = {
           // The mapping for 7.1 is: [0 1 4 5 2 3 6 7]
           AudioMode::Speakers::FRONT_LEFT,
@@ -84,7 +99,7 @@ describe(const RTSP_PACKET &req, const events::StreamSession &session) {
      * as a result, Moonlight rotates all channels from index '3' to the right
      * To work around this, rotate channels to the left from index '3'
      */
-    if (audio_mode.channels > 2) { // 5.1 and 7.1
+    if (normal_surround) { // 5.1 and 7.1
       std::rotate(mapping_p.begin() + 3, mapping_p.begin() + 4, mapping_p.end());
     }
     std::string audio_speakers =
@@ -121,7 +136,7 @@ RTSP_PACKET setup(const RTSP_PACKET &req, const events::StreamSession &session)
     service_port = session.video_stream_port;
     break;
   case utils::hash("control"):
-    service_port = state::CONTROL_PORT;
+    service_port = state::get_control_port(session.session_id);
     break;
   default:
     return error_msg(404, "NOT FOUND", req.seq_number);
@@ -186,6 +201,9 @@ announce(const RTSP_PACKET &req, const events::StreamSession &session) {
   }
 
   auto audio_channels = args["x-nv-audio.surround.numChannels"].value_or(session.audio_channel_count);
+  // Same as advertised in describe()
+  auto high_quality_audio =
+      args["x-nv-audio.surround.AudioQuality"].value_or(0) == 1 && supports_high_quality_audio(*session.app);
   auto fec_percentage = 20; // TODO: setting?
 
   long bitrate = args["x-nv-vqos[0].bw.maximumBitrateKbps"].value_or(15500);
@@ -201,7 +219,7 @@ announce(const RTSP_PACKET &req, const events::StreamSession &session) {
 
     // Adjust the bitrate to account for audio traffic bandwidth usage (capped at 20% reduction).
     // The bitrate per channel is 256 Kbps for high quality mode and 96 Kbps for normal quality.
-    auto audioBitrateAdjustment = 96 * audio_channels;
+    auto audioBitrateAdjustment = (high_quality_audio ? 256 : 96) * audio_channels;
     bitrate -= std::min((std::int64_t)audioBitrateAdjustment, bitrate / 5);
 
     // Reduce it by another 500Kbps to account for A/V packet overhead and control data
@@ -233,7 +251,6 @@ announce(const RTSP_PACKET &req, const events::StreamSession &session) {
   session.event_bus->fire_event(immer::box<events::VideoSession>(video));
 
   // Audio session
-  auto high_quality_audio = args["x-nv-audio.surround.AudioQuality"].value_or(0) == 1;
   auto audio_mode = state::get_audio_mode(audio_channels, high_quality_audio);
   events::AudioSession audio = {
       .gst_pipeline = session.app->opus_gst_pipeline,
@@ -258,6 +275,7 @@ RTSP_PACKET
 message_handler(const RTSP_PACKET &req, const events::StreamSession &session) {
   auto cmd = req.request.cmd;
   logs::log(logs::debug, "[RTSP] received command {}", cmd);
+  auto phase = streaming::startup::Registry::get().phase(session.session_id, "RTSP " + cmd);
 
   switch (utils::hash(cmd)) {
   case utils::hash("OPTIONS"):
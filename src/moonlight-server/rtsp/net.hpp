@@ -5,8 +5,10 @@
 #include <boost/enable_shared_from_this.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/shared_ptr.hpp>
+#include <handover/handover.hpp>
 #include <rtsp/commands.hpp>
 #include <state/sessions.hpp>
+#include <stop_token>
 #include <string_view>
 #include <thread>
 #include <utility>
@@ -66,9 +68,10 @@ public:
     receive_message([self = shared_from_this()](auto parsed_msg) {
       if (parsed_msg) {
         auto user_ip = self->socket().remote_endpoint().address().to_string();
-        auto session = state::get_session_by_ip(self->stream_sessions->load(), user_ip);
-        if (session) {
-          auto response = commands::message_handler(parsed_msg.value(), session.value());
+        // No copy of the session: the index keeps it alive while we build the response
+        auto sessions_index = self->stream_sessions->load_index();
+        if (auto session = state::find_session_by_ip(sessions_index, user_ip)) {
+          auto response = commands::message_handler(parsed_msg.value(), *session);
           self->send_message(response, [self](auto bytes) { self->close(); });
         } else {
           logs::log(logs::warning, "[RTSP] received packet from unrecognised client: {}", user_ip);
@@ -190,14 +193,36 @@ protected:
 class tcp_server {
 public:
   tcp_server(boost::asio::io_context &io_context, int port, state::SessionsAtoms state)
-      : io_context_(io_context), acceptor_(io_context, tcp::endpoint(tcp::v4(), port)),
-        stream_sessions(std::move(state)) {
-    acceptor_.set_option(boost::asio::socket_base::reuse_address{true});
-    acceptor_.listen(4096);
+      : io_context_(io_context), acceptor_(make_acceptor(io_context, port)), stream_sessions(std::move(state)) {
+    handover::Sockets::get().publish("rtsp", acceptor_.native_handle());
     start_accept();
   }
 
+  ~tcp_server() {
+    handover::Sockets::get().unpublish("rtsp");
+  }
+
 private:
+  /**
+   * Adopts the listening socket of the previous Wolf process when there is one, so that no connection gets refused
+   * while restarting.
+   */
+  static tcp::acceptor make_acceptor(boost::asio::io_context &io_context, int port) {
+    if (auto fd = handover::Sockets::get().take_inherited("rtsp")) {
+      tcp::acceptor inherited(io_context, tcp::v4(), *fd);
+      if (inherited.local_endpoint().port() == port) {
+        logs::log(logs::info, "[RTSP] Using the socket of the previous process");
+        return inherited;
+      }
+      logs::log(logs::warning, "[RTSP] The previous process was listening on a different port, ignoring it");
+    }
+
+    tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), port));
+    acceptor.set_option(boost::asio::socket_base::reuse_address{true});
+    acceptor.listen(4096);
+    return acceptor;
+  }
+
   /**
    * Creates a socket and initiates an asynchronous accept operation to wait for a new connection
    */
@@ -228,12 +253,13 @@ private:
 };
 
 /**
- * Starts a new RTSP server, calling this method will block execution.
+ * Starts a new RTSP server, calling this method will block execution until a stop is requested.
  */
-void run_server(int port, const state::SessionsAtoms &running_sessions) {
+void run_server(int port, const state::SessionsAtoms &running_sessions, std::stop_token stop_token = {}) {
   try {
     boost::asio::io_context io_context;
     tcp_server server(io_context, port, running_sessions);
+    std::stop_callback stop_server(stop_token, [&io_context]() { io_context.stop(); });
 
     logs::log(logs::info, "RTSP server started on port: {}", port);
 
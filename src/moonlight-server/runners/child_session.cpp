@@ -16,8 +16,8 @@ void RunChildSession::run(std::size_t session_id,
                           const immer::map<std::string, std::string> &env_variables,
                           std::string_view render_node) {
 
-  auto child_session = state::get_session_by_id(running_sessions->load(), session_id);
-  auto parent_session = state::get_session_by_id(running_sessions->load(), parent_session_id);
+  auto child_session = state::get_session_by_id(running_sessions->load_index(), session_id);
+  auto parent_session = state::get_session_by_id(running_sessions->load_index(), parent_session_id);
 
   if (!child_session.has_value() || !parent_session.has_value()) {
     logs::log(logs::error, "Unable to run child session, could not find parent or child session");
@@ -51,25 +51,25 @@ void RunChildSession::run(std::size_t session_id,
   /* true when this session should quit */
   std::shared_ptr<std::atomic_bool> is_over = std::make_shared<std::atomic<bool>>(false);
 
-  auto stop_handler = ev_bus->register_handler<immer::box<events::StopStreamEvent>>(
-      [session_id, parent_session_id = parent_session_id, is_over](
-          const immer::box<events::StopStreamEvent> &terminate_ev) {
-        if (terminate_ev->session_id == session_id || terminate_ev->session_id == parent_session_id) {
-          *is_over = true;
-        }
-      });
+  // The child session is over when either itself or its parent is stopped
+  auto on_stop = [is_over, plugged_devices_queue](const immer::box<events::StopStreamEvent> &terminate_ev) {
+    *is_over = true;
+    plugged_devices_queue->close();
+  };
+  auto stop_handler = ev_bus->register_session_handler<immer::box<events::StopStreamEvent>>(session_id, on_stop);
+  auto parent_stop_handler =
+      ev_bus->register_session_handler<immer::box<events::StopStreamEvent>>(parent_session_id, on_stop);
 
-  auto unplug_handler = ev_bus->register_handler<immer::box<events::UnplugDeviceEvent>>(
-      [session_id, parent_id = parent_session_id, ev_bus = ev_bus](const immer::box<events::UnplugDeviceEvent> &ev) {
-        if (ev->session_id == session_id) {
-          events::UnplugDeviceEvent unplug_ev = *ev;
-          unplug_ev.session_id = parent_id;
-          ev_bus->fire_event(immer::box<events::UnplugDeviceEvent>(unplug_ev));
-        }
+  auto unplug_handler = ev_bus->register_session_handler<immer::box<events::UnplugDeviceEvent>>(
+      session_id,
+      [parent_id = parent_session_id, ev_bus = ev_bus](const immer::box<events::UnplugDeviceEvent> &ev) {
+        events::UnplugDeviceEvent unplug_ev = *ev;
+        unplug_ev.session_id = parent_id;
+        ev_bus->fire_event(immer::box<events::UnplugDeviceEvent>(unplug_ev));
       });
 
-  while (!*is_over) {
-    while (auto device_ev = plugged_devices_queue->pop(500ms)) {
+  while (!*is_over && !plugged_devices_queue->is_closed()) {
+    while (auto device_ev = plugged_devices_queue->try_pop()) {
       if (device_ev->get().session_id == session_id) {
         events::PlugDeviceEvent plug_ev = device_ev->get();
         plug_ev.session_id = parent_session_id;
@@ -77,6 +77,7 @@ void RunChildSession::run(std::size_t session_id,
         plugged_devices.push_back(plug_ev);
       }
     }
+    plugged_devices_queue->wait();
   }
 
   // This child session is over, unplug all devices that we've plugged
@@ -120,45 +120,50 @@ void RunDocker::run(std::size_t session_id,
                              .devices = devices,
                              .env = full_env};
 
+  auto container_start = streaming::startup::clock::now();
   if (auto docker_container = docker_api.create(new_container, final_json_opts)) {
     auto container_id = docker_container->id;
     docker_api.start_by_id(container_id);
+    streaming::startup::Registry::get().record(session_id, "Docker container start", container_start);
 
     logs::log(logs::info, "[DOCKER] Starting container: {}", docker_container->name);
     logs::log(logs::debug, "[DOCKER] Starting container: {}", *docker_container);
 
-    auto terminate_handler = this->ev_bus->register_handler<immer::box<events::StopStreamEvent>>(
-        [session_id, container_id, this](const immer::box<events::StopStreamEvent> &terminate_ev) {
-          if (terminate_ev->session_id == session_id) {
-            docker_api.stop_by_id(container_id);
+    // Stopping a container can take up to the Docker stop timeout: it's done below by this thread so that stopping
+    // many sessions at once doesn't queue them up on the shared blocking pool
+    std::atomic<bool> stop_requested = false;
+    auto terminate_handler = this->ev_bus->register_session_handler<immer::box<events::StopStreamEvent>>(
+        session_id,
+        [&stop_requested](const immer::box<events::StopStreamEvent> &terminate_ev) { stop_requested = true; });
+
+    // Docker API calls can be slow: don't block the thread that fired the event
+    auto docker_executor = events::Executor::blocking_strand();
+
+    auto unplug_device_handler = this->ev_bus->register_session_handler<immer::box<events::UnplugDeviceEvent>>(
+        session_id,
+        docker_executor,
+        [container_id, hw_db_path, this](const immer::box<events::UnplugDeviceEvent> &ev) {
+          for (const auto &[filename, content] : ev->udev_hw_db_entries) {
+            std::filesystem::remove(hw_db_path / filename);
           }
-        });
-
-    auto unplug_device_handler = this->ev_bus->register_handler<immer::box<events::UnplugDeviceEvent>>(
-        [session_id, container_id, hw_db_path, this](const immer::box<events::UnplugDeviceEvent> &ev) {
-          if (ev->session_id == session_id) {
-            for (const auto &[filename, content] : ev->udev_hw_db_entries) {
-              std::filesystem::remove(hw_db_path / filename);
-            }
 
-            for (auto udev_ev : ev->udev_events) {
-              udev_ev["ACTION"] = "remove";
-              std::string udev_msg = base64_encode(map_to_string(udev_ev));
-              std::string cmd;
-              if (udev_ev.count("DEVNAME") == 0) {
-                cmd = fmt::format("fake-udev -m {}", udev_msg);
-              } else {
-                cmd = fmt::format("fake-udev -m {} && rm {}", udev_msg, udev_ev["DEVNAME"]);
-              }
-              logs::log(logs::debug, "[DOCKER] Executing command: {}", cmd);
-              docker_api.exec(container_id, {"/bin/bash", "-c", cmd}, "root");
+          for (auto udev_ev : ev->udev_events) {
+            udev_ev["ACTION"] = "remove";
+            std::string udev_msg = base64_encode(map_to_string(udev_ev));
+            std::string cmd;
+            if (udev_ev.count("DEVNAME") == 0) {
+              cmd = fmt::format("fake-udev -m {}", udev_msg);
+            } else {
+              cmd = fmt::format("fake-udev -m {} && rm {}", udev_msg, udev_ev["DEVNAME"]);
             }
+            logs::log(logs::debug, "[DOCKER] Executing command: {}", cmd);
+            docker_api.exec(container_id, {"/bin/bash", "-c", cmd}, "root");
           }
         });
 
     do {
       // Plug all devices that are waiting in the queue
-      while (auto device_ev = plugged_devices_queue->pop(50ms)) {
+      while (auto device_ev = plugged_devices_queue->try_pop()) {
         if (device_ev->get().session_id == session_id) {
           if (use_fake_udev) {
             create_udev_hw_files(hw_db_path, device_ev->get().udev_hw_db_entries);
@@ -183,9 +188,17 @@ void RunDocker::run(std::size_t session_id,
         }
       }
 
-      std::this_thread::sleep_for(500ms);
+      // Wakes up as soon as a device is plugged, the container status is checked at least every 500ms
+      if (plugged_devices_queue->is_closed()) {
+        std::this_thread::sleep_for(500ms);
+      } else {
+        plugged_devices_queue->wait(500ms);
+      }
+    } while (!stop_requested && docker_api.get_by_id(container_id)->status == RUNNING);
 
-    } while (docker_api.get_by_id(container_id)->status == RUNNING);
+    if (stop_requested) {
+      docker_api.stop_by_id(container_id);
+    }
 
     logs::log(logs::debug, "[DOCKER] Container logs: \n{}", docker_api.get_logs(container_id));
     logs::log(logs::debug, "[DOCKER] Stopping container: {}", docker_container->name);
@@ -11,6 +11,7 @@
 #include <platforms/hw.hpp>
 #include <range/v3/view.hpp>
 #include <state/data-structures.hpp>
+#include <streaming/startup.hpp>
 #include <utility>
 
 namespace wolf::core::docker {
@@ -43,11 +43,10 @@ void RunProcess::run(std::size_t session_id,
     return;
   }
 
-  auto terminate_handler = this->ev_bus->register_handler<immer::box<StopStreamEvent>>(
-      [&group_proc, session_id](const immer::box<StopStreamEvent> &terminate_ev) {
-        if (terminate_ev->session_id == session_id) {
-          group_proc.terminate(); // Manually terminate the process
-        }
+  auto terminate_handler = this->ev_bus->register_session_handler<immer::box<StopStreamEvent>>(
+      session_id,
+      [&group_proc](const immer::box<StopStreamEvent> &terminate_ev) {
+        group_proc.terminate(); // Manually terminate the process
       });
 
   ios.run();         // This will stop here until the process is over
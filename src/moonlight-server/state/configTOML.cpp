@@ -242,7 +242,8 @@ Config load_or_default(const std::string &source,
                         .start_virtual_compositor = app.start_virtual_compositor.value_or(true),
                         .start_audio_server = app.start_audio_server.value_or(true),
                         .runner = get_runner(app.runner, ev_bus, running_sessions),
-                        .joypad_type = get_controller_type(app.joypad_type.value_or(ControllerType::AUTO))}};
+                        .joypad_type = get_controller_type(app.joypad_type.value_or(ControllerType::AUTO)),
+                        .input_coalescing_window_us = app.input_coalescing_window_us}};
       }) |                                                  //
       ranges::to<immer::vector<immer::box<events::App>>>(); //
 
@@ -254,7 +255,8 @@ Config load_or_default(const std::string &source,
                 .support_hevc = hevc_encoder.has_value(),
                 .support_av1 = av1_encoder.has_value() && encoder_type(*av1_encoder) != SOFTWARE,
                 .paired_clients = clients_atom,
-                .apps = apps_atom};
+                .apps = apps_atom,
+                .threads = cfg.threads.value_or(ThreadsCfg{})};
 }
 
 void pair(const Config &cfg, const PairedClient &client) {
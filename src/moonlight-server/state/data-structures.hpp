@@ -1,24 +1,35 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <boost/asio.hpp>
 #include <chrono>
+#include <cstdint>
 #include <core/audio.hpp>
 #include <core/input.hpp>
 #include <core/virtual-display.hpp>
 #include <deque>
 #include <eventbus/event_bus.hpp>
 #include <events/events.hpp>
-#include <helpers/tsqueue.hpp>
+#include <fmt/format.h>
+#include <helpers/mpmc_queue.hpp>
+#include <helpers/utils.hpp>
 #include <immer/array.hpp>
 #include <immer/atom.hpp>
 #include <immer/box.hpp>
 #include <immer/map.hpp>
+#include <immer/map_transient.hpp>
+#include <immer/set.hpp>
 #include <immer/vector.hpp>
+#include <memory>
 #include <moonlight/control.hpp>
 #include <moonlight/data-structures.hpp>
 #include <openssl/x509.h>
 #include <optional>
 #include <state/serialised_config.hpp>
+#include <stdexcept>
 #include <utility>
 
 namespace state {
@@ -38,6 +49,34 @@ enum STANDARD_PORTS_MAPPING {
   RTSP_SETUP_PORT = 48010
 };
 
+/**
+ * The control server can run multiple ENet hosts, each one on its own thread, listening on CONTROL_PORT + shard.
+ * Ports are taken from the range between CONTROL_PORT and RTSP_SETUP_PORT.
+ */
+static constexpr int MAX_CONTROL_SHARDS = RTSP_SETUP_PORT - CONTROL_PORT;
+
+inline int get_control_shards() {
+  static const int shards =
+      std::clamp(std::stoi(utils::get_env("WOLF_CONTROL_SHARDS", "1")), 1, static_cast<int>(MAX_CONTROL_SHARDS));
+  return shards;
+}
+
+/**
+ * The port of the first control shard, CONTROL_PORT unless we have taken over from a process that is still listening
+ * there (see handover::pick_control_port())
+ */
+inline std::atomic<unsigned short> &control_port_base() {
+  static std::atomic<unsigned short> base = CONTROL_PORT;
+  return base;
+}
+
+/**
+ * Sessions are spread over the control shards based on their id, the client is told which port to use over RTSP
+ */
+inline unsigned short get_control_port(std::size_t session_id) {
+  return control_port_base() + session_id % get_control_shards();
+}
+
 using PairedClientList = immer::vector<immer::box<wolf::config::PairedClient>>;
 
 enum Encoder {
@@ -69,6 +108,11 @@ struct Config {
    * List of available Apps
    */
   std::shared_ptr<immer::atom<immer::vector<immer::box<events::App>>>> apps;
+
+  /**
+   * CPU affinity and scheduling of the long-running threads, see platforms/threads.hpp
+   */
+  wolf::config::ThreadsCfg threads;
 };
 
 /**
@@ -99,7 +143,263 @@ struct PairCache {
   std::optional<std::string> client_hash;
 };
 
-using SessionsAtoms = std::shared_ptr<immer::atom<immer::vector<events::StreamSession>>>;
+/**
+ * Video and audio RTP ports are handed out from a fixed range: one bit for each port.
+ * Like the rest of the running sessions state this is immutable, set() and release() return an updated copy.
+ */
+class PortAllocator {
+public:
+  /* 48100-48199 for video, 48200-48299 for audio */
+  static constexpr std::size_t MAX_PORTS = AUDIO_PING_PORT - VIDEO_PING_PORT;
+
+  explicit PortAllocator(unsigned short base_port) : base_port(base_port) {}
+
+  /**
+   * @return the lowest port that isn't used by any session, empty if all the ports are taken
+   */
+  [[nodiscard]] std::optional<unsigned short> next_available() const {
+    for (std::size_t word = 0; word < used.size(); word++) {
+      if (used[word] != ~std::uint64_t{0}) {
+        auto bit = word * 64 + std::countr_one(used[word]);
+        if (bit < MAX_PORTS) {
+          return static_cast<unsigned short>(base_port + bit);
+        }
+      }
+    }
+    return {};
+  }
+
+  [[nodiscard]] bool is_used(unsigned short port) const {
+    return in_range(port) && (used[(port - base_port) / 64] & mask(port)) != 0;
+  }
+
+  [[nodiscard]] PortAllocator set(unsigned short port) const {
+    auto res = *this;
+    if (in_range(port)) {
+      res.used[(port - base_port) / 64] |= mask(port);
+    }
+    return res;
+  }
+
+  [[nodiscard]] PortAllocator release(unsigned short port) const {
+    auto res = *this;
+    if (in_range(port)) {
+      res.used[(port - base_port) / 64] &= ~mask(port);
+    }
+    return res;
+  }
+
+private:
+  [[nodiscard]] bool in_range(unsigned short port) const {
+    return port >= base_port && port < base_port + MAX_PORTS;
+  }
+
+  [[nodiscard]] std::uint64_t mask(unsigned short port) const {
+    return std::uint64_t{1} << ((port - base_port) % 64);
+  }
+
+  unsigned short base_port;
+  std::array<std::uint64_t, (MAX_PORTS + 63) / 64> used = {};
+};
+
+/**
+ * A cheap reference to a running session: the session is stored once, when it's added to RunningSessions, and
+ * shared by all the handles; copying a handle doesn't copy (or bump the refcount of) any of the session fields.
+ *
+ * Hot paths (control packets, input) keep the handle around and only check is_current() before using it,
+ * a relaxed atomic load, instead of looking up the session again for each packet.
+ */
+class SessionHandle {
+public:
+  SessionHandle() = default;
+
+  explicit SessionHandle(events::StreamSession session)
+      : entry(std::make_shared<Entry>(std::move(session))) {}
+
+  [[nodiscard]] std::size_t id() const {
+    return entry->session.session_id;
+  }
+
+  /**
+   * false once the session has been removed or replaced (ex: when resuming, the encryption keys change)
+   */
+  [[nodiscard]] bool is_current() const {
+    return entry && !entry->retired.load(std::memory_order_relaxed);
+  }
+
+  const events::StreamSession &operator*() const {
+    return entry->session;
+  }
+
+  const events::StreamSession *operator->() const {
+    return &entry->session;
+  }
+
+  explicit operator bool() const {
+    return entry != nullptr;
+  }
+
+private:
+  friend class RunningSessions;
+
+  struct Entry {
+    explicit Entry(events::StreamSession session) : session(std::move(session)) {}
+
+    const events::StreamSession session;
+    std::atomic<bool> retired = false;
+  };
+
+  void retire() const {
+    entry->retired.store(true, std::memory_order_relaxed);
+  }
+
+  std::shared_ptr<Entry> entry;
+};
+
+/**
+ * The running sessions, keyed by session id, together with the lookup tables and the allocated ports.
+ * Adding or removing a session only touches the entries of that session, so that hot paths (control, RTSP, HTTP)
+ * can find a session with a single hash probe and updates stay cheap with hundreds of sessions.
+ */
+struct SessionsIndex {
+  immer::map<std::size_t, SessionHandle> by_id;
+  /* More than one session for an IP makes lookups by IP ambiguous */
+  immer::map<std::string, immer::set<std::size_t>> by_ip;
+  PortAllocator video_ports = PortAllocator(VIDEO_PING_PORT);
+  PortAllocator audio_ports = PortAllocator(AUDIO_PING_PORT);
+};
+
+/**
+ * Removes the session with the given id, if present
+ */
+inline SessionsIndex remove_session(const SessionsIndex &index, std::size_t session_id) {
+  auto handle = index.by_id.find(session_id);
+  if (!handle) {
+    return index;
+  }
+
+  const auto &session = **handle;
+  auto res = index;
+  res.by_id = index.by_id.erase(session_id);
+  if (auto ip_sessions = index.by_ip.find(session.ip)) {
+    auto remaining = ip_sessions->erase(session_id);
+    res.by_ip = remaining.empty() ? index.by_ip.erase(session.ip) : index.by_ip.set(session.ip, remaining);
+  }
+  res.video_ports = index.video_ports.release(session.video_stream_port);
+  res.audio_ports = index.audio_ports.release(session.audio_stream_port);
+  return res;
+}
+
+/**
+ * Adds the session, replacing the one with the same id (ex: when resuming)
+ */
+inline SessionsIndex add_session(const SessionsIndex &index, const SessionHandle &handle) {
+  const auto &session = *handle;
+  auto res = remove_session(index, session.session_id);
+  res.by_id = res.by_id.set(session.session_id, handle);
+  auto ip_sessions = res.by_ip.find(session.ip);
+  auto same_ip = ip_sessions ? *ip_sessions : immer::set<std::size_t>{};
+  res.by_ip = res.by_ip.set(session.ip, same_ip.insert(session.session_id));
+  res.video_ports = res.video_ports.set(session.video_stream_port);
+  res.audio_ports = res.audio_ports.set(session.audio_stream_port);
+  return res;
+}
+
+/**
+ * The running (and paused) sessions, shared between all the threads; updates are atomic.
+ */
+class RunningSessions {
+public:
+  using value_type = immer::map<std::size_t, SessionHandle>;
+
+  [[nodiscard]] value_type load() const {
+    return snapshot.load()->by_id;
+  }
+
+  [[nodiscard]] immer::box<SessionsIndex> load_index() const {
+    return snapshot.load();
+  }
+
+  /**
+   * Adds a new session, or replaces the one with the same id
+   */
+  void add(const events::StreamSession &session) {
+    auto handle = SessionHandle(session);
+    SessionHandle previous;
+    snapshot.update([&](const SessionsIndex &current) {
+      auto found = current.by_id.find(session.session_id);
+      previous = found ? *found : SessionHandle{};
+      return add_session(current, handle);
+    });
+    if (previous) {
+      previous.retire();
+    }
+  }
+
+  void remove(std::size_t session_id) {
+    SessionHandle previous;
+    snapshot.update([&](const SessionsIndex &current) {
+      auto found = current.by_id.find(session_id);
+      previous = found ? *found : SessionHandle{};
+      return remove_session(current, session_id);
+    });
+    if (previous) {
+      previous.retire();
+    }
+  }
+
+  /**
+   * Picks the lowest free video and audio ports and marks them as used in a single update, so that two sessions
+   * being created at the same time can't get the same ports. add() takes them over, if the session is never added
+   * they have to be given back with release_ports().
+   * @throws std::runtime_error when all the ports in the range are taken
+   */
+  std::pair<unsigned short, unsigned short> allocate_ports() {
+    std::optional<unsigned short> video_port, audio_port;
+    snapshot.update([&](const SessionsIndex &current) {
+      video_port = current.video_ports.next_available();
+      audio_port = current.audio_ports.next_available();
+      if (!video_port || !audio_port) {
+        return current;
+      }
+      auto res = current;
+      res.video_ports = current.video_ports.set(*video_port);
+      res.audio_ports = current.audio_ports.set(*audio_port);
+      return res;
+    });
+    if (!video_port || !audio_port) {
+      throw std::runtime_error(
+          fmt::format("No {} port available, too many sessions running", video_port ? "audio" : "video"));
+    }
+    return {*video_port, *audio_port};
+  }
+
+  /**
+   * Marks the ports as used without adding a session: they are still streaming from a previous Wolf process
+   */
+  void reserve_ports(unsigned short video_port, unsigned short audio_port) {
+    snapshot.update([&](const SessionsIndex &current) {
+      auto res = current;
+      res.video_ports = current.video_ports.set(video_port);
+      res.audio_ports = current.audio_ports.set(audio_port);
+      return res;
+    });
+  }
+
+  void release_ports(unsigned short video_port, unsigned short audio_port) {
+    snapshot.update([&](const SessionsIndex &current) {
+      auto res = current;
+      res.video_ports = current.video_ports.release(video_port);
+      res.audio_ports = current.audio_ports.release(audio_port);
+      return res;
+    });
+  }
+
+private:
+  immer::atom<SessionsIndex> snapshot;
+};
+
+using SessionsAtoms = std::shared_ptr<RunningSessions>;
 
 /**
  * The whole application state as a composition of immutable datastructures
@@ -137,16 +437,27 @@ struct AppState {
   SessionsAtoms running_sessions;
 };
 
+/**
+ * For each channel layout: the normal quality configuration followed by the high quality one.
+ * Moonlight will pick the first advertised `surround-params` for the requested channels as normal quality
+ * and the second one as high quality.
+ *
+ * High quality surround encodes each channel as a separate (uncoupled) stream, this is only possible using our own
+ * `moonlightopusenc`; the upstream `opusenc` hardcodes the number of streams.
+ */
 const static immer::array<audio::AudioMode> AUDIO_CONFIGURATIONS = {
-    // TODO: opusenc doesn't allow us to set `coupled_streams` and `streams`
-    //       don't change these or Moonlight will not be able to decode audio
-    //       https://gitlab.freedesktop.org/gstreamer/gstreamer/-/blob/1.24.6/subprojects/gst-plugins-base/ext/opus/gstopusenc.c#L661-666
     {// Stereo
      {.channels = 2,
       .streams = 1,
       .coupled_streams = 1,
       .speakers = {audio::AudioMode::Speakers::FRONT_LEFT, audio::AudioMode::Speakers::FRONT_RIGHT},
       .bitrate = 96000},
+     // High quality stereo
+     {.channels = 2,
+      .streams = 1,
+      .coupled_streams = 1,
+      .speakers = {audio::AudioMode::Speakers::FRONT_LEFT, audio::AudioMode::Speakers::FRONT_RIGHT},
+      .bitrate = 512000},
      // 5.1
      {.channels = 6,
       .streams = 4,
@@ -158,6 +469,17 @@ const static immer::array<audio::AudioMode> AUDIO_CONFIGURATIONS = {
                    audio::AudioMode::Speakers::BACK_LEFT,
                    audio::AudioMode::Speakers::BACK_RIGHT},
       .bitrate = 256000},
+     // High quality 5.1
+     {.channels = 6,
+      .streams = 6,
+      .coupled_streams = 0,
+      .speakers = {audio::AudioMode::Speakers::FRONT_LEFT,
+                   audio::AudioMode::Speakers::FRONT_RIGHT,
+                   audio::AudioMode::Speakers::FRONT_CENTER,
+                   audio::AudioMode::Speakers::LOW_FREQUENCY,
+                   audio::AudioMode::Speakers::BACK_LEFT,
+                   audio::AudioMode::Speakers::BACK_RIGHT},
+      .bitrate = 1536000},
      // 7.1
      {.channels = 8,
       .streams = 5,
@@ -170,7 +492,20 @@ const static immer::array<audio::AudioMode> AUDIO_CONFIGURATIONS = {
                    audio::AudioMode::Speakers::BACK_RIGHT,
                    audio::AudioMode::Speakers::SIDE_LEFT,
                    audio::AudioMode::Speakers::SIDE_RIGHT},
-      .bitrate = 450000}}};
+      .bitrate = 450000},
+     // High quality 7.1
+     {.channels = 8,
+      .streams = 8,
+      .coupled_streams = 0,
+      .speakers = {audio::AudioMode::Speakers::FRONT_LEFT,
+                   audio::AudioMode::Speakers::FRONT_RIGHT,
+                   audio::AudioMode::Speakers::FRONT_CENTER,
+                   audio::AudioMode::Speakers::LOW_FREQUENCY,
+                   audio::AudioMode::Speakers::BACK_LEFT,
+                   audio::AudioMode::Speakers::BACK_RIGHT,
+                   audio::AudioMode::Speakers::SIDE_LEFT,
+                   audio::AudioMode::Speakers::SIDE_RIGHT},
+      .bitrate = 2048000}}};
 
 static const audio::AudioMode &get_audio_mode(int channels, bool high_quality) {
   int base_index = 0;
@@ -180,8 +515,7 @@ static const audio::AudioMode &get_audio_mode(int channels, bool high_quality) {
     base_index = 4;
   }
 
-  return AUDIO_CONFIGURATIONS[base_index]; // TODO: add high quality settings, it sounds bad if we can't change the
-                                           //       opusenc settings too..
+  return AUDIO_CONFIGURATIONS[base_index + (high_quality ? 1 : 0)];
 }
 
 /**
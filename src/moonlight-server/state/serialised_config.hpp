@@ -97,9 +97,31 @@ struct BaseApp {
   std::optional<ControllerType> joypad_type;
   std::optional<bool> start_virtual_compositor;
   std::optional<bool> start_audio_server;
+  std::optional<int> input_coalescing_window_us;
   rfl::TaggedUnion<"type", AppCMD, AppDocker, AppChildSession> runner;
 };
 
+enum class ThreadScheduling {
+  OTHER,
+  FIFO,
+  RR
+};
+
+struct ThreadRoleCfg {
+  std::optional<std::vector<int>> cpus;
+  std::optional<ThreadScheduling> scheduling;
+  /* Only used by FIFO and RR, between 1 and 99 */
+  std::optional<int> priority;
+  std::optional<int> nice;
+};
+
+struct ThreadsCfg {
+  std::optional<ThreadRoleCfg> control;
+  std::optional<ThreadRoleCfg> video;
+  std::optional<ThreadRoleCfg> audio;
+  std::optional<ThreadRoleCfg> api;
+};
+
 struct WolfConfig {
   std::string hostname;
   std::string uuid;
@@ -107,6 +129,7 @@ struct WolfConfig {
   std::vector<PairedClient> paired_clients;
   std::vector<BaseApp> apps;
   GstreamerSettings gstreamer;
+  std::optional<ThreadsCfg> threads;
 };
 
 struct BaseConfig {
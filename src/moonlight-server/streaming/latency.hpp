@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <helpers/utils.hpp>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Opt-in (WOLF_LATENCY_TRACING=TRUE) tracing of the input to photon path of a session.
+ *
+ * An input event is timestamped when:
+ *  - receive: the control thread gets the ENet packet
+ *  - inject: handle_input() has written it to the virtual device
+ *  - capture: the next frame is pulled out of the Wayland compositor (custom_src::push_data)
+ *  - send: the next frame has been encoded and split into RTP packets by the video payloader
+ *
+ * Only the first input that comes after a frame is tracked, all the others are part of the same frame anyway.
+ * This doesn't know if the app did react to the input in the captured frame, it's the best case: the time the input
+ * spent in Wolf plus how long the app had to render it.
+ */
+namespace streaming::latency {
+
+using clock = std::chrono::steady_clock;
+
+inline bool is_enabled() {
+  static const bool enabled = std::string(utils::get_env("WOLF_LATENCY_TRACING", "FALSE")) == "TRUE";
+  return enabled;
+}
+
+struct HistogramBucket {
+  /* Empty for the last bucket, which holds everything above the previous one */
+  std::optional<std::int64_t> upper_bound_us;
+  std::uint64_t count;
+};
+
+struct HistogramSnapshot {
+  std::uint64_t count;
+  double mean_us;
+  std::int64_t max_us;
+  /* Percentiles are approximated to the upper bound of the bucket they fall in */
+  std::int64_t p50_us;
+  std::int64_t p99_us;
+  std::vector<HistogramBucket> buckets;
+};
+
+/**
+ * Fixed, roughly exponential, buckets: from sub millisecond up to a few frames at 60 FPS
+ */
+class Histogram {
+public:
+  static constexpr std::array<std::int64_t, 12> BUCKETS_US =
+      {100, 250, 500, 1'000, 2'000, 4'000, 8'000, 16'000, 33'000, 66'000, 133'000, 266'000};
+
+  void record(std::chrono::microseconds duration) {
+    auto us = std::max<std::int64_t>(duration.count(), 0);
+    auto bucket = std::lower_bound(BUCKETS_US.begin(), BUCKETS_US.end(), us) - BUCKETS_US.begin();
+    counts[bucket]++;
+    count++;
+    sum_us += us;
+    max_us = std::max(max_us, us);
+  }
+
+  [[nodiscard]] HistogramSnapshot snapshot() const {
+    HistogramSnapshot res = {.count = count,
+                             .mean_us = count == 0 ? 0.0 : static_cast<double>(sum_us) / count,
+                             .max_us = max_us,
+                             .p50_us = percentile(0.5),
+                             .p99_us = percentile(0.99)};
+    for (std::size_t i = 0; i < counts.size(); i++) {
+      res.buckets.push_back({.upper_bound_us = i < BUCKETS_US.size() ? std::optional(BUCKETS_US[i]) : std::nullopt,
+                             .count = counts[i]});
+    }
+    return res;
+  }
+
+private:
+  [[nodiscard]] std::int64_t percentile(double p) const {
+    if (count == 0) {
+      return 0;
+    }
+    auto target = std::max<std::uint64_t>(1, static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(count))));
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKETS_US.size(); i++) {
+      seen += counts[i];
+      if (seen >= target) {
+        return std::min(BUCKETS_US[i], max_us);
+      }
+    }
+    return max_us;
+  }
+
+  std::array<std::uint64_t, BUCKETS_US.size() + 1> counts = {};
+  std::uint64_t count = 0;
+  std::int64_t sum_us = 0;
+  std::int64_t max_us = 0;
+};
+
+/**
+ * The timestamps of a single input event, all the way to the frame that has been sent
+ */
+struct Trace {
+  clock::time_point received;
+  clock::time_point injected;
+  clock::time_point captured;
+  clock::time_point sent;
+};
+
+struct SessionLatencySnapshot {
+  std::string session_id;
+  HistogramSnapshot receive_to_inject;
+  HistogramSnapshot inject_to_capture;
+  HistogramSnapshot capture_to_send;
+  HistogramSnapshot receive_to_send;
+};
+
+/**
+ * Each stage is called from a different thread (input worker, Wayland producer, video pipeline),
+ * since this is opt-in we just guard everything with a mutex.
+ */
+class SessionTracer {
+public:
+  /**
+   * How many complete traces we keep for the Chrome trace export
+   */
+  static constexpr std::size_t MAX_TRACES = 512;
+
+  explicit SessionTracer(std::size_t session_id) : session_id(session_id) {}
+
+  void on_inject(clock::time_point received, clock::time_point injected = clock::now()) {
+    std::lock_guard lock(m);
+    receive_to_inject.record(std::chrono::duration_cast<std::chrono::microseconds>(injected - received));
+    if (!waiting_capture) {
+      waiting_capture = Trace{.received = received, .injected = injected};
+    }
+  }
+
+  void on_capture(clock::time_point captured = clock::now()) {
+    std::lock_guard lock(m);
+    if (!waiting_capture) {
+      return;
+    }
+    waiting_capture->captured = captured;
+    inject_to_capture.record(
+        std::chrono::duration_cast<std::chrono::microseconds>(captured - waiting_capture->injected));
+    // If the previous frame didn't make it out yet we'll attribute it to the oldest input
+    if (!waiting_send) {
+      waiting_send = waiting_capture;
+    }
+    waiting_capture.reset();
+  }
+
+  void on_send(clock::time_point sent = clock::now()) {
+    std::lock_guard lock(m);
+    if (!waiting_send) {
+      return;
+    }
+    waiting_send->sent = sent;
+    capture_to_send.record(std::chrono::duration_cast<std::chrono::microseconds>(sent - waiting_send->captured));
+    receive_to_send.record(std::chrono::duration_cast<std::chrono::microseconds>(sent - waiting_send->received));
+    if (traces.size() >= MAX_TRACES) {
+      traces.pop_front();
+    }
+    traces.push_back(*waiting_send);
+    waiting_send.reset();
+  }
+
+  [[nodiscard]] SessionLatencySnapshot snapshot() const {
+    std::lock_guard lock(m);
+    return {.session_id = std::to_string(session_id),
+            .receive_to_inject = receive_to_inject.snapshot(),
+            .inject_to_capture = inject_to_capture.snapshot(),
+            .capture_to_send = capture_to_send.snapshot(),
+            .receive_to_send = receive_to_send.snapshot()};
+  }
+
+  [[nodiscard]] std::vector<Trace> get_traces() const {
+    std::lock_guard lock(m);
+    return {traces.begin(), traces.end()};
+  }
+
+  [[nodiscard]] std::size_t get_session_id() const {
+    return session_id;
+  }
+
+private:
+  std::size_t session_id;
+  mutable std::mutex m;
+
+  std::optional<Trace> waiting_capture;
+  std::optional<Trace> waiting_send;
+  std::deque<Trace> traces;
+
+  Histogram receive_to_inject;
+  Histogram inject_to_capture;
+  Histogram capture_to_send;
+  Histogram receive_to_send;
+};
+
+/**
+ * Tracers are looked up once when the pipelines (or the input worker) are created, not on the hot path
+ */
+class Registry {
+public:
+  static Registry &get() {
+    static Registry registry;
+    return registry;
+  }
+
+  /**
+   * @return the tracer for the session, nullptr if tracing is disabled
+   */
+  std::shared_ptr<SessionTracer> get_or_create(std::size_t session_id) {
+    if (!is_enabled()) {
+      return nullptr;
+    }
+    std::lock_guard lock(m);
+    auto &tracer = tracers[session_id];
+    if (!tracer) {
+      tracer = std::make_shared<SessionTracer>(session_id);
+    }
+    return tracer;
+  }
+
+  void remove(std::size_t session_id) {
+    std::lock_guard lock(m);
+    tracers.erase(session_id);
+  }
+
+  std::vector<std::shared_ptr<SessionTracer>> get_all() {
+    std::lock_guard lock(m);
+    std::vector<std::shared_ptr<SessionTracer>> res;
+    for (const auto &[_, tracer] : tracers) {
+      res.push_back(tracer);
+    }
+    return res;
+  }
+
+private:
+  std::mutex m;
+  std::unordered_map<std::size_t, std::shared_ptr<SessionTracer>> tracers;
+};
+
+/**
+ * Trace Event Format (https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU)
+ * loadable in chrome://tracing and https://ui.perfetto.dev
+ */
+struct ChromeTraceEvent {
+  std::string name;
+  std::string ph = "X";
+  std::int64_t ts;  // microseconds
+  std::int64_t dur; // microseconds
+  std::size_t pid;  // the session
+  int tid;          // the stage
+};
+
+struct ChromeTrace {
+  std::vector<ChromeTraceEvent> traceEvents;
+  std::string displayTimeUnit = "ms";
+};
+
+inline ChromeTrace to_chrome_trace(const std::vector<std::shared_ptr<SessionTracer>> &tracers) {
+  auto to_us = [](clock::time_point tp) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(tp.time_since_epoch()).count();
+  };
+  auto event = [&](const char *name, int tid, std::size_t pid, clock::time_point from, clock::time_point to) {
+    return ChromeTraceEvent{.name = name, .ts = to_us(from), .dur = to_us(to) - to_us(from), .pid = pid, .tid = tid};
+  };
+
+  ChromeTrace res;
+  for (const auto &tracer : tracers) {
+    auto pid = tracer->get_session_id();
+    for (const auto &trace : tracer->get_traces()) {
+      res.traceEvents.push_back(event("receive -> inject", 1, pid, trace.received, trace.injected));
+      res.traceEvents.push_back(event("inject -> capture", 2, pid, trace.injected, trace.captured));
+      res.traceEvents.push_back(event("capture -> send", 3, pid, trace.captured, trace.sent));
+    }
+  }
+  return res;
+}
+
+} // namespace streaming::latency
@@ -0,0 +1,167 @@
+#include <helpers/logger.hpp>
+#include <streaming/orchestrator.hpp>
+#include <streaming/startup.hpp>
+#include <thread>
+
+namespace streaming {
+
+template <typename Session> static constexpr const char *stream_name() {
+  if constexpr (std::is_same_v<Session, events::VideoSession>) {
+    return "Video";
+  } else {
+    return "Audio";
+  }
+}
+
+SessionOrchestrator::SessionOrchestrator(boost::asio::io_context &io_context,
+                                         std::shared_ptr<events::EventBusType> event_bus,
+                                         std::chrono::milliseconds ping_timeout,
+                                         StartVideo start_video,
+                                         StartAudio start_audio)
+    : io_context(io_context), event_bus(std::move(event_bus)), ping_timeout(ping_timeout),
+      start_video(std::move(start_video)), start_audio(std::move(start_audio)) {
+  // Handlers only hand over the events to the io_context, they never block the thread that fired them
+  handlers.emplace_back(this->event_bus->register_handler<immer::box<events::VideoSession>>(
+      [this](const immer::box<events::VideoSession> &session) {
+        boost::asio::post(this->io_context, [this, session]() { on_session(video_streams, session); });
+      }));
+  handlers.emplace_back(this->event_bus->register_handler<immer::box<events::AudioSession>>(
+      [this](const immer::box<events::AudioSession> &session) {
+        boost::asio::post(this->io_context, [this, session]() { on_session(audio_streams, session); });
+      }));
+  handlers.emplace_back(this->event_bus->register_handler<immer::box<events::RTPVideoPingEvent>>(
+      [this](const immer::box<events::RTPVideoPingEvent> &ping) {
+        boost::asio::post(this->io_context, [this, ping]() {
+          on_ping(video_streams, ping->client_ip, ping->client_port, this->start_video);
+        });
+      }));
+  handlers.emplace_back(this->event_bus->register_handler<immer::box<events::RTPAudioPingEvent>>(
+      [this](const immer::box<events::RTPAudioPingEvent> &ping) {
+        boost::asio::post(this->io_context, [this, ping]() {
+          on_ping(audio_streams, ping->client_ip, ping->client_port, this->start_audio);
+        });
+      }));
+  handlers.emplace_back(this->event_bus->register_handler<immer::box<events::PauseStreamEvent>>(
+      [this](const immer::box<events::PauseStreamEvent> &ev) {
+        boost::asio::post(this->io_context, [this, session_id = ev->session_id]() { on_pause(session_id); });
+      }));
+  handlers.emplace_back(this->event_bus->register_handler<immer::box<events::StopStreamEvent>>(
+      [this](const immer::box<events::StopStreamEvent> &ev) {
+        boost::asio::post(this->io_context, [this, session_id = ev->session_id]() { on_stop(session_id); });
+      }));
+}
+
+template <typename Session>
+void SessionOrchestrator::on_session(Streams<Session> &streams, const immer::box<Session> &session) {
+  auto timer = std::make_shared<boost::asio::steady_timer>(io_context, ping_timeout);
+  {
+    std::lock_guard lock(m);
+    // A new session replaces the previous one (ex: resume), if we were still waiting for a PING that's cancelled
+    if (auto previous = streams.find(session->session_id); previous != streams.end()) {
+      previous->second.ping_timer->cancel();
+    }
+    streams.insert_or_assign(session->session_id,
+                             Stream<Session>{.session = session,
+                                             .ping_timer = timer,
+                                             .queued_at = std::chrono::steady_clock::now(),
+                                             .phase = SessionPhase::WAITING_PING});
+  }
+  logs::log(logs::debug, "{} session {}, waiting for PING...", stream_name<Session>(), session->session_id);
+
+  timer->async_wait([this, &streams, timer, session_id = session->session_id](const boost::system::error_code &ec) {
+    if (ec == boost::asio::error::operation_aborted) {
+      return;
+    }
+    std::lock_guard lock(m);
+    auto stream = streams.find(session_id);
+    // The timer might have expired right before being cancelled, make sure it's still the one we are waiting for
+    if (stream != streams.end() && stream->second.ping_timer == timer &&
+        stream->second.phase == SessionPhase::WAITING_PING) {
+      logs::log(logs::warning, "{} session {} timed out waiting for PING", stream_name<Session>(), session_id);
+      streams.erase(stream);
+    }
+  });
+}
+
+template <typename Session, typename Start>
+void SessionOrchestrator::on_ping(Streams<Session> &streams,
+                                  const std::string &client_ip,
+                                  unsigned short client_port,
+                                  Start start) {
+  std::optional<immer::box<Session>> session;
+  std::chrono::steady_clock::time_point queued_at;
+  {
+    std::lock_guard lock(m);
+    // We'll keep receiving PING requests, but we only want the first one of each session
+    for (auto &[session_id, stream] : streams) {
+      if (stream.phase == SessionPhase::WAITING_PING && stream.session->client_ip == client_ip &&
+          (!session || stream.queued_at < queued_at)) {
+        session = stream.session;
+        queued_at = stream.queued_at;
+      }
+    }
+    if (!session) {
+      return;
+    }
+    auto &stream = streams.at((*session)->session_id);
+    stream.ping_timer->cancel();
+    stream.phase = SessionPhase::STREAMING;
+  }
+
+  auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - queued_at);
+  logs::log(logs::debug,
+            "{} session {} got PING from {}:{} after {}ms, starting pipeline",
+            stream_name<Session>(),
+            (*session)->session_id,
+            client_ip,
+            client_port,
+            waited.count());
+  startup::Registry::get().record((*session)->session_id,
+                                  fmt::format("RTP {} PING", stream_name<Session>()),
+                                  queued_at);
+
+  // The pipeline runs its own GStreamer main loop until it's stopped
+  std::thread([start, session = *session, client_port]() { start(session, client_port); }).detach();
+}
+
+void SessionOrchestrator::on_pause(std::size_t session_id) {
+  auto pause = [session_id](auto &streams) {
+    if (auto stream = streams.find(session_id);
+        stream != streams.end() && stream->second.phase == SessionPhase::STREAMING) {
+      stream->second.phase = SessionPhase::PAUSED;
+    }
+  };
+  std::lock_guard lock(m);
+  pause(video_streams);
+  pause(audio_streams);
+}
+
+void SessionOrchestrator::on_stop(std::size_t session_id) {
+  auto stop = [session_id](auto &streams) {
+    if (auto stream = streams.find(session_id); stream != streams.end()) {
+      stream->second.ping_timer->cancel();
+      streams.erase(stream);
+    }
+  };
+  std::lock_guard lock(m);
+  stop(video_streams);
+  stop(audio_streams);
+}
+
+std::optional<SessionPhase> SessionOrchestrator::get_video_phase(std::size_t session_id) const {
+  std::lock_guard lock(m);
+  if (auto stream = video_streams.find(session_id); stream != video_streams.end()) {
+    return stream->second.phase;
+  }
+  return {};
+}
+
+std::optional<SessionPhase> SessionOrchestrator::get_audio_phase(std::size_t session_id) const {
+  std::lock_guard lock(m);
+  if (auto stream = audio_streams.find(session_id); stream != audio_streams.end()) {
+    return stream->second.phase;
+  }
+  return {};
+}
+
+} // namespace streaming
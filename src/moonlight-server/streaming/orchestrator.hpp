@@ -0,0 +1,88 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <chrono>
+#include <events/events.hpp>
+#include <functional>
+#include <immer/box.hpp>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+namespace streaming {
+
+using namespace wolf::core;
+
+enum class SessionPhase {
+  WAITING_PING, // The client has been told where to connect, waiting for the first RTP PING
+  STREAMING,    // The pipeline has been started
+  PAUSED
+};
+
+/**
+ * Drives the audio/video streams of every session on a single io_context: PING waits are timers and completion
+ * handlers instead of a thread parked on a future for each stream.
+ *
+ * Only the pipelines get their own thread once the PING has arrived, since they run a GStreamer main loop.
+ */
+class SessionOrchestrator {
+public:
+  using StartVideo = std::function<void(const immer::box<events::VideoSession> &, unsigned short /* client_port */)>;
+  using StartAudio = std::function<void(const immer::box<events::AudioSession> &, unsigned short /* client_port */)>;
+
+  SessionOrchestrator(boost::asio::io_context &io_context,
+                      std::shared_ptr<events::EventBusType> event_bus,
+                      std::chrono::milliseconds ping_timeout,
+                      StartVideo start_video,
+                      StartAudio start_audio);
+
+  SessionOrchestrator(const SessionOrchestrator &) = delete;
+  SessionOrchestrator &operator=(const SessionOrchestrator &) = delete;
+
+  /**
+   * Can be called from any thread
+   * @return an empty optional if there's no video stream for this session
+   */
+  [[nodiscard]] std::optional<SessionPhase> get_video_phase(std::size_t session_id) const;
+
+  /**
+   * Can be called from any thread
+   * @return an empty optional if there's no audio stream for this session
+   */
+  [[nodiscard]] std::optional<SessionPhase> get_audio_phase(std::size_t session_id) const;
+
+private:
+  template <typename Session> struct Stream {
+    immer::box<Session> session;
+    std::shared_ptr<boost::asio::steady_timer> ping_timer;
+    std::chrono::steady_clock::time_point queued_at;
+    SessionPhase phase;
+  };
+
+  template <typename Session> using Streams = std::unordered_map<std::size_t /* session_id */, Stream<Session>>;
+
+  template <typename Session> void on_session(Streams<Session> &streams, const immer::box<Session> &session);
+
+  template <typename Session, typename Start>
+  void on_ping(Streams<Session> &streams, const std::string &client_ip, unsigned short client_port, Start start);
+
+  void on_pause(std::size_t session_id);
+  void on_stop(std::size_t session_id);
+
+  boost::asio::io_context &io_context;
+  std::shared_ptr<events::EventBusType> event_bus;
+  std::chrono::milliseconds ping_timeout;
+  StartVideo start_video;
+  StartAudio start_audio;
+
+  // Only modified by the io_context thread, the lock is for the getters
+  mutable std::mutex m;
+  Streams<events::VideoSession> video_streams;
+  Streams<events::AudioSession> audio_streams;
+
+  std::vector<immer::box<events::EventBusHandlers>> handlers;
+};
+
+} // namespace streaming
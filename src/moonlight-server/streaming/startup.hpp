@@ -0,0 +1,202 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * Records how long each step takes to start a session, from the launch request until the first video packet is sent,
+ * so that we can see where the time to first frame goes:
+ *
+ *  HTTPS /launch -> RTSP DESCRIBE/SETUP/ANNOUNCE/PLAY -> RTP PING -> GStreamer pipelines -> first video packet
+ *
+ * with the Wayland compositor, the PulseAudio sink and the runner (ex: Docker) being set up in parallel.
+ *
+ * Only a handful of phases are recorded for each session so this is always enabled.
+ */
+namespace streaming::startup {
+
+using clock = std::chrono::steady_clock;
+
+inline constexpr const char *FIRST_VIDEO_PACKET = "first video packet sent";
+
+struct PhaseSnapshot {
+  std::string name;
+  /* Relative to the session creation */
+  std::int64_t start_us;
+  std::int64_t duration_us;
+};
+
+struct SessionStartupSnapshot {
+  std::string session_id;
+  /* Empty until the first video packet has been sent */
+  std::optional<std::int64_t> time_to_first_frame_us;
+  /* Sorted by start time */
+  std::vector<PhaseSnapshot> phases;
+};
+
+/**
+ * Phases are recorded from different threads (HTTPS, RTSP, runners, pipelines), they are guarded by a mutex
+ */
+class SessionProfile {
+public:
+  explicit SessionProfile(std::size_t session_id, clock::time_point created = clock::now())
+      : session_id(session_id), created(created) {}
+
+  void record(std::string name, clock::time_point start, clock::time_point end = clock::now()) {
+    std::lock_guard lock(m);
+    phases.push_back({.name = std::move(name), .start = start, .end = end});
+  }
+
+  /**
+   * Records an instantaneous phase, only the first call for a given name is kept
+   * @return false if this has been already marked
+   */
+  bool mark_once(const std::string &name, clock::time_point at = clock::now()) {
+    std::lock_guard lock(m);
+    if (std::any_of(phases.begin(), phases.end(), [&name](const Phase &phase) { return phase.name == name; })) {
+      return false;
+    }
+    phases.push_back({.name = name, .start = at, .end = at});
+    return true;
+  }
+
+  [[nodiscard]] SessionStartupSnapshot snapshot() const {
+    auto to_us = [](clock::duration duration) {
+      return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+    };
+
+    std::lock_guard lock(m);
+    SessionStartupSnapshot res = {.session_id = std::to_string(session_id)};
+    for (const auto &phase : phases) {
+      res.phases.push_back({.name = phase.name,
+                            .start_us = to_us(phase.start - created),
+                            .duration_us = to_us(phase.end - phase.start)});
+      if (phase.name == FIRST_VIDEO_PACKET) {
+        res.time_to_first_frame_us = to_us(phase.start - created);
+      }
+    }
+    std::stable_sort(res.phases.begin(), res.phases.end(), [](const PhaseSnapshot &a, const PhaseSnapshot &b) {
+      return a.start_us < b.start_us;
+    });
+    return res;
+  }
+
+  [[nodiscard]] std::size_t get_session_id() const {
+    return session_id;
+  }
+
+private:
+  struct Phase {
+    std::string name;
+    clock::time_point start;
+    clock::time_point end;
+  };
+
+  std::size_t session_id;
+  clock::time_point created;
+  mutable std::mutex m;
+  std::vector<Phase> phases;
+};
+
+/**
+ * Records the time spent from its creation until it goes out of scope
+ */
+class ScopedPhase {
+public:
+  ScopedPhase(std::shared_ptr<SessionProfile> profile, std::string name, clock::time_point start = clock::now())
+      : profile(std::move(profile)), name(std::move(name)), start(start) {}
+
+  ScopedPhase(const ScopedPhase &) = delete;
+  ScopedPhase &operator=(const ScopedPhase &) = delete;
+
+  ~ScopedPhase() {
+    if (profile) {
+      profile->record(std::move(name), start);
+    }
+  }
+
+private:
+  std::shared_ptr<SessionProfile> profile;
+  std::string name;
+  clock::time_point start;
+};
+
+/**
+ * The profiles of the latest sessions, they are kept after the session is over so that they can be inspected
+ */
+class Registry {
+public:
+  static constexpr std::size_t MAX_PROFILES = 32;
+
+  static Registry &get() {
+    static Registry registry;
+    return registry;
+  }
+
+  /**
+   * Starts a new profile for the session, replacing the previous one (ex: when resuming)
+   * @param created: phase offsets are relative to this, usually when the launch request has been received
+   */
+  std::shared_ptr<SessionProfile> start(std::size_t session_id, clock::time_point created = clock::now()) {
+    auto profile = std::make_shared<SessionProfile>(session_id, created);
+    std::lock_guard lock(m);
+    std::erase(order, session_id);
+    order.push_back(session_id);
+    profiles.insert_or_assign(session_id, profile);
+    while (order.size() > MAX_PROFILES) {
+      profiles.erase(order.front());
+      order.pop_front();
+    }
+    return profile;
+  }
+
+  /**
+   * @return the current profile for the session, nullptr if it hasn't been started
+   */
+  std::shared_ptr<SessionProfile> get_profile(std::size_t session_id) {
+    std::lock_guard lock(m);
+    auto profile = profiles.find(session_id);
+    return profile == profiles.end() ? nullptr : profile->second;
+  }
+
+  ScopedPhase phase(std::size_t session_id, std::string name) {
+    return {get_profile(session_id), std::move(name)};
+  }
+
+  void record(std::size_t session_id,
+              std::string name,
+              clock::time_point start,
+              clock::time_point end = clock::now()) {
+    if (auto profile = get_profile(session_id)) {
+      profile->record(std::move(name), start, end);
+    }
+  }
+
+  /**
+   * Oldest session first
+   */
+  std::vector<std::shared_ptr<SessionProfile>> get_all() {
+    std::lock_guard lock(m);
+    std::vector<std::shared_ptr<SessionProfile>> res;
+    for (auto session_id : order) {
+      res.push_back(profiles.at(session_id));
+    }
+    return res;
+  }
+
+private:
+  std::mutex m;
+  std::unordered_map<std::size_t, std::shared_ptr<SessionProfile>> profiles;
+  std::deque<std::size_t> order;
+};
+
+} // namespace streaming::startup
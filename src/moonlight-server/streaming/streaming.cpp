@@ -4,6 +4,7 @@
 #include <immer/array_transient.hpp>
 #include <immer/box.hpp>
 #include <memory>
+#include <platforms/threads.hpp>
 #include <streaming/streaming.hpp>
 
 namespace streaming {
@@ -30,6 +31,7 @@ bool push_data(GstAppDataState *data) {
 
   if (data->wayland_state) {
     auto buffer = get_frame(*data->wayland_state);
+    auto captured_at = latency::clock::now();
     /**
      * get_frame() will internally sleep until vsync or a new frame is available.
      * we have to make sure that the pipeline is still running or we might access some invalid pointer
@@ -44,6 +46,9 @@ bool push_data(GstAppDataState *data) {
       // gst_app_src_push_buffer takes ownership of the buffer
       ret = gst_app_src_push_buffer(GST_APP_SRC(data->app_src.get()), buffer);
       if (ret == GST_FLOW_OK) {
+        if (data->latency_tracer) {
+          data->latency_tracer->on_capture(captured_at);
+        }
         return true;
       }
     } else {
@@ -76,17 +81,32 @@ void app_src_enough_data(GstElement *pipeline, guint size, GstAppDataState *data
 using namespace wolf::core::gstreamer;
 using namespace wolf::core;
 
+/**
+ * Gives the role to the GStreamer streaming threads of a pipeline (encoders, payloaders, udpsink...)
+ */
+static StreamingThreadHook streaming_threads_role(threads::Role role) {
+  return [role](bool entering) {
+    if (entering) {
+      threads::Topology::get().enter(role);
+    } else {
+      threads::Topology::get().leave();
+    }
+  };
+}
+
 void start_video_producer(std::size_t session_id,
                           wolf::core::virtual_display::wl_state_ptr wl_state,
                           const wolf::core::virtual_display::DisplayMode &display_mode,
                           const std::shared_ptr<events::EventBusType> &event_bus) {
   auto appsrc_state = streaming::custom_src::setup_app_src(display_mode, std::move(wl_state));
+  appsrc_state->latency_tracer = latency::Registry::get().get_or_create(session_id);
   auto pipeline = fmt::format("appsrc is-live=true name=wolf_wayland_source ! "                              //
                               "queue ! "                                                                     //
                               "interpipesink name={}_video sync=true async=false max-bytes=0 max-buffers=3", //
                               session_id);
   logs::log(logs::debug, "[GSTREAMER] Starting video producer: {}", pipeline);
-  run_pipeline(pipeline, [=](auto pipeline, auto loop) {
+  threads::ScopedRole thread_role(threads::Role::VIDEO);
+  auto on_ready = [=](auto pipeline, auto loop) {
     if (auto app_src_el = gst_bin_get_by_name(GST_BIN(pipeline.get()), "wolf_wayland_source")) {
       appsrc_state->context = g_main_context_get_thread_default();
       logs::log(logs::debug, "Setting up wolf_wayland_source");
@@ -112,16 +132,16 @@ void start_video_producer(std::size_t session_id,
 
     // TODO: pause and resume? Should we do it?
 
-    auto stop_handler = event_bus->register_handler<immer::box<events::StopStreamEvent>>(
+    auto stop_handler = event_bus->register_session_handler<immer::box<events::StopStreamEvent>>(
+        session_id,
         [session_id, loop](const immer::box<events::StopStreamEvent> &ev) {
-          if (ev->session_id == session_id) {
-            logs::log(logs::debug, "[GSTREAMER] Stopping video producer: {}", session_id);
-            g_main_loop_quit(loop.get());
-          }
+          logs::log(logs::debug, "[GSTREAMER] Stopping video producer: {}", session_id);
+          g_main_loop_quit(loop.get());
         });
 
-    return immer::array<immer::box<events::EventBusHandlers>>{std::move(stop_handler)};
-  });
+    return immer::array<immer::box<events::SessionHandlerRegistration>>{std::move(stop_handler)};
+  };
+  run_pipeline(pipeline, on_ready, streaming_threads_role(threads::Role::VIDEO));
 }
 
 void start_audio_producer(std::size_t session_id,
@@ -140,16 +160,109 @@ void start_audio_producer(std::size_t session_id,
       fmt::arg("server_name", server_name));
   logs::log(logs::debug, "[GSTREAMER] Starting audio producer: {}", pipeline);
 
-  run_pipeline(pipeline, [=](auto pipeline, auto loop) {
-    auto stop_handler = event_bus->register_handler<immer::box<events::StopStreamEvent>>(
+  threads::ScopedRole thread_role(threads::Role::AUDIO);
+  auto on_ready = [=](auto pipeline, auto loop) {
+    auto stop_handler = event_bus->register_session_handler<immer::box<events::StopStreamEvent>>(
+        session_id,
         [session_id, loop](const immer::box<events::StopStreamEvent> &ev) {
-          if (ev->session_id == session_id) {
-            logs::log(logs::debug, "[GSTREAMER] Stopping audio producer: {}", session_id);
-            g_main_loop_quit(loop.get());
-          }
+          logs::log(logs::debug, "[GSTREAMER] Stopping audio producer: {}", session_id);
+          g_main_loop_quit(loop.get());
         });
 
-    return immer::array<immer::box<events::EventBusHandlers>>{std::move(stop_handler)};
+    return immer::array<immer::box<events::SessionHandlerRegistration>>{std::move(stop_handler)};
+  };
+  run_pipeline(pipeline, on_ready, streaming_threads_role(threads::Role::AUDIO));
+}
+
+/**
+ * @return the first element in the bin (recursively) created by the given factory, nullptr if not found
+ */
+static GstElement *find_element_by_factory(GstBin *bin, const char *factory_name) {
+  auto it = gst_bin_iterate_recurse(bin);
+  GValue found = G_VALUE_INIT;
+  GstElement *element = nullptr;
+  auto same_factory = [](gconstpointer value, gconstpointer name) -> gint {
+    auto factory = gst_element_get_factory(GST_ELEMENT(g_value_get_object((const GValue *)value)));
+    return factory && g_strcmp0(GST_OBJECT_NAME(factory), (const char *)name) == 0 ? 0 : 1;
+  };
+  if (gst_iterator_find_custom(it, same_factory, &found, (gpointer)factory_name)) {
+    element = GST_ELEMENT(g_value_dup_object(&found));
+    g_value_unset(&found);
+  }
+  gst_iterator_free(it);
+  return element;
+}
+
+/**
+ * Marks the frames that have been encoded and split into RTP packets as sent, for latency tracing
+ */
+static void trace_sent_frames(GstElement *pipeline, std::size_t session_id) {
+  auto tracer = latency::Registry::get().get_or_create(session_id);
+  if (!tracer) {
+    return;
+  }
+  auto payloader = find_element_by_factory(GST_BIN(pipeline), "rtpmoonlightpay_video");
+  if (!payloader) {
+    logs::log(logs::warning, "[LATENCY] rtpmoonlightpay_video not found, can't trace sent frames");
+    return;
+  }
+  auto src_pad = gst_element_get_static_pad(payloader, "src");
+  gst_pad_add_probe(
+      src_pad,
+      (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      [](GstPad *, GstPadProbeInfo *, gpointer user_data) {
+        (*static_cast<std::shared_ptr<latency::SessionTracer> *>(user_data))->on_send();
+        return GST_PAD_PROBE_OK;
+      },
+      new std::shared_ptr<latency::SessionTracer>(std::move(tracer)),
+      [](gpointer user_data) { delete static_cast<std::shared_ptr<latency::SessionTracer> *>(user_data); });
+  gst_object_unref(src_pad);
+  gst_object_unref(payloader);
+}
+
+/**
+ * Records when the first video packet leaves the pipeline, that's the end of the session startup profile
+ */
+static void profile_first_video_packet(GstElement *pipeline, std::size_t session_id) {
+  auto profile = startup::Registry::get().get_profile(session_id);
+  if (!profile) {
+    return;
+  }
+  auto payloader = find_element_by_factory(GST_BIN(pipeline), "rtpmoonlightpay_video");
+  if (!payloader) {
+    logs::log(logs::debug, "[STARTUP] rtpmoonlightpay_video not found, can't profile the first video packet");
+    return;
+  }
+  auto src_pad = gst_element_get_static_pad(payloader, "src");
+  gst_pad_add_probe(
+      src_pad,
+      (GstPadProbeType)(GST_PAD_PROBE_TYPE_BUFFER | GST_PAD_PROBE_TYPE_BUFFER_LIST),
+      [](GstPad *, GstPadProbeInfo *, gpointer user_data) {
+        (*static_cast<std::shared_ptr<startup::SessionProfile> *>(user_data))->mark_once(startup::FIRST_VIDEO_PACKET);
+        return GST_PAD_PROBE_REMOVE;
+      },
+      new std::shared_ptr<startup::SessionProfile>(std::move(profile)),
+      [](gpointer user_data) { delete static_cast<std::shared_ptr<startup::SessionProfile> *>(user_data); });
+  gst_object_unref(src_pad);
+  gst_object_unref(payloader);
+}
+
+/**
+ * Runs the event handlers on the thread that runs the pipeline main loop, the thread that fired the event (ex: the
+ * control stream) doesn't have to wait for the pipeline
+ */
+static events::Executor main_loop_executor(const gst_main_loop_ptr &loop) {
+  gst_main_context_ptr context = {g_main_context_ref(g_main_loop_get_context(loop.get())), ::g_main_context_unref};
+  return events::Executor([context](events::Executor::Task task) {
+    g_main_context_invoke_full(
+        context.get(),
+        G_PRIORITY_DEFAULT,
+        [](gpointer data) {
+          (*static_cast<events::Executor::Task *>(data))();
+          return G_SOURCE_REMOVE;
+        },
+        new events::Executor::Task(std::move(task)),
+        [](gpointer data) { delete static_cast<events::Executor::Task *>(data); });
   });
 }
 
@@ -190,57 +303,62 @@ void start_streaming_video(const immer::box<events::VideoSession> &video_session
                               fmt::arg("host_port", video_session->port));
   logs::log(logs::debug, "Starting video pipeline: \n{}", pipeline);
 
-  run_pipeline(pipeline, [video_session, event_bus](auto pipeline, auto loop) {
+  auto pipeline_start = startup::clock::now();
+  threads::ScopedRole thread_role(threads::Role::VIDEO);
+  auto on_ready = [video_session, event_bus, pipeline_start](auto pipeline, auto loop) {
+    startup::Registry::get().record(video_session->session_id, "GStreamer video pipeline", pipeline_start);
+    trace_sent_frames(pipeline.get(), video_session->session_id);
+    profile_first_video_packet(pipeline.get(), video_session->session_id);
+
     /*
      * The force IDR event will be triggered by the control stream.
      * We have to pass this back into the gstreamer pipeline
      * in order to force the encoder to produce a new IDR packet
      */
-    auto idr_handler = event_bus->register_handler<immer::box<events::IDRRequestEvent>>(
-        [sess_id = video_session->session_id, pipeline](const immer::box<events::IDRRequestEvent> &ctrl_ev) {
-          if (ctrl_ev->session_id == sess_id) {
-            logs::log(logs::debug, "[GSTREAMER] Forcing IDR");
-            // Force IDR event, see: https://github.com/centricular/gstwebrtc-demos/issues/186
-            // https://gstreamer.freedesktop.org/documentation/additional/design/keyframe-force.html?gi-language=c
-            wolf::core::gstreamer::send_message(
-                pipeline.get(),
-                gst_structure_new("GstForceKeyUnit", "all-headers", G_TYPE_BOOLEAN, TRUE, NULL));
-          }
+    auto idr_handler = event_bus->register_session_handler<immer::box<events::IDRRequestEvent>>(
+        video_session->session_id,
+        main_loop_executor(loop),
+        [pipeline](const immer::box<events::IDRRequestEvent> &ctrl_ev) {
+          logs::log(logs::debug, "[GSTREAMER] Forcing IDR");
+          // Force IDR event, see: https://github.com/centricular/gstwebrtc-demos/issues/186
+          // https://gstreamer.freedesktop.org/documentation/additional/design/keyframe-force.html?gi-language=c
+          wolf::core::gstreamer::send_message(
+              pipeline.get(),
+              gst_structure_new("GstForceKeyUnit", "all-headers", G_TYPE_BOOLEAN, TRUE, NULL));
         });
 
-    auto pause_handler = event_bus->register_handler<immer::box<events::PauseStreamEvent>>(
+    auto pause_handler = event_bus->register_session_handler<immer::box<events::PauseStreamEvent>>(
+        video_session->session_id,
         [sess_id = video_session->session_id, loop](const immer::box<events::PauseStreamEvent> &ev) {
-          if (ev->session_id == sess_id) {
-            logs::log(logs::debug, "[GSTREAMER] Pausing pipeline: {}", sess_id);
-
-            /**
-             * Unfortunately here we can't just pause the pipeline,
-             * when a pipeline will be resumed there are a lot of breaking changes
-             * like:
-             *  - Client IP:PORT
-             *  - AES key and IV for encrypted payloads
-             *  - Client resolution, framerate, and encoding
-             *
-             *  The only solution is to kill the pipeline and re-create it again
-             * when a resume happens
-             */
-
-            g_main_loop_quit(loop.get());
-          }
+          logs::log(logs::debug, "[GSTREAMER] Pausing pipeline: {}", sess_id);
+
+          /**
+           * Unfortunately here we can't just pause the pipeline,
+           * when a pipeline will be resumed there are a lot of breaking changes
+           * like:
+           *  - Client IP:PORT
+           *  - AES key and IV for encrypted payloads
+           *  - Client resolution, framerate, and encoding
+           *
+           *  The only solution is to kill the pipeline and re-create it again
+           * when a resume happens
+           */
+
+          g_main_loop_quit(loop.get());
         });
 
-    auto stop_handler = event_bus->register_handler<immer::box<events::StopStreamEvent>>(
+    auto stop_handler = event_bus->register_session_handler<immer::box<events::StopStreamEvent>>(
+        video_session->session_id,
         [sess_id = video_session->session_id, loop](const immer::box<events::StopStreamEvent> &ev) {
-          if (ev->session_id == sess_id) {
-            logs::log(logs::debug, "[GSTREAMER] Stopping pipeline: {}", sess_id);
-            g_main_loop_quit(loop.get());
-          }
+          logs::log(logs::debug, "[GSTREAMER] Stopping pipeline: {}", sess_id);
+          g_main_loop_quit(loop.get());
         });
 
-    return immer::array<immer::box<events::EventBusHandlers>>{std::move(idr_handler),
-                                                              std::move(pause_handler),
-                                                              std::move(stop_handler)};
-  });
+    return immer::array<immer::box<events::SessionHandlerRegistration>>{std::move(idr_handler),
+                                                                        std::move(pause_handler),
+                                                                        std::move(stop_handler)};
+  };
+  run_pipeline(pipeline, on_ready, streaming_threads_role(threads::Role::VIDEO));
 }
 
 /**
@@ -256,8 +374,7 @@ void start_streaming_audio(const immer::box<events::AudioSession> &audio_session
       fmt::arg("session_id", audio_session->session_id),
       fmt::arg("channels", audio_session->audio_mode.channels),
       fmt::arg("bitrate", audio_session->audio_mode.bitrate),
-      // TODO: opusenc hardcodes those two
-      // https://gitlab.freedesktop.org/gstreamer/gstreamer/-/blob/1.24.6/subprojects/gst-plugins-base/ext/opus/gstopusenc.c#L661-666
+      // opusenc hardcodes those two, they are only honoured by moonlightopusenc
       fmt::arg("streams", audio_session->audio_mode.streams),
       fmt::arg("coupled_streams", audio_session->audio_mode.coupled_streams),
       fmt::arg("sink_name", sink_name),
@@ -271,38 +388,41 @@ void start_streaming_audio(const immer::box<events::AudioSession> &audio_session
       fmt::arg("host_port", audio_session->port));
   logs::log(logs::debug, "Starting audio pipeline: \n{}", pipeline);
 
-  run_pipeline(pipeline, [session_id = audio_session->session_id, event_bus](auto pipeline, auto loop) {
-    auto pause_handler = event_bus->register_handler<immer::box<events::PauseStreamEvent>>(
+  auto pipeline_start = startup::clock::now();
+  threads::ScopedRole thread_role(threads::Role::AUDIO);
+  auto on_ready = [session_id = audio_session->session_id, event_bus, pipeline_start](auto pipeline, auto loop) {
+    startup::Registry::get().record(session_id, "GStreamer audio pipeline", pipeline_start);
+    auto pause_handler = event_bus->register_session_handler<immer::box<events::PauseStreamEvent>>(
+        session_id,
         [session_id, loop](const immer::box<events::PauseStreamEvent> &ev) {
-          if (ev->session_id == session_id) {
-            logs::log(logs::debug, "[GSTREAMER] Pausing pipeline: {}", session_id);
-
-            /**
-             * Unfortunately here we can't just pause the pipeline,
-             * when a pipeline will be resumed there are a lot of breaking changes
-             * like:
-             *  - Client IP:PORT
-             *  - AES key and IV for encrypted payloads
-             *  - Client resolution, framerate, and encoding
-             *
-             *  The only solution is to kill the pipeline and re-create it again
-             * when a resume happens
-             */
-
-            g_main_loop_quit(loop.get());
-          }
+          logs::log(logs::debug, "[GSTREAMER] Pausing pipeline: {}", session_id);
+
+          /**
+           * Unfortunately here we can't just pause the pipeline,
+           * when a pipeline will be resumed there are a lot of breaking changes
+           * like:
+           *  - Client IP:PORT
+           *  - AES key and IV for encrypted payloads
+           *  - Client resolution, framerate, and encoding
+           *
+           *  The only solution is to kill the pipeline and re-create it again
+           * when a resume happens
+           */
+
+          g_main_loop_quit(loop.get());
         });
 
-    auto stop_handler = event_bus->register_handler<immer::box<events::StopStreamEvent>>(
+    auto stop_handler = event_bus->register_session_handler<immer::box<events::StopStreamEvent>>(
+        session_id,
         [session_id, loop](const immer::box<events::StopStreamEvent> &ev) {
-          if (ev->session_id == session_id) {
-            logs::log(logs::debug, "[GSTREAMER] Stopping pipeline: {}", session_id);
-            g_main_loop_quit(loop.get());
-          }
+          logs::log(logs::debug, "[GSTREAMER] Stopping pipeline: {}", session_id);
+          g_main_loop_quit(loop.get());
         });
 
-    return immer::array<immer::box<events::EventBusHandlers>>{std::move(pause_handler), std::move(stop_handler)};
-  });
+    return immer::array<immer::box<events::SessionHandlerRegistration>>{std::move(pause_handler),
+                                                                        std::move(stop_handler)};
+  };
+  run_pipeline(pipeline, on_ready, streaming_threads_role(threads::Role::AUDIO));
 }
 
 } // namespace streaming
\ No newline at end of file
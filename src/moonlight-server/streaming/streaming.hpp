@@ -6,6 +6,7 @@
 #include <events/events.hpp>
 #include <fmt/core.h>
 #include <fmt/format.h>
+#include <gst-plugin/gstmoonlightopusenc.hpp>
 #include <gst-plugin/gstrtpmoonlightpay_audio.hpp>
 #include <gst-plugin/gstrtpmoonlightpay_video.hpp>
 #include <gst-plugin/video.hpp>
@@ -14,6 +15,8 @@
 #include <gstreamer-1.0/gst/app/gstappsrc.h>
 #include <immer/box.hpp>
 #include <memory>
+#include <streaming/latency.hpp>
+#include <streaming/startup.hpp>
 
 namespace streaming {
 
@@ -49,6 +52,7 @@ struct GstAppDataState {
   GSource *source;
   int framerate;
   GstClockTime timestamp = 0;
+  std::shared_ptr<latency::SessionTracer> latency_tracer = nullptr;
 };
 
 std::shared_ptr<GstAppDataState> setup_app_src(const wolf::core::virtual_display::DisplayMode &video_session,
@@ -85,6 +89,9 @@ inline void init() {
   GstPlugin *audio_plugin = gst_plugin_load_by_name("rtpmoonlightpay_audio");
   gst_element_register(audio_plugin, "rtpmoonlightpay_audio", GST_RANK_PRIMARY, gst_TYPE_rtp_moonlight_pay_audio);
 
+  GstPlugin *opus_plugin = gst_plugin_load_by_name("moonlightopusenc");
+  gst_element_register(opus_plugin, "moonlightopusenc", GST_RANK_NONE, gst_TYPE_moonlight_opus_enc);
+
   moonlight::fec::init();
 }
 
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <control/input_handler.hpp>
+#include <control/recording.hpp>
+#include <events/events.hpp>
+#include <fstream>
+#include <helpers/logger.hpp>
+#include <helpers/utils.hpp>
+#include <map>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Replays a control stream recording (see WOLF_CONTROL_RECORDING_DIR) into handle_input(), reports how long it took
+ * to process each packet.
+ *
+ * Usage: wolf-control-replay <recording> [--speed <factor>] [--no-devices]
+ *  --speed: 1 (default) keeps the original timing, 2 is twice as fast, 0 replays everything as fast as possible
+ *  --no-devices: don't create the virtual mouse and keyboard, only measures parsing and dispatching
+ */
+
+using namespace wolf::core;
+using namespace moonlight::control;
+using namespace std::chrono;
+
+struct Options {
+  std::string recording;
+  double speed = 1.0;
+  bool create_devices = true;
+};
+
+static std::optional<Options> parse_args(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--speed" && i + 1 < argc) {
+      options.speed = std::stod(argv[++i]);
+    } else if (arg == "--no-devices") {
+      options.create_devices = false;
+    } else if (options.recording.empty() && !arg.starts_with("--")) {
+      options.recording = arg;
+    } else {
+      return {};
+    }
+  }
+  if (options.recording.empty() || options.speed < 0) {
+    return {};
+  }
+  return options;
+}
+
+static void create_devices(events::StreamSession &session) {
+  if (auto mouse = input::Mouse::create()) {
+    session.mouse->emplace(input::Mouse(std::move(*mouse)));
+  } else {
+    logs::log(logs::error, "Failed to create mouse: {}", mouse.getErrorMessage());
+  }
+  if (auto keyboard = input::Keyboard::create()) {
+    session.keyboard->emplace(input::Keyboard(std::move(*keyboard)));
+  } else {
+    logs::log(logs::error, "Failed to create keyboard: {}", keyboard.getErrorMessage());
+  }
+}
+
+struct Timings {
+  std::vector<nanoseconds> durations;
+
+  void report(const std::string &name) {
+    if (durations.empty()) {
+      return;
+    }
+    std::sort(durations.begin(), durations.end());
+    auto percentile = [this](double p) {
+      return durations[std::min(durations.size() - 1, static_cast<std::size_t>(p * durations.size()))].count();
+    };
+    nanoseconds total = {};
+    for (auto duration : durations) {
+      total += duration;
+    }
+    logs::log(logs::info,
+              "{:<20} | {:>8} | mean {:>10}ns | p50 {:>10}ns | p99 {:>10}ns | max {:>10}ns",
+              name,
+              durations.size(),
+              total.count() / static_cast<long>(durations.size()),
+              percentile(0.5),
+              percentile(0.99),
+              durations.back().count());
+  }
+};
+
+int main(int argc, char *argv[]) {
+  logs::init(logs::parse_level(utils::get_env("WOLF_LOG_LEVEL", "INFO")));
+
+  auto options = parse_args(argc, argv);
+  if (!options) {
+    logs::log(logs::error, "Usage: {} <recording> [--speed <factor>] [--no-devices]", argv[0]);
+    return 1;
+  }
+
+  std::ifstream file(options->recording, std::ios::binary);
+  if (!file.is_open()) {
+    logs::log(logs::error, "Unable to open {}", options->recording);
+    return 1;
+  }
+
+  std::vector<control::recording::Record> records;
+  try {
+    records = control::recording::read_recording(file);
+  } catch (std::runtime_error &e) {
+    logs::log(logs::error, "Unable to read {}: {}", options->recording, e.what());
+    return 1;
+  }
+
+  auto session = events::StreamSession{.event_bus = std::make_shared<events::EventBusType>(),
+                                       .app = std::make_shared<events::App>(events::App{.joypad_type = pkts::AUTO})};
+  if (options->create_devices) {
+    create_devices(session);
+  }
+  // Nobody will receive rumble and motion requests
+  auto connected_clients = std::make_shared<immer::atom<control::enet_clients_map>>();
+
+  std::map<std::string, Timings> timings;
+  Timings all;
+  std::array<char, MAX_PAYLOAD_SIZE> buffer = {};
+  auto start = steady_clock::now();
+  for (const auto &record : records) {
+    auto packet = reinterpret_cast<const ControlPacket *>(record.payload.data());
+    if (record.payload.size() < sizeof(pkts::INPUT_PKT) || record.payload.size() > buffer.size() ||
+        packet->type != pkts::INPUT_DATA) {
+      continue;
+    }
+
+    if (options->speed > 0) {
+      std::this_thread::sleep_until(start + duration_cast<nanoseconds>(record.timestamp / options->speed));
+    }
+
+    // handle_input() works on a mutable packet, don't touch the recording
+    std::copy(record.payload.begin(), record.payload.end(), buffer.begin());
+    auto input_pkt = reinterpret_cast<pkts::INPUT_PKT *>(buffer.data());
+
+    auto before = steady_clock::now();
+    try {
+      control::handle_input(session, connected_clients, input_pkt);
+    } catch (std::runtime_error &e) {
+      logs::log(logs::warning, "Unable to handle input: {}", e.what());
+    }
+    auto duration = duration_cast<nanoseconds>(steady_clock::now() - before);
+
+    timings[control::input_type_to_str(input_pkt->type)].durations.push_back(duration);
+    all.durations.push_back(duration);
+  }
+
+  logs::log(logs::info,
+            "Replayed {} input packets out of {} recorded in {}ms",
+            all.durations.size(),
+            records.size(),
+            duration_cast<milliseconds>(steady_clock::now() - start).count());
+  for (auto &[name, timing] : timings) {
+    timing.report(name);
+  }
+  all.report("ALL");
+  return 0;
+}
@@ -7,6 +7,7 @@
 #include <csignal>
 #include <exceptions/exceptions.h>
 #include <filesystem>
+#include <handover/handover.hpp>
 #include <immer/array_transient.hpp>
 #include <immer/map_transient.hpp>
 #include <immer/vector_transient.hpp>
@@ -14,10 +15,16 @@
 #include <mdns_cpp/mdns.hpp>
 #include <memory>
 #include <platforms/hw.hpp>
+#include <platforms/services.hpp>
+#include <platforms/threads.hpp>
 #include <rest/rest.hpp>
+#include <rtp/udp-ping.hpp>
 #include <rtsp/net.hpp>
 #include <state/config.hpp>
+#include <state/sessions.hpp>
+#include <streaming/orchestrator.hpp>
 #include <streaming/streaming.hpp>
+#include <unistd.h>
 #include <vector>
 
 namespace ba = boost::asio;
@@ -28,6 +35,7 @@ using namespace std::chrono_literals;
 using namespace wolf::core;
 
 static constexpr int DEFAULT_SESSION_TIMEOUT_MILLIS = 4000;
+static constexpr auto SHUTDOWN_SESSIONS_TIMEOUT = 5s;
 
 /**
  * @brief Will try to load the config file and fallback to defaults
@@ -75,7 +83,7 @@ state::Host get_host_config(std::string_view pkey_filename, std::string_view cer
  */
 auto initialize(std::string_view config_file, std::string_view pkey_filename, std::string_view cert_filename) {
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   auto config = load_config(config_file, event_bus, running_sessions);
 
   auto host = get_host_config(pkey_filename, cert_filename);
@@ -92,8 +100,29 @@ auto initialize(std::string_view config_file, std::string_view pkey_filename, st
 struct AudioServer {
   std::shared_ptr<audio::Server> server;
   std::optional<docker::Container> container = {};
+  std::shared_ptr<audio::VSinkPool> sink_pool = {};
 };
 
+/**
+ * Pre-create a few virtual sinks for each of the supported channel layouts
+ * so that sessions don't have to wait for PulseAudio to load a new module
+ */
+std::shared_ptr<audio::VSinkPool> setup_sink_pool(const std::shared_ptr<audio::Server> &server) {
+  auto pool_size = std::stoi(utils::get_env("WOLF_PULSE_SINK_POOL_SIZE", "1"));
+  std::vector<audio::AudioMode> modes(state::AUDIO_CONFIGURATIONS.begin(), state::AUDIO_CONFIGURATIONS.end());
+  return audio::create_sink_pool(server, modes, std::max(pool_size, 0));
+}
+
+/**
+ * The name of the virtual sink that has been leased to the given session
+ */
+std::string get_sink_name(const events::StreamSession &session) {
+  if (auto vsink = session.audio_sink->load().get()) {
+    return vsink->device.sink_name;
+  }
+  return fmt::format("virtual_sink_{}", session.session_id);
+}
+
 /**
  * We first try to connect to a running PulseAudio server
  * if that fails, we run our own PulseAudio container and connect to it
@@ -102,7 +131,7 @@ struct AudioServer {
 std::optional<AudioServer> setup_audio_server(const std::string &runtime_dir) {
   auto audio_server = audio::connect();
   if (audio::connected(audio_server)) {
-    return {{.server = audio_server}};
+    return {{.server = audio_server, .sink_pool = setup_sink_pool(audio_server)}};
   } else {
     logs::log(logs::info, "Starting PulseAudio docker container");
     docker::DockerAPI docker_api(utils::get_env("WOLF_DOCKER_SOCKET", "/var/run/docker.sock"));
@@ -131,7 +160,8 @@ std::optional<AudioServer> setup_audio_server(const std::string &runtime_dir) {
     if (container && docker_api.start_by_id(container.value().id)) {
       auto ms = std::stoi(utils::get_env("WOLF_PULSE_CONTAINER_TIMEOUT_MS", "2000"));
       std::this_thread::sleep_for(std::chrono::milliseconds(ms)); // TODO: Better way of knowing when ready?
-      return {{.server = audio::connect(fmt::format("{}/pulse-socket", runtime_dir)), .container = container}};
+      audio_server = audio::connect(fmt::format("{}/pulse-socket", runtime_dir));
+      return {{.server = audio_server, .container = container, .sink_pool = setup_sink_pool(audio_server)}};
     }
   }
 
@@ -157,11 +187,22 @@ auto setup_sessions_handlers(const immer::box<state::AppState> &app_state,
       [&app_state, plugged_devices_queue](const immer::box<events::StopStreamEvent> &ev) {
         // Remove session from app state so that HTTP/S applist gets updated
         // This should effectively destroy the virtual Wayland session since it holds the last reference
-        app_state->running_sessions->update([&ev](const immer::vector<events::StreamSession> &ses_v) {
-          return state::remove_session(ses_v, {.session_id = ev->session_id});
-        });
-
+        app_state->running_sessions->remove(ev->session_id);
+
+        // Wakes up the runner, it'll stop waiting for new devices
+        if (auto devices_q = plugged_devices_queue->load()->find(ev->session_id)) {
+          devices_q->get()->close();
+          auto stats = devices_q->get()->get_stats();
+          logs::log(stats.rejected > 0 ? logs::warning : logs::debug,
+                    "Session {} devices queue: {} pushed, {} popped, {} rejected, at most {} waiting",
+                    ev->session_id,
+                    stats.pushed,
+                    stats.popped,
+                    stats.rejected,
+                    stats.high_watermark);
+        }
         plugged_devices_queue->update([=](const auto map) { return map.erase(ev->session_id); });
+        streaming::latency::Registry::get().remove(ev->session_id);
       }));
 
   handlers.push_back(app_state->event_bus->register_handler<immer::box<events::PlugDeviceEvent>>(
@@ -169,7 +210,9 @@ auto setup_sessions_handlers(const immer::box<state::AppState> &app_state,
         logs::log(logs::debug, "{} received hot-plug device event", hotplug_ev->session_id);
 
         if (auto session_devices_queue = plugged_devices_queue->load()->find(hotplug_ev->session_id)) {
-          session_devices_queue->get()->push(hotplug_ev);
+          if (!session_devices_queue->get()->push(immer::box<events::PlugDeviceEvent>(hotplug_ev))) {
+            logs::log(logs::warning, "Dropping hot-plug device event for session {}", hotplug_ev->session_id);
+          }
         } else {
           logs::log(logs::warning, "Unable to find plugged_devices_queue for session {}", hotplug_ev->session_id);
         }
@@ -185,12 +228,14 @@ auto setup_sessions_handlers(const immer::box<state::AppState> &app_state,
 
         if (session->app->start_virtual_compositor) {
           logs::log(logs::debug, "[STREAM_SESSION] Create wayland compositor");
+          auto compositor_start = streaming::startup::clock::now();
 
           auto render_node = session->app->render_node;
           auto wl_state = virtual_display::create_wayland_display({}, render_node);
           virtual_display::set_resolution(
               *wl_state,
               {session->display_mode.width, session->display_mode.height, session->display_mode.refreshRate});
+          streaming::startup::Registry::get().record(session->session_id, "Wayland compositor", compositor_start);
 
           // Set the wayland display
           session->wayland_display->store(wl_state);
@@ -236,18 +281,16 @@ auto setup_sessions_handlers(const immer::box<state::AppState> &app_state,
         }
 
         /* Create audio virtual sink */
-        logs::log(logs::debug, "[STREAM_SESSION] Create virtual audio sink");
-        auto pulse_sink_name = fmt::format("virtual_sink_{}", session->session_id);
-        std::shared_ptr<audio::VSink> v_device;
+        logs::log(logs::debug, "[STREAM_SESSION] Lease virtual audio sink");
         if (session->app->start_audio_server && audio_server && audio_server->server) {
-          v_device = audio::create_virtual_sink(
-              audio_server->server,
-              audio::AudioDevice{.sink_name = pulse_sink_name,
-                                 .mode = state::get_audio_mode(session->audio_channel_count, true)});
+          auto sink_start = streaming::startup::clock::now();
+          auto v_device = audio::lease_virtual_sink(audio_server->sink_pool,
+                                                    state::get_audio_mode(session->audio_channel_count, true));
+          streaming::startup::Registry::get().record(session->session_id, "PulseAudio sink", sink_start);
           session->audio_sink->store(v_device);
 
           std::thread([session, audio_server = audio_server->server]() {
-            auto sink_name = fmt::format("virtual_sink_{}.monitor", session->session_id);
+            auto sink_name = get_sink_name(*session) + ".monitor";
             streaming::start_audio_producer(session->session_id,
                                             session->event_bus,
                                             session->audio_channel_count,
@@ -279,7 +322,7 @@ auto setup_sessions_handlers(const immer::box<state::AppState> &app_state,
           immer::map_transient<std::string, std::string> full_env;
           full_env.set("XDG_RUNTIME_DIR", runtime_dir);
 
-          auto pulse_sink_name = fmt::format("virtual_sink_{}", session->session_id);
+          auto pulse_sink_name = get_sink_name(*session);
           auto audio_server_name = audio_server ? audio::get_server_name(audio_server->server) : "";
           full_env.set("PULSE_SINK", pulse_sink_name);
           full_env.set("PULSE_SOURCE", pulse_sink_name + ".monitor");
@@ -345,115 +388,194 @@ auto setup_sessions_handlers(const immer::box<state::AppState> &app_state,
 
           if (run_session->stop_stream_when_over) {
             /* App exited, cleanup */
-            logs::log(logs::debug, "[STREAM_SESSION] Remove virtual audio sink");
-            if (session->app->start_audio_server) {
-              audio::delete_virtual_sink(audio_server->server, session->audio_sink->load());
-            }
-
             session->wayland_display->store(nullptr);
 
             app_state->event_bus->fire_event(
                 immer::box<events::StopStreamEvent>(events::StopStreamEvent{.session_id = session->session_id}));
+
+            /* The audio producer has been stopped, we can safely hand over the sink to the next session */
+            if (auto v_device = session->audio_sink->load().get(); v_device && audio_server) {
+              logs::log(logs::debug, "[STREAM_SESSION] Return virtual audio sink");
+              audio::return_virtual_sink(audio_server->sink_pool, v_device);
+              session->audio_sink->store(nullptr);
+            }
           }
         }).detach();
       }));
 
-  // Video streaming pipeline
-  handlers.push_back(app_state->event_bus->register_handler<immer::box<events::VideoSession>>(
-      [=](const immer::box<events::VideoSession> &sess) {
-        std::thread([=]() {
-          boost::promise<unsigned short> port_promise;
-          auto port_fut = port_promise.get_future();
-          std::once_flag called;
-          auto ev_handler = app_state->event_bus->register_handler<immer::box<events::RTPVideoPingEvent>>(
-              [pp = std::ref(port_promise), &called, sess](const immer::box<events::RTPVideoPingEvent> &ping_ev) {
-                std::call_once(called, [=]() { // We'll keep receiving PING requests, but we only want the first one
-                  if (ping_ev->client_ip == sess->client_ip) {
-                    pp.get().set_value(ping_ev->client_port); // This throws when set multiple times
-                  }
-                });
-              });
-
-          std::shared_ptr<std::atomic_bool> cancel_job = std::make_shared<std::atomic<bool>>(false);
-          auto cancel_event = app_state->event_bus->register_handler<immer::box<events::VideoSession>>(
-              [=](const immer::box<events::VideoSession> &new_sess) {
-                if (new_sess->session_id == sess->session_id) {
-                  // A new VideoSession has been queued whilst we still haven't received a PING
-                  *cancel_job = true;
-                }
-              });
-
-          logs::log(logs::debug, "Video session {}, waiting for PING...", sess->session_id);
-
-          // Stop here until we get a PING
-          auto status = port_fut.wait_for(boost::chrono::milliseconds(DEFAULT_SESSION_TIMEOUT_MILLIS));
-          if (status != boost::future_status::ready) {
-            logs::log(logs::warning, "Video session {} timed out waiting for PING", sess->session_id);
-            return;
-          }
-          auto client_port = port_fut.get();
-          cancel_event.unregister();
-          ev_handler.unregister();
+  return handlers.persistent();
+}
 
-          if (*cancel_job) {
-            return;
-          }
+/**
+ * Audio and video pipelines are started as soon as the client PINGs the RTP ports
+ */
+auto setup_session_orchestrator(ba::io_context &io_context,
+                                const immer::box<state::AppState> &app_state,
+                                const std::optional<AudioServer> &audio_server) {
+  return std::make_unique<streaming::SessionOrchestrator>(
+      io_context,
+      app_state->event_bus,
+      std::chrono::milliseconds(DEFAULT_SESSION_TIMEOUT_MILLIS),
+      [app_state](const immer::box<events::VideoSession> &sess, unsigned short client_port) {
+        streaming::start_streaming_video(sess, app_state->event_bus, client_port);
+      },
+      [app_state, audio_server](const immer::box<events::AudioSession> &sess, unsigned short client_port) {
+        auto audio_server_name = audio_server ? audio::get_server_name(audio_server->server)
+                                              : std::optional<std::string>();
+        auto stream_session = state::get_session_by_id(app_state->running_sessions->load_index(), sess->session_id);
+        auto sink_name = fmt::format("virtual_sink_{}.monitor", sess->session_id);
+        if (stream_session) {
+          sink_name = get_sink_name(*stream_session) + ".monitor";
+        }
+        auto server_name = audio_server_name ? audio_server_name.value() : "";
 
-          streaming::start_streaming_video(sess, app_state->event_bus, client_port);
-        }).detach();
-      }));
+        streaming::start_streaming_audio(sess, app_state->event_bus, client_port, sink_name, server_name);
+      });
+}
 
-  // Audio streaming pipeline
-  handlers.push_back(app_state->event_bus->register_handler<immer::box<events::AudioSession>>(
-      [=](const immer::box<events::AudioSession> &sess) {
-        std::thread([=]() {
-          boost::promise<unsigned short> port_promise;
-          auto port_fut = port_promise.get_future();
-          std::once_flag called;
-          auto ev_handler = app_state->event_bus->register_handler<immer::box<events::RTPAudioPingEvent>>(
-              [pp = std::ref(port_promise), &called, sess](const immer::box<events::RTPAudioPingEvent> &ping_ev) {
-                std::call_once(called, [=]() { // We'll keep receiving PING requests, but we only want the first one
-                  if (ping_ev->client_ip == sess->client_ip) {
-                    pp.get().set_value(ping_ev->client_port); // This throws when set multiple times
-                  }
-                });
-              });
-
-          std::shared_ptr<std::atomic_bool> cancel_job = std::make_shared<std::atomic<bool>>(false);
-          auto cancel_event = app_state->event_bus->register_handler<immer::box<events::AudioSession>>(
-              [=](const immer::box<events::AudioSession> &new_sess) {
-                if (new_sess->session_id == sess->session_id) {
-                  // A new AudioSession has been queued whilst we still haven't received a PING
-                  *cancel_job = true;
-                }
-              });
-
-          logs::log(logs::debug, "Audio session {}, waiting for PING...", sess->session_id);
-
-          // Stop here until we get a PING
-          auto status = port_fut.wait_for(boost::chrono::milliseconds(DEFAULT_SESSION_TIMEOUT_MILLIS));
-          if (status != boost::future_status::ready) {
-            logs::log(logs::warning, "Audio session {} timed out waiting for PING", sess->session_id);
-            return;
-          }
-          auto client_port = port_fut.get();
-          cancel_event.unregister();
-          ev_handler.unregister();
+/**
+ * Stops all the running sessions and waits (up to timeout) for them to be removed
+ */
+void stop_running_sessions(const immer::box<state::AppState> &app_state, std::chrono::milliseconds timeout) {
+  for (const auto &[session_id, session] : app_state->running_sessions->load()) {
+    logs::log(logs::info, "Stopping session {}", session_id);
+    app_state->event_bus->fire_event(
+        immer::box<events::StopStreamEvent>(events::StopStreamEvent{.session_id = session_id}));
+  }
 
-          if (*cancel_job) {
-            return;
-          }
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!app_state->running_sessions->load().empty() && std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(100ms);
+  }
+}
 
-          auto audio_server_name = audio_server ? audio::get_server_name(audio_server->server)
-                                                : std::optional<std::string>();
-          auto sink_name = fmt::format("virtual_sink_{}.monitor", sess->session_id);
-          auto server_name = audio_server_name ? audio_server_name.value() : "";
+/**
+ * The Wolf process that we have taken over from, its sessions are still running
+ */
+struct PreviousProcess {
+  int connection;
+  handover::State state;
+};
 
-          streaming::start_streaming_audio(sess, app_state->event_bus, client_port, sink_name, server_name);
-        }).detach();
-      }));
+/**
+ * Takes over from the Wolf process listening on the handover socket, if there's one
+ */
+std::optional<PreviousProcess> take_over(const std::string &socket_path, const immer::box<state::AppState> &app_state) {
+  auto connection = handover::connect(socket_path);
+  if (!connection) {
+    return {};
+  }
 
-  return handlers.persistent();
+  handover::ReceivedState received;
+  try {
+    received = handover::receive_state(*connection);
+    // The previous process has stopped accepting new sessions, we can start our servers
+    handover::wait_ack(*connection);
+  } catch (const std::exception &e) {
+    logs::log(logs::warning, "[HANDOVER] Unable to take over from the previous process: {}", e.what());
+    for (auto fd : received.fds) {
+      ::close(fd);
+    }
+    ::close(*connection);
+    return {};
+  }
+
+  for (std::size_t i = 0; i < received.fds.size(); i++) {
+    handover::Sockets::get().inherit(received.state.sockets[i], received.fds[i]);
+  }
+  handover::adopt_state(app_state, received.state);
+  if (auto control_port = handover::pick_control_port(received.state, state::get_control_shards())) {
+    state::control_port_base() = *control_port;
+    logs::log(logs::info, "[HANDOVER] New sessions will use the control ports from {}", *control_port);
+  } else {
+    logs::log(logs::warning,
+              "[HANDOVER] Not enough free control ports, new sessions can't connect until the previous process exits");
+  }
+  logs::log(logs::info,
+            "[HANDOVER] Took over from the previous process, {} sessions are still running there",
+            received.state.sessions.size());
+  return PreviousProcess{.connection = *connection, .state = received.state};
+}
+
+/**
+ * Waits for the next Wolf process on the handover socket and hands over the listening sockets; running sessions
+ * keep streaming from this process until they are over, then this process shuts down.
+ */
+void serve_handover(const std::string &socket_path,
+                    const immer::box<state::AppState> &app_state,
+                    const streaming::SessionOrchestrator &orchestrator,
+                    services::Registry &service_registry,
+                    std::stop_token stop_token) {
+  ba::io_context io_context;
+  ba::local::stream_protocol::acceptor acceptor(io_context);
+  ba::local::stream_protocol::socket next_process(io_context);
+  try {
+    fs::remove(socket_path);
+    acceptor.open();
+    acceptor.bind(ba::local::stream_protocol::endpoint(socket_path));
+    // Whoever connects gets our sockets and paired clients: restrict it before accepting connections
+    fs::permissions(socket_path, fs::perms::owner_read | fs::perms::owner_write);
+    acceptor.listen(1);
+  } catch (const std::exception &e) {
+    logs::log(logs::error, "[HANDOVER] Unable to listen on {}: {}", socket_path, e.what());
+    return;
+  }
+  logs::log(logs::info, "[HANDOVER] Waiting for the next process on {}", socket_path);
+
+  bool connected = false;
+  std::stop_callback stop_handover(stop_token, [&io_context]() { io_context.stop(); });
+  acceptor.async_accept(next_process, [&connected](const boost::system::error_code &ec) { connected = !ec; });
+  io_context.run();
+  acceptor.close();
+  if (!connected) {
+    std::error_code ec;
+    fs::remove(socket_path, ec);
+    return;
+  }
+
+  logs::log(logs::info, "[HANDOVER] Handing over to the next process");
+  try {
+    auto state = handover::collect_state(app_state);
+    std::vector<int> fds;
+    for (const auto &[name, fd] : handover::Sockets::get().get_published()) {
+      state.sockets.push_back(name);
+      fds.push_back(fd);
+    }
+    handover::send_state(next_process.native_handle(), state, fds);
+  } catch (const std::exception &e) {
+    logs::log(logs::error, "[HANDOVER] Unable to send our state: {}", e.what());
+    return;
+  }
+
+  // New sessions are up to the next process from now on
+  service_registry.stop("http");
+  service_registry.stop("https");
+  service_registry.stop("rtsp");
+  rtp::ping_server().close_all();
+  try {
+    handover::send_ack(next_process.native_handle());
+  } catch (const std::exception &e) {
+    logs::log(logs::warning, "[HANDOVER] The next process has gone away: {}", e.what());
+  }
+
+  while (!stop_token.stop_requested()) {
+    auto sessions = app_state->running_sessions->load();
+    if (sessions.empty()) {
+      logs::log(logs::info, "[HANDOVER] All the sessions are over, shutting down");
+      std::raise(SIGTERM); // Same as a normal shutdown, this will also close the connection to the next process
+      return;
+    }
+    // Without our servers paused or starting sessions can't go on, the next process can't resume them either: the
+    // clients will have to launch them again
+    for (const auto &[session_id, session] : sessions) {
+      if (orchestrator.get_video_phase(session_id) != streaming::SessionPhase::STREAMING) {
+        logs::log(logs::info, "[HANDOVER] Stopping session {}, it's not streaming", session_id);
+        app_state->event_bus->fire_event(
+            immer::box<events::StopStreamEvent>(events::StopStreamEvent{.session_id = session_id}));
+      }
+    }
+    std::this_thread::sleep_for(1s);
+  }
 }
 
 /**
@@ -471,31 +593,63 @@ void run() {
   auto p_key_file = utils::get_env("WOLF_PRIVATE_KEY_FILE", "key.pem");
   auto p_cert_file = utils::get_env("WOLF_PRIVATE_CERT_FILE", "cert.pem");
   auto local_state = initialize(config_file, p_key_file, p_cert_file);
+  threads::Topology::get().configure(local_state->config->threads);
+
+  // Zero-downtime restarts: take over from the previous process, if it's still running
+  auto handover_socket = utils::get_env("WOLF_HANDOVER_SOCKET");
+  std::optional<PreviousProcess> previous_process;
+  if (handover_socket) {
+    previous_process = take_over(handover_socket, local_state);
+  }
+
+  auto &service_registry = services::Registry::get();
 
   // HTTP APIs
-  auto http_thread = std::thread([local_state]() {
+  service_registry.start("http", [local_state](std::stop_token stop_token) {
     HttpServer server = HttpServer();
+    std::stop_callback stop_server(stop_token, [&server]() { server.stop(); });
     HTTPServers::startServer(&server, local_state, state::HTTP_PORT);
   });
 
   // HTTPS APIs
-  std::thread([local_state, p_key_file, p_cert_file]() {
+  service_registry.start("https", [local_state, p_key_file, p_cert_file](std::stop_token stop_token) {
     HttpsServer server = HttpsServer(p_cert_file, p_key_file);
+    std::stop_callback stop_server(stop_token, [&server]() { server.stop(); });
     HTTPServers::startServer(&server, local_state, state::HTTPS_PORT);
-  }).detach();
+  });
 
   // RTSP
-  std::thread([sessions = local_state->running_sessions]() {
-    rtsp::run_server(state::RTSP_SETUP_PORT, sessions);
-  }).detach();
+  service_registry.start("rtsp", [sessions = local_state->running_sessions](std::stop_token stop_token) {
+    rtsp::run_server(state::RTSP_SETUP_PORT, sessions, stop_token);
+  });
 
-  // Control
-  std::thread([sessions = local_state->running_sessions, ev_bus = local_state->event_bus]() {
-    control::run_control(state::CONTROL_PORT, sessions, ev_bus);
-  }).detach();
+  // Control, one thread per ENet host
+  for (int shard = 0; shard < state::get_control_shards(); shard++) {
+    auto sessions = local_state->running_sessions;
+    auto ev_bus = local_state->event_bus;
+    service_registry.start(fmt::format("control-{}", shard), [sessions, ev_bus, shard](std::stop_token stop_token) {
+      // Inherited by the input workers spawned from here
+      threads::ScopedRole thread_role(threads::Role::CONTROL);
+      // After a handover the previous process keeps its ENet hosts until all of its sessions are over, we only have
+      // to wait for them when there was no room for a separate range of ports
+      bool retrying = false;
+      while (!stop_token.stop_requested()) {
+        try {
+          control::run_control(state::control_port_base() + shard, sessions, ev_bus, stop_token);
+        } catch (const std::exception &e) {
+          logs::log(retrying ? logs::debug : logs::warning, "{}, retrying every second", e.what());
+          retrying = true;
+          std::this_thread::sleep_for(1s);
+        }
+      }
+    });
+  }
 
   // Wolf API server
-  std::thread([local_state]() { wolf::api::start_server(local_state); }).detach();
+  service_registry.start("api", [local_state](std::stop_token stop_token) {
+    threads::ScopedRole thread_role(threads::Role::API);
+    wolf::api::start_server(local_state, stop_token);
+  });
 
   // mDNS
   try {
@@ -515,7 +669,50 @@ void run() {
   auto audio_server = setup_audio_server(runtime_dir);
   auto sess_handlers = setup_sessions_handlers(local_state, runtime_dir, audio_server);
 
-  http_thread.join(); // Let's park the main thread over here
+  // A single thread drives the setup of all the sessions
+  ba::io_context sessions_io_context;
+  auto orchestrator = setup_session_orchestrator(sessions_io_context, local_state, audio_server);
+  service_registry.start("sessions", [&sessions_io_context](std::stop_token stop_token) {
+    auto work_guard = ba::make_work_guard(sessions_io_context);
+    std::stop_callback stop_sessions(stop_token, [&sessions_io_context]() { sessions_io_context.stop(); });
+    sessions_io_context.run();
+  });
+
+  if (previous_process) {
+    auto previous = *previous_process;
+    service_registry.start("handover-previous", [local_state, previous](std::stop_token stop_token) {
+      while (!stop_token.stop_requested()) {
+        if (handover::wait_closed(previous.connection, 1s)) {
+          logs::log(logs::info, "[HANDOVER] The previous process has exited");
+          handover::release_ports(local_state, previous.state);
+          break;
+        }
+      }
+      ::close(previous.connection);
+    });
+  }
+  if (handover_socket) {
+    auto socket_path = std::string(handover_socket);
+    auto sessions_orchestrator = orchestrator.get();
+    service_registry.start("handover", [local_state, socket_path, sessions_orchestrator](std::stop_token stop_token) {
+      serve_handover(socket_path, local_state, *sessions_orchestrator, services::Registry::get(), stop_token);
+    });
+  }
+
+  // Let's park the main thread over here until we are asked to stop
+  ba::io_context signals_io_context;
+  ba::signal_set signals(signals_io_context, SIGINT, SIGTERM);
+  signals.async_wait([](const boost::system::error_code &ec, int signal_number) {
+    logs::log(logs::info, "Received signal {}, shutting down", signal_number);
+  });
+  signals_io_context.run();
+
+  stop_running_sessions(local_state, SHUTDOWN_SESSIONS_TIMEOUT);
+  service_registry.stop_all();
+  if (audio_server) {
+    audio::delete_sink_pool(audio_server->sink_pool);
+  }
+  logs::log(logs::info, "Bye!");
 }
 
 int main(int argc, char *argv[]) try {
@@ -60,7 +60,7 @@ TEST_CASE("Docker TOML", "DOCKER") {
   docker::DockerAPI docker_api;
 
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   std::string toml_cfg = R"(
 
     type = "docker"
@@ -7,6 +7,7 @@
 #include <catch2/matchers/catch_matchers_vector.hpp>
 #include <chrono>
 #include <control/input_handler.hpp>
+#include <core/keycodes.hpp>
 #include <platforms/input.hpp>
 #include <platforms/linux/uinput/uinput.hpp>
 #include <thread>
@@ -51,6 +52,26 @@ TEST_CASE("uinput - keyboard", "[UINPUT]") {
   REQUIRE(events[0]->value == 0);
 }
 
+TEST_CASE("Moonlight key codes", "[UINPUT]") {
+  REQUIRE(keycodes::moonlight_to_linux(0x41) == KEY_A);
+  REQUIRE(keycodes::moonlight_to_linux(0xA0) == KEY_LEFTSHIFT);
+  REQUIRE_FALSE(keycodes::moonlight_to_linux(0xFF).has_value());
+  REQUIRE_FALSE(keycodes::moonlight_to_linux(0x1234).has_value());
+
+  REQUIRE(keycodes::linux_to_moonlight(KEY_A) == 0x41);
+  REQUIRE(keycodes::linux_to_moonlight(KEY_LEFTSHIFT) == 0x10); // The first mapping wins
+  REQUIRE_FALSE(keycodes::linux_to_moonlight(KEY_MAX + 1).has_value());
+
+  REQUIRE(keycodes::moonlight_button_to_linux(1) == BTN_LEFT);
+  REQUIRE(keycodes::moonlight_button_to_linux(42) == BTN_EXTRA);
+
+  // Unknown input types are ignored
+  auto session = events::StreamSession{};
+  auto unknown_pkt = pkts::MOUSE_BUTTON_PACKET{};
+  unknown_pkt.type = static_cast<pkts::INPUT_TYPE>(boost::endian::native_to_little(0x55000042));
+  REQUIRE_NOTHROW(control::handle_input(session, {}, &unknown_pkt));
+}
+
 TEST_CASE("uinput - pen tablet", "[UINPUT]") {
   auto session = events::StreamSession{.event_bus = std::make_shared<events::EventBusType>()};
   auto packet = pkts::PEN_PACKET{.event_type = pkts::TOUCH_EVENT_HOVER,
@@ -326,6 +347,27 @@ TEST_CASE("uinput - joypad", "[UINPUT]") {
 
     // TODO: test pressing buttons
 
+    { // Sticks and triggers are sent in a single frame
+      libevdev_ptr joypad_dev(libevdev_new(), ::libevdev_free);
+      auto event_node = std::find_if(dev_nodes.begin(), dev_nodes.end(), [](const std::string &node) {
+        return node.find("event") != std::string::npos;
+      });
+      REQUIRE(event_node != dev_nodes.end());
+      link_devnode(joypad_dev.get(), *event_node);
+
+      std::get<XboxOneJoypad>(*joypad).set_axes(1000, 2000, -1000, -2000, 100, 200);
+      auto events = fetch_events_debug(joypad_dev);
+      REQUIRE(events.size() == 6);
+      REQUIRE_THAT(libevdev_event_code_get_name(events[0]->type, events[0]->code), Equals("ABS_X"));
+      REQUIRE(events[0]->value == 1000);
+      REQUIRE_THAT(libevdev_event_code_get_name(events[1]->type, events[1]->code), Equals("ABS_Y"));
+      REQUIRE(events[1]->value == -2000);
+      REQUIRE_THAT(libevdev_event_code_get_name(events[4]->type, events[4]->code), Equals("ABS_Z"));
+      REQUIRE(events[4]->value == 100);
+      REQUIRE_THAT(libevdev_event_code_get_name(events[5]->type, events[5]->code), Equals("ABS_RZ"));
+      REQUIRE(events[5]->value == 200);
+    }
+
     { // UDEV
       std::vector<std::map<std::string, std::string>> udev_events;
       std::visit([&udev_events](auto &joypad) { udev_events = joypad.get_udev_events(); }, *joypad);
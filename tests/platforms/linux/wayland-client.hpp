@@ -9,7 +9,7 @@ extern "C" {
 #include <errno.h>
 #include <fcntl.h>
 #include <helpers/logger.hpp>
-#include <helpers/tsqueue.hpp>
+#include <helpers/mpmc_queue.hpp>
 #include <helpers/utils.hpp>
 #include <memory>
 #include <sys/mman.h>
@@ -227,7 +227,7 @@ static const struct wl_keyboard_listener wl_keyboard_listener = {
            struct wl_surface *surface,
            struct wl_array *keys) {
           logs::log(logs::debug, "[KEYBOARD] Got enter event: serial={}", serial);
-          auto queue = static_cast<TSQueue<KeyEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<KeyEvent, 1024> *>(data);
           uint32_t *key;
           WL_ARRAY_FOR_EACH(key, keys, unsigned int *) {
             queue->push({*key, true});
@@ -240,7 +240,7 @@ static const struct wl_keyboard_listener wl_keyboard_listener = {
     .key =
         [](void *data, struct wl_keyboard *wl_keyboard, uint32_t serial, uint32_t time, uint32_t key, uint32_t state) {
           logs::log(logs::debug, "[KEYBOARD] Got key event: time={}, key={}, state={}", time, key, state);
-          auto queue = static_cast<TSQueue<KeyEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<KeyEvent, 1024> *>(data);
           queue->push({key, state == WL_KEYBOARD_KEY_STATE_PRESSED});
         },
     .modifiers =
@@ -262,11 +262,11 @@ static const struct wl_keyboard_listener wl_keyboard_listener = {
           logs::log(logs::debug, "[KEYBOARD] Got repeat info event: rate={}, delay={}", rate, delay);
         }};
 
-std::shared_ptr<TSQueue<KeyEvent>> w_get_keyboard_queue(WClientState &w_state) {
+std::shared_ptr<MPMCQueue<KeyEvent, 1024>> w_get_keyboard_queue(WClientState &w_state) {
   auto w_kb = wl_seat_get_keyboard(w_state.seat.get());
   REQUIRE(w_kb != nullptr);
   w_state.keyboard = std::shared_ptr<wl_keyboard>(w_kb, &wl_keyboard_destroy);
-  auto queue = std::make_shared<TSQueue<KeyEvent>>();
+  auto queue = std::make_shared<MPMCQueue<KeyEvent, 1024>>();
   wl_keyboard_add_listener(w_kb, &wl_keyboard_listener, queue.get());
   return queue;
 }
@@ -306,26 +306,26 @@ static const struct wl_pointer_listener wl_pointer_listener = {
            wl_fixed_t surface_x,
            wl_fixed_t surface_y) {
           logs::log(logs::debug, "[MOUSE] Got mouse enter event: surface_x={}, surface_y={}", surface_x, surface_y);
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::ENTER, .x = surface_x, .y = surface_y});
           // TODO: wl_pointer_set_cursor() here
         },
     .leave =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface) {
           logs::log(logs::debug, "[MOUSE] Got mouse leave event");
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::LEAVE});
         },
     .motion =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
           logs::log(logs::debug, "[MOUSE] Got mouse motion event: surface_x={}, surface_y={}", surface_x, surface_y);
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::MOTION, .x = surface_x, .y = surface_y});
         },
     .button =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
           logs::log(logs::debug, "[MOUSE] Got mouse button event: button={}, state={}", button, state);
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::BUTTON,
                        .button = button,
                        .button_pressed = state == WL_POINTER_BUTTON_STATE_PRESSED});
@@ -333,37 +333,37 @@ static const struct wl_pointer_listener wl_pointer_listener = {
     .axis =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis, wl_fixed_t value) {
           logs::log(logs::debug, "[MOUSE] Got mouse axis event: axis={}, value={}", axis, value);
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::AXIS, .axis = axis, .axis_value = value});
         },
     .frame =
         [](void *data, struct wl_pointer *wl_pointer) {
           logs::log(logs::debug, "[MOUSE] Got mouse frame event");
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::FRAME});
         },
     .axis_source =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t axis_source) {
           logs::log(logs::debug, "[MOUSE] Got mouse axis source event: axis_source={}", axis_source);
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::AXIS_SOURCE});
         },
     .axis_stop =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis) {
           logs::log(logs::debug, "[MOUSE] Got mouse axis stop event: time={}, axis={}", time, axis);
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::AXIS_STOP});
         },
     .axis_discrete =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t discrete) {
           logs::log(logs::debug, "[MOUSE] Got mouse axis discrete event: axis={}, discrete={}", axis, discrete);
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::AXIS_DISCRETE});
         },
     .axis_value120 =
         [](void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t value120) {
           logs::log(logs::debug, "[MOUSE] Got mouse axis value120 event: axis={}, value120={}", axis, value120);
-          auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+          auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
           queue->push({.type = MouseEventType::AXIS_VALUE120});
         }};
 
@@ -377,15 +377,15 @@ static const struct zwp_relative_pointer_v1_listener zwp_relative_pointer_v1_lis
                           wl_fixed_t dx_unaccel,
                           wl_fixed_t dy_unaccel) {
       logs::log(logs::debug, "[MOUSE] Got mouse relative motion event: dx={}, dy={}", dx, dy);
-      auto queue = static_cast<TSQueue<MouseEvent> *>(data);
+      auto queue = static_cast<MPMCQueue<MouseEvent, 1024> *>(data);
       queue->push({.type = MouseEventType::MOTION, .x = dx, .y = dy});
     }};
 
-std::shared_ptr<TSQueue<MouseEvent>> w_get_mouse_queue(WClientState &w_state) {
+std::shared_ptr<MPMCQueue<MouseEvent, 1024>> w_get_mouse_queue(WClientState &w_state) {
   auto w_pointer = wl_seat_get_pointer(w_state.seat.get());
   REQUIRE(w_pointer != nullptr);
   w_state.pointer = std::shared_ptr<wl_pointer>(w_pointer, &wl_pointer_destroy);
-  auto queue = std::make_shared<TSQueue<MouseEvent>>();
+  auto queue = std::make_shared<MPMCQueue<MouseEvent, 1024>>();
   wl_pointer_add_listener(w_pointer, &wl_pointer_listener, queue.get());
 
   auto zwp_pointer =
@@ -3,7 +3,23 @@
 
 using Catch::Matchers::Equals;
 
+#include <algorithm>
+#include <control/input_coalescer.hpp>
+#include <control/recording.hpp>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <helpers/mpmc_queue.hpp>
+#include <helpers/spsc_queue.hpp>
+#include <memory>
 #include <moonlight/control.hpp>
+#include <sstream>
+#include <streaming/latency.hpp>
+#include <thread>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
 using namespace moonlight::control;
 
 static std::string to_string(const ControlEncryptedPacket &packet) {
@@ -78,6 +94,464 @@ TEST_CASE("Control AES Encryption", "CONTROL") {
   }
 }
 
+TEST_CASE("Control AES Encryption with a reused context", "CONTROL") {
+  std::string aes_key = "EDF04A215C4FBEA20934120C8480D855";
+  auto encrypt_ctx = create_gcm_context(aes_key);
+  auto decrypt_ctx = create_gcm_context(aes_key);
+  std::array<unsigned char, sizeof(ControlEncryptedPacket)> packet_buffer = {};
+  std::array<char, MAX_PAYLOAD_SIZE> decrypt_buffer = {};
+
+  // Same packets as above, all going through the same contexts and buffers
+  std::vector<std::tuple<std::uint32_t, std::string, std::string>> packets = {
+      {0, "020302000000", "01001A0000000000BF0EB6DA10E47C702EC8644EB87D9CF7B6FAC9FF75CA"},
+      {1, "0703010000", "010019000100000021DBB8DC0590AF3A2B20BCE5A347DE31D366E5B9C5"},
+      {2, "000208000400000000000000", "0100200002000000220722FBADED58A03F2E8898F0F1DCB7C93F6235590618E4186AD990"},
+      {6,
+       "060212000000000E05000000033400C00000059F0329",
+       "01002A00060000005A4D999FB2542F85BDD39D99F77EB825254569D2C04E21241B5CEC01BD3F93129718ECC1F153"}};
+
+  for (const auto &[seq, payload_hex, expected] : packets) {
+    auto payload = crypto::hex_to_str(payload_hex);
+    auto size = encrypt_packet(encrypt_ctx, seq, payload, packet_buffer);
+    REQUIRE(size == encrypted_packet_size(payload.size()));
+    REQUIRE_THAT(crypto::str_to_hex({(char *)packet_buffer.data(), size}), Equals(expected));
+
+    auto decrypted = decrypt_packet(*(ControlEncryptedPacket *)packet_buffer.data(), decrypt_ctx, decrypt_buffer);
+    REQUIRE(decrypted == payload);
+  }
+
+  SECTION("Tampered packets are rejected") {
+    auto size = encrypt_packet(encrypt_ctx, 7, crypto::hex_to_str("0703010000"), packet_buffer);
+    packet_buffer[size - 1] ^= 0xFF;
+    REQUIRE_THROWS(decrypt_packet(*(ControlEncryptedPacket *)packet_buffer.data(), decrypt_ctx, decrypt_buffer));
+  }
+
+  SECTION("Output buffer too small") {
+    std::array<unsigned char, 8> small_buffer = {};
+    REQUIRE_THROWS(encrypt_packet(encrypt_ctx, 0, crypto::hex_to_str("0703010000"), small_buffer));
+  }
+}
+
+TEST_CASE("Control replay window", "CONTROL") {
+  ReplayWindow window;
+
+  SECTION("In order packets") {
+    for (std::uint32_t seq = 0; seq < 600; seq++) { // Goes past the wrap around of the authenticated byte
+      REQUIRE(window.check(seq));
+      window.update(seq);
+      REQUIRE_FALSE(window.check(seq));
+    }
+  }
+
+  SECTION("Out of order packets inside the window") {
+    window.update(10);
+    REQUIRE(window.check(5));
+    window.update(5);
+    REQUIRE_FALSE(window.check(5));
+    REQUIRE(window.check(9));
+    REQUIRE_FALSE(window.check(10));
+
+    window.update(12); // shifting the window doesn't forget what we've already seen
+    REQUIRE_FALSE(window.check(5));
+    REQUIRE_FALSE(window.check(10));
+    REQUIRE(window.check(11));
+  }
+
+  SECTION("Replayed packets with a bumped high byte are rejected") {
+    std::string aes_key = "EDF04A215C4FBEA20934120C8480D855";
+    auto encrypt_ctx = create_gcm_context(aes_key);
+    auto decrypt_ctx = create_gcm_context(aes_key);
+    std::array<unsigned char, sizeof(ControlEncryptedPacket)> packet_buffer = {};
+    std::array<char, MAX_PAYLOAD_SIZE> decrypt_buffer = {};
+    auto packet = (ControlEncryptedPacket *)packet_buffer.data();
+
+    for (std::uint32_t seq = 0; seq < 6; seq++) {
+      encrypt_packet(encrypt_ctx, seq, crypto::hex_to_str("0703010000"), packet_buffer);
+      REQUIRE(window.check(packet->seq));
+      decrypt_packet(*packet, decrypt_ctx, decrypt_buffer);
+      window.update(packet->seq);
+    }
+
+    // Only the low byte goes into the IV: the replayed packet still authenticates
+    packet->seq = boost::endian::native_to_little(std::uint32_t{5 + 256 * 3});
+    REQUIRE_NOTHROW(decrypt_packet(*packet, decrypt_ctx, decrypt_buffer));
+    REQUIRE_FALSE(window.check(packet->seq));
+
+    // The window hasn't moved: legitimate packets keep flowing
+    encrypt_packet(encrypt_ctx, 6, crypto::hex_to_str("0703010000"), packet_buffer);
+    REQUIRE(window.check(packet->seq));
+    window.update(packet->seq);
+    REQUIRE_FALSE(window.check(4));
+  }
+}
+
+TEST_CASE("Input SPSC queue", "CONTROL") {
+  SPSCQueue<int, 4> queue;
+
+  SECTION("Bounded") {
+    for (int i = 0; i < 4; i++) {
+      REQUIRE(queue.try_push(i));
+    }
+    REQUIRE_FALSE(queue.try_push(4));
+    REQUIRE(queue.size() == 4);
+
+    REQUIRE(queue.try_pop() == 0);
+    REQUIRE(queue.try_push(4));
+
+    std::vector<int> consumed;
+    REQUIRE(queue.consume_all([&consumed](int &value) { consumed.push_back(value); }) == 4);
+    REQUIRE(consumed == std::vector<int>{1, 2, 3, 4});
+    REQUIRE(queue.empty());
+    REQUIRE_FALSE(queue.try_pop().has_value());
+  }
+
+  SECTION("Close wakes up the consumer") {
+    REQUIRE(queue.try_push(1));
+    queue.close();
+    REQUIRE_FALSE(queue.try_push(2));
+    REQUIRE(queue.wait()); // pending elements can still be read
+    REQUIRE(queue.try_pop() == 1);
+    REQUIRE_FALSE(queue.wait());
+  }
+
+  SECTION("Wake up the consumer without pushing") {
+    std::atomic<bool> has_work = false;
+    auto waker = std::thread([&]() {
+      has_work = true;
+      queue.wake();
+    });
+    REQUIRE(queue.wait([&has_work]() { return has_work.load(); }));
+    REQUIRE(queue.empty());
+    waker.join();
+  }
+
+  SECTION("Wait with a deadline") {
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE(queue.wait_until(start + std::chrono::milliseconds(20), []() { return false; }));
+    REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(20));
+    REQUIRE(queue.empty());
+
+    // A push wakes up the consumer well before the deadline
+    auto producer = std::thread([&]() {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      queue.try_push(1);
+    });
+    start = std::chrono::steady_clock::now();
+    REQUIRE(queue.wait_until(start + std::chrono::seconds(10), []() { return false; }));
+    REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    REQUIRE(queue.try_pop() == 1);
+    producer.join();
+
+    queue.close();
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    REQUIRE_FALSE(queue.wait_until(deadline, []() { return false; }));
+  }
+
+  SECTION("Producer and consumer on different threads") {
+    constexpr int total = 10000;
+    int expected = 0;
+    bool in_order = true;
+    auto consumer = std::thread([&]() { // Catch2 assertions aren't thread safe, we check the results after join()
+      while (queue.wait()) {
+        queue.consume_all([&](int &value) { in_order = in_order && value == expected++; });
+      }
+    });
+
+    for (int i = 0; i < total; i++) {
+      while (!queue.try_push(i)) {
+        std::this_thread::yield();
+      }
+    }
+    queue.close();
+    consumer.join();
+    REQUIRE(in_order);
+    REQUIRE(expected == total);
+  }
+}
+
+TEST_CASE("MPMC queue", "CONTROL") {
+  MPMCQueue<std::unique_ptr<int>, 4> queue;
+
+  SECTION("Bounded, move only") {
+    for (int i = 0; i < 4; i++) {
+      REQUIRE(queue.push(std::make_unique<int>(i)));
+    }
+    auto rejected = std::make_unique<int>(4);
+    REQUIRE_FALSE(queue.push(std::move(rejected)));
+    REQUIRE(rejected); // a failed push doesn't steal the item
+    REQUIRE(queue.size() == 4);
+
+    for (int i = 0; i < 4; i++) {
+      REQUIRE(*queue.try_pop().value() == i);
+    }
+    REQUIRE_FALSE(queue.try_pop().has_value());
+
+    auto stats = queue.get_stats();
+    REQUIRE(stats.pushed == 4);
+    REQUIRE(stats.popped == 4);
+    REQUIRE(stats.rejected == 1);
+    REQUIRE(stats.high_watermark == 4);
+  }
+
+  SECTION("Timeout") {
+    REQUIRE_FALSE(queue.pop(std::chrono::milliseconds(5)).has_value());
+    REQUIRE_FALSE(queue.wait(std::chrono::milliseconds(5)));
+  }
+
+  SECTION("Close wakes up the consumer") {
+    auto consumer = std::thread([&queue]() { queue.wait(); });
+    queue.close();
+    consumer.join();
+    REQUIRE(queue.is_closed());
+    REQUIRE_FALSE(queue.push(std::make_unique<int>(1)));
+  }
+
+  SECTION("The eventfd becomes readable once armed") {
+    pollfd fd = {.fd = queue.native_handle(), .events = POLLIN, .revents = 0};
+    REQUIRE_FALSE(queue.arm());
+    REQUIRE(::poll(&fd, 1, 0) == 0);
+    REQUIRE(queue.push(std::make_unique<int>(1)));
+    REQUIRE(::poll(&fd, 1, 0) == 1);
+    REQUIRE(queue.arm()); // the element hasn't been popped yet
+  }
+
+  SECTION("Many producers and consumers") {
+    MPMCQueue<int, 64> ints;
+    constexpr int producers = 4;
+    constexpr int per_producer = 10000;
+    std::atomic<int> consumed = 0;
+    std::atomic<long> sum = 0;
+
+    std::vector<std::thread> threads;
+    for (int c = 0; c < 2; c++) {
+      threads.emplace_back([&]() {
+        while (true) {
+          if (auto value = ints.try_pop()) {
+            sum += *value;
+            consumed++;
+          } else if (ints.is_closed()) {
+            return;
+          } else {
+            ints.wait(std::chrono::milliseconds(10));
+          }
+        }
+      });
+    }
+    for (int p = 0; p < producers; p++) {
+      threads.emplace_back([&]() {
+        for (int i = 0; i < per_producer; i++) {
+          while (!ints.push(int(i))) {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+    for (int p = 0; p < producers; p++) {
+      threads[2 + p].join();
+    }
+    while (!ints.empty()) {
+      std::this_thread::yield();
+    }
+    ints.close();
+    threads[0].join();
+    threads[1].join();
+
+    REQUIRE(consumed == producers * per_producer);
+    REQUIRE(sum == long(producers) * per_producer * (per_producer - 1) / 2);
+    REQUIRE(ints.get_stats().high_watermark <= ints.capacity());
+  }
+}
+
+template <typename T> static control::InputPayload to_payload(const T &pkt) {
+  control::InputPayload payload = {.size = sizeof(T)};
+  std::copy_n((const char *)&pkt, sizeof(T), payload.data.begin());
+  return payload;
+}
+
+static control::InputPayload mouse_rel(short delta_x, short delta_y) {
+  pkts::MOUSE_MOVE_REL_PACKET pkt = {};
+  pkt.type = pkts::MOUSE_MOVE_REL;
+  pkt.delta_x = boost::endian::native_to_big(delta_x);
+  pkt.delta_y = boost::endian::native_to_big(delta_y);
+  return to_payload(pkt);
+}
+
+static control::InputPayload controller_motion(uint8_t controller_number, pkts::MOTION_TYPE type, float x) {
+  pkts::CONTROLLER_MOTION_PACKET pkt = {};
+  pkt.type = pkts::CONTROLLER_MOTION;
+  pkt.controller_number = controller_number;
+  pkt.motion_type = type;
+  pkt.x[0] = static_cast<uint8_t>(x);
+  return to_payload(pkt);
+}
+
+TEST_CASE("Input coalescing", "CONTROL") {
+  control::InputCoalescer coalescer(std::chrono::microseconds(0));
+  std::vector<control::InputPayload> flushed;
+  auto flush = [&]() { coalescer.flush([&](const control::InputPayload &input) { flushed.push_back(input); }); };
+
+  SECTION("Relative mouse movements are summed up") {
+    REQUIRE(coalescer.add(mouse_rel(1, -2)));
+    REQUIRE(coalescer.add(mouse_rel(10, -20)));
+    REQUIRE(coalescer.add(mouse_rel(100, -200)));
+    flush();
+
+    REQUIRE(flushed.size() == 1);
+    auto pkt = (pkts::MOUSE_MOVE_REL_PACKET *)flushed[0].pkt();
+    REQUIRE(boost::endian::big_to_native(pkt->delta_x) == 111);
+    REQUIRE(boost::endian::big_to_native(pkt->delta_y) == -222);
+    REQUIRE(coalescer.get_stats().received == 3);
+    REQUIRE(coalescer.get_stats().coalesced == 2);
+    REQUIRE(coalescer.empty());
+  }
+
+  SECTION("Overflowing deltas are not merged") {
+    REQUIRE(coalescer.add(mouse_rel(32000, 0)));
+    REQUIRE_FALSE(coalescer.add(mouse_rel(1000, 0)));
+  }
+
+  SECTION("Only the latest motion sample is kept, per controller and type") {
+    REQUIRE(coalescer.add(controller_motion(0, pkts::GYROSCOPE, 1)));
+    REQUIRE(coalescer.add(controller_motion(0, pkts::ACCELERATION, 2)));
+    REQUIRE(coalescer.add(controller_motion(1, pkts::GYROSCOPE, 3)));
+    REQUIRE(coalescer.add(controller_motion(0, pkts::GYROSCOPE, 4)));
+    flush();
+
+    REQUIRE(flushed.size() == 3);
+    auto first = (pkts::CONTROLLER_MOTION_PACKET *)flushed[0].pkt();
+    REQUIRE(first->controller_number == 0);
+    REQUIRE(first->motion_type == pkts::GYROSCOPE);
+    REQUIRE(first->x[0] == 4);
+    REQUIRE(((pkts::CONTROLLER_MOTION_PACKET *)flushed[1].pkt())->motion_type == pkts::ACCELERATION);
+    REQUIRE(((pkts::CONTROLLER_MOTION_PACKET *)flushed[2].pkt())->controller_number == 1);
+  }
+
+  SECTION("Other events can't be coalesced") {
+    pkts::KEYBOARD_PACKET key_pkt = {};
+    key_pkt.type = pkts::KEY_PRESS;
+    REQUIRE_FALSE(coalescer.add(to_payload(key_pkt)));
+
+    REQUIRE(coalescer.add(mouse_rel(1, 1)));
+    pkts::MOUSE_MOVE_ABS_PACKET abs_pkt = {};
+    abs_pkt.type = pkts::MOUSE_MOVE_ABS;
+    REQUIRE_FALSE(coalescer.add(to_payload(abs_pkt))); // relative and absolute moves must keep their order
+  }
+}
+
+TEST_CASE("Control stream recording", "CONTROL") {
+  using namespace control::recording;
+  using namespace std::chrono_literals;
+
+  auto out = std::make_unique<std::ostringstream>();
+  auto &recorded = *out;
+  Recorder recorder(std::move(out));
+  auto start = std::chrono::steady_clock::now();
+  recorder.write("first", start + 5ms);
+  recorder.write(std::string_view("\0\x06\x02", 3), start + 9ms);
+  REQUIRE(recorder.recorded_packets() == 2);
+
+  std::istringstream in(recorded.str());
+  auto records = read_recording(in);
+  REQUIRE(records.size() == 2);
+  REQUIRE(records[0].payload == "first");
+  REQUIRE(records[1].payload == std::string("\0\x06\x02", 3));
+  REQUIRE(records[1].timestamp - records[0].timestamp == 4ms);
+
+  // A partially written packet at the end is ignored
+  auto truncated = recorded.str();
+  truncated.pop_back();
+  std::istringstream truncated_in(truncated);
+  REQUIRE(read_recording(truncated_in).size() == 1);
+
+  std::istringstream invalid("not a recording");
+  REQUIRE_THROWS_AS(read_recording(invalid), std::runtime_error);
+
+  SECTION("Files are never reused") {
+    auto dir = std::filesystem::temp_directory_path() / fmt::format("wolf-recording-{}", ::getpid());
+    std::filesystem::remove_all(dir);
+    ::setenv("WOLF_CONTROL_RECORDING_DIR", dir.c_str(), 1);
+
+    // Same session, same second
+    auto first = Recorder::create(1234);
+    first->write("first");
+    auto second = Recorder::create(1234);
+    REQUIRE(first);
+    REQUIRE(second);
+    first.reset();
+    second.reset();
+
+    using std::filesystem::perms;
+    std::vector<std::size_t> recorded_packets;
+    for (const auto &entry : std::filesystem::directory_iterator(dir)) {
+      REQUIRE((entry.status().permissions() & perms::all) == (perms::owner_read | perms::owner_write));
+      std::ifstream file(entry.path(), std::ios::binary);
+      recorded_packets.push_back(read_recording(file).size());
+    }
+    // The first recording hasn't been truncated by the second one
+    std::sort(recorded_packets.begin(), recorded_packets.end());
+    REQUIRE(recorded_packets == std::vector<std::size_t>{0, 1});
+
+    ::unsetenv("WOLF_CONTROL_RECORDING_DIR");
+    std::filesystem::remove_all(dir);
+  }
+}
+
+TEST_CASE("Input latency tracing", "CONTROL") {
+  using namespace std::chrono_literals;
+  using namespace streaming::latency;
+
+  SECTION("Histogram") {
+    Histogram histogram;
+    REQUIRE(histogram.snapshot().count == 0);
+    REQUIRE(histogram.snapshot().p50_us == 0);
+
+    for (int i = 0; i < 98; i++) {
+      histogram.record(200us);
+    }
+    histogram.record(3ms);
+    histogram.record(1s);
+
+    auto snapshot = histogram.snapshot();
+    REQUIRE(snapshot.count == 100);
+    REQUIRE(snapshot.max_us == 1'000'000);
+    REQUIRE(snapshot.p50_us == 250);
+    REQUIRE(snapshot.p99_us == 4'000);
+    REQUIRE(snapshot.buckets.size() == Histogram::BUCKETS_US.size() + 1);
+    REQUIRE(snapshot.buckets[1].count == 98);
+    REQUIRE(snapshot.buckets.back().count == 1);
+    REQUIRE_FALSE(snapshot.buckets.back().upper_bound_us.has_value());
+  }
+
+  SECTION("Stages are correlated with the next frame") {
+    SessionTracer tracer(1234);
+    auto start = clock::now();
+
+    tracer.on_capture(start); // No input, nothing to trace
+    tracer.on_inject(start, start + 1ms);
+    tracer.on_inject(start + 2ms, start + 3ms); // Same frame, only the first one is traced end to end
+    tracer.on_capture(start + 10ms);
+    tracer.on_capture(start + 26ms);
+    tracer.on_send(start + 15ms);
+    tracer.on_send(start + 30ms); // Nothing pending
+
+    auto snapshot = tracer.snapshot();
+    REQUIRE(snapshot.session_id == "1234");
+    REQUIRE(snapshot.receive_to_inject.count == 2);
+    REQUIRE(snapshot.inject_to_capture.count == 1);
+    REQUIRE(snapshot.inject_to_capture.max_us == 9'000);
+    REQUIRE(snapshot.capture_to_send.max_us == 5'000);
+    REQUIRE(snapshot.receive_to_send.max_us == 15'000);
+
+    auto traces = tracer.get_traces();
+    REQUIRE(traces.size() == 1);
+    REQUIRE(traces[0].received == start);
+    REQUIRE(traces[0].sent == start + 15ms);
+
+    auto chrome_trace = to_chrome_trace({std::make_shared<SessionTracer>(1)});
+    REQUIRE(chrome_trace.traceEvents.empty());
+  }
+}
+
 TEST_CASE("control joypad input packets") {
   std::string payload =
       crypto::hex_to_str("060222000000001E0C0000001A000000010014000010000000000000000000009C0000005500");
@@ -0,0 +1,254 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include <algorithm>
+#include <gst-plugin/video.hpp>
+#include <moonlight/fec.hpp>
+#include <random>
+#include <vector>
+
+/*
+ * Simulates lossy links on top of our Reed Solomon implementation in order to see how much of the stream we can
+ * recover for a given FEC configuration, and at what cost in bandwidth.
+ */
+
+/**
+ * Each packet is lost independently with probability `loss`
+ */
+struct RandomLoss {
+  double loss;
+
+  bool is_lost(std::mt19937 &rng) {
+    return std::bernoulli_distribution(loss)(rng);
+  }
+};
+
+/**
+ * Gilbert-Elliott model: a two state Markov chain (good, bad) that models bursty losses.
+ * See: https://en.wikipedia.org/wiki/Burst_error#Gilbert%E2%80%93Elliott_model
+ */
+struct GilbertElliottLoss {
+  double good_to_bad;
+  double bad_to_good;
+  double loss_in_good = 0.0;
+  double loss_in_bad = 1.0;
+  bool in_bad_state = false;
+
+  bool is_lost(std::mt19937 &rng) {
+    auto transition = std::bernoulli_distribution(in_bad_state ? bad_to_good : good_to_bad)(rng);
+    if (transition) {
+      in_bad_state = !in_bad_state;
+    }
+    return std::bernoulli_distribution(in_bad_state ? loss_in_bad : loss_in_good)(rng);
+  }
+};
+
+/**
+ * For each frame, whether each packet of that frame is lost
+ */
+using LossMasks = std::vector<std::vector<bool>>;
+
+/* Reed Solomon can't go over 255 shards */
+static constexpr int MAX_SHARDS = 255;
+
+/**
+ * Draws the lost packets ahead of time, so that different FEC configurations can be compared under the exact same
+ * loss pattern: packet i of a frame is lost in every configuration, no matter how many shards it has.
+ */
+template <typename LossModel> static LossMasks generate_losses(LossModel loss_model, int frames, int seed = 42) {
+  std::mt19937 rng(seed);
+  LossMasks losses(frames, std::vector<bool>(MAX_SHARDS));
+  for (auto &frame : losses) {
+    for (int i = 0; i < MAX_SHARDS; i++) {
+      frame[i] = loss_model.is_lost(rng);
+    }
+  }
+  return losses;
+}
+
+/**
+ * The first `lost_packets` packets of every frame are lost
+ */
+static LossMasks lose_first(int lost_packets, int frames) {
+  LossMasks losses(frames, std::vector<bool>(MAX_SHARDS));
+  for (auto &frame : losses) {
+    std::fill_n(frame.begin(), lost_packets, true);
+  }
+  return losses;
+}
+
+struct SimulationResult {
+  int frames = 0;
+  int recovered_frames = 0;
+  int sent_packets = 0;
+  int lost_packets = 0;
+  int parity_shards = 0;
+  double bandwidth_overhead = 0.0; // parity bytes / data bytes
+
+  double recovery_rate() const {
+    return frames == 0 ? 0.0 : (double)recovered_frames / frames;
+  }
+};
+
+/**
+ * Splits a frame of `data_shards` packets for each of `losses` using the same FEC settings as
+ * rtpmoonlightpay_video, drops the packets marked in `losses` and tries to reconstruct them using
+ * moonlight::fec::decode
+ */
+static SimulationResult simulate_loss(const LossMasks &losses,
+                                      int data_shards,
+                                      int fec_percentage,
+                                      int min_required_fec_packets,
+                                      int seed = 42) {
+  auto rtpmoonlightpay = (gst_rtp_moonlight_pay_video *)g_object_new(gst_TYPE_rtp_moonlight_pay_video, nullptr);
+  rtpmoonlightpay->payload_size = 1024;
+  rtpmoonlightpay->fec_percentage = fec_percentage;
+  rtpmoonlightpay->min_required_fec_packets = min_required_fec_packets;
+  auto blocks = gst_moonlight_video::determine_split(*rtpmoonlightpay, data_shards);
+  g_object_unref(rtpmoonlightpay);
+
+  const auto nr_shards = blocks.data_shards + blocks.parity_shards;
+  REQUIRE(nr_shards <= MAX_SHARDS);
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> byte_dist(0, 255);
+
+  std::vector<std::vector<unsigned char>> original(nr_shards, std::vector<unsigned char>(blocks.block_size));
+  std::vector<std::vector<unsigned char>> received(nr_shards, std::vector<unsigned char>(blocks.block_size));
+  std::vector<unsigned char *> shards(nr_shards);
+  std::vector<unsigned char> marks(nr_shards);
+
+  SimulationResult result{.parity_shards = blocks.parity_shards,
+                          .bandwidth_overhead = (double)blocks.parity_shards / blocks.data_shards};
+  auto rs = moonlight::fec::create(blocks.data_shards, blocks.parity_shards);
+
+  for (const auto &frame_losses : losses) {
+    for (int i = 0; i < blocks.data_shards; i++) {
+      std::generate(original[i].begin(), original[i].end(), [&]() { return byte_dist(rng); });
+    }
+    for (int i = 0; i < nr_shards; i++) {
+      shards[i] = original[i].data();
+    }
+    REQUIRE(moonlight::fec::encode(rs.get(), shards.data(), nr_shards, blocks.block_size) == 0);
+
+    int lost = 0;
+    for (int i = 0; i < nr_shards; i++) {
+      marks[i] = frame_losses[i] ? 1 : 0;
+      lost += marks[i];
+      if (marks[i]) {
+        std::fill(received[i].begin(), received[i].end(), 0);
+      } else {
+        received[i] = original[i];
+      }
+      shards[i] = received[i].data();
+    }
+    result.frames++;
+    result.sent_packets += nr_shards;
+    result.lost_packets += lost;
+
+    if (lost == 0) {
+      result.recovered_frames++;
+      continue;
+    }
+
+    if (moonlight::fec::decode(rs.get(), shards.data(), marks.data(), nr_shards, blocks.block_size) == 0) {
+      bool all_data_ok = true;
+      for (int i = 0; i < blocks.data_shards && all_data_ok; i++) {
+        all_data_ok = received[i] == original[i];
+      }
+      result.recovered_frames += all_data_ok ? 1 : 0;
+    }
+  }
+
+  return result;
+}
+
+TEST_CASE("FEC recovers up to parity_shards lost packets", "[FEC]") {
+  moonlight::fec::init();
+
+  // No loss: everything should go through
+  auto no_loss = simulate_loss(lose_first(0, 50), 10, 20, 0);
+  REQUIRE(no_loss.recovered_frames == no_loss.frames);
+  REQUIRE(no_loss.lost_packets == 0);
+  REQUIRE(no_loss.parity_shards > 0);
+
+  // Exactly parity_shards lost packets can always be recovered, one more can't
+  auto parity_lost = simulate_loss(lose_first(no_loss.parity_shards, 50), 10, 20, 0);
+  REQUIRE(parity_lost.recovered_frames == parity_lost.frames);
+  auto too_many_lost = simulate_loss(lose_first(no_loss.parity_shards + 1, 50), 10, 20, 0);
+  REQUIRE(too_many_lost.recovered_frames == 0);
+
+  // min_required_fec_packets increases the overhead for small frames
+  auto min_fec = simulate_loss(lose_first(0, 1), 4, 20, 2);
+  REQUIRE(min_fec.bandwidth_overhead == 0.5);
+}
+
+TEST_CASE("FEC under random loss", "[FEC]") {
+  moonlight::fec::init();
+  auto losses = generate_losses(RandomLoss{.loss = 0.05}, 200);
+
+  // With a fixed seed the results must be reproducible
+  auto random_a = simulate_loss(losses, 20, 20, 0);
+  auto random_b = simulate_loss(generate_losses(RandomLoss{.loss = 0.05}, 200), 20, 20, 0);
+  REQUIRE(random_a.recovered_frames == random_b.recovered_frames);
+
+  // More parity should never make things worse under the same loss pattern
+  auto more_fec = simulate_loss(losses, 20, 50, 0);
+  REQUIRE(more_fec.recovered_frames >= random_a.recovered_frames);
+}
+
+TEST_CASE("FEC loss simulation report", "[.][FEC-simulation]") {
+  moonlight::fec::init();
+
+  auto fec_percentage = GENERATE(10, 20, 50);
+  auto min_required_fec_packets = GENERATE(0, 2, 4);
+  auto data_shards = GENERATE(4, 20, 80);
+  constexpr auto frames = 2000;
+
+  auto random = simulate_loss(generate_losses(RandomLoss{.loss = 0.02}, frames),
+                              data_shards,
+                              fec_percentage,
+                              min_required_fec_packets);
+  auto bursty = simulate_loss(generate_losses(GilbertElliottLoss{.good_to_bad = 0.01, .bad_to_good = 0.3}, frames),
+                              data_shards,
+                              fec_percentage,
+                              min_required_fec_packets);
+
+  logs::log(logs::info,
+            "[FEC] data_shards: {:3}, fec_percentage: {:2}%, min_required_fec_packets: {} | overhead: {:6.2f}% | "
+            "random (2%) recovered: {:6.2f}% | gilbert-elliott ({:.2f}% lost) recovered: {:6.2f}%",
+            data_shards,
+            fec_percentage,
+            min_required_fec_packets,
+            random.bandwidth_overhead * 100,
+            random.recovery_rate() * 100,
+            100.0 * bursty.lost_packets / bursty.sent_packets,
+            bursty.recovery_rate() * 100);
+}
+
+TEST_CASE("FEC decode benchmark", "[.][FEC-benchmark]") {
+  moonlight::fec::init();
+
+  auto data_shards = GENERATE(20, 80);
+  constexpr auto parity_shards = 16;
+  constexpr auto block_size = 1024;
+  const auto nr_shards = data_shards + parity_shards;
+
+  auto rs = moonlight::fec::create(data_shards, parity_shards);
+  std::vector<std::vector<unsigned char>> blocks(nr_shards, std::vector<unsigned char>(block_size, 0xAB));
+  std::vector<unsigned char *> shards(nr_shards);
+  for (int i = 0; i < nr_shards; i++) {
+    shards[i] = blocks[i].data();
+  }
+  moonlight::fec::encode(rs.get(), shards.data(), nr_shards, block_size);
+
+  std::vector<unsigned char> marks(nr_shards, 0);
+  for (int i = 0; i < parity_shards; i++) {
+    marks[i * data_shards / parity_shards] = 1; // spread the losses over the data shards
+  }
+
+  BENCHMARK("decode " + std::to_string(data_shards) + " data shards, " + std::to_string(parity_shards) + " lost") {
+    auto marks_copy = marks;
+    return moonlight::fec::decode(rs.get(), shards.data(), marks_copy.data(), nr_shards, block_size);
+  };
+}
@@ -7,8 +7,11 @@
 using Catch::Matchers::Equals;
 
 #include <gst-plugin/audio.hpp>
+#include <gst-plugin/gstmoonlightopusenc.hpp>
+#include <gst/app/gstappsink.h>
 #include <gst-plugin/video.hpp>
 #include <moonlight/fec.hpp>
+#include <state/data-structures.hpp>
 #include <string>
 
 using namespace std::string_literals;
@@ -364,6 +367,11 @@ TEST_CASE_METHOD(GStreamerTestsFixture, "Audio RTP packet creation", "[GSTPlugin
   auto first_pkt = gst_buffer_list_get(rtp_packets, 0);
 
   SECTION("First packet") {
+    // Header and ciphertext are written into a single pooled buffer
+    REQUIRE(rtpmoonlightpay->packets_pool != nullptr);
+    REQUIRE(first_pkt->pool == rtpmoonlightpay->packets_pool);
+    REQUIRE(gst_buffer_n_memory(first_pkt) == 1);
+
     auto rtp_packet = get_rtp_audio_from_buf(first_pkt);
 
     REQUIRE(rtp_packet->rtp.ssrc == 0);
@@ -498,3 +506,59 @@ TEST_CASE_METHOD(GStreamerTestsFixture, "Audio RTP packet creation", "[GSTPlugin
     }
   }
 }
+
+TEST_CASE_METHOD(GStreamerTestsFixture, "Opus multistream encoder", "[GSTPlugin]") {
+  gst_element_register(nullptr, "moonlightopusenc", GST_RANK_NONE, gst_TYPE_moonlight_opus_enc);
+
+  auto audio_mode = state::get_audio_mode(6, true);
+  REQUIRE(audio_mode.streams == 6);
+  REQUIRE(audio_mode.coupled_streams == 0);
+  REQUIRE(state::get_audio_mode(6, false).coupled_streams == 2);
+
+  auto pipeline_str = fmt::format("audiotestsrc num-buffers=20 ! audioconvert ! "
+                                  "audio/x-raw, channels={}, rate=48000, channel-mask=(bitmask)0x3f ! "
+                                  "moonlightopusenc name=encoder bitrate={} streams={} coupled_streams={} ! "
+                                  "appsink name=sink sync=false",
+                                  audio_mode.channels,
+                                  audio_mode.bitrate,
+                                  audio_mode.streams,
+                                  audio_mode.coupled_streams);
+  auto pipeline = gst_parse_launch(pipeline_str.c_str(), nullptr);
+  REQUIRE(pipeline != nullptr);
+  auto sink = gst_bin_get_by_name(GST_BIN(pipeline), "sink");
+  REQUIRE(gst_element_set_state(pipeline, GST_STATE_PLAYING) != GST_STATE_CHANGE_FAILURE);
+
+  auto sample = gst_app_sink_pull_sample(GST_APP_SINK(sink));
+  REQUIRE(sample != nullptr);
+  auto first_pkt_size = gst_buffer_get_size(gst_sample_get_buffer(sample));
+  REQUIRE(first_pkt_size > 0);
+  REQUIRE(first_pkt_size <= AUDIO_MAX_BLOCK_SIZE);
+  gst_sample_unref(sample);
+
+  // CBR: all packets should have the same size
+  sample = gst_app_sink_pull_sample(GST_APP_SINK(sink));
+  REQUIRE(sample != nullptr);
+  REQUIRE(gst_buffer_get_size(gst_sample_get_buffer(sample)) == first_pkt_size);
+  gst_sample_unref(sample);
+
+  // Bitrate can be changed at runtime
+  auto encoder = gst_bin_get_by_name(GST_BIN(pipeline), "encoder");
+  g_object_set(encoder, "bitrate", 256000, nullptr);
+  int bitrate = 0;
+  g_object_get(encoder, "bitrate", &bitrate, nullptr);
+  REQUIRE(bitrate == 256000);
+
+  // Opus can't encode frames of any duration
+  gst_element_set_state(pipeline, GST_STATE_NULL);
+  g_object_set(encoder, "packet_duration", 7, nullptr);
+  int packet_duration = 0;
+  g_object_get(encoder, "packet_duration", &packet_duration, nullptr);
+  REQUIRE(packet_duration == 5);
+  g_object_set(encoder, "packet_duration", 20, nullptr);
+  g_object_get(encoder, "packet_duration", &packet_duration, nullptr);
+  REQUIRE(packet_duration == 20);
+
+  gst_object_unref(encoder);
+  gst_object_unref(sink);
+  gst_object_unref(pipeline);
+}
@@ -1,3 +1,4 @@
+#include <catch2/benchmark/catch_benchmark.hpp>
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_container_properties.hpp>
 #include <catch2/matchers/catch_matchers_contains.hpp>
@@ -7,12 +8,26 @@
 
 using Catch::Matchers::Equals;
 
+#include <algorithm>
 #include <crypto/crypto.hpp>
+#include <filesystem>
+#include <future>
+#include <handover/handover.hpp>
 #include <moonlight/protocol.hpp>
+#include <netinet/in.h>
+#include <platforms/services.hpp>
+#include <platforms/threads.hpp>
 #include <range/v3/view.hpp>
+#include <rtp/udp-ping.hpp>
 #include <rest/helpers.hpp>
 #include <state/config.hpp>
+#include <streaming/orchestrator.hpp>
 #include <streaming/streaming.hpp>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
 
 using namespace moonlight;
 using namespace state;
@@ -20,7 +35,7 @@ using namespace ranges;
 
 TEST_CASE("LocalState load TOML", "[LocalState]") {
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   auto state = state::load_or_default("config.test.toml", event_bus, running_sessions);
   REQUIRE(state.hostname == "Wolf");
   REQUIRE(state.uuid == "0000-1111-2222-3333");
@@ -132,7 +147,7 @@ TEST_CASE("LocalState pairing information", "[LocalState]") {
 
 TEST_CASE("Mocked serverinfo", "[MoonlightProtocol]") {
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   auto cfg = state::load_or_default("config.test.toml", event_bus, running_sessions);
   immer::array<DisplayMode> displayModes = {{1920, 1080, 60}, {1024, 768, 30}};
 
@@ -337,7 +352,7 @@ TEST_CASE("Pairing moonlight", "[MoonlightProtocol]") {
 
 TEST_CASE("applist", "[MoonlightProtocol]") {
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   auto cfg = state::load_or_default("config.test.toml", event_bus, running_sessions);
   auto base_apps = cfg.apps->load().get() | views::transform([](auto app) { return app->base; }) |
                    to<immer::vector<moonlight::App>>();
@@ -351,7 +366,7 @@ TEST_CASE("applist", "[MoonlightProtocol]") {
 
 TEST_CASE("launch", "[MoonlightProtocol]") {
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   auto cfg = state::load_or_default("config.test.toml", event_bus, running_sessions);
   auto result = launch_success("192.168.1.1", "3021");
   REQUIRE(xml_to_str(result) == "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
@@ -369,39 +384,647 @@ TEST_CASE("Multiple users", "[HTTP]") {
       .host = {},
       .pairing_cache = std::make_shared<immer::atom<immer::map<std::string, state::PairCache>>>(),
       .event_bus = event_bus,
-      .running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>()};
+      .running_sessions = std::make_shared<state::RunningSessions>()};
 
-  auto client1 = state::PairedClient{.app_state_folder = "test"};
   auto app1 = events::App{.base = moonlight::App{.title = "test_app"}};
-  auto client1_ip = "0.0.0.0";
-  auto client1_headers = SimpleWeb::CaseInsensitiveMultimap{{"rikey", "1234"}, {"rikeyid", "5678"}};
-  auto session1 = endpoints::https::create_run_session(client1_headers, client1_ip, client1, app_state, app1);
+  auto client_ip = "0.0.0.0";
+  auto client_headers = SimpleWeb::CaseInsensitiveMultimap{{"rikey", "1234"}, {"rikeyid", "5678"}};
+  auto client1 = state::PairedClient{.client_cert = "1", .app_state_folder = "test"};
+  auto client2 = state::PairedClient{.client_cert = "2", .app_state_folder = "test"};
+  auto client3 = state::PairedClient{.client_cert = "3", .app_state_folder = "test"};
+  auto session1 = endpoints::https::create_run_session(client_headers, client_ip, client1, app_state, app1);
 
   REQUIRE(session1->video_stream_port == 48100);
   REQUIRE(session1->audio_stream_port == 48200);
 
-  app_state.running_sessions->update([session1](auto &sessions) { return sessions.push_back(*session1); });
-  auto session2 = endpoints::https::create_run_session(client1_headers, client1_ip, client1, app_state, app1);
+  app_state.running_sessions->add(*session1);
+  auto session2 = endpoints::https::create_run_session(client_headers, client_ip, client2, app_state, app1);
 
   REQUIRE(session2->video_stream_port == 48101);
   REQUIRE(session2->audio_stream_port == 48201);
 
   // Saving only the second session
-  app_state.running_sessions->update(
-      [session2](auto &sessions) { return immer::vector<events::StreamSession>{*session2}; });
+  app_state.running_sessions->add(*session2);
+  app_state.running_sessions->remove(session1->session_id);
   // We should now assign back the now available [48100, 48200] ports
-  auto session3 = endpoints::https::create_run_session(client1_headers, client1_ip, client1, app_state, app1);
+  auto session3 = endpoints::https::create_run_session(client_headers, client_ip, client3, app_state, app1);
 
   REQUIRE(session3->video_stream_port == 48100);
   REQUIRE(session3->audio_stream_port == 48200);
 
-  // Saving all 3 sessions (even if one is a duplicate)
-  app_state.running_sessions->update([session1, session2, session3](auto &sessions) {
-    return immer::vector<events::StreamSession>{*session1, *session2, *session3};
+  // Resuming replaces the session with the same id, the ports of the old session are released
+  app_state.running_sessions->add(*session3);
+  auto resumed_session3 = endpoints::https::create_run_session(client_headers, client_ip, client3, app_state, app1);
+  REQUIRE(resumed_session3->video_stream_port == 48102);
+  app_state.running_sessions->add(*resumed_session3);
+  REQUIRE(app_state.running_sessions->load().size() == 2);
+  auto session4 = endpoints::https::create_run_session(client_headers, client_ip, client1, app_state, app1);
+
+  REQUIRE(session4->video_stream_port == 48100);
+  REQUIRE(session4->audio_stream_port == 48200);
+}
+
+TEST_CASE("Running sessions index", "[LocalState]") {
+  auto running_sessions = state::RunningSessions();
+  auto session1 = events::StreamSession{.session_id = 1, .ip = "192.168.1.1"};
+  auto session2 = events::StreamSession{.session_id = 2, .ip = "192.168.1.2"};
+
+  REQUIRE(state::find_session_by_id(running_sessions.load_index(), 1) == nullptr);
+
+  running_sessions.add(session1);
+  running_sessions.add(session2);
+  {
+    auto index = running_sessions.load_index();
+    REQUIRE(state::find_session_by_id(index, 1)->ip == "192.168.1.1");
+    REQUIRE(state::find_session_by_ip(index, "192.168.1.2")->session_id == 2);
+    REQUIRE(state::find_session_by_ip(index, "10.0.0.1") == nullptr);
+    REQUIRE(state::get_session_by_id(index, 2)->ip == running_sessions.load().at(2)->ip);
+  }
+
+  // A session sharing the IP with another one makes IP lookups ambiguous, ID lookups still work
+  auto session3 = events::StreamSession{.session_id = 3, .ip = "192.168.1.1"};
+  running_sessions.add(session3);
+  REQUIRE(state::find_session_by_ip(running_sessions.load_index(), "192.168.1.1") == nullptr);
+  REQUIRE(state::find_session_by_id(running_sessions.load_index(), 3) != nullptr);
+
+  // The index follows removals
+  running_sessions.remove(session3.session_id);
+  REQUIRE(state::find_session_by_ip(running_sessions.load_index(), "192.168.1.1")->session_id == 1);
+  REQUIRE(state::find_session_by_id(running_sessions.load_index(), 3) == nullptr);
+  REQUIRE(running_sessions.load().size() == 2);
+}
+
+TEST_CASE("Session handles", "[LocalState]") {
+  auto running_sessions = state::RunningSessions();
+  running_sessions.add(events::StreamSession{.session_id = 1, .ip = "192.168.1.1"});
+
+  auto handle = state::get_session_handle_by_ip(running_sessions.load_index(), "192.168.1.1");
+  REQUIRE(handle);
+  REQUIRE(handle.is_current());
+  REQUIRE(handle.id() == 1);
+  REQUIRE(handle->ip == "192.168.1.1");
+
+  // Replacing the session (ex: resume) retires the old handle, the session it points to stays valid
+  running_sessions.add(events::StreamSession{.session_id = 1, .ip = "192.168.1.2"});
+  REQUIRE_FALSE(handle.is_current());
+  REQUIRE(handle->ip == "192.168.1.1");
+
+  handle = state::get_session_handle(running_sessions.load_index(), 1);
+  REQUIRE(handle.is_current());
+  REQUIRE(handle->ip == "192.168.1.2");
+
+  running_sessions.remove(1);
+  REQUIRE_FALSE(handle.is_current());
+  REQUIRE_FALSE(state::get_session_handle(running_sessions.load_index(), 1));
+  REQUIRE_FALSE(state::SessionHandle().is_current());
+}
+
+TEST_CASE("RTP port allocator", "[LocalState]") {
+  auto ports = state::PortAllocator(state::VIDEO_PING_PORT);
+  for (std::size_t i = 0; i < state::PortAllocator::MAX_PORTS; i++) {
+    auto port = ports.next_available();
+    REQUIRE(port == state::VIDEO_PING_PORT + i);
+    ports = ports.set(*port);
+  }
+  REQUIRE_FALSE(ports.next_available().has_value());
+
+  ports = ports.release(state::VIDEO_PING_PORT + 70);
+  REQUIRE(ports.next_available() == state::VIDEO_PING_PORT + 70);
+  REQUIRE(ports.is_used(state::VIDEO_PING_PORT + 69));
+  // Ports outside of the range are ignored
+  REQUIRE(ports.set(state::AUDIO_PING_PORT).next_available() == state::VIDEO_PING_PORT + 70);
+}
+
+TEST_CASE("Allocating session ports", "[LocalState]") {
+  state::RunningSessions running_sessions;
+
+  // Concurrent launches never get the same ports, even before their sessions are added
+  std::vector<std::pair<unsigned short, unsigned short>> allocated(state::PortAllocator::MAX_PORTS);
+  std::vector<std::thread> launches;
+  for (std::size_t thread = 0; thread < 4; thread++) {
+    launches.emplace_back([&, thread]() {
+      for (auto i = thread; i < allocated.size(); i += 4) {
+        allocated[i] = running_sessions.allocate_ports();
+      }
+    });
+  }
+  for (auto &launch : launches) {
+    launch.join();
+  }
+  std::sort(allocated.begin(), allocated.end());
+  REQUIRE(std::adjacent_find(allocated.begin(), allocated.end(), [](const auto &a, const auto &b) {
+            return a.first == b.first || a.second == b.second;
+          }) == allocated.end());
+
+  REQUIRE_THROWS_AS(running_sessions.allocate_ports(), std::runtime_error);
+
+  running_sessions.release_ports(state::VIDEO_PING_PORT + 3, state::AUDIO_PING_PORT + 3);
+  REQUIRE(running_sessions.allocate_ports() ==
+          std::pair<unsigned short, unsigned short>{state::VIDEO_PING_PORT + 3, state::AUDIO_PING_PORT + 3});
+}
+
+TEST_CASE("Session scoped event handlers", "[EventBus]") {
+  auto event_bus = std::make_shared<events::EventBusType>();
+  int session_1_stops = 0, session_2_stops = 0, global_stops = 0;
+
+  auto session_1 = event_bus->register_session_handler<immer::box<events::StopStreamEvent>>(
+      1,
+      [&session_1_stops](const immer::box<events::StopStreamEvent> &ev) { session_1_stops++; });
+  auto session_2 = event_bus->register_session_handler<immer::box<events::StopStreamEvent>>(
+      2,
+      [&session_2_stops](const immer::box<events::StopStreamEvent> &ev) { session_2_stops++; });
+  auto global = event_bus->register_handler<immer::box<events::StopStreamEvent>>(
+      [&global_stops](const immer::box<events::StopStreamEvent> &ev) { global_stops++; });
+  REQUIRE(event_bus->session_handler_count<immer::box<events::StopStreamEvent>>(1) == 1);
+  REQUIRE(event_bus->session_handler_count<immer::box<events::IDRRequestEvent>>(1) == 0);
+
+  event_bus->fire_event(immer::box<events::StopStreamEvent>(events::StopStreamEvent{.session_id = 1}));
+  REQUIRE(session_1_stops == 1);
+  REQUIRE(session_2_stops == 0);
+  REQUIRE(global_stops == 1);
+
+  // Events of other types for the same session don't reach the handler
+  event_bus->fire_event(immer::box<events::IDRRequestEvent>(events::IDRRequestEvent{.session_id = 1}));
+  REQUIRE(session_1_stops == 1);
+
+  session_1.unregister();
+  REQUIRE(event_bus->session_handler_count<immer::box<events::StopStreamEvent>>(1) == 0);
+  event_bus->fire_event(immer::box<events::StopStreamEvent>(events::StopStreamEvent{.session_id = 1}));
+  event_bus->fire_event(immer::box<events::StopStreamEvent>(events::StopStreamEvent{.session_id = 2}));
+  REQUIRE(session_1_stops == 1);
+  REQUIRE(session_2_stops == 1);
+  REQUIRE(global_stops == 3);
+
+  global.unregister();
+  event_bus.reset(); // session_2 outlives the event bus
+}
+
+TEST_CASE("Session handlers firing events", "[EventBus]") {
+  auto event_bus = std::make_shared<events::EventBusType>();
+  std::vector<std::string> calls;
+
+  // Like a child session forwarding its events to the parent session
+  auto child = event_bus->register_session_handler<immer::box<events::UnplugDeviceEvent>>(
+      2,
+      [&calls, event_bus](const immer::box<events::UnplugDeviceEvent> &ev) {
+        calls.push_back("child");
+        event_bus->fire_event(immer::box<events::UnplugDeviceEvent>(events::UnplugDeviceEvent{.session_id = 1}));
+      });
+  // A handler that fires an event for its own session
+  bool refired = false;
+  auto parent = event_bus->register_session_handler<immer::box<events::UnplugDeviceEvent>>(
+      1,
+      [&calls, &refired, event_bus](const immer::box<events::UnplugDeviceEvent> &ev) {
+        calls.push_back("parent");
+        if (!refired) {
+          refired = true;
+          event_bus->fire_event(immer::box<events::UnplugDeviceEvent>(events::UnplugDeviceEvent{.session_id = 1}));
+        }
+      });
+  auto global = event_bus->register_handler<immer::box<events::UnplugDeviceEvent>>(
+      [&calls](const immer::box<events::UnplugDeviceEvent> &ev) { calls.push_back("global"); });
+
+  event_bus->fire_event(immer::box<events::UnplugDeviceEvent>(events::UnplugDeviceEvent{.session_id = 2}));
+  // Global handlers are called before the session ones
+  REQUIRE(calls == std::vector<std::string>{"global", "child", "global", "parent", "global", "parent"});
+  global.unregister();
+}
+
+TEST_CASE("Asynchronous session handlers", "[EventBus]") {
+  auto event_bus = std::make_shared<events::EventBusType>();
+  boost::asio::io_context io_context;
+  std::vector<std::size_t> received;
+
+  auto handler = event_bus->register_session_handler<immer::box<events::IDRRequestEvent>>(
+      1,
+      events::Executor::asio(io_context.get_executor()),
+      [&received](const immer::box<events::IDRRequestEvent> &ev) { received.push_back(ev->session_id); });
+
+  // Firing only enqueues the handler, it runs when the executor gets to it
+  event_bus->fire_event(immer::box<events::IDRRequestEvent>(events::IDRRequestEvent{.session_id = 1}));
+  event_bus->fire_event(immer::box<events::IDRRequestEvent>(events::IDRRequestEvent{.session_id = 1}));
+  REQUIRE(received.empty());
+  io_context.run();
+  REQUIRE(received.size() == 2);
+
+  // Events that are still queued are dropped once the handler is unregistered
+  event_bus->fire_event(immer::box<events::IDRRequestEvent>(events::IDRRequestEvent{.session_id = 1}));
+  handler.unregister();
+  io_context.restart();
+  io_context.run();
+  REQUIRE(received.size() == 2);
+}
+
+/**
+ * Run with: wolftests "[EventBus-benchmark]"
+ * Before: every handler is registered on the global bus and filters on the session id.
+ * After: the session handlers are routed by session id, the handlers that want every session stay global.
+ */
+TEST_CASE("Event bus fan-out benchmark", "[.][EventBus-benchmark]") {
+  constexpr std::size_t sessions = 50;
+  constexpr std::size_t handlers_per_session = 5; // video, audio, producers and runner all wait for a StopStreamEvent
+  constexpr std::size_t shared_handlers = 3;      // control, wolf.cpp bookkeeping and the API
+  std::size_t calls = 0;
+
+  auto global_bus = std::make_shared<events::EventBusType>();
+  std::vector<immer::box<events::EventBusHandlers>> global_handlers;
+  auto session_bus = std::make_shared<events::EventBusType>();
+  std::vector<events::SessionHandlerRegistration> session_handlers;
+  for (std::size_t i = 0; i < shared_handlers; i++) {
+    for (const auto &bus : {global_bus, session_bus}) {
+      global_handlers.emplace_back(bus->register_handler<immer::box<events::IDRRequestEvent>>(
+          [&calls](const immer::box<events::IDRRequestEvent> &ev) { calls++; }));
+    }
+  }
+  for (std::size_t session_id = 0; session_id < sessions; session_id++) {
+    for (std::size_t i = 0; i < handlers_per_session; i++) {
+      global_handlers.emplace_back(global_bus->register_handler<immer::box<events::IDRRequestEvent>>(
+          [session_id, &calls](const immer::box<events::IDRRequestEvent> &ev) {
+            if (ev->session_id == session_id) {
+              calls++;
+            }
+          }));
+      session_handlers.push_back(session_bus->register_session_handler<immer::box<events::IDRRequestEvent>>(
+          session_id,
+          [&calls](const immer::box<events::IDRRequestEvent> &ev) { calls++; }));
+    }
+  }
+
+  auto ev = immer::box<events::IDRRequestEvent>(events::IDRRequestEvent{.session_id = sessions / 2});
+  BENCHMARK("before: global handlers filtering on session_id, " + std::to_string(sessions) + " sessions") {
+    global_bus->fire_event(immer::box<events::IDRRequestEvent>(ev));
+    return calls;
+  };
+  BENCHMARK("after: session scoped handlers, " + std::to_string(sessions) + " sessions") {
+    session_bus->fire_event(immer::box<events::IDRRequestEvent>(ev));
+    return calls;
+  };
+}
+
+TEST_CASE("Session orchestrator", "[EventBus]") {
+  auto event_bus = std::make_shared<events::EventBusType>();
+  boost::asio::io_context io_context;
+  std::promise<unsigned short> video_started;
+  std::atomic<int> audio_started = 0;
+  streaming::SessionOrchestrator orchestrator(
+      io_context,
+      event_bus,
+      std::chrono::milliseconds(50),
+      [&video_started](const immer::box<events::VideoSession> &, unsigned short port) {
+        video_started.set_value(port);
+      },
+      [&audio_started](const immer::box<events::AudioSession> &, unsigned short) { audio_started++; });
+
+  event_bus->fire_event(
+      immer::box<events::VideoSession>(events::VideoSession{.session_id = 1, .client_ip = "1.2.3.4"}));
+  event_bus->fire_event(
+      immer::box<events::AudioSession>(events::AudioSession{.session_id = 1, .client_ip = "1.2.3.4"}));
+  io_context.poll();
+  REQUIRE(orchestrator.get_video_phase(1) == streaming::SessionPhase::WAITING_PING);
+  REQUIRE(orchestrator.get_audio_phase(1) == streaming::SessionPhase::WAITING_PING);
+
+  // PINGs from another client are ignored
+  event_bus->fire_event(
+      immer::box<events::RTPVideoPingEvent>(events::RTPVideoPingEvent{.client_ip = "5.6.7.8", .client_port = 1}));
+  event_bus->fire_event(
+      immer::box<events::RTPVideoPingEvent>(events::RTPVideoPingEvent{.client_ip = "1.2.3.4", .client_port = 1234}));
+  io_context.poll();
+  REQUIRE(orchestrator.get_video_phase(1) == streaming::SessionPhase::STREAMING);
+  auto video_port = video_started.get_future();
+  REQUIRE(video_port.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+  REQUIRE(video_port.get() == 1234);
+
+  // The audio stream never got a PING
+  io_context.run_for(std::chrono::milliseconds(100));
+  REQUIRE_FALSE(orchestrator.get_audio_phase(1).has_value());
+  REQUIRE(audio_started == 0);
+
+  event_bus->fire_event(immer::box<events::PauseStreamEvent>(events::PauseStreamEvent{.session_id = 1}));
+  io_context.poll();
+  REQUIRE(orchestrator.get_video_phase(1) == streaming::SessionPhase::PAUSED);
+
+  event_bus->fire_event(immer::box<events::StopStreamEvent>(events::StopStreamEvent{.session_id = 1}));
+  io_context.poll();
+  REQUIRE_FALSE(orchestrator.get_video_phase(1).has_value());
+}
+
+TEST_CASE("RTP ping server", "[RTP]") {
+  boost::asio::io_context io_context;
+  rtp::PingServer server(io_context);
+  std::vector<unsigned short> pings;
+  server.expect_ping(48999,
+                     "127.0.0.1",
+                     std::chrono::milliseconds(100),
+                     [&pings](unsigned short client_port, const std::string &client_ip) {
+                       pings.push_back(client_port);
+                     });
+  io_context.poll();
+
+  boost::asio::io_context client_io_context;
+  auto client = rtp::udp::socket(client_io_context, rtp::udp::endpoint(rtp::udp::v4(), 0));
+  auto server_endpoint = rtp::udp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 48999);
+  client.send_to(boost::asio::buffer("PING", 4), server_endpoint);
+  io_context.run_for(std::chrono::milliseconds(20));
+  REQUIRE(pings.size() == 1);
+  REQUIRE(pings[0] == client.local_endpoint().port());
+
+  // Once the timeout expires pings are ignored, but the port is still bound for the next session
+  io_context.run_for(std::chrono::milliseconds(150));
+  client.send_to(boost::asio::buffer("PING", 4), server_endpoint);
+  io_context.run_for(std::chrono::milliseconds(20));
+  REQUIRE(pings.size() == 1);
+}
+
+TEST_CASE("Session startup profile", "[Sessions]") {
+  using namespace streaming::startup;
+  auto profile = Registry::get().start(42);
+  auto created = clock::now();
+  {
+    auto phase = Registry::get().phase(42, "RTSP DESCRIBE");
+  }
+  Registry::get().record(42, "RTP Video PING", created - std::chrono::milliseconds(5), created);
+  REQUIRE(profile->mark_once(FIRST_VIDEO_PACKET));
+  REQUIRE_FALSE(profile->mark_once(FIRST_VIDEO_PACKET));
+
+  auto snapshot = profile->snapshot();
+  REQUIRE(snapshot.session_id == "42");
+  REQUIRE(snapshot.time_to_first_frame_us.has_value());
+  REQUIRE(snapshot.phases.size() == 3);
+  // Sorted by start time
+  REQUIRE(snapshot.phases[0].name == "RTP Video PING");
+  REQUIRE(snapshot.phases[0].duration_us == 5000);
+  REQUIRE(snapshot.phases[1].name == "RTSP DESCRIBE");
+  REQUIRE(snapshot.phases[2].name == FIRST_VIDEO_PACKET);
+
+  // A new session (ex: resume) starts from scratch
+  Registry::get().start(42);
+  REQUIRE(Registry::get().get_profile(42)->snapshot().phases.empty());
+
+  // The endpoint starts the profile when the request comes in, its own phase starts at 0
+  auto request_start = clock::now() - std::chrono::milliseconds(10);
+  auto resumed = Registry::get().start(42, request_start);
+  {
+    auto resume_phase = ScopedPhase(resumed, "HTTPS /resume", request_start);
+  }
+  REQUIRE(resumed->snapshot().phases.at(0).start_us == 0);
+  REQUIRE(resumed->snapshot().phases.at(0).duration_us >= 10000);
+}
+
+TEST_CASE("Thread topology", "[Threads]") {
+  using namespace wolf::core;
+  threads::Topology::get().configure(
+      {.video = wolf::config::ThreadRoleCfg{.nice = 5}, .audio = wolf::config::ThreadRoleCfg{.cpus = {{-1}}}});
+
+  std::vector<threads::ThreadInfo> running;
+  std::int64_t tid;
+  std::thread([&running, &tid]() {
+    threads::ScopedRole thread_role(threads::Role::VIDEO);
+    running = threads::Topology::get().get_threads();
+    tid = threads::current_thread_id();
+  }).join();
+  REQUIRE(running.size() == 1);
+  REQUIRE(running[0].role == "video");
+  REQUIRE(running[0].tid == tid);
+  REQUIRE(running[0].nice == 5);
+  REQUIRE_FALSE(running[0].cpus.empty());
+  REQUIRE_FALSE(running[0].error.has_value());
+  REQUIRE(threads::Topology::get().get_threads().empty());
+
+  // Settings that can't be applied are reported, the thread keeps running
+  threads::ThreadInfo audio;
+  std::thread([&audio]() {
+    threads::ScopedRole thread_role(threads::Role::AUDIO);
+    audio = threads::Topology::get().get_threads().at(0);
+  }).join();
+  REQUIRE(audio.role == "audio");
+  REQUIRE(audio.error.has_value());
+
+  // A pooled thread gets its own settings back once it leaves the role
+  auto all_cpus = threads::get_current_thread_settings().cpus;
+  REQUIRE(all_cpus.has_value());
+  threads::Topology::get().configure({.video = wolf::config::ThreadRoleCfg{.cpus = {{all_cpus->front()}}}});
+  std::optional<std::vector<int>> cpus_in_role, cpus_after;
+  std::thread([&cpus_in_role, &cpus_after]() {
+    threads::Topology::get().enter(threads::Role::VIDEO);
+    cpus_in_role = threads::get_current_thread_settings().cpus;
+    threads::Topology::get().leave();
+    cpus_after = threads::get_current_thread_settings().cpus;
+  }).join();
+  REQUIRE(cpus_in_role->size() == 1);
+  REQUIRE(cpus_after == all_cpus);
+
+  threads::Topology::get().configure({});
+}
+
+TEST_CASE("Service registry", "[Threads]") {
+  using namespace wolf::core;
+  services::Registry registry;
+  registry.start("busy", [](std::stop_token stop_token) {
+    volatile std::uint64_t n = 0;
+    while (!stop_token.stop_requested()) {
+      n = n + 1;
+    }
   });
-  // We should now assign the 2nd port (even if we have 3 sessions) because of port clash
-  auto session4 = endpoints::https::create_run_session(client1_headers, client1_ip, client1, app_state, app1);
+  registry.start("failing", [](std::stop_token stop_token) { throw std::runtime_error("boom"); });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  auto running = registry.get_all();
+  REQUIRE(running.size() == 2);
+  REQUIRE(running[0].name == "busy");
+  REQUIRE(running[0].running);
+  REQUIRE_FALSE(running[0].stop_requested);
+  REQUIRE(running[0].tid != 0);
+  REQUIRE(running[0].cpu_time_us > 0);
+
+  registry.stop_all();
+  auto stopped = registry.get_all();
+  REQUIRE_FALSE(stopped[0].running);
+  REQUIRE(stopped[0].stop_requested);
+  REQUIRE(stopped[0].cpu_time_us >= running[0].cpu_time_us);
+  // An exception only stops the service that raised it
+  REQUIRE(stopped[1].name == "failing");
+  REQUIRE_FALSE(stopped[1].running);
+}
+
+TEST_CASE("Handover", "[Handover]") {
+  auto make_state = [](const std::string &client_cert) {
+    auto paired_clients = std::make_shared<immer::atom<state::PairedClientList>>(
+        state::PairedClientList{immer::box<state::PairedClient>(state::PairedClient{.client_cert = client_cert})});
+    return immer::box<state::AppState>(state::AppState{.config = state::Config{.paired_clients = paired_clients},
+                                                       .event_bus = std::make_shared<events::EventBusType>(),
+                                                       .running_sessions = std::make_shared<state::RunningSessions>()});
+  };
+  auto previous = make_state("1");
+  auto next = make_state("2");
+  previous->running_sessions->add(events::StreamSession{
+      .app = std::make_shared<events::App>(events::App{.base = moonlight::App{.title = "Test", .id = "42"}}),
+      .session_id = 1234,
+      .ip = "192.168.1.1",
+      .video_stream_port = state::VIDEO_PING_PORT,
+      .audio_stream_port = state::AUDIO_PING_PORT});
+
+  // The two processes are connected over a socketpair, a pipe stands in for the listening socket
+  int connection[2];
+  REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, connection) == 0);
+  int pipe_fds[2];
+  REQUIRE(pipe(pipe_fds) == 0);
+
+  std::thread previous_process([&]() {
+    auto state = handover::collect_state(previous);
+    state.sockets.push_back("rtsp");
+    handover::send_state(connection[0], state, {pipe_fds[1]});
+    handover::send_ack(connection[0]);
+  });
+  auto received = handover::receive_state(connection[1]);
+  handover::wait_ack(connection[1]);
+  previous_process.join();
+
+  REQUIRE(received.state.sessions.size() == 1);
+  REQUIRE(received.state.sessions[0].session_id == "1234");
+  REQUIRE(received.state.sessions[0].client_ip == "192.168.1.1");
+  REQUIRE(received.state.sessions[0].app_id == "42");
+  REQUIRE(received.state.sockets == std::vector<std::string>{"rtsp"});
+  REQUIRE(received.fds.size() == 1);
+
+  // We got our own copy of the file descriptor
+  close(pipe_fds[1]);
+  REQUIRE(write(received.fds[0], "W", 1) == 1);
+  char buffer = 0;
+  REQUIRE(read(pipe_fds[0], &buffer, 1) == 1);
+  REQUIRE(buffer == 'W');
+
+  handover::Sockets sockets;
+  sockets.inherit("rtsp", received.fds[0]);
+  REQUIRE(sockets.take_inherited("rtsp") == received.fds[0]);
+  REQUIRE_FALSE(sockets.take_inherited("rtsp"));
+
+  // Paired clients are merged, the ports of the sessions still running in the previous process can't be used
+  handover::adopt_state(next, received.state);
+  REQUIRE(next->config->paired_clients->load()->size() == 2);
+  REQUIRE(next->running_sessions->load().empty());
+  REQUIRE(next->running_sessions->load_index()->video_ports.next_available() == state::VIDEO_PING_PORT + 1);
+  REQUIRE(next->running_sessions->load_index()->audio_ports.next_available() == state::AUDIO_PING_PORT + 1);
+
+  REQUIRE_FALSE(handover::wait_closed(connection[1], std::chrono::milliseconds(10)));
+  close(connection[0]);
+  REQUIRE(handover::wait_closed(connection[1], std::chrono::milliseconds(10)));
+  handover::release_ports(next, received.state);
+  REQUIRE(next->running_sessions->load_index()->video_ports.next_available() == state::VIDEO_PING_PORT);
+
+  close(received.fds[0]);
+  close(pipe_fds[0]);
+  close(connection[1]);
+}
+
+TEST_CASE("Handover between two processes", "[Handover]") {
+  auto bind_udp = [](unsigned short port) {
+    auto fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr = {.s_addr = htonl(INADDR_LOOPBACK)}};
+    if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+      close(fd);
+      return -1;
+    }
+    return fd;
+  };
+
+  auto paired_clients = std::make_shared<immer::atom<state::PairedClientList>>();
+  auto previous = immer::box<state::AppState>(state::AppState{.config = state::Config{.paired_clients = paired_clients},
+                                                              .event_bus = std::make_shared<events::EventBusType>(),
+                                                              .running_sessions =
+                                                                  std::make_shared<state::RunningSessions>()});
+  previous->running_sessions->add(events::StreamSession{
+      .app = std::make_shared<events::App>(events::App{.base = moonlight::App{.title = "Test", .id = "42"}}),
+      .session_id = 1234,
+      .ip = "192.168.1.1",
+      .video_stream_port = state::VIDEO_PING_PORT,
+      .audio_stream_port = state::AUDIO_PING_PORT});
+
+  // Set up before forking: the handover socket, a listening socket to hand over and the control port of the session
+  auto socket_path = (std::filesystem::temp_directory_path() / fmt::format("wolf-handover-{}.sock", getpid())).string();
+  std::filesystem::remove(socket_path);
+  auto listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  sockaddr_un listener_addr = {.sun_family = AF_UNIX};
+  std::copy(socket_path.begin(), socket_path.end(), listener_addr.sun_path);
+  REQUIRE(bind(listener, reinterpret_cast<sockaddr *>(&listener_addr), sizeof(listener_addr)) == 0);
+  REQUIRE(listen(listener, 1) == 0);
+  auto rtsp_socket = bind_udp(0);
+  REQUIRE(rtsp_socket >= 0);
+  auto previous_control = bind_udp(state::CONTROL_PORT);
+  REQUIRE(previous_control >= 0);
+  // The previous process exits when its session is over: when we close our end of the pipe
+  int session_over[2];
+  REQUIRE(pipe(session_over) == 0);
+
+  auto previous_pid = fork();
+  REQUIRE(previous_pid >= 0);
+  if (previous_pid == 0) {
+    close(session_over[1]);
+    int res = 1;
+    try {
+      auto connection = accept(listener, nullptr, nullptr);
+      auto state = handover::collect_state(previous);
+      state.sockets.push_back("rtsp");
+      handover::send_state(connection, state, {rtsp_socket});
+      handover::send_ack(connection);
+      char buffer = 0;
+      res = read(session_over[0], &buffer, 1) == 0 ? 0 : 1;
+    } catch (...) {
+    }
+    _exit(res);
+  }
+  // From now on they are only open in the previous process
+  close(listener);
+  close(rtsp_socket);
+  close(previous_control);
+  close(session_over[0]);
+
+  auto connection = handover::connect(socket_path);
+  REQUIRE(connection);
+  auto received = handover::receive_state(*connection);
+  handover::wait_ack(*connection);
+  REQUIRE(received.state.sessions.size() == 1);
+  REQUIRE(received.state.sessions[0].session_id == "1234");
+  REQUIRE(received.state.sockets == std::vector<std::string>{"rtsp"});
+  REQUIRE(received.fds.size() == 1);
+
+  // The socket that we have received is still bound to the same address
+  sockaddr_in rtsp_addr = {};
+  socklen_t rtsp_addr_len = sizeof(rtsp_addr);
+  REQUIRE(getsockname(received.fds[0], reinterpret_cast<sockaddr *>(&rtsp_addr), &rtsp_addr_len) == 0);
+  REQUIRE(sendto(received.fds[0], "W", 1, 0, reinterpret_cast<sockaddr *>(&rtsp_addr), rtsp_addr_len) == 1);
+  char buffer = 0;
+  REQUIRE(recv(received.fds[0], &buffer, 1, 0) == 1);
+  REQUIRE(buffer == 'W');
+
+  // The control port is still taken by the previous process, new sessions have to use a different one
+  REQUIRE(received.state.control_port == state::CONTROL_PORT);
+  REQUIRE(bind_udp(state::CONTROL_PORT) < 0);
+  auto control_port = handover::pick_control_port(received.state, 1);
+  REQUIRE(control_port == state::CONTROL_PORT + 1);
+  auto next_control = bind_udp(*control_port);
+  REQUIRE(next_control >= 0);
+
+  REQUIRE_FALSE(handover::wait_closed(*connection, std::chrono::milliseconds(10)));
+  close(session_over[1]);
+  REQUIRE(handover::wait_closed(*connection, std::chrono::seconds(5)));
+  int status = 0;
+  REQUIRE(waitpid(previous_pid, &status, 0) == previous_pid);
+  REQUIRE(WIFEXITED(status));
+  REQUIRE(WEXITSTATUS(status) == 0);
+  auto control = bind_udp(state::CONTROL_PORT);
+  REQUIRE(control >= 0);
+
+  close(control);
+  close(next_control);
+  close(received.fds[0]);
+  close(*connection);
+  std::filesystem::remove(socket_path);
 
-  REQUIRE(session4->video_stream_port == 48102);
-  REQUIRE(session4->audio_stream_port == 48202);
+  // A previous process that didn't tell us listens from CONTROL_PORT onwards, with as many shards as ours
+  REQUIRE(handover::pick_control_port({}, 3) == state::CONTROL_PORT + 3);
+  REQUIRE(handover::pick_control_port({.control_port = state::CONTROL_PORT + 1, .control_shards = 1}, 1) ==
+          state::CONTROL_PORT);
+  REQUIRE(handover::pick_control_port({.control_port = state::CONTROL_PORT, .control_shards = 5}, 6) ==
+          state::CONTROL_PORT + 5);
+  REQUIRE_FALSE(handover::pick_control_port({.control_port = state::CONTROL_PORT, .control_shards = 6}, 6));
 }
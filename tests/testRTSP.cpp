@@ -246,6 +246,21 @@ TEST_CASE("Custom Parser", "[RTSP]") {
   }
 }
 
+TEST_CASE("DESCRIBE high quality audio", "[RTSP]") {
+  events::StreamSession session = {
+      .display_mode = {1920, 1080, 60, false},
+      .app = std::make_shared<events::App>(
+          events::App{.opus_gst_pipeline = "moonlightopusenc ! rtpmoonlightpay_audio"}),
+  };
+  auto response = commands::describe(RTSP_PACKET{.seq_number = 2}, session);
+  REQUIRE(response.payloads.size() == 7);
+  REQUIRE_THAT(response.payloads[1].second, Equals("fmtp:97 surround-params=21101"));
+  REQUIRE_THAT(response.payloads[2].second, Equals("fmtp:97 surround-params=642014235"));
+  REQUIRE_THAT(response.payloads[3].second, Equals("fmtp:97 surround-params=660012345"));
+  REQUIRE_THAT(response.payloads[4].second, Equals("fmtp:97 surround-params=85301423675"));
+  REQUIRE_THAT(response.payloads[5].second, Equals("fmtp:97 surround-params=88001234567"));
+}
+
 state::SessionsAtoms test_init_state() {
   events::StreamSession session = {
       .display_mode = {1920, 1080, 60},
@@ -263,8 +278,9 @@ state::SessionsAtoms test_init_state() {
       .video_stream_port = 1234,
       .audio_stream_port = 1235,
   };
-  return std::make_shared<immer::atom<immer::vector<events::StreamSession>>>(
-      immer::vector<events::StreamSession>{session});
+  auto running_sessions = std::make_shared<state::RunningSessions>();
+  running_sessions->add(session);
+  return running_sessions;
 }
 
 TEST_CASE("Commands", "[RTSP]") {
@@ -308,13 +324,18 @@ TEST_CASE("Commands", "[RTSP]") {
                        REQUIRE(response);
                        REQUIRE(response.value().response.status_code == 200);
                        REQUIRE(response.value().seq_number == 2);
-                       REQUIRE(response.value().payloads.size() == 5);
+                       REQUIRE(response.value().payloads.size() == 8);
                        REQUIRE_THAT(response.value().payloads[0].first, Equals("sprop-parameter-sets"));
                        REQUIRE_THAT(response.value().payloads[0].second, Equals("AAAAAU"));
                        REQUIRE_THAT(response.value().payloads[1].second, Equals("fmtp:97 surround-params=21101"));
-                       REQUIRE_THAT(response.value().payloads[2].second, Equals("fmtp:97 surround-params=642014235"));
-                       REQUIRE_THAT(response.value().payloads[3].second, Equals("fmtp:97 surround-params=85301423675"));
-                       REQUIRE_THAT(response.value().payloads[4].second, Equals("x-ss-general.featureFlags: 3"));
+                       REQUIRE_THAT(response.value().payloads[2].second, Equals("fmtp:97 surround-params=21101"));
+                       REQUIRE_THAT(response.value().payloads[3].second, Equals("fmtp:97 surround-params=642014235"));
+                       // The app doesn't use moonlightopusenc: no high quality layouts
+                       REQUIRE_THAT(response.value().payloads[4].second, Equals("fmtp:97 surround-params=642014235"));
+                       REQUIRE_THAT(response.value().payloads[5].second, Equals("fmtp:97 surround-params=85301423675"));
+                       REQUIRE_THAT(response.value().payloads[6].second,
+                                    Equals("fmtp:97 surround-params=85301423675"));
+                       REQUIRE_THAT(response.value().payloads[7].second, Equals("x-ss-general.featureFlags: 3"));
                      });
   }
 
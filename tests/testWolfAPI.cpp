@@ -2,7 +2,7 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/matchers/catch_matchers_string.hpp>
 #include <curl/curl.h>
-#include <helpers/tsqueue.hpp>
+#include <helpers/mpmc_queue.hpp>
 #include <state/config.hpp>
 
 using Catch::Matchers::Equals;
@@ -82,7 +82,7 @@ req(CURL *handle,
 
 TEST_CASE("Pair APIs", "[API]") {
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   auto config = immer::box<state::Config>(state::load_or_default("config.test.toml", event_bus, running_sessions));
   auto app_state = immer::box<state::AppState>(state::AppState{
       .config = config,
@@ -138,7 +138,7 @@ TEST_CASE("Pair APIs", "[API]") {
 
 TEST_CASE("APPs APIs", "[API]") {
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   auto config = immer::box<state::Config>(state::load_or_default("config.test.toml", event_bus, running_sessions));
   auto app_state = immer::box<state::AppState>(state::AppState{
       .config = config,
@@ -211,7 +211,7 @@ TEST_CASE("APPs APIs", "[API]") {
 
 TEST_CASE("Sessions APIs", "[API]") {
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   auto config = immer::box<state::Config>(state::load_or_default("config.test.toml", event_bus, running_sessions));
   auto app_state = immer::box<state::AppState>(state::AppState{
       .config = config,
@@ -272,7 +272,7 @@ struct SSEEvent {
   std::string data;
 };
 
-void listen_sse(CURL *handle, std::shared_ptr<TSQueue<SSEEvent>> queue, std::string_view api_endpoint) {
+void listen_sse(CURL *handle, std::shared_ptr<MPMCQueue<SSEEvent, 64>> queue, std::string_view api_endpoint) {
   curl_easy_setopt(handle, CURLOPT_URL, api_endpoint.data());
   curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_0);
 
@@ -283,7 +283,7 @@ void listen_sse(CURL *handle, std::shared_ptr<TSQueue<SSEEvent>> queue, std::str
         std::string data{ptr, size * nmemb};
         logs::log(logs::debug, "[CURL] Received: {}", data);
 
-        auto ts_queue = static_cast<TSQueue<SSEEvent> *>(tsqueue);
+        auto ts_queue = static_cast<MPMCQueue<SSEEvent, 64> *>(tsqueue);
         auto lines = utils::split(data, '\n');
         if (lines.size() >= 2 && lines[0].starts_with("event: ") && lines[1].starts_with("data: ")) {
           ts_queue->push(SSEEvent{.event = std::string(lines[0].substr(7)), .data = std::string(lines[1].substr(6))});
@@ -300,7 +300,7 @@ void listen_sse(CURL *handle, std::shared_ptr<TSQueue<SSEEvent>> queue, std::str
 
 TEST_CASE("SSE APIs", "[API]") {
   auto event_bus = std::make_shared<events::EventBusType>();
-  auto running_sessions = std::make_shared<immer::atom<immer::vector<events::StreamSession>>>();
+  auto running_sessions = std::make_shared<state::RunningSessions>();
   auto config = immer::box<state::Config>(state::load_or_default("config.test.toml", event_bus, running_sessions));
   auto app_state = immer::box<state::AppState>(state::AppState{
       .config = config,
@@ -318,7 +318,7 @@ TEST_CASE("SSE APIs", "[API]") {
 
   curl_easy_setopt(curl.get(), CURLOPT_UNIX_SOCKET_PATH, "/tmp/wolf.sock");
 
-  auto queue = std::make_shared<TSQueue<SSEEvent>>();
+  auto queue = std::make_shared<MPMCQueue<SSEEvent, 64>>();
 
   std::thread sse_thread(listen_sse, curl.get(), queue, "http://localhost/api/v1/events");
   sse_thread.detach();